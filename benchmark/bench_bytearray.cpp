@@ -0,0 +1,101 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/14 14:36:08
+ * @version: 1.0
+ * @description: 比较链表与连续两种内存布局的ByteArray
+ * 每条消息新建ByteArray 写入varint与字符串交替的数据 回到开头全部读出
+ * 再在消息内随机定位并读取一个字节
+ * 用法: bench_bytearray [每种大小处理的总字节数MB=64]
+ ********************************************************************************/
+#include "base/ByteArray.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+static const std::string g_field(24, 'x');
+
+struct Result {
+	double write_ns;
+	double read_ns;
+	double seek_ns;
+};
+
+static void fill(ByteArray& bt, size_t payload) {
+	for (uint32_t i = 0; bt.getSize() < payload; ++i) {
+		bt.writeUint32(i * 131);
+		bt.writeStringVint(g_field);
+	}
+}
+
+static Result run(ByteArray::Layout layout, size_t payload, size_t messages) {
+	auto make = [&]() {
+		// 链表布局使用默认的4KB节点 连续布局不指定初始容量
+		return layout == ByteArray::Layout::Chained
+		           ? std::make_shared<ByteArray>()
+		           : std::make_shared<ByteArray>(layout, 0);
+	};
+	std::vector<ByteArray::ptr> keep(messages < 64 ? messages : 64);
+	uint64_t checksum = 0;
+
+	auto begin = steady_clock::now();
+	for (size_t m = 0; m < messages; ++m) {
+		auto bt = make();
+		fill(*bt, payload);
+		keep[m % keep.size()] = bt;
+	}
+	auto write_time = steady_clock::now() - begin;
+
+	// 读取与定位使用同一批写好的消息
+	begin = steady_clock::now();
+	for (size_t m = 0; m < messages; ++m) {
+		auto& bt = keep[m % keep.size()];
+		bt->setPosition(0);
+		while (bt->getReadSize() > 0) {
+			checksum += bt->readUint32();
+			checksum += bt->readStringVint().size();
+		}
+	}
+	auto read_time = steady_clock::now() - begin;
+
+	std::mt19937 rng(7);
+	size_t seeks = messages * 16;
+	begin = steady_clock::now();
+	for (size_t i = 0; i < seeks; ++i) {
+		auto& bt = keep[i % keep.size()];
+		bt->setPosition(rng() % bt->getSize());
+		checksum += bt->readFuint8();
+	}
+	auto seek_time = steady_clock::now() - begin;
+
+	if (checksum == 42)
+		std::printf("\n");
+	auto ns = [](auto d, size_t n) {
+		return double(duration_cast<nanoseconds>(d).count()) / double(n);
+	};
+	return {ns(write_time, messages), ns(read_time, messages),
+	        ns(seek_time, seeks)};
+}
+
+int main(int argc, char* argv[]) {
+	size_t total = (argc > 1 ? std::atoll(argv[1]) : 64) << 20;
+	std::printf("%-8s %-10s %14s %14s %12s\n", "payload", "layout",
+	            "write ns/msg", "read ns/msg", "seek ns");
+	for (size_t payload : {size_t(64), size_t(4096), size_t(1) << 20}) {
+		size_t messages = total / payload < 16 ? 16 : total / payload;
+		for (auto layout :
+		     {ByteArray::Layout::Chained, ByteArray::Layout::Contiguous}) {
+			auto r = run(layout, payload, messages);
+			std::printf("%-8zu %-10s %14.1f %14.1f %12.1f\n", payload,
+			            layout == ByteArray::Layout::Chained ? "chained"
+			                                                 : "contiguous",
+			            r.write_ns, r.read_ns, r.seek_ns);
+		}
+	}
+	return 0;
+}
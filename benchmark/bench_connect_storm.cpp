@@ -0,0 +1,147 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/22 15:12:09
+ * @version: 1.0
+ * @description: 连接风暴 多个线程按固定速率建立并立即关闭连接
+ * 统计实际的建连速率、connect耗时 以及服务端的accept计数与内核监听队列溢出
+ * 用法: bench_connect_storm [每秒连接数=10000] [持续秒数=3] [客户端线程数=4]
+ *                           [reactor数=1] [监听队列长度=4096]
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "net/Reactor.h"
+#include "net/TcpServer.h"
+#include "net/UringReactor.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct Result {
+	uint64_t connects{0};
+	uint64_t failures{0};
+	double seconds{0};
+	double avg_us{0};
+	double p99_us{0};
+	AcceptStats stats;
+};
+
+static Result run_backend(IoBackend backend, int port, int rate, int seconds,
+                          int threads, int reactors, int backlog) {
+	TcpServer server;
+	server.set_io_backend(backend);
+	auto ret = server.start(port, backlog, reactors);
+	if (!ret.is_successful()) {
+		fprintf(stderr, "start failed: %s\n", ret.message().c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+	std::atomic<uint64_t> failures{0};
+	std::mutex latency_mtx;
+	std::vector<uint32_t> latencies; // 纳秒
+	auto begin = std::chrono::steady_clock::now();
+	auto end = begin + std::chrono::seconds(seconds);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threads; ++i) {
+		workers.emplace_back([&, i]() {
+			// 各线程错开发起的时间 总体保持均匀的速率
+			auto interval = std::chrono::nanoseconds(1000000000LL * threads / rate);
+			auto next = begin + interval * i / threads;
+			std::vector<uint32_t> local;
+			// connect超时后落后于计划 不再补发 到时间即停止
+			while (next < end && std::chrono::steady_clock::now() < end) {
+				std::this_thread::sleep_until(next);
+				next += interval;
+				auto start = std::chrono::steady_clock::now();
+				int fd = socket(AF_INET, SOCK_STREAM, 0);
+				// 监听队列溢出时SYN会被丢弃重传 超过1秒记为失败
+				timeval timeout{1, 0};
+				setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+				if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+					++failures;
+					::close(fd);
+					continue;
+				}
+				local.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				                    std::chrono::steady_clock::now() - start)
+				                    .count());
+				// 直接RST关闭 客户端不进入TIME_WAIT 避免耗尽本地端口
+				linger lin{1, 0};
+				setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+				::close(fd);
+			}
+			std::lock_guard<std::mutex> lock(latency_mtx);
+			latencies.insert(latencies.end(), local.begin(), local.end());
+		});
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+
+	Result result;
+	result.seconds = std::chrono::duration<double>(
+	                     std::chrono::steady_clock::now() - begin)
+	                     .count();
+	result.connects = latencies.size();
+	result.failures = failures;
+	if (!latencies.empty()) {
+		uint64_t total = 0;
+		for (auto ns : latencies)
+			total += ns;
+		result.avg_us = static_cast<double>(total) / latencies.size() / 1000.0;
+		auto p99 = latencies.begin() + latencies.size() * 99 / 100;
+		std::nth_element(latencies.begin(), p99, latencies.end());
+		result.p99_us = *p99 / 1000.0;
+	}
+	// 等待服务端处理完剩余的连接
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	result.stats = server.accept_stats();
+	server.close();
+	return result;
+}
+
+static void print_result(const char* name, const Result& result) {
+	printf("%-10s %10lu %10.0f %10.1f %10.1f %10lu %10lu %10lu %10lu\n", name,
+	       result.connects, result.connects / result.seconds, result.avg_us,
+	       result.p99_us, result.failures, result.stats.accepted,
+	       result.stats.rejected, result.stats.listen_overflows);
+}
+
+int main(int argc, char* argv[]) {
+	int rate = argc > 1 ? atoi(argv[1]) : 10000;
+	int seconds = argc > 2 ? atoi(argv[2]) : 3;
+	int threads = argc > 3 ? atoi(argv[3]) : 4;
+	int reactors = argc > 4 ? atoi(argv[4]) : 1;
+	int backlog = argc > 5 ? atoi(argv[5]) : 4096;
+	g_log_level = Logger::WARNING; // 关闭每个连接的日志
+
+	printf("rate: %d/s, duration: %ds, threads: %d, reactors: %d, backlog: %d\n",
+	       rate, seconds, threads, reactors, backlog);
+	printf("%-10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "backend",
+	       "connects", "conn/s", "avg(us)", "p99(us)", "failures", "accepted",
+	       "rejected", "overflows");
+	print_result("epoll", run_backend(IoBackend::EPOLL, 18092, rate, seconds,
+	                                  threads, reactors, backlog));
+	if (!UringReactor::is_supported()) {
+		printf("%-10s io_uring is not supported by this kernel\n", "io_uring");
+		return 0;
+	}
+	print_result("io_uring", run_backend(IoBackend::IO_URING, 18093, rate,
+	                                     seconds, threads, reactors, backlog));
+	return 0;
+}
@@ -0,0 +1,121 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/15 15:12:40
+ * @version: 1.0
+ * @description: 比较连接表与原先按fd索引的哈希表的查找与增删开销
+ * 原先每次读事件需要查找 clients_idx_ 与 client_write_mtx_ 两张哈希表并加锁
+ * 用法: bench_connection_table [连接数=100000] [查找次数=10000000]
+ ********************************************************************************/
+#include "net/Client.h"
+#include "net/ConnectionTable.h"
+#include "net/FileDescriptor.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#define FD_BASE 16 // 模拟的fd从这里开始 跳过标准输入输出等
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_ns(bench_clock::time_point begin) {
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - begin)
+	    .count();
+}
+
+// 防止编译器把查找优化掉
+static volatile uintptr_t g_sink = 0;
+
+int main(int argc, char* argv[]) {
+	int connections = argc > 1 ? atoi(argv[1]) : 100000;
+	int lookups = argc > 2 ? atoi(argv[2]) : 10000000;
+
+	// Client的构造函数只记录fd 不会真的操作这些fd
+	std::vector<Client::ptr> clients;
+	clients.reserve(connections);
+	for (int i = 0; i < connections; ++i) {
+		clients.push_back(std::make_shared<Client>(FD_BASE + i));
+	}
+	// 事件到达的顺序是随机的
+	std::mt19937 rng(42);
+	std::vector<int> order(lookups);
+	for (auto& fd : order) {
+		fd = FD_BASE + static_cast<int>(rng() % connections);
+	}
+
+	// 原先的结构: 连接与写锁分别存放在两张哈希表中
+	std::unordered_map<FileDescriptor, Client::ptr> clients_idx;
+	std::unordered_map<FileDescriptor, std::unique_ptr<std::mutex>> write_mtx;
+	std::mutex clients_mtx;
+	auto begin = bench_clock::now();
+	for (auto& client : clients) {
+		clients_idx.insert({client->get_filedesc(), client});
+		write_mtx.emplace(client->get_filedesc(), std::make_unique<std::mutex>());
+	}
+	double map_insert = elapsed_ns(begin) / connections;
+
+	begin = bench_clock::now();
+	for (int fd : order) {
+		std::lock_guard<std::mutex> lock(clients_mtx);
+		auto iter = clients_idx.find(FileDescriptor(fd));
+		auto mtx = write_mtx.find(FileDescriptor(fd));
+		g_sink = g_sink + reinterpret_cast<uintptr_t>(iter->second.get()) +
+		         reinterpret_cast<uintptr_t>(mtx->second.get());
+	}
+	double map_lookup = elapsed_ns(begin) / lookups;
+
+	// 连接表: reactor线程按句柄查找 不加锁也不修改引用计数
+	ConnectionTable table(FD_BASE + connections);
+	std::vector<ConnectionTable::handle_t> handles(FD_BASE + connections);
+	begin = bench_clock::now();
+	for (auto& client : clients) {
+		handles[client->get_filedesc().get()] = table.insert(client);
+	}
+	double table_insert = elapsed_ns(begin) / connections;
+
+	begin = bench_clock::now();
+	for (int fd : order) {
+		g_sink = g_sink + reinterpret_cast<uintptr_t>(table.get(handles[fd]));
+	}
+	double table_lookup = elapsed_ns(begin) / lookups;
+
+	// 其他线程读取时使用原子的shared_ptr
+	begin = bench_clock::now();
+	for (int fd : order) {
+		g_sink = g_sink + reinterpret_cast<uintptr_t>(table.load(fd).get());
+	}
+	double table_load = elapsed_ns(begin) / lookups;
+
+	// 连接关闭再重新建立
+	begin = bench_clock::now();
+	for (auto& client : clients) {
+		clients_idx.erase(client->get_filedesc());
+		write_mtx.erase(client->get_filedesc());
+		clients_idx.insert({client->get_filedesc(), client});
+		write_mtx.emplace(client->get_filedesc(), std::make_unique<std::mutex>());
+	}
+	double map_churn = elapsed_ns(begin) / connections;
+
+	begin = bench_clock::now();
+	for (auto& client : clients) {
+		table.remove(client->get_filedesc().get());
+		table.insert(client);
+	}
+	double table_churn = elapsed_ns(begin) / connections;
+
+	printf("%d connections, %d lookups\n", connections, lookups);
+	printf("%-24s %12s %12s %12s\n", "", "insert(ns)", "lookup(ns)",
+	       "churn(ns)");
+	printf("%-24s %12.1f %12.1f %12.1f\n", "unordered_map x2 + lock",
+	       map_insert, map_lookup, map_churn);
+	printf("%-24s %12.1f %12.1f %12.1f\n", "ConnectionTable::get", table_insert,
+	       table_lookup, table_churn);
+	printf("%-24s %12s %12.1f %12s\n", "ConnectionTable::load", "-", table_load,
+	       "-");
+	return 0;
+}
@@ -0,0 +1,122 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/04 10:26:37
+ * @version: 1.0
+ * @description: 调用下游服务的方法 同步实现与协程实现的吞吐量对比
+ * 后端方法等待delay毫秒后返回(协程 不占用线程) 前端方法依次调用后端fanout次
+ * 客户端让每个工作线程同时有per_worker个请求 同步实现在等待下游时占住工作线程
+ * 需要注册中心 用法: bench_coroutine_fanout [per_worker=1000] [fanout=2]
+ * [delay_ms=1]
+ ********************************************************************************/
+#include "rpc/RPCClient.h"
+#include "rpc/RPCServer.h"
+#include "rpc/Task.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace std::chrono;
+
+static RPCClient* g_downstream = nullptr;
+static int g_fanout = 2;
+static milliseconds g_delay{1};
+
+static rpc::Task<int> delay(int v) {
+	co_await rpc::sleep_for(g_delay);
+	co_return v;
+}
+
+static int fanout_sync(int v) {
+	int sum = 0;
+	for (int i = 0; i < g_fanout; ++i) {
+		sum += g_downstream->call<int>("delay", v).getVal();
+	}
+	return sum;
+}
+
+static rpc::Task<int> fanout_co(int v) {
+	int sum = 0;
+	for (int i = 0; i < g_fanout; ++i) {
+		auto ret = co_await g_downstream->async_call<int>("delay", v);
+		sum += ret.getVal();
+	}
+	co_return sum;
+}
+
+static rpc::Task<> request(RPCClient& client, const char* method, int v,
+                           std::atomic_int& done, std::atomic_int& failed) {
+	auto ret = co_await client.async_call<int>(method, v);
+	if (ret.getCode() != RPC_SUCCESS || ret.getVal() != v * g_fanout)
+		failed.fetch_add(1, std::memory_order_relaxed);
+	done.fetch_add(1, std::memory_order_release);
+}
+
+static void run(RPCClient& client, const char* method, int total) {
+	std::atomic_int done{0};
+	std::atomic_int failed{0};
+	auto begin = steady_clock::now();
+	for (int i = 0; i < total; ++i) {
+		// 不在执行器中 请求的协程在客户端的读取线程中恢复
+		rpc::spawn(nullptr, request(client, method, i, done, failed), []() {});
+	}
+	while (done.load(std::memory_order_acquire) < total) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin);
+	std::printf("%-12s %6d calls %8.1f ms %10.0f calls/s failed %d\n", method,
+	            total, elapsed.count() / 1000.0,
+	            total * 1e6 / elapsed.count(), failed.load());
+}
+
+int main(int argc, char* argv[]) {
+	int per_worker = argc > 1 ? std::atoi(argv[1]) : 1000;
+	g_fanout = argc > 2 ? std::atoi(argv[2]) : 2;
+	g_delay = milliseconds(argc > 3 ? std::atoi(argv[3]) : 1);
+
+	ini::IniFile backend_ini;
+	backend_ini["rpc_server"]["port"] = 18110;
+	ini::IniFile frontend_ini;
+	frontend_ini["rpc_server"]["port"] = 18111;
+	frontend_ini["rpc_client"]["provider_service_name"] =
+	    std::string("/bench-backend");
+	ini::IniFile client_ini;
+	client_ini["rpc_client"]["provider_service_name"] =
+	    std::string("/bench-frontend");
+
+	auto* backend = new RPCServer(backend_ini);
+	backend->registerService("/bench-backend");
+	backend->registerMethod("delay", delay);
+	auto* frontend = new RPCServer(frontend_ini);
+	frontend->registerService("/bench-frontend");
+	frontend->registerMethod("fanout_sync", fanout_sync);
+	frontend->registerMethod("fanout_co", fanout_co);
+
+	auto* downstream = new RPCClient(frontend_ini);
+	if (!downstream->connect_server().is_successful()) {
+		std::printf("connect backend failed\n");
+		return 1;
+	}
+	g_downstream = downstream;
+	RPCClient client(client_ini);
+	if (!client.connect_server().is_successful()) {
+		std::printf("connect frontend failed\n");
+		return 1;
+	}
+
+	size_t workers = frontend->pool_stats().front().threads;
+	int total = static_cast<int>(workers) * per_worker;
+	std::printf("workers %zu, %d concurrent calls per worker, fanout %d, "
+	            "delay %lld ms\n",
+	            workers, per_worker, g_fanout,
+	            static_cast<long long>(g_delay.count()));
+	run(client, "fanout_sync", total);
+	run(client, "fanout_co", total);
+
+	delete frontend; // 先停止使用下游连接的服务
+	delete downstream;
+	delete backend;
+	return 0;
+}
@@ -0,0 +1,88 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/12 16:18:40
+ * @version: 1.0
+ * @description: 提供者频繁上下线时 变化传播到客户端目录的延迟
+ * 每一轮一个提供者登记后注销 记录订阅者看到上线与下线的时间
+ * 默认使用本机目录注册中心 不需要zookeeper
+ * 用法: bench_discovery_churn [轮数=1000] [file|zookeeper]
+ ********************************************************************************/
+#include "rpc/Registry.h"
+#include "rpc/ServiceDirectory.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+static void report(const char* name, std::vector<long long>& samples) {
+	std::sort(samples.begin(), samples.end());
+	auto at = [&](double q) { return samples[size_t(q * (samples.size() - 1))]; };
+	std::printf("%-8s p50 %8lld us  p99 %8lld us  max %8lld us\n", name,
+	            at(0.5), at(0.99), samples.back());
+}
+
+int main(int argc, char* argv[]) {
+	int rounds = argc > 1 ? std::atoi(argv[1]) : 1000;
+	Registry::Options options;
+	options.type = argc > 2 ? argv[2] : "file";
+	options.path = "/tmp/bench_discovery_churn." + std::to_string(getpid());
+	std::string service = "/bench-churn-" + std::to_string(getpid());
+
+	ServiceDirectory directory(Registry::create(options));
+	std::mutex mtx;
+	std::condition_variable cond;
+	size_t providers = 0;
+	auto id = directory.watch(service, [&](const ServiceDirectory::Snapshot& s) {
+		std::lock_guard<std::mutex> lock(mtx);
+		providers = s->size();
+		cond.notify_one();
+	});
+	auto wait_until = [&](size_t expected) {
+		std::unique_lock<std::mutex> lock(mtx);
+		return cond.wait_for(lock, seconds(5),
+		                     [&]() { return providers == expected; });
+	};
+
+	std::vector<long long> up;
+	std::vector<long long> down;
+	auto begin = steady_clock::now();
+	for (int i = 0; i < rounds; ++i) {
+		auto provider = Registry::create(options);
+		auto start = steady_clock::now();
+		provider->register_services({service}, "127.0.0.1:" + std::to_string(i));
+		if (!wait_until(1)) {
+			std::printf("timeout waiting for register\n");
+			return 1;
+		}
+		up.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+		start = steady_clock::now();
+		provider.reset();
+		if (!wait_until(0)) {
+			std::printf("timeout waiting for deregister\n");
+			return 1;
+		}
+		down.push_back(
+		    duration_cast<microseconds>(steady_clock::now() - start).count());
+	}
+	auto elapsed = duration_cast<milliseconds>(steady_clock::now() - begin);
+	directory.unwatch(id);
+
+	std::printf("%s registry, %d rounds in %lld ms, version %llu\n",
+	            options.type.c_str(), rounds,
+	            static_cast<long long>(elapsed.count()),
+	            static_cast<unsigned long long>(directory.version()));
+	report("register", up);
+	report("remove", down);
+	if (options.type == "file")
+		std::filesystem::remove_all(options.path);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/10 16:38:20
+ * @version: 1.0
+ * @description: 在回环地址上比较epoll与io_uring两种IO后端的回显吞吐与延迟
+ * 用法: bench_io_backend [连接数=32] [持续秒数=3] [消息字节数=64] [reactor数=1]
+ ********************************************************************************/
+#include "base/ByteArray.h"
+#include "base/Logger.h"
+#include "net/Client.h"
+#include "net/Reactor.h"
+#include "net/TcpServer.h"
+#include "net/UringReactor.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 收到的数据原样写回
+class EchoServer : public TcpServer {
+protected:
+	void publish_client_msg(Client::ptr client, ByteArray::ptr bt) override {
+		auto data = bt->toString();
+		send_to_client(client, data.data(), data.size());
+	}
+};
+
+static int connect_to(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		::close(fd);
+		return -1;
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	timeval timeout{5, 0}; // 服务端异常时不至于一直阻塞
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	return fd;
+}
+
+struct Result {
+	uint64_t requests{0};
+	double seconds{0};
+	double avg_latency_us{0};
+};
+
+static Result run_backend(IoBackend backend, int port, int conns, int seconds,
+                          size_t msg_size, int reactors) {
+	EchoServer server;
+	server.set_io_backend(backend);
+	auto ret = server.start(port, 1024, reactors);
+	if (!ret.is_successful()) {
+		fprintf(stderr, "start failed: %s\n", ret.message().c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	std::atomic_bool stop{false};
+	std::atomic<uint64_t> total{0};
+	std::atomic<uint64_t> total_ns{0};
+	std::vector<std::thread> workers;
+	for (int i = 0; i < conns; ++i) {
+		workers.emplace_back([&]() {
+			int fd = connect_to(port);
+			if (fd < 0) {
+				perror("connect");
+				return;
+			}
+			std::string msg(msg_size, 'x');
+			std::vector<char> buf(msg_size);
+			uint64_t count = 0, ns = 0;
+			while (!stop) {
+				auto begin = std::chrono::steady_clock::now();
+				if (::send(fd, msg.data(), msg.size(), MSG_NOSIGNAL) !=
+				    (ssize_t)msg.size())
+					break;
+				size_t got = 0;
+				while (got < msg_size) {
+					auto n = ::recv(fd, buf.data() + got, msg_size - got, 0);
+					if (n <= 0)
+						break;
+					got += n;
+				}
+				if (got < msg_size) {
+					fprintf(stderr, "echo timeout after %lu requests\n", count);
+					break;
+				}
+				ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+				          std::chrono::steady_clock::now() - begin)
+				          .count();
+				++count;
+			}
+			total += count;
+			total_ns += ns;
+			::close(fd);
+		});
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	stop = true;
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	Result result;
+	result.seconds = std::chrono::duration<double>(
+	                     std::chrono::steady_clock::now() - begin)
+	                     .count();
+	result.requests = total;
+	result.avg_latency_us =
+	    total ? static_cast<double>(total_ns) / total / 1000.0 : 0;
+	server.close();
+	return result;
+}
+
+static void print_result(const char* name, const Result& result) {
+	printf("%-10s %12lu %14.0f %14.2f\n", name, result.requests,
+	       result.requests / result.seconds, result.avg_latency_us);
+}
+
+int main(int argc, char* argv[]) {
+	int conns = argc > 1 ? atoi(argv[1]) : 32;
+	int seconds = argc > 2 ? atoi(argv[2]) : 3;
+	size_t msg_size = argc > 3 ? atoi(argv[3]) : 64;
+	int reactors = argc > 4 ? atoi(argv[4]) : 1;
+	g_log_level = Logger::WARNING; // 关闭每条消息的日志
+
+	printf("connections: %d, duration: %ds, message: %lu bytes, reactors: %d\n",
+	       conns, seconds, msg_size, reactors);
+	printf("%-10s %12s %14s %14s\n", "backend", "requests", "requests/s",
+	       "avg_lat(us)");
+	print_result("epoll", run_backend(IoBackend::EPOLL, 18090, conns, seconds,
+	                                  msg_size, reactors));
+	if (!UringReactor::is_supported()) {
+		printf("%-10s io_uring is not supported by this kernel\n", "io_uring");
+		return 0;
+	}
+	print_result("io_uring", run_backend(IoBackend::IO_URING, 18091, conns,
+	                                     seconds, msg_size, reactors));
+	return 0;
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/07 16:45:10
+ * @version: 1.0
+ * @description: 三个提供者 其中一个每次调用多等待delay毫秒 比较负载均衡策略
+ * 客户端保持window个请求在途 统计吞吐量、延迟与每个提供者分到的调用
+ * 需要注册中心 用法: bench_load_balance [调用数=50000] [window=64] [delay_ms=2]
+ ********************************************************************************/
+#include "rpc/RPCClient.h"
+#include "rpc/RPCServer.h"
+#include "rpc/Task.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+static milliseconds g_delay{2};
+
+static int fast(int v) { return v; }
+
+static rpc::Task<int> slow(int v) {
+	co_await rpc::sleep_for(g_delay);
+	co_return v;
+}
+
+static void run(RPCClient& client, const char* name, LoadBalancer::Policy policy,
+                int total, int window) {
+	client.set_load_balance(policy);
+	auto before = client.endpoint_stats();
+	std::atomic_int done{0};
+	std::atomic_int failed{0};
+	std::mutex mtx;
+	std::vector<int64_t> latencies;
+	latencies.reserve(total);
+	auto begin = steady_clock::now();
+	for (int i = 0; i < total; ++i) {
+		while (i - done.load(std::memory_order_acquire) >= window) {
+			std::this_thread::yield();
+		}
+		auto start = steady_clock::now();
+		client.async_call<int>("work", i)
+		    .key("user-" + std::to_string(i % 1000))
+		    .then([&, i, start](RPCResult<int> ret) {
+			    auto us =
+			        duration_cast<microseconds>(steady_clock::now() - start).count();
+			    if (ret.getCode() != RPC_SUCCESS || ret.getVal() != i)
+				    failed.fetch_add(1, std::memory_order_relaxed);
+			    {
+				    std::lock_guard<std::mutex> lock(mtx);
+				    latencies.push_back(us);
+			    }
+			    done.fetch_add(1, std::memory_order_release);
+		    });
+	}
+	while (done.load(std::memory_order_acquire) < total) {
+		std::this_thread::yield();
+	}
+	auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin);
+	std::sort(latencies.begin(), latencies.end());
+	std::printf("%-16s %9.0f calls/s p50 %6lld us p99 %6lld us failed %d  share",
+	            name, total * 1e6 / elapsed.count(),
+	            static_cast<long long>(latencies[latencies.size() / 2]),
+	            static_cast<long long>(latencies[latencies.size() * 99 / 100]),
+	            failed.load());
+	auto after = client.endpoint_stats();
+	for (size_t i = 0; i < after.size(); ++i) {
+		std::printf(" %s %4.1f%%", after[i].endpoint.c_str(),
+		            (after[i].calls - before[i].calls) * 100.0 / total);
+	}
+	std::printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+	int total = argc > 1 ? std::atoi(argv[1]) : 50000;
+	int window = argc > 2 ? std::atoi(argv[2]) : 64;
+	g_delay = milliseconds(argc > 3 ? std::atoi(argv[3]) : 2);
+
+	std::vector<RPCServer*> servers;
+	for (int i = 0; i < 3; ++i) {
+		ini::IniFile ini;
+		ini["rpc_server"]["port"] = 18113 + i;
+		auto* server = new RPCServer(ini);
+		server->registerService("/bench-lb");
+		if (i == 0) {
+			server->registerMethod("work", slow);
+		} else {
+			server->registerMethod("work", fast);
+		}
+		servers.push_back(server);
+	}
+
+	ini::IniFile client_ini;
+	client_ini["rpc_client"]["provider_service_name"] = std::string("/bench-lb");
+	RPCClient client(client_ini);
+	if (!client.connect_server().is_successful()) {
+		std::printf("connect server failed\n");
+		return 1;
+	}
+	std::printf("%d calls, window %d, providers %zu, port 18113 is %lld ms "
+	            "slower\n",
+	            total, window, client.endpoint_stats().size(),
+	            static_cast<long long>(g_delay.count()));
+	using Policy = LoadBalancer::Policy;
+	run(client, "round_robin", Policy::ROUND_ROBIN, total, window);
+	run(client, "p2c_outstanding", Policy::P2C_OUTSTANDING, total, window);
+	run(client, "p2c_latency", Policy::P2C_LATENCY, total, window);
+	run(client, "consistent_hash", Policy::CONSISTENT_HASH, total, window);
+	return 0;
+}
@@ -0,0 +1,115 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/29 16:48:35
+ * @version: 1.0
+ * @description: 生产者/消费者竞争下的队列吞吐量(元素数/秒)
+ * locked:  ThreadSafeQueue(std::queue + 互斥锁 + 条件变量)
+ * mpmc:    BlockingMPMCQueue 逐个push/pop
+ * bulk:    BlockingMPMCQueue 每次最多32个
+ * 用法: bench_mpmc_queue [元素数=2000000] [容量=1024]
+ ********************************************************************************/
+#include "base/MPMCQueue.hpp"
+#include "base/ThreadSafeQueue.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static constexpr size_t BATCH = 32;
+
+// 每个生产者压入total/producers个元素 消费者取到队列停止
+template <class Produce, class Consume, class Stop>
+static double run(int producers, int consumers, long total, Produce produce,
+                  Consume consume, Stop stop) {
+	long per_producer = total / producers;
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> consumer_threads;
+	for (int i = 0; i < consumers; ++i) {
+		consumer_threads.emplace_back(consume);
+	}
+	std::vector<std::thread> producer_threads;
+	for (int i = 0; i < producers; ++i) {
+		producer_threads.emplace_back([&]() { produce(per_producer); });
+	}
+	for (auto& t : producer_threads) {
+		t.join();
+	}
+	stop();
+	for (auto& t : consumer_threads) {
+		t.join();
+	}
+	std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+	return per_producer * producers / cost.count();
+}
+
+static double run_locked(int producers, int consumers, long total, size_t) {
+	putils::ThreadSafeQueue<long> queue;
+	return run(
+	    producers, consumers, total,
+	    [&](long n) {
+		    for (long i = 0; i < n; ++i)
+			    queue.push(i);
+	    },
+	    [&]() {
+		    long value;
+		    while (queue.waitAndPop(value)) {
+		    }
+	    },
+	    [&]() { queue.stop(); });
+}
+
+static double run_mpmc(int producers, int consumers, long total,
+                       size_t capacity) {
+	putils::BlockingMPMCQueue<long> queue(capacity);
+	return run(
+	    producers, consumers, total,
+	    [&](long n) {
+		    for (long i = 0; i < n; ++i)
+			    queue.push(i);
+	    },
+	    [&]() {
+		    long value;
+		    while (queue.pop(value)) {
+		    }
+	    },
+	    [&]() { queue.stop(); });
+}
+
+static double run_bulk(int producers, int consumers, long total,
+                       size_t capacity) {
+	putils::BlockingMPMCQueue<long> queue(capacity);
+	return run(
+	    producers, consumers, total,
+	    [&](long n) {
+		    long batch[BATCH];
+		    for (long i = 0; i < n; i += BATCH) {
+			    size_t count = std::min<long>(BATCH, n - i);
+			    for (size_t k = 0; k < count; ++k)
+				    batch[k] = i + k;
+			    queue.push_bulk(batch, count);
+		    }
+	    },
+	    [&]() {
+		    long values[BATCH];
+		    while (queue.pop_bulk(values, BATCH) > 0) {
+		    }
+	    },
+	    [&]() { queue.stop(); });
+}
+
+int main(int argc, char* argv[]) {
+	long total = argc > 1 ? atol(argv[1]) : 2000000;
+	size_t capacity = argc > 2 ? atol(argv[2]) : 1024;
+	printf("items: %ld, capacity: %zu, cpus: %u\n", total, capacity,
+	       std::thread::hardware_concurrency());
+	printf("%-8s %14s %14s %14s\n", "P x C", "locked/s", "mpmc/s", "bulk/s");
+	for (int threads : {1, 2, 4, 8}) {
+		printf("%d x %-4d %14.0f %14.0f %14.0f\n", threads, threads,
+		       run_locked(threads, threads, total, capacity),
+		       run_mpmc(threads, threads, total, capacity),
+		       run_bulk(threads, threads, total, capacity));
+	}
+	return 0;
+}
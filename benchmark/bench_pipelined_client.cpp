@@ -0,0 +1,106 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/05 14:08:52
+ * @version: 1.0
+ * @description: 同一连接上同步调用与流水线异步调用的吞吐量
+ * sync: 逐个调用 一次只有一个请求在途 吞吐量受限于1/RTT
+ * future: 每次发出window个请求后依次等待
+ * callback: 回调中统计结果 主线程保持window个请求在途
+ * 需要注册中心 用法: bench_pipelined_client [调用数=100000] [window=1000]
+ ********************************************************************************/
+#include "rpc/RPCClient.h"
+#include "rpc/RPCServer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+static int add(int a, int b) { return a + b; }
+
+static void report(const char* name, int total, steady_clock::time_point begin,
+                   int failed) {
+	auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin);
+	std::printf("%-9s %7d calls %9.1f ms %10.0f calls/s failed %d\n", name,
+	            total, elapsed.count() / 1000.0, total * 1e6 / elapsed.count(),
+	            failed);
+}
+
+static void run_sync(RPCClient& client, int total) {
+	int failed = 0;
+	auto begin = steady_clock::now();
+	for (int i = 0; i < total; ++i) {
+		auto ret = client.call<int>("add", i, 1);
+		if (ret.getCode() != RPC_SUCCESS || ret.getVal() != i + 1)
+			++failed;
+	}
+	report("sync", total, begin, failed);
+}
+
+static void run_future(RPCClient& client, int total, int window) {
+	int failed = 0;
+	std::vector<std::future<RPCResult<int>>> futures;
+	futures.reserve(window);
+	auto begin = steady_clock::now();
+	for (int i = 0; i < total; i += window) {
+		int n = std::min(window, total - i);
+		for (int j = 0; j < n; ++j) {
+			futures.push_back(client.async_call<int>("add", i + j, 1).future());
+		}
+		for (int j = 0; j < n; ++j) {
+			auto ret = futures[j].get();
+			if (ret.getCode() != RPC_SUCCESS || ret.getVal() != i + j + 1)
+				++failed;
+		}
+		futures.clear();
+	}
+	report("future", total, begin, failed);
+}
+
+static void run_callback(RPCClient& client, int total, int window) {
+	std::atomic_int done{0};
+	std::atomic_int failed{0};
+	auto begin = steady_clock::now();
+	for (int i = 0; i < total; ++i) {
+		while (i - done.load(std::memory_order_acquire) >= window) {
+			std::this_thread::yield();
+		}
+		client.async_call<int>("add", i, 1).then([&, i](RPCResult<int> ret) {
+			if (ret.getCode() != RPC_SUCCESS || ret.getVal() != i + 1)
+				failed.fetch_add(1, std::memory_order_relaxed);
+			done.fetch_add(1, std::memory_order_release);
+		});
+	}
+	while (done.load(std::memory_order_acquire) < total) {
+		std::this_thread::yield();
+	}
+	report("callback", total, begin, failed.load());
+}
+
+int main(int argc, char* argv[]) {
+	int total = argc > 1 ? std::atoi(argv[1]) : 100000;
+	int window = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+	ini::IniFile ini;
+	ini["rpc_server"]["port"] = 18112;
+	ini["rpc_client"]["provider_service_name"] = std::string("/bench-pipeline");
+	RPCServer server(ini);
+	server.registerService("/bench-pipeline");
+	server.registerMethod("add", add);
+
+	RPCClient client(ini);
+	if (!client.connect_server().is_successful()) {
+		std::printf("connect server failed\n");
+		return 1;
+	}
+	std::printf("%d calls, window %d, one connection\n", total, window);
+	run_sync(client, std::min(total, 20000)); // 同步调用太慢 限制次数
+	run_future(client, total, window);
+	run_callback(client, total, window);
+	return 0;
+}
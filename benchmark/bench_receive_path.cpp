@@ -0,0 +1,168 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/21 16:05:42
+ * @version: 1.0
+ * @description: 比较原先与现在的接收路径 每个请求的内存分配次数、分配字节数与耗时
+ * 原先: 每次读取新建ByteArray(4KB节点) 读入清零的4KB栈数组后再拷贝一次
+ *       分帧时还要先拷贝到分帧缓冲区 再拷贝到发布的ByteArray
+ * 现在: readv直接读入连接复用的环形缓冲区 发布时只拷贝一次 ByteArray按数据大小分配
+ * 用法: bench_receive_path [请求数=200000] [请求字节数=64]
+ ********************************************************************************/
+#include "base/ByteArray.h"
+#include "net/Client.h"
+#include "net/FrameDecoder.h"
+#include "net/common.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HEADER_LENGTH 11
+#define LENGTH_OFFSET 7
+
+// 统计全局的内存分配
+static std::atomic<size_t> g_allocs{0};
+static std::atomic<size_t> g_alloc_bytes{0};
+
+void* operator new(size_t size) {
+	++g_allocs;
+	g_alloc_bytes += size;
+	if (void* ptr = malloc(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+static ByteArray::ptr g_last; // 模拟上层持有收到的消息
+static const std::function<void(Client::ptr, ClientEvent, ByteArray::ptr)> g_handler =
+    [](Client::ptr, ClientEvent, ByteArray::ptr bt) { g_last = bt; };
+
+// 原先的 Client::receive_data 以及基于std::string的分帧 同样经由事件回调发布
+static void legacy_receive(const Client::ptr& client, bool framed,
+                           std::string& pending) {
+	int fd = client->get_filedesc().get();
+	ByteArray::ptr byte = std::make_shared<ByteArray>();
+	while (true) {
+		char rec_buf[MAX_PACKET_SIZE] = {'\0'};
+		auto n = ::recv(fd, rec_buf, MAX_PACKET_SIZE, 0);
+		if (n > 0) {
+			if (framed)
+				pending.append(rec_buf, n);
+			else
+				byte->write(rec_buf, n);
+			continue;
+		}
+		if (!framed) {
+			byte->setPosition(0);
+			g_handler(client, ClientEvent::INCOMING_MSG, byte);
+			return;
+		}
+		size_t end = 0;
+		while (pending.size() - end >= HEADER_LENGTH) {
+			auto* field =
+			    reinterpret_cast<const uint8_t*>(pending.data() + end + LENGTH_OFFSET);
+			size_t length = HEADER_LENGTH + ((size_t)field[0] << 24 |
+			                                 (size_t)field[1] << 16 |
+			                                 (size_t)field[2] << 8 | field[3]);
+			if (pending.size() - end < length)
+				break;
+			end += length;
+		}
+		if (end > 0) {
+			auto frames = std::make_shared<ByteArray>();
+			frames->write(pending.data(), end);
+			frames->setPosition(0);
+			pending.erase(0, end);
+			g_handler(client, ClientEvent::INCOMING_MSG, frames);
+		}
+		return;
+	}
+}
+
+struct Result {
+	double allocs;
+	double bytes;
+	double ns;
+};
+
+template <class F>
+static Result run(int requests, int peer, const std::string& request, F receive) {
+	size_t allocs = g_allocs, bytes = g_alloc_bytes;
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < requests; ++i) {
+		::send(peer, request.data(), request.size(), 0);
+		receive();
+	}
+	double ns = std::chrono::duration<double, std::nano>(
+	                std::chrono::steady_clock::now() - begin)
+	                .count();
+	return Result{double(g_allocs - allocs) / requests,
+	              double(g_alloc_bytes - bytes) / requests, ns / requests};
+}
+
+int main(int argc, char* argv[]) {
+	int requests = argc > 1 ? atoi(argv[1]) : 200000;
+	int size = argc > 2 ? atoi(argv[2]) : 64;
+	size = std::max(size, HEADER_LENGTH);
+
+	// 按协议格式构造请求 content length 写在偏移7处
+	std::string request(size, 'x');
+	uint32_t content = size - HEADER_LENGTH;
+	request[LENGTH_OFFSET] = char(content >> 24);
+	request[LENGTH_OFFSET + 1] = char(content >> 16);
+	request[LENGTH_OFFSET + 2] = char(content >> 8);
+	request[LENGTH_OFFSET + 3] = char(content);
+
+	printf("%d requests, %d bytes each\n", requests, size);
+	printf("%-18s %12s %14s %10s\n", "", "allocs/req", "alloc bytes/req",
+	       "ns/req");
+	for (bool framed : {false, true}) {
+		int fds[2];
+		socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+		auto client = std::make_shared<Client>(fds[0]);
+		client->set_event_handler(g_handler);
+		if (framed) {
+			FrameDecoder::Options options;
+			options.header_length = HEADER_LENGTH;
+			options.length_offset = LENGTH_OFFSET;
+			client->set_frame_decoder(options);
+		}
+
+		std::string pending;
+		client->receive_data(); // 预先分配接收缓冲区
+		// 先各跑一轮预热 避免先运行的一方吃亏
+		run(requests / 10, fds[1], request,
+		    [&]() { legacy_receive(client, framed, pending); });
+		run(requests / 10, fds[1], request, [&]() { client->receive_data(); });
+
+		auto legacy = run(requests, fds[1], request,
+		                  [&]() { legacy_receive(client, framed, pending); });
+		auto current = run(requests, fds[1], request,
+		                   [&]() { client->receive_data(); });
+
+		const char* mode = framed ? "framed" : "raw";
+		printf("%-8s %-9s %12.2f %14.1f %10.1f\n", mode, "legacy",
+		       legacy.allocs, legacy.bytes, legacy.ns);
+		printf("%-8s %-9s %12.2f %14.1f %10.1f\n", mode, "ring",
+		       current.allocs, current.bytes, current.ns);
+		g_last.reset();
+		::close(fds[0]);
+		::close(fds[1]);
+	}
+	return 0;
+}
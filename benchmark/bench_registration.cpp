@@ -0,0 +1,59 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/11 10:36:12
+ * @version: 1.0
+ * @description: 服务提供者启动时注册服务的耗时(到可以被发现为止)
+ * serial: 每一级路径先检查再创建 每个请求等待一次往返(原来registerService的做法)
+ * batch: 所有请求连续发送 只等待一次(create_batch)
+ * 需要注册中心 用法: bench_registration [服务数=100]
+ ********************************************************************************/
+#include "rpc/ZKClient.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+int main(int argc, char* argv[]) {
+	int services = argc > 1 ? std::atoi(argv[1]) : 100;
+	// 每次运行使用不同的前缀 永久节点都需要新建
+	std::string root = "/bench-register-" + std::to_string(getpid());
+	std::string data = "127.0.0.1:18117";
+
+	ZKClient zkclient;
+	zkclient.start();
+
+	auto begin = steady_clock::now();
+	zkclient.create(root.c_str(), "", 0);
+	for (int i = 0; i < services; ++i) {
+		std::string path = root + "/serial" + std::to_string(i);
+		if (!zkclient.check_znode_exists(path.c_str()))
+			zkclient.create(path.c_str(), "", 0);
+		path += "/rpc-provider";
+		zkclient.create(path.c_str(), data.c_str(), data.size(),
+		                ZOO_EPHEMERAL_SEQUENTIAL);
+	}
+	auto serial = duration_cast<microseconds>(steady_clock::now() - begin);
+
+	std::vector<std::string> parents;
+	std::vector<ZKClient::CreateRequest> nodes;
+	for (int i = 0; i < services; ++i) {
+		std::string path = root + "/batch" + std::to_string(i);
+		parents.push_back(path);
+		nodes.push_back({path + "/rpc-provider", data, ZOO_EPHEMERAL_SEQUENTIAL});
+	}
+	std::vector<std::string> created;
+	begin = steady_clock::now();
+	int rc = zkclient.create_batch(parents, nodes, &created);
+	auto batch = duration_cast<microseconds>(steady_clock::now() - begin);
+
+	std::printf("serial %d services %10lld us\n", services,
+	            static_cast<long long>(serial.count()));
+	std::printf("batch  %d services %10lld us (rc %d, created %zu)\n", services,
+	            static_cast<long long>(batch.count()), rc, created.size());
+	return rc == ZOK ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/10 17:20:55
+ * @version: 1.0
+ * @description: 服务发现缓存的查询开销 与直接读取注册中心对比
+ * lookup: 多个线程同时查询已经订阅的服务
+ * zookeeper: 每次查询都读取子节点与数据(原来RPCClient构造时的做法)
+ * 需要注册中心 用法: bench_service_lookup [线程数=4] [每线程查询数=1000000]
+ ********************************************************************************/
+#include "rpc/RPCServer.h"
+#include "rpc/ServiceDirectory.h"
+#include "rpc/ZKClient.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+int main(int argc, char* argv[]) {
+	int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+	int per_thread = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+	ini::IniFile ini;
+	ini["rpc_server"]["port"] = 18116;
+	RPCServer server(ini);
+	server.registerService("/bench-lookup");
+
+	auto& directory = ServiceDirectory::shared();
+	auto begin = steady_clock::now();
+	directory.lookup("/bench-lookup"); // 第一次读取注册中心
+	auto first = duration_cast<microseconds>(steady_clock::now() - begin);
+
+	std::atomic_size_t total{0};
+	std::vector<std::thread> workers;
+	begin = steady_clock::now();
+	for (int t = 0; t < threads; ++t) {
+		workers.emplace_back([&]() {
+			size_t found = 0;
+			for (int i = 0; i < per_thread; ++i) {
+				found += directory.lookup("/bench-lookup")->size();
+			}
+			total += found;
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - begin);
+	std::printf("first lookup %lld us\n", static_cast<long long>(first.count()));
+	std::printf("lookup     %d threads %9.1f ns/op %12.0f ops/s (found %zu)\n",
+	            threads, elapsed.count() / double(per_thread),
+	            threads * per_thread * 1e9 / elapsed.count(), total.load());
+
+	ZKClient zkclient;
+	zkclient.start();
+	int rounds = 1000;
+	begin = steady_clock::now();
+	for (int i = 0; i < rounds; ++i) {
+		for (auto& child : zkclient.get_children("/bench-lookup")) {
+			zkclient.get_data(("/bench-lookup/" + child).c_str());
+		}
+	}
+	auto zk = duration_cast<nanoseconds>(steady_clock::now() - begin);
+	std::printf("zookeeper  1 thread  %9.1f ns/op\n", zk.count() / double(rounds));
+	return 0;
+}
@@ -0,0 +1,92 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/28 15:31:02
+ * @version: 1.0
+ * @description: 每个任务的堆分配次数与吞吐量 submit(std::bind + packaged_task +
+ * future)与execute(SmallFunction)对比
+ * 任务捕获48字节 与RPCServer提交的任务(Client::ptr + 请求数组 + this)大小相同
+ * 用法: bench_task_alloc [任务数=1000000] [线程数=4]
+ ********************************************************************************/
+#include "base/ThreadPool.hpp"
+#include "base/WorkStealingPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+static std::atomic<long> g_allocs{0};
+
+void* operator new(std::size_t size) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+static std::atomic<long> g_done{0};
+
+struct Payload {
+	std::shared_ptr<int> client;
+	std::vector<int> requests;
+	void* self;
+};
+
+static void wait_done(long total) {
+	while (g_done.load(std::memory_order_acquire) < total) {
+		std::this_thread::yield();
+	}
+}
+
+template <class Pool, bool Execute>
+static void run(const char* name, size_t threads, long total) {
+	g_done = 0;
+	Pool pool(threads);
+	auto client = std::make_shared<int>(0);
+	// 预热 让队列节点与缓冲区达到稳定大小
+	for (int i = 0; i < 10000; ++i) {
+		pool.execute([]() { g_done.fetch_add(1, std::memory_order_release); });
+	}
+	wait_done(10000);
+	g_done = 0;
+
+	long allocs_before = g_allocs.load();
+	auto begin = std::chrono::steady_clock::now();
+	for (long i = 0; i < total; ++i) {
+		Payload payload{client, {}, &pool};
+		auto task = [payload = std::move(payload)]() {
+			g_done.fetch_add(1, std::memory_order_release);
+		};
+		if constexpr (Execute) {
+			pool.execute(std::move(task));
+		} else {
+			pool.submit(std::move(task));
+		}
+	}
+	wait_done(total);
+	std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+	long allocs = g_allocs.load() - allocs_before;
+	printf("%-28s %14.0f %14.3f\n", name, total / cost.count(),
+	       static_cast<double>(allocs) / total);
+}
+
+int main(int argc, char* argv[]) {
+	long total = argc > 1 ? atol(argv[1]) : 1000000;
+	size_t threads = argc > 2 ? atol(argv[2]) : 4;
+	printf("tasks: %ld, threads: %zu, cpus: %u\n", total, threads,
+	       std::thread::hardware_concurrency());
+	printf("%-28s %14s %14s\n", "", "tasks/s", "allocs/task");
+	run<putils::ThreadPool, false>("ThreadPool::submit", threads, total);
+	run<putils::ThreadPool, true>("ThreadPool::execute", threads, total);
+	run<putils::WorkStealingPool, false>("WorkStealingPool::submit", threads,
+	                                     total);
+	run<putils::WorkStealingPool, true>("WorkStealingPool::execute", threads,
+	                                    total);
+	return 0;
+}
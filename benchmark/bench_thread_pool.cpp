@@ -0,0 +1,76 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/27 17:22:51
+ * @version: 1.0
+ * @description: ThreadPool(单个加锁队列)与WorkStealingPool的吞吐量(任务数/秒)
+ * external: 一个外部线程提交所有任务(reactor线程把请求交给线程池的情形)
+ * nested:   任务在工作线程中继续提交任务(fork/join)
+ * 用法: bench_thread_pool [任务数=1000000]
+ ********************************************************************************/
+#include "base/ThreadPool.hpp"
+#include "base/WorkStealingPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+static std::atomic<long> g_done{0};
+
+static void wait_done(long total) {
+	while (g_done.load(std::memory_order_acquire) < total) {
+		std::this_thread::yield();
+	}
+}
+
+template <class Pool> static double run_external(size_t threads, long total) {
+	g_done = 0;
+	Pool pool(threads);
+	auto begin = std::chrono::steady_clock::now();
+	for (long i = 0; i < total; ++i) {
+		pool.submit([]() { g_done.fetch_add(1, std::memory_order_release); });
+	}
+	wait_done(total);
+	std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+	return total / cost.count();
+}
+
+// 每个任务再提交两个子任务 直到达到深度
+template <class Pool> static void spawn(Pool& pool, int depth) {
+	g_done.fetch_add(1, std::memory_order_release);
+	if (depth == 0)
+		return;
+	pool.submit([&pool, depth]() { spawn(pool, depth - 1); });
+	pool.submit([&pool, depth]() { spawn(pool, depth - 1); });
+}
+
+template <class Pool> static double run_nested(size_t threads, long total) {
+	int depth = 0;
+	while ((2L << (depth + 1)) - 1 <= total)
+		++depth;
+	long count = (2L << depth) - 1;
+	g_done = 0;
+	Pool pool(threads);
+	auto begin = std::chrono::steady_clock::now();
+	pool.submit([&pool, depth]() { spawn(pool, depth); });
+	wait_done(count);
+	std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+	return count / cost.count();
+}
+
+int main(int argc, char* argv[]) {
+	long total = argc > 1 ? atol(argv[1]) : 1000000;
+	printf("tasks: %ld, cpus: %u\n", total, std::thread::hardware_concurrency());
+	printf("%-8s %-9s %16s %16s\n", "threads", "pattern", "ThreadPool/s",
+	       "WorkStealing/s");
+	for (size_t threads : {1, 8, 32}) {
+		printf("%-8zu %-9s %16.0f %16.0f\n", threads, "external",
+		       run_external<putils::ThreadPool>(threads, total),
+		       run_external<putils::WorkStealingPool>(threads, total));
+		printf("%-8zu %-9s %16.0f %16.0f\n", threads, "nested",
+		       run_nested<putils::ThreadPool>(threads, total),
+		       run_nested<putils::WorkStealingPool>(threads, total));
+	}
+	return 0;
+}
@@ -0,0 +1,126 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/23 16:02:45
+ * @version: 1.0
+ * @description: 大量定时任务下 分层时间轮与有序集合(按到期时间排序的std::set)的比较
+ * 依次测量添加、取消一半、推进到全部到期的平均耗时
+ * 用法: bench_timer_wheel [定时任务数=1000000] [最大到期tick=600000]
+ ********************************************************************************/
+#include "base/TimingWheel.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+// 按到期时间排序的定时器 插入与取消为O(log n)
+class SetTimers {
+public:
+	using TimerId = std::pair<uint64_t, uint64_t>; // 到期tick, 序号
+
+	TimerId add(uint64_t ticks, std::function<void()> cb) {
+		TimerId id{now_ + ticks, ++seq_};
+		timers_.emplace(id, std::move(cb));
+		return id;
+	}
+	bool cancel(TimerId id) {
+		auto iter = timers_.find(Entry{id, nullptr});
+		if (iter == timers_.end())
+			return false;
+		timers_.erase(iter);
+		return true;
+	}
+	void advance(uint64_t ticks) {
+		now_ += ticks;
+		while (!timers_.empty() && timers_.begin()->first.first <= now_) {
+			auto cb = std::move(timers_.begin()->second);
+			timers_.erase(timers_.begin());
+			cb();
+		}
+	}
+	size_t size() const { return timers_.size(); }
+
+private:
+	using Entry = std::pair<TimerId, std::function<void()>>;
+	struct Less {
+		bool operator()(const Entry& lhs, const Entry& rhs) const {
+			return lhs.first < rhs.first;
+		}
+	};
+	std::set<Entry, Less> timers_;
+	uint64_t now_{0};
+	uint64_t seq_{0};
+};
+
+struct Result {
+	double add_ns;
+	double cancel_ns;
+	double expire_ns;
+	uint64_t fired;
+};
+
+template <class Timers, class Step>
+static Result run(size_t count, const std::vector<uint64_t>& ticks, Step step) {
+	using clock = std::chrono::steady_clock;
+	Timers timers;
+	uint64_t fired = 0;
+	std::vector<typename Timers::TimerId> ids;
+	ids.reserve(count);
+
+	auto begin = clock::now();
+	for (size_t i = 0; i < count; ++i) {
+		ids.push_back(timers.add(ticks[i], [&fired]() { ++fired; }));
+	}
+	auto added = clock::now();
+	for (size_t i = 0; i < count; i += 2) {
+		timers.cancel(ids[i]);
+	}
+	auto cancelled = clock::now();
+	while (timers.size() > 0) {
+		step(timers);
+	}
+	auto expired = clock::now();
+
+	auto ns = [](clock::duration d, size_t n) {
+		return std::chrono::duration<double, std::nano>(d).count() / n;
+	};
+	return Result{ns(added - begin, count), ns(cancelled - added, count / 2),
+	              ns(expired - cancelled, count - count / 2), fired};
+}
+
+static void print_result(const char* name, const Result& result) {
+	printf("%-12s %12.1f %12.1f %12.1f %12lu\n", name, result.add_ns,
+	       result.cancel_ns, result.expire_ns, result.fired);
+}
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? atol(argv[1]) : 1000000;
+	uint64_t max_ticks = argc > 2 ? atol(argv[2]) : 600000; // 1ms一格 默认10分钟
+
+	std::mt19937_64 rng(1);
+	std::vector<uint64_t> ticks(count);
+	for (auto& tick : ticks) {
+		tick = 1 + rng() % max_ticks;
+	}
+
+	printf("timers: %lu, max ticks: %lu\n", count, max_ticks);
+	printf("%-12s %12s %12s %12s %12s\n", "", "add(ns)", "cancel(ns)",
+	       "expire(ns)", "fired");
+	// 两者都按1ms推进 时间轮另外测试按next_expiry()跳跃推进(事件循环的用法)
+	print_result("std::set", run<SetTimers>(count, ticks, [](SetTimers& timers) {
+		             timers.advance(1);
+	             }));
+	print_result("wheel", run<putils::TimingWheel>(
+	                          count, ticks,
+	                          [](putils::TimingWheel& wheel) { wheel.advance(1); }));
+	print_result("wheel(skip)",
+	             run<putils::TimingWheel>(count, ticks, [](putils::TimingWheel& wheel) {
+		             wheel.advance(wheel.next_expiry());
+	             }));
+	return 0;
+}
@@ -16,6 +16,16 @@
 class ByteArray {
 public:
 	using ptr = std::shared_ptr<ByteArray>;
+
+	/**
+	 * @brief 内存布局
+	 * Chained: 固定大小内存块组成的链表 扩容不拷贝 定位需要从头遍历
+	 * Contiguous: 一整块连续内存 按倍数扩容 定位O(1)
+	 * 不超过INLINE_SIZE时使用对象内的存储 不分配堆内存
+	 */
+	enum class Layout { Chained, Contiguous };
+	static constexpr size_t INLINE_SIZE = 128;
+
 	struct Node {
 		/**
 		 * @brief 构造指定大小的内存块
@@ -39,6 +49,17 @@ public:
 	 */
 	ByteArray(size_t base_size = 4096);
 
+	/**
+	 * @brief 使用指定的内存布局构造ByteArray
+	 *
+	 * @param layout 内存布局
+	 * @param size Chained时为内存块大小 Contiguous时为初始容量
+	 */
+	ByteArray(Layout layout, size_t size = 4096);
+
+	ByteArray(const ByteArray&) = delete;
+	ByteArray& operator=(const ByteArray&) = delete;
+
 	~ByteArray();
 	template <class T> void writeFint(T value) {
 		if (endian_ != std::endian::native) {
@@ -411,6 +432,14 @@ public:
 	 * @return size_t
 	 */
 	size_t getSize() const { return size_; }
+	/**
+	 * @brief 返回内存布局
+	 *
+	 * @return Layout
+	 */
+	Layout getLayout() const {
+		return data_ ? Layout::Contiguous : Layout::Chained;
+	}
 
 private:
     /**
@@ -425,6 +454,20 @@ private:
      * @return size_t 
      */
     size_t getCapacity() const { return capacity_ - position_; }
+	/**
+	 * @brief 连续内存按倍数扩容 保留[0, size_)的数据
+	 *
+	 * @param capacity 需要的总容量
+	 */
+	void reserve(size_t capacity);
+	/**
+	 * @brief 连续内存中读取无符号Varint 直接在指针上解码
+	 */
+	uint64_t readVarint(int bits);
+	/**
+	 * @brief 读取len长度的字符串
+	 */
+	std::string readString(size_t len);
 
 private:
 	size_t baseSize_;    // 内存块大小
@@ -432,8 +475,11 @@ private:
 	size_t capacity_;    // 当前的总容量
 	size_t size_;        // 当前数据的大小
 	std::endian endian_; // 字节序
-	Node* root_;         // 内存块的起始指针
+	Node* root_;         // 内存块的起始指针 连续布局时为空
 	Node* cur_;          // 当前指针
+	char* data_;         // 连续布局的内存 链表布局时为空
+	std::unique_ptr<char[]> heap_; // 连续布局超过INLINE_SIZE后的内存
+	char inline_[INLINE_SIZE];     // 连续布局的对象内存储
 };
 
 #endif // BYTEARRAY_H
\ No newline at end of file
@@ -0,0 +1,406 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/29 10:12:44
+ * @version: 1.0
+ * @description: 有界无锁多生产者多消费者队列 (Dmitry Vyukov, "Bounded MPMC queue")
+ * 每个槽位带序号 生产者与消费者各自在一个位置计数器上CAS 不需要互斥锁
+ * 有界 队列满时try_push失败 调用者由此得到背压
+ * BlockingMPMCQueue在其上提供阻塞的push/pop 只在有线程等待时才唤醒
+ ********************************************************************************/
+#ifndef MPMCQUEUE_HPP
+#define MPMCQUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace putils {
+
+template <typename T> class MPMCQueue {
+public:
+	/**
+	 * @param capacity 向上取整为2的幂 至少为2
+	 */
+	explicit MPMCQueue(size_t capacity) {
+		size_t cap = 2;
+		while (cap < capacity)
+			cap <<= 1;
+		mask_ = cap - 1;
+		cells_.reset(new Cell[cap]);
+		for (size_t i = 0; i < cap; ++i) {
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~MPMCQueue() {
+		T value;
+		while (try_pop(value)) {
+		}
+	}
+
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+	/**
+	 * @brief 压入一个元素
+	 * @return false 队列已满
+	 */
+	template <typename... Args> bool try_emplace(Args&&... args) {
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				// 槽位空闲 抢占这个位置
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+				                                       std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false; // 上一轮的元素还没有被取走
+			} else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		::new (cell->data()) T(std::forward<Args>(args)...);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_push(const T& value) { return try_emplace(value); }
+	bool try_push(T&& value) { return try_emplace(std::move(value)); }
+
+	/**
+	 * @brief 弹出一个元素
+	 * @return false 队列为空
+	 */
+	bool try_pop(T& value) {
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff =
+			    static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+				                                       std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false; // 这个位置还没有写入
+			} else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		take(cell, pos, value);
+		return true;
+	}
+
+	/**
+	 * @brief 批量压入 一次CAS占用连续的多个位置
+	 * @param first 元素被移动走
+	 * @return size_t 实际压入的个数 队列剩余空间不足时小于count
+	 */
+	template <typename It> size_t push_bulk(It first, size_t count) {
+		if (count == 0)
+			return 0;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t n;
+		while (true) {
+			// 从pos开始数出连续空闲的槽位
+			// 这些位置还没有生产者占用 CAS成功前序号不会改变
+			n = 0;
+			while (n < count) {
+				size_t seq =
+				    cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire);
+				if (seq != pos + n)
+					break;
+				++n;
+			}
+			if (n == 0) {
+				size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+				if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos) < 0)
+					return 0; // 队列已满
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+				continue;
+			}
+			if (enqueue_pos_.compare_exchange_weak(pos, pos + n,
+			                                       std::memory_order_relaxed))
+				break;
+		}
+		for (size_t i = 0; i < n; ++i, ++first) {
+			Cell& cell = cells_[(pos + i) & mask_];
+			::new (cell.data()) T(std::move(*first));
+			cell.seq.store(pos + i + 1, std::memory_order_release);
+		}
+		return n;
+	}
+
+	/**
+	 * @brief 批量弹出 一次CAS取走连续的多个元素
+	 * @param out 输出迭代器
+	 * @return size_t 实际弹出的个数 为0时队列为空
+	 */
+	template <typename OutputIt> size_t pop_bulk(OutputIt out, size_t max) {
+		if (max == 0)
+			return 0;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		size_t n;
+		while (true) {
+			n = 0;
+			while (n < max) {
+				size_t seq =
+				    cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire);
+				if (seq != pos + n + 1)
+					break;
+				++n;
+			}
+			if (n == 0) {
+				size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+				if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0)
+					return 0; // 队列为空
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+				continue;
+			}
+			if (dequeue_pos_.compare_exchange_weak(pos, pos + n,
+			                                       std::memory_order_relaxed))
+				break;
+		}
+		for (size_t i = 0; i < n; ++i, ++out) {
+			Cell& cell = cells_[(pos + i) & mask_];
+			T* item = cell.data();
+			*out = std::move(*item);
+			item->~T();
+			cell.seq.store(pos + i + mask_ + 1, std::memory_order_release);
+		}
+		return n;
+	}
+
+	size_t capacity() const { return mask_ + 1; }
+
+	/**
+	 * @brief 近似的元素个数 并发修改时只作参考
+	 */
+	size_t size_approx() const {
+		size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+		size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+
+	bool empty_approx() const { return size_approx() == 0; }
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		alignas(T) unsigned char storage[sizeof(T)];
+		T* data() { return std::launder(reinterpret_cast<T*>(storage)); }
+	};
+
+	void take(Cell* cell, size_t pos, T& value) {
+		T* item = cell->data();
+		value = std::move(*item);
+		item->~T();
+		// 下一轮的生产者可以使用这个槽位
+		cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+	}
+
+private:
+	// 生产者与消费者的计数器放在不同的缓存行上
+	alignas(64) std::atomic<size_t> enqueue_pos_{0};
+	alignas(64) std::atomic<size_t> dequeue_pos_{0};
+	alignas(64) std::unique_ptr<Cell[]> cells_;
+	size_t mask_;
+};
+
+/**
+ * @brief 阻塞的有界队列 队列满时push等待 为空时pop等待
+ * 先自旋 再在futex(std::atomic::wait)上休眠 另一端只在有线程休眠时才唤醒
+ */
+template <typename T> class BlockingMPMCQueue {
+public:
+	explicit BlockingMPMCQueue(size_t capacity)
+	    : queue_(capacity) {}
+
+	/**
+	 * @brief 压入 队列满时等待
+	 * @return false 队列已停止
+	 */
+	bool push(T value) {
+		if (stopped())
+			return false;
+		bool pushed = false;
+		not_full_.wait(this, [&]() {
+			return pushed = queue_.try_push(std::move(value));
+		});
+		if (pushed)
+			not_empty_.notify();
+		return pushed;
+	}
+
+	/**
+	 * @brief 全部压入前等待
+	 * @return size_t 压入的个数 队列停止时可能小于count
+	 */
+	template <typename It> size_t push_bulk(It first, size_t count) {
+		size_t done = 0;
+		while (done < count && !stopped()) {
+			size_t n = 0;
+			not_full_.wait(this, [&]() {
+				n = queue_.push_bulk(first, count - done);
+				return n > 0;
+			});
+			if (n == 0)
+				break;
+			std::advance(first, n);
+			done += n;
+			not_empty_.notify();
+		}
+		return done;
+	}
+
+	bool try_push(T value) {
+		if (stopped() || !queue_.try_push(std::move(value)))
+			return false;
+		not_empty_.notify();
+		return true;
+	}
+
+	/**
+	 * @brief 弹出 队列为空时等待
+	 * @return false 队列已停止且为空
+	 */
+	bool pop(T& value) {
+		bool popped = false;
+		not_empty_.wait(this, [&]() { return popped = queue_.try_pop(value); });
+		if (popped)
+			not_full_.notify();
+		return popped;
+	}
+
+	/**
+	 * @brief 至少取出一个元素前等待 一次最多取出max个
+	 * @return size_t 为0时队列已停止且为空
+	 */
+	template <typename OutputIt> size_t pop_bulk(OutputIt out, size_t max) {
+		if (max == 0)
+			return 0;
+		size_t n = 0;
+		not_empty_.wait(this, [&]() {
+			n = queue_.pop_bulk(out, max);
+			return n > 0;
+		});
+		if (n > 0)
+			not_full_.notify();
+		return n;
+	}
+
+	bool try_pop(T& value) {
+		if (!queue_.try_pop(value))
+			return false;
+		not_full_.notify();
+		return true;
+	}
+
+	/**
+	 * @brief 唤醒所有等待的线程 之后push失败 pop取完剩余元素后失败
+	 */
+	void stop() {
+		stop_.store(true, std::memory_order_seq_cst);
+		not_empty_.notify();
+		not_full_.notify();
+	}
+
+	bool stopped() const { return stop_.load(std::memory_order_relaxed); }
+	size_t capacity() const { return queue_.capacity(); }
+	size_t size_approx() const { return queue_.size_approx(); }
+
+private:
+	static constexpr int SPIN_ROUNDS = 64; // 休眠前重试的次数
+
+	static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	/**
+	 * @brief 一端的等待者
+	 * state的高32位是轮次 低32位是本轮登记的休眠者数目
+	 * notify把数目清零并进入下一轮 唤醒本轮所有休眠者
+	 * 被唤醒的线程重新登记之前 其他notify只读一次state 不做系统调用
+	 * (只有一个CPU时被唤醒的线程要等通知方让出CPU才能运行 逐个唤醒会在每次pop时都进入内核)
+	 */
+	struct alignas(64) Waiters {
+		std::atomic<uint64_t> state{0};
+
+		/**
+		 * @brief 重试ready直到成功或队列停止
+		 * 先登记为休眠者再重试一次 与notify中先修改队列再读取state配对
+		 * 保证不会错过唤醒
+		 */
+		template <typename Ready> void wait(BlockingMPMCQueue* q, Ready&& ready) {
+			for (int i = 0; i < SPIN_ROUNDS; ++i) {
+				if (ready())
+					return;
+				cpu_relax();
+			}
+			while (true) {
+				if (ready())
+					return;
+				uint64_t cur = state.fetch_add(1, std::memory_order_seq_cst) + 1;
+				uint64_t round = cur >> 32;
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (ready() || q->stop_.load(std::memory_order_seq_cst)) {
+					cancel(round);
+					return;
+				}
+				while ((cur >> 32) == round) {
+					state.wait(cur, std::memory_order_seq_cst);
+					cur = state.load(std::memory_order_seq_cst);
+				}
+			}
+		}
+
+		// 不再休眠 本轮还没有被唤醒时撤销登记
+		void cancel(uint64_t round) {
+			uint64_t cur = state.load(std::memory_order_seq_cst);
+			while ((cur >> 32) == round &&
+			       !state.compare_exchange_weak(cur, cur - 1,
+			                                    std::memory_order_seq_cst)) {
+			}
+		}
+
+		void notify() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			uint64_t cur = state.load(std::memory_order_relaxed);
+			while ((cur & 0xffffffffu) != 0) {
+				uint64_t next = ((cur >> 32) + 1) << 32;
+				if (state.compare_exchange_weak(cur, next,
+				                                std::memory_order_seq_cst)) {
+					state.notify_all();
+					return;
+				}
+			}
+		}
+	};
+
+private:
+	MPMCQueue<T> queue_;
+	Waiters not_empty_; // 等待元素的消费者
+	Waiters not_full_;  // 等待空间的生产者
+	std::atomic<bool> stop_{false};
+};
+
+} // namespace putils
+
+#endif // MPMCQUEUE_HPP
@@ -0,0 +1,152 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/21 09:58:14
+ * @version: 1.0
+ * @description: 可扩容的环形缓冲区 容量为2的幂 读写位置单调递增 取模得到下标
+ * 空闲空间与可读数据最多分成两段 可直接交给readv/writev 非线程安全
+ ********************************************************************************/
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <algorithm>
+#include <bits/types/struct_iovec.h>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace putils {
+
+class RingBuffer {
+public:
+	/**
+	 * @brief 缓冲区在第一次写入时才分配 空闲的连接不占用内存
+	 *
+	 * @param capacity 初始容量 向上取整为2的幂
+	 */
+	explicit RingBuffer(size_t capacity = 4096)
+	    : initial_(round_up(capacity)) {}
+
+	size_t readable() const { return write_pos_ - read_pos_; }
+	size_t writable() const { return capacity_ - readable(); }
+	size_t capacity() const { return capacity_; }
+	bool empty() const { return read_pos_ == write_pos_; }
+
+	/**
+	 * @brief 保证至少有size字节的空闲空间 不够时按2倍扩容并保留已有数据
+	 *
+	 * @param size
+	 */
+	void ensure_writable(size_t size) {
+		if (writable() >= size)
+			return;
+		size_t capacity = capacity_ ? capacity_ : initial_;
+		while (capacity - readable() < size) {
+			capacity <<= 1;
+		}
+		std::unique_ptr<char[]> buffer(new char[capacity]);
+		size_t length = readable();
+		peek(buffer.get(), length);
+		buffer_ = std::move(buffer);
+		capacity_ = capacity;
+		read_pos_ = 0;
+		write_pos_ = length;
+	}
+
+	/**
+	 * @brief 空闲空间对应的缓冲区 写入后调用commit
+	 *
+	 * @param iov 至少两个元素
+	 * @return size_t 使用的iov数目
+	 */
+	size_t write_buffers(iovec* iov) {
+		if (writable() == 0)
+			return 0;
+		size_t start = write_pos_ & (capacity_ - 1);
+		size_t first = std::min(writable(), capacity_ - start);
+		iov[0].iov_base = buffer_.get() + start;
+		iov[0].iov_len = first;
+		if (first == writable())
+			return 1;
+		iov[1].iov_base = buffer_.get();
+		iov[1].iov_len = writable() - first;
+		return 2;
+	}
+
+	/**
+	 * @brief 可读数据对应的缓冲区 读取后调用consume
+	 *
+	 * @param iov 至少两个元素
+	 * @return size_t 使用的iov数目
+	 */
+	size_t read_buffers(iovec* iov) const {
+		if (empty())
+			return 0;
+		size_t start = read_pos_ & (capacity_ - 1);
+		size_t first = std::min(readable(), capacity_ - start);
+		iov[0].iov_base = buffer_.get() + start;
+		iov[0].iov_len = first;
+		if (first == readable())
+			return 1;
+		iov[1].iov_base = buffer_.get();
+		iov[1].iov_len = readable() - first;
+		return 2;
+	}
+
+	void commit(size_t size) { write_pos_ += size; }
+
+	void consume(size_t size) {
+		read_pos_ += std::min(size, readable());
+		if (empty()) {
+			read_pos_ = write_pos_ = 0; // 下次从头写 尽量只用一段
+		}
+	}
+
+	void append(const void* data, size_t size) {
+		if (size == 0)
+			return;
+		ensure_writable(size);
+		size_t start = write_pos_ & (capacity_ - 1);
+		size_t first = std::min(size, capacity_ - start);
+		memcpy(buffer_.get() + start, data, first);
+		memcpy(buffer_.get(), static_cast<const char*>(data) + first,
+		       size - first);
+		write_pos_ += size;
+	}
+
+	/**
+	 * @brief 拷贝出从可读位置偏移offset开始的size字节 不移动读位置
+	 *
+	 * @param dest
+	 * @param size 需保证 offset + size <= readable()
+	 * @param offset
+	 */
+	void peek(void* dest, size_t size, size_t offset = 0) const {
+		if (size == 0)
+			return;
+		size_t start = (read_pos_ + offset) & (capacity_ - 1);
+		size_t first = std::min(size, capacity_ - start);
+		memcpy(dest, buffer_.get() + start, first);
+		memcpy(static_cast<char*>(dest) + first, buffer_.get(), size - first);
+	}
+
+private:
+	static size_t round_up(size_t size) {
+		size_t capacity = 1;
+		while (capacity < size) {
+			capacity <<= 1;
+		}
+		return capacity;
+	}
+
+private:
+	std::unique_ptr<char[]> buffer_;
+	size_t initial_;
+	size_t capacity_{0};
+	size_t read_pos_{0};
+	size_t write_pos_{0};
+};
+
+} // namespace putils
+
+#endif // RINGBUFFER_HPP
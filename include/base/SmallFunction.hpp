@@ -0,0 +1,151 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/28 09:42:16
+ * @version: 1.0
+ * @description: 带小对象优化的只能移动的可调用对象
+ * 不超过InlineSize字节的可调用对象直接存放在内部 不分配堆内存
+ * 与std::function相比 可以保存只能移动的对象(例如捕获了unique_ptr的lambda)
+ ********************************************************************************/
+#ifndef SMALLFUNCTION_HPP
+#define SMALLFUNCTION_HPP
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace putils {
+
+template <typename Signature, std::size_t InlineSize = 64> class SmallFunction;
+
+template <typename R, typename... Args, std::size_t InlineSize>
+class SmallFunction<R(Args...), InlineSize> {
+public:
+	/**
+	 * @brief 可调用对象F是否存放在内部
+	 * 移动时可能抛出异常的对象也放在堆上 保证SmallFunction的移动不抛出异常
+	 */
+	template <typename F>
+	static constexpr bool fits_inline =
+	    sizeof(F) <= InlineSize &&
+	    alignof(F) <= alignof(std::max_align_t) &&
+	    std::is_nothrow_move_constructible_v<F>;
+
+	SmallFunction() noexcept = default;
+	SmallFunction(std::nullptr_t) noexcept {}
+
+	template <typename F, typename D = std::decay_t<F>,
+	          typename = std::enable_if_t<
+	              !std::is_same_v<D, SmallFunction> &&
+	              std::is_invocable_r_v<R, D&, Args...>>>
+	SmallFunction(F&& f) {
+		if constexpr (fits_inline<D>) {
+			::new (static_cast<void*>(&storage_)) D(std::forward<F>(f));
+		} else {
+			*heap_slot() = new D(std::forward<F>(f));
+		}
+		vtable_ = &vtable_for<D>;
+	}
+
+	SmallFunction(SmallFunction&& other) noexcept { move_from(other); }
+
+	SmallFunction& operator=(SmallFunction&& other) noexcept {
+		if (this != &other) {
+			reset();
+			move_from(other);
+		}
+		return *this;
+	}
+
+	SmallFunction& operator=(std::nullptr_t) noexcept {
+		reset();
+		return *this;
+	}
+
+	SmallFunction(const SmallFunction&) = delete;
+	SmallFunction& operator=(const SmallFunction&) = delete;
+
+	~SmallFunction() { reset(); }
+
+	R operator()(Args... args) {
+		if (!vtable_)
+			throw std::bad_function_call();
+		return vtable_->invoke(&storage_, std::forward<Args>(args)...);
+	}
+
+	explicit operator bool() const noexcept { return vtable_ != nullptr; }
+
+private:
+	struct VTable {
+		R (*invoke)(void* storage, Args&&... args);
+		// 移动构造到dst并析构src
+		void (*relocate)(void* dst, void* src) noexcept;
+		void (*destroy)(void* storage) noexcept;
+	};
+
+	template <typename F> static F* target(void* storage) noexcept {
+		if constexpr (fits_inline<F>) {
+			return std::launder(reinterpret_cast<F*>(storage));
+		} else {
+			return *static_cast<F**>(storage);
+		}
+	}
+
+	template <typename F>
+	static R invoke_impl(void* storage, Args&&... args) {
+		return std::invoke(*target<F>(storage), std::forward<Args>(args)...);
+	}
+
+	template <typename F>
+	static void relocate_impl(void* dst, void* src) noexcept {
+		if constexpr (fits_inline<F>) {
+			F* from = target<F>(src);
+			::new (dst) F(std::move(*from));
+			from->~F();
+		} else {
+			// 堆上的对象只需要转移指针
+			*static_cast<F**>(dst) = *static_cast<F**>(src);
+		}
+	}
+
+	template <typename F> static void destroy_impl(void* storage) noexcept {
+		if constexpr (fits_inline<F>) {
+			target<F>(storage)->~F();
+		} else {
+			delete target<F>(storage);
+		}
+	}
+
+	template <typename F>
+	static constexpr VTable vtable_for = {&invoke_impl<F>, &relocate_impl<F>,
+	                                      &destroy_impl<F>};
+
+	void** heap_slot() noexcept { return reinterpret_cast<void**>(&storage_); }
+
+	void move_from(SmallFunction& other) noexcept {
+		if (other.vtable_) {
+			other.vtable_->relocate(&storage_, &other.storage_);
+			vtable_ = other.vtable_;
+			other.vtable_ = nullptr;
+		}
+	}
+
+	void reset() noexcept {
+		if (vtable_) {
+			vtable_->destroy(&storage_);
+			vtable_ = nullptr;
+		}
+	}
+
+private:
+	const VTable* vtable_{nullptr};
+	alignas(std::max_align_t) unsigned char storage_[InlineSize < sizeof(void*)
+	                                                     ? sizeof(void*)
+	                                                     : InlineSize];
+};
+
+} // namespace putils
+
+#endif // SMALLFUNCTION_HPP
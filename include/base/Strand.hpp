@@ -0,0 +1,165 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/30 09:31:27
+ * @version: 1.0
+ * @description: 串行执行器(strand)
+ * 投递到同一个strand的任务按投递顺序逐个执行 不需要互斥锁
+ * 不同strand的任务在线程池中并行执行
+ * 任务放入无锁的多生产者单消费者队列 第一个任务到来时向线程池提交一次排空任务
+ ********************************************************************************/
+#ifndef STRAND_HPP
+#define STRAND_HPP
+
+#include "SmallFunction.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace putils {
+
+/**
+ * @tparam Executor 提供execute(F&&)的线程池 例如WorkStealingPool
+ */
+template <typename Executor>
+class Strand : public std::enable_shared_from_this<Strand<Executor>> {
+public:
+	using ptr = std::shared_ptr<Strand>;
+	using TaskType = SmallFunction<void()>;
+
+	/**
+	 * @brief 排空任务持有strand的shared_ptr 因此只能通过create创建
+	 * @param executor 需要比strand上的最后一个任务活得更久
+	 */
+	static ptr create(Executor& executor) { return ptr(new Strand(executor)); }
+
+	~Strand() {
+		while (Node* node = pop()) {
+			delete node;
+		}
+	}
+
+	Strand(const Strand&) = delete;
+	Strand& operator=(const Strand&) = delete;
+
+	/**
+	 * @brief 投递任务 总是在线程池中执行 排在之前投递的任务之后
+	 */
+	template <typename F> void post(F&& f) {
+		push(new Node(std::forward<F>(f)));
+		if (pending_.fetch_add(1, std::memory_order_acq_rel) == 0)
+			schedule();
+	}
+
+	/**
+	 * @brief strand空闲时直接在调用线程中执行 否则同post
+	 * 用于reactor线程或工作线程中的短任务(例如写入一次回复) 省去一次线程切换
+	 * 执行期间投递的任务交给线程池 调用者不会被其他任务拖住
+	 */
+	template <typename F> void dispatch(F&& f) {
+		size_t idle = 0;
+		if (!pending_.compare_exchange_strong(idle, 1,
+		                                      std::memory_order_acq_rel)) {
+			post(std::forward<F>(f));
+			return;
+		}
+		f();
+		if (pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			schedule();
+	}
+
+	/**
+	 * @brief 已投递还没有执行完的任务数
+	 */
+	size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t RUN_BATCH = 64; // 一次排空最多执行的任务数
+
+	struct Node {
+		Node() = default;
+		template <typename F>
+		explicit Node(F&& f)
+		    : fn(std::forward<F>(f)) {}
+		TaskType fn;
+		std::atomic<Node*> next{nullptr};
+	};
+
+	explicit Strand(Executor& executor)
+	    : executor_(executor)
+	    , head_(&stub_)
+	    , tail_(&stub_) {}
+
+	void schedule() {
+		executor_.execute([self = this->shared_from_this()]() { self->run(); });
+	}
+
+	/**
+	 * @brief 排空任务 同一时刻只有一个线程执行
+	 * 执行了RUN_BATCH个任务后重新提交自己 让出工作线程给其他连接
+	 */
+	void run() {
+		for (size_t i = 0; i < RUN_BATCH; ++i) {
+			Node* node;
+			// pending_不为0时任务一定已经或者即将放入队列
+			while (!(node = pop())) {
+				std::this_thread::yield();
+			}
+			node->fn();
+			delete node;
+			if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				return;
+		}
+		schedule();
+	}
+
+	// Vyukov的无锁多生产者单消费者队列 生产者只交换一次head_
+	void push(Node* node) {
+		node->next.store(nullptr, std::memory_order_relaxed);
+		Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	/**
+	 * @brief 只由持有strand的线程调用
+	 * @return Node* 为空或者生产者正在放入时返回nullptr
+	 */
+	Node* pop() {
+		Node* tail = tail_;
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (tail == &stub_) {
+			if (!next)
+				return nullptr;
+			tail_ = next;
+			tail = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next) {
+			tail_ = next;
+			return tail;
+		}
+		if (tail != head_.load(std::memory_order_acquire))
+			return nullptr;
+		// 只剩最后一个节点 放回哨兵后才能取出
+		push(&stub_);
+		next = tail->next.load(std::memory_order_acquire);
+		if (next) {
+			tail_ = next;
+			return tail;
+		}
+		return nullptr;
+	}
+
+private:
+	Executor& executor_;
+	std::atomic<size_t> pending_{0};
+	alignas(64) std::atomic<Node*> head_; // 生产者
+	alignas(64) Node* tail_;              // 消费者
+	Node stub_;
+};
+
+} // namespace putils
+
+#endif // STRAND_HPP
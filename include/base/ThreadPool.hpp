@@ -9,6 +9,7 @@
 #ifndef THREADPOOL_THREADPOOL_HPP
 #define THREADPOOL_THREADPOOL_HPP
 
+#include "SmallFunction.hpp"
 #include "ThreadSafeQueue.hpp"
 #include <condition_variable>
 #include <functional>
@@ -21,7 +22,7 @@ namespace putils {
 
 class ThreadPool {
 public:
-	using TaskType = std::function<void()>;
+	using TaskType = SmallFunction<void()>;
 	explicit ThreadPool(
 	    std::size_t thread_size = std::thread::hardware_concurrency()) {
 
@@ -47,7 +48,7 @@ public:
 		    std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
 
 		TaskType task = [p_task]() { (*p_task)(); };
-		this->tasks_.push(task);
+		this->tasks_.push(std::move(task));
 
 		return p_task->get_future();
 	}
@@ -62,11 +63,20 @@ public:
 
 		TaskType task = [p_task]() { (*p_task)(); };
 
-		this->tasks_.push(task);
+		this->tasks_.push(std::move(task));
 		return p_task->get_future();
 	}
 #endif
 
+	/**
+	 * @brief 提交不需要返回值的任务
+	 * 不超过64字节的可调用对象直接存放在任务中 不经过std::bind与future
+	 * @param f 可以是只能移动的对象
+	 */
+	template <typename F> void execute(F&& f) {
+		tasks_.push(TaskType(std::forward<F>(f)));
+	}
+
 	~ThreadPool() {
 		tasks_.stop();
 		for (auto& worker : this->workers_) {
@@ -39,9 +39,11 @@ public:
 	 * @param new_value 向队列中加入的新值
 	 */
 	void push(T new_value) {
-		std::lock_guard<std::mutex> lk(mutex_);
-		data_.push(std::move(new_value));
-		cond_.notify_one();
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			data_.push(std::move(new_value));
+		}
+		cond_.notify_one(); // 解锁后再唤醒 被唤醒的线程不必再等待这把锁
 	}
 	/**
 	 * 等待并弹出值
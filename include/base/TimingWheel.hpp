@@ -0,0 +1,339 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/13 09:26:44
+ * @version: 1.0
+ * @description: 分层时间轮 4层 每层256个槽 覆盖2^32个tick 插入与取消都是O(1)
+ * 定时任务保存在连续的节点数组中 以下标串成双向链表 空闲节点复用 不逐个分配内存
+ * 非线程安全 由所属的事件循环线程使用(或由使用者加锁)
+ ********************************************************************************/
+#ifndef TIMINGWHEEL_HPP
+#define TIMINGWHEEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace putils {
+
+class TimingWheel {
+public:
+	// 低32位为节点下标 高32位为节点的代数 节点复用后旧的id自然失效 0表示无效
+	using TimerId = uint64_t;
+	using callback_t = std::function<void()>;
+
+	static constexpr size_t LEVELS = 4;
+	static constexpr size_t SLOT_BITS = 8;
+	static constexpr size_t SLOTS = 1 << SLOT_BITS;
+	static constexpr uint64_t MAX_TICKS = (1ULL << (LEVELS * SLOT_BITS)) - 1;
+	static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+	/**
+	 * @brief 到期的定时任务 由advance()取出 使用者在合适的时机(例如释放锁之后)执行
+	 */
+	struct Expired {
+		TimerId id;
+		bool periodic; // 周期任务执行后需调用restart()
+		callback_t cb; // 周期任务为拷贝 单次任务为移出
+	};
+
+	TimingWheel() {
+		for (auto& level : heads_) {
+			for (auto& head : level) {
+				head = NIL;
+			}
+		}
+	}
+
+	/**
+	 * @brief 添加定时任务
+	 *
+	 * @param ticks 多少个tick之后触发 至少为1 超过MAX_TICKS时按MAX_TICKS处理
+	 * @param cb
+	 * @param interval 大于0时为周期任务 每次执行后间隔interval个tick再次触发
+	 * @return TimerId 用于取消
+	 */
+	TimerId add(uint64_t ticks, callback_t cb, uint64_t interval = 0) {
+		uint32_t index;
+		if (free_ != NIL) {
+			index = free_;
+			free_ = nodes_[index].next;
+		} else {
+			index = static_cast<uint32_t>(nodes_.size());
+			nodes_.emplace_back();
+		}
+		Node& node = nodes_[index];
+		node.expire = now_ + clamp(ticks);
+		node.interval = interval;
+		node.cb = std::move(cb);
+		node.state = LINKED;
+		link(index);
+		++size_;
+		return make_id(index, node.generation);
+	}
+
+	/**
+	 * @brief 取消定时任务 已触发(单次任务)或不存在时忽略
+	 * 周期任务在执行期间被取消时 restart()不再重新安排
+	 * @param id
+	 * @return true 取消成功
+	 */
+	bool cancel(TimerId id) {
+		Node* node = find(id);
+		if (!node)
+			return false;
+		if (node->state == LINKED)
+			unlink(static_cast<uint32_t>(id));
+		release(static_cast<uint32_t>(id));
+		return true;
+	}
+
+	/**
+	 * @brief 周期任务执行完毕后 从当前时间起间隔interval个tick再次安排
+	 *
+	 * @param id
+	 * @return false 任务在执行期间已被取消
+	 */
+	bool restart(TimerId id) {
+		Node* node = find(id);
+		if (!node || node->state != FIRING)
+			return false;
+		node->expire = now_ + clamp(node->interval);
+		node->state = LINKED;
+		link(static_cast<uint32_t>(id));
+		return true;
+	}
+
+	/**
+	 * @brief 时间轮前进ticks个tick 取出到期的任务 不执行回调
+	 * 连续的空槽整段跳过 长时间没有推进也不需要逐个tick处理
+	 * @param ticks
+	 * @param expired 按到期的先后追加
+	 */
+	void advance(uint64_t ticks, std::vector<Expired>& expired) {
+		uint64_t target = now_ + ticks;
+		while (now_ < target) {
+			if (size_ == 0) {
+				now_ = target;
+				break;
+			}
+			// 直接跳到第0层下一个非空的槽 或者需要下放上层任务的整256个tick处
+			uint64_t step = SLOTS - (now_ & (SLOTS - 1));
+			size_t cur = now_ & (SLOTS - 1);
+			size_t next = next_occupied(0, cur + 1);
+			if (next < SLOTS)
+				step = std::min<uint64_t>(step, next - cur);
+			step = std::min(step, target - now_);
+			now_ += step;
+			if ((now_ & (SLOTS - 1)) == 0)
+				cascade();
+			collect(now_ & (SLOTS - 1), expired);
+		}
+	}
+
+	/**
+	 * @brief 前进ticks个tick并执行到期的回调 回调中可以继续添加或取消任务
+	 *
+	 * @param ticks
+	 */
+	void advance(uint64_t ticks) {
+		// 复用缓冲区 回调中再次调用advance()时拿到的是空的缓冲区
+		std::vector<Expired> expired;
+		expired.swap(expired_);
+		advance(ticks, expired);
+		for (auto& timer : expired) {
+			timer.cb();
+			if (timer.periodic)
+				restart(timer.id);
+		}
+		expired.clear();
+		expired_.swap(expired);
+	}
+
+	void tick() { advance(1); }
+
+	/**
+	 * @brief 距离下一次需要推进的tick数
+	 * 任务在上层时返回下放的时刻 可能早于任务真正到期 届时再次查询即可
+	 * @return uint64_t 没有任务时返回NEVER
+	 */
+	uint64_t next_expiry() const {
+		if (size_ == 0)
+			return NEVER;
+		uint64_t result = NEVER;
+		for (size_t level = 0; level < LEVELS; ++level) {
+			size_t shift = level * SLOT_BITS;
+			size_t cur = (now_ >> shift) & (SLOTS - 1);
+			// 当前槽之后的槽属于这一圈 之前(含当前)的槽属于下一圈
+			uint64_t rotation = now_ >> (shift + SLOT_BITS);
+			size_t slot = next_occupied(level, cur + 1);
+			if (slot >= SLOTS) {
+				slot = next_occupied(level, 0);
+				if (slot > cur)
+					continue; // 这一层为空
+				++rotation;
+			}
+			uint64_t when = (rotation << (shift + SLOT_BITS)) |
+			                (static_cast<uint64_t>(slot) << shift);
+			result = std::min(result, when - now_);
+		}
+		return result;
+	}
+
+	uint64_t now() const { return now_; }
+
+	size_t size() const { return size_; }
+
+private:
+	static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+	enum State : uint8_t {
+		FREE,
+		LINKED, // 在某个槽的链表中
+		FIRING, // 周期任务正在执行 等待restart()
+	};
+
+	struct Node {
+		uint64_t expire{0};
+		uint64_t interval{0};
+		callback_t cb;
+		uint32_t prev{NIL};
+		uint32_t next{NIL}; // 空闲时串成空闲链表
+		uint32_t generation{1};
+		uint8_t level{0};
+		uint8_t slot{0};
+		State state{FREE};
+	};
+
+	static uint64_t clamp(uint64_t ticks) {
+		if (ticks == 0)
+			return 1;
+		return ticks > MAX_TICKS ? MAX_TICKS : ticks;
+	}
+
+	static TimerId make_id(uint32_t index, uint32_t generation) {
+		return (static_cast<TimerId>(generation) << 32) | index;
+	}
+
+	Node* find(TimerId id) {
+		uint32_t index = static_cast<uint32_t>(id);
+		if (index >= nodes_.size())
+			return nullptr;
+		Node& node = nodes_[index];
+		if (node.state == FREE || node.generation != (id >> 32))
+			return nullptr;
+		return &node;
+	}
+
+	void release(uint32_t index) {
+		Node& node = nodes_[index];
+		node.cb = nullptr;
+		node.state = FREE;
+		if (++node.generation == 0)
+			node.generation = 1; // 保证id不为0
+		node.next = free_;
+		free_ = index;
+		--size_;
+	}
+
+	// 按距离到期的tick数决定所在的层 到期的tick决定所在的槽
+	void link(uint32_t index) {
+		Node& node = nodes_[index];
+		uint64_t delta = node.expire > now_ ? node.expire - now_ : 0;
+		size_t level = 0;
+		while (level + 1 < LEVELS && delta >= (1ULL << ((level + 1) * SLOT_BITS))) {
+			++level;
+		}
+		size_t slot = (node.expire >> (level * SLOT_BITS)) & (SLOTS - 1);
+		node.level = static_cast<uint8_t>(level);
+		node.slot = static_cast<uint8_t>(slot);
+		node.prev = NIL;
+		node.next = heads_[level][slot];
+		if (node.next != NIL)
+			nodes_[node.next].prev = index;
+		heads_[level][slot] = index;
+		occupied_[level][slot >> 6] |= 1ULL << (slot & 63);
+	}
+
+	void unlink(uint32_t index) {
+		Node& node = nodes_[index];
+		if (node.prev != NIL)
+			nodes_[node.prev].next = node.next;
+		else
+			heads_[node.level][node.slot] = node.next;
+		if (node.next != NIL)
+			nodes_[node.next].prev = node.prev;
+		if (heads_[node.level][node.slot] == NIL)
+			occupied_[node.level][node.slot >> 6] &= ~(1ULL << (node.slot & 63));
+	}
+
+	// 取出整个槽的链表
+	uint32_t take_slot(size_t level, size_t slot) {
+		uint32_t head = heads_[level][slot];
+		heads_[level][slot] = NIL;
+		occupied_[level][slot >> 6] &= ~(1ULL << (slot & 63));
+		return head;
+	}
+
+	// 低层转完一圈 把上层对应槽中的任务按剩余时间重新放置 从高层往低层进行
+	void cascade() {
+		size_t levels = 1;
+		while (levels < LEVELS &&
+		       ((now_ >> (levels * SLOT_BITS)) & (SLOTS - 1)) == 0) {
+			++levels;
+		}
+		for (size_t level = std::min(levels, LEVELS - 1); level >= 1; --level) {
+			size_t slot = (now_ >> (level * SLOT_BITS)) & (SLOTS - 1);
+			for (uint32_t index = take_slot(level, slot); index != NIL;) {
+				uint32_t next = nodes_[index].next;
+				link(index);
+				index = next;
+			}
+		}
+	}
+
+	void collect(size_t slot, std::vector<Expired>& expired) {
+		for (uint32_t index = take_slot(0, slot); index != NIL;) {
+			Node& node = nodes_[index];
+			uint32_t next = node.next;
+			TimerId id = make_id(index, node.generation);
+			if (node.interval > 0) {
+				node.state = FIRING;
+				expired.push_back(Expired{id, true, node.cb});
+			} else {
+				expired.push_back(Expired{id, false, std::move(node.cb)});
+				release(index);
+			}
+			index = next;
+		}
+	}
+
+	// 从start开始(含)第一个非空的槽 没有时返回SLOTS
+	size_t next_occupied(size_t level, size_t start) const {
+		for (size_t word = start >> 6; word < SLOTS / 64; ++word) {
+			uint64_t bits = occupied_[level][word];
+			if (word == (start >> 6))
+				bits &= ~0ULL << (start & 63);
+			if (bits)
+				return (word << 6) + __builtin_ctzll(bits);
+		}
+		return SLOTS;
+	}
+
+private:
+	std::vector<Node> nodes_;
+	uint32_t free_{NIL};
+	size_t size_{0};
+	uint64_t now_{0};
+	uint32_t heads_[LEVELS][SLOTS];
+	uint64_t occupied_[LEVELS][SLOTS / 64]{};
+	std::vector<Expired> expired_;
+};
+
+} // namespace putils
+
+#endif // TIMINGWHEEL_HPP
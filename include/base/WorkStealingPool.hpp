@@ -0,0 +1,449 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/27 10:05:43
+ * @version: 1.0
+ * @description: 工作窃取线程池
+ * 每个工作线程有自己的Chase-Lev双端队列 工作线程提交的任务放入自己的队列(无锁)
+ * 外部线程提交的任务放入全局注入队列 工作线程自己的队列为空时先从注入队列批量取
+ * 再从其他工作线程的队列顶部窃取 都没有任务时先自旋 再在futex上休眠
+ * 任务按值存放在SmallFunction中 队列节点由工作线程回收复用 稳定后提交任务不分配内存
+ ********************************************************************************/
+#ifndef WORKSTEALINGPOOL_HPP
+#define WORKSTEALINGPOOL_HPP
+
+#include "SmallFunction.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace putils {
+
+/**
+ * @brief Chase-Lev双端队列 ("Correct and Efficient Work-Stealing for Weak
+ * Memory Models", PPoPP'13) 所有者在底部push/pop 其他线程在顶部steal
+ * 容量不足时扩容为两倍 旧数组可能仍被窃取者读取 保留到队列析构
+ * @tparam T 指针类型
+ */
+template <typename T> class ChaseLevDeque {
+public:
+	explicit ChaseLevDeque(size_t capacity = 256) {
+		size_t cap = 1;
+		while (cap < capacity)
+			cap <<= 1;
+		arrays_.push_back(std::make_unique<Array>(cap));
+		array_.store(arrays_.back().get(), std::memory_order_relaxed);
+	}
+
+	ChaseLevDeque(const ChaseLevDeque&) = delete;
+	ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+	/**
+	 * @brief 所有者线程在底部压入
+	 */
+	void push(T item) {
+		int64_t b = bottom_.load(std::memory_order_relaxed);
+		int64_t t = top_.load(std::memory_order_acquire);
+		Array* a = array_.load(std::memory_order_relaxed);
+		if (b - t > static_cast<int64_t>(a->mask)) {
+			a = grow(a, t, b);
+		}
+		a->put(b, item);
+		bottom_.store(b + 1, std::memory_order_release);
+	}
+
+	/**
+	 * @brief 所有者线程从底部弹出(后进先出 缓存更热)
+	 * @return T 为空时返回nullptr
+	 */
+	T pop() {
+		int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+		Array* a = array_.load(std::memory_order_relaxed);
+		// 与steal对top_的读取之间需要全序
+		bottom_.store(b, std::memory_order_seq_cst);
+		int64_t t = top_.load(std::memory_order_seq_cst);
+		if (t > b) {
+			bottom_.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		T item = a->get(b);
+		if (t == b) {
+			// 只剩最后一个 与窃取者竞争
+			if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+			                                  std::memory_order_relaxed))
+				item = nullptr;
+			bottom_.store(b + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	/**
+	 * @brief 其他线程从顶部窃取(先进先出)
+	 * @return T 为空或者与其他线程竞争失败时返回nullptr
+	 */
+	T steal() {
+		int64_t t = top_.load(std::memory_order_seq_cst);
+		int64_t b = bottom_.load(std::memory_order_seq_cst);
+		if (t >= b)
+			return nullptr;
+		Array* a = array_.load(std::memory_order_acquire);
+		T item = a->get(t);
+		if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+		                                  std::memory_order_relaxed))
+			return nullptr;
+		return item;
+	}
+
+	/**
+	 * @brief 近似的元素个数 只用于判断是否值得窃取
+	 */
+	size_t size() const {
+		int64_t b = bottom_.load(std::memory_order_relaxed);
+		int64_t t = top_.load(std::memory_order_relaxed);
+		return b > t ? static_cast<size_t>(b - t) : 0;
+	}
+
+	bool empty() const { return size() == 0; }
+
+private:
+	struct Array {
+		explicit Array(size_t capacity)
+		    : mask(capacity - 1)
+		    , slots(new std::atomic<T>[capacity]) {}
+		T get(int64_t index) const {
+			return slots[index & mask].load(std::memory_order_relaxed);
+		}
+		void put(int64_t index, T item) {
+			slots[index & mask].store(item, std::memory_order_relaxed);
+		}
+		size_t mask;
+		std::unique_ptr<std::atomic<T>[]> slots;
+	};
+
+	Array* grow(Array* old, int64_t t, int64_t b) {
+		arrays_.push_back(std::make_unique<Array>((old->mask + 1) * 2));
+		Array* a = arrays_.back().get();
+		for (int64_t i = t; i < b; ++i) {
+			a->put(i, old->get(i));
+		}
+		array_.store(a, std::memory_order_release);
+		return a;
+	}
+
+private:
+	alignas(64) std::atomic<int64_t> top_{0};
+	alignas(64) std::atomic<int64_t> bottom_{0};
+	std::atomic<Array*> array_{nullptr};
+	std::vector<std::unique_ptr<Array>> arrays_; // 只由所有者修改
+};
+
+class WorkStealingPool {
+public:
+	using TaskType = SmallFunction<void()>;
+
+	explicit WorkStealingPool(
+	    std::size_t thread_size = std::thread::hardware_concurrency()) {
+		if (thread_size == 0)
+			thread_size = 1;
+		for (std::size_t i = 0; i < thread_size; ++i) {
+			queues_.push_back(std::make_unique<Worker>());
+		}
+		for (std::size_t i = 0; i < thread_size; ++i) {
+			workers_.emplace_back([this, i]() { run(i); });
+		}
+	}
+
+	/**
+	 * @brief 提交任务 与ThreadPool::submit相同
+	 * @return std::future 任务的返回值
+	 */
+	template <typename F, typename... Args> auto submit(F&& f, Args&&... args) {
+		std::function<decltype(f(args...))()> func =
+		    std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+
+		// 用异步操作封装
+		auto p_task =
+		    std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
+
+		execute([p_task]() { (*p_task)(); });
+		return p_task->get_future();
+	}
+
+	/**
+	 * @brief 提交不需要返回值的任务 省去std::bind与future的分配
+	 * 在工作线程中调用时放入该线程自己的队列 否则放入注入队列
+	 * @param f 不超过64字节的可调用对象不分配堆内存 可以是只能移动的对象
+	 */
+	template <typename F> void execute(F&& f) {
+		TaskType task(std::forward<F>(f));
+		if (current_pool() == this) {
+			auto& worker = *queues_[current_index()];
+			worker.deque.push(worker.acquire(std::move(task)));
+		} else {
+			std::lock_guard<std::mutex> lock(inject_mtx_);
+			inject_.push(std::move(task));
+			inject_size_.store(inject_.size(), std::memory_order_relaxed);
+		}
+		notify();
+	}
+
+	std::size_t size() const { return workers_.size(); }
+
+	~WorkStealingPool() {
+		// 与ThreadPool一致 已提交的任务执行完毕后退出
+		stop_.store(true, std::memory_order_seq_cst);
+		epoch_.fetch_add(1, std::memory_order_seq_cst);
+		epoch_.notify_all();
+		for (auto& worker : workers_) {
+			if (worker.joinable()) {
+				worker.join();
+			}
+		}
+	}
+
+	// 禁止拷贝
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// 禁止移动
+	WorkStealingPool(WorkStealingPool&&) = delete;
+	WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+
+private:
+	static constexpr int SPIN_ROUNDS = 64;    // 休眠前查找任务的轮数
+	static constexpr size_t INJECT_BATCH = 32; // 一次从注入队列取出的上限
+	static constexpr size_t FREE_LIMIT = 1024; // 每个线程缓存的空闲节点上限
+
+	// 工作线程队列中的节点
+	struct Task {
+		TaskType fn;
+		Task* next{nullptr}; // 空闲链表
+	};
+
+	struct Worker {
+		ChaseLevDeque<Task*> deque;
+		// 空闲节点 只由所属的工作线程访问
+		// 被窃取的任务由执行它的线程回收 超过上限的释放
+		Task* free_list{nullptr};
+		size_t free_count{0};
+
+		Task* acquire(TaskType&& fn) {
+			Task* task = free_list;
+			if (task) {
+				free_list = task->next;
+				--free_count;
+			} else {
+				task = new Task;
+			}
+			task->fn = std::move(fn);
+			return task;
+		}
+
+		void release(Task* task) {
+			task->fn = nullptr; // 及时析构捕获的对象
+			if (free_count >= FREE_LIMIT) {
+				delete task;
+				return;
+			}
+			task->next = free_list;
+			free_list = task;
+			++free_count;
+		}
+
+		~Worker() {
+			while (free_list) {
+				Task* next = free_list->next;
+				delete free_list;
+				free_list = next;
+			}
+		}
+	};
+
+	/**
+	 * @brief 注入队列 按值存放任务的环形缓冲区 容量不足时扩容为两倍
+	 * 由inject_mtx_保护
+	 */
+	class TaskRing {
+	public:
+		void push(TaskType&& task) {
+			if (size_ == slots_.size())
+				grow();
+			slots_[(head_ + size_) & (slots_.size() - 1)] = std::move(task);
+			++size_;
+		}
+		TaskType pop() {
+			TaskType task = std::move(slots_[head_]);
+			head_ = (head_ + 1) & (slots_.size() - 1);
+			--size_;
+			return task;
+		}
+		std::size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+
+	private:
+		void grow() {
+			std::vector<TaskType> slots(slots_.empty() ? 64 : slots_.size() * 2);
+			for (std::size_t i = 0; i < size_; ++i) {
+				slots[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+			}
+			slots_.swap(slots);
+			head_ = 0;
+		}
+
+		std::vector<TaskType> slots_; // 容量是2的幂
+		std::size_t head_{0};
+		std::size_t size_{0};
+	};
+
+	static WorkStealingPool*& current_pool() {
+		thread_local WorkStealingPool* pool = nullptr;
+		return pool;
+	}
+	static std::size_t& current_index() {
+		thread_local std::size_t index = 0;
+		return index;
+	}
+
+	static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	// 有线程在休眠时唤醒一个 没有时只是一次读取
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers_.load(std::memory_order_relaxed) > 0) {
+			epoch_.fetch_add(1, std::memory_order_seq_cst);
+			epoch_.notify_one();
+		}
+	}
+
+	void run(std::size_t index) {
+		current_pool() = this;
+		current_index() = index;
+		auto& worker = *queues_[index];
+		while (true) {
+			Task* task = find_task(index);
+			for (int i = 0; !task && i < SPIN_ROUNDS; ++i) {
+				cpu_relax();
+				task = find_task(index);
+			}
+			if (task) {
+				task->fn();
+				worker.release(task);
+				continue;
+			}
+			if (!park())
+				return;
+		}
+	}
+
+	/**
+	 * @brief 休眠直到有新任务提交
+	 * 先登记为休眠者再检查一次队列 与notify中先放入任务再读取休眠者数目配对
+	 * 保证不会错过唤醒
+	 * @return false 线程池已停止且没有剩余任务
+	 */
+	bool park() {
+		auto epoch = epoch_.load(std::memory_order_seq_cst);
+		sleepers_.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool has_work = has_task();
+		if (!has_work) {
+			if (stop_.load(std::memory_order_seq_cst)) {
+				sleepers_.fetch_sub(1, std::memory_order_relaxed);
+				return false;
+			}
+			epoch_.wait(epoch, std::memory_order_seq_cst);
+		}
+		sleepers_.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool has_task() const {
+		if (inject_size_.load(std::memory_order_seq_cst) > 0)
+			return true;
+		for (const auto& queue : queues_) {
+			if (!queue->deque.empty())
+				return true;
+		}
+		return false;
+	}
+
+	Task* find_task(std::size_t index) {
+		auto& worker = *queues_[index];
+		if (Task* task = worker.deque.pop())
+			return task;
+		if (Task* task = take_injected(worker))
+			return task;
+		// 从随机位置开始窃取 避免所有线程挤在同一个队列上
+		std::size_t n = queues_.size();
+		std::size_t start = next_random() % n;
+		for (std::size_t i = 0; i < n; ++i) {
+			std::size_t victim = (start + i) % n;
+			if (victim == index)
+				continue;
+			if (Task* task = queues_[victim]->deque.steal())
+				return task;
+		}
+		return nullptr;
+	}
+
+	// 从注入队列取出一批任务 第一个直接执行 其余放入自己的队列供其他线程窃取
+	Task* take_injected(Worker& worker) {
+		if (inject_size_.load(std::memory_order_relaxed) == 0)
+			return nullptr;
+		std::lock_guard<std::mutex> lock(inject_mtx_);
+		if (inject_.empty())
+			return nullptr;
+		// 按线程数平分 留一部分给其他线程
+		std::size_t batch = std::min(
+		    {INJECT_BATCH, inject_.size(), inject_.size() / queues_.size() + 1});
+		Task* first = worker.acquire(inject_.pop());
+		for (std::size_t i = 1; i < batch; ++i) {
+			worker.deque.push(worker.acquire(inject_.pop()));
+		}
+		inject_size_.store(inject_.size(), std::memory_order_relaxed);
+		if (batch > 1)
+			notify(); // 放入本地队列的任务可以被休眠的线程窃取
+		return first;
+	}
+
+	static std::size_t next_random() {
+		thread_local uint32_t state =
+		    static_cast<uint32_t>(std::hash<std::thread::id>{}(
+		        std::this_thread::get_id())) |
+		    1;
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+private:
+	std::vector<std::unique_ptr<Worker>> queues_; // 每个工作线程一个
+	std::vector<std::thread> workers_;
+
+	std::mutex inject_mtx_;
+	TaskRing inject_; // 外部线程提交的任务
+	std::atomic<std::size_t> inject_size_{0};
+
+	alignas(64) std::atomic<uint32_t> epoch_{0}; // 休眠的线程在其上等待
+	std::atomic<int> sleepers_{0};
+	std::atomic<bool> stop_{false};
+};
+
+} // namespace putils
+
+#endif // WORKSTEALINGPOOL_HPP
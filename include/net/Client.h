@@ -9,10 +9,16 @@
 #define CLIENT_H
 
 #include "FileDescriptor.h"
+#include "FrameDecoder.h"
 #include "base/ByteArray.h"
+#include "base/RingBuffer.hpp"
+#include "base/Strand.hpp"
+#include "base/WorkStealingPool.hpp"
 #include <atomic>
 #include <bits/types/struct_iovec.h>
+#include <chrono>
 #include <cstddef>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -30,6 +36,13 @@ class Client:public std::enable_shared_from_this<Client> {
 	    std::function<void(std::shared_ptr<Client>, ClientEvent, ByteArray::ptr )>;
 public:
 	using ptr = std::shared_ptr<Client>;
+	// 发送代理 返回接受的字节数 连接已失效时返回-1
+	using send_handler_t = std::function<ssize_t(const iovec*, size_t)>;
+	// 关注的事件(可读/可写)发生变化 由reactor设置 可能在任意线程中回调
+	using interest_handler_t = std::function<void()>;
+	// 待发送数据越过水位 high为true表示超过高水位 false表示回落到低水位
+	using watermark_handler_t = std::function<void(std::shared_ptr<Client>, bool)>;
+	using strand_t = putils::Strand<putils::WorkStealingPool>;
 	Client(int);
 	bool operator==(const Client& other) const {
 		return (this->sock_fd_.get() == other.sock_fd_.get()) &&
@@ -44,9 +57,65 @@ public:
 		handler_callback_ = event_handle;
 	}
 
+	/**
+	 * @brief 设置发送代理 设置后send不再直接写socket 而是把数据交给代理
+	 * 例如io_uring后端由reactor线程统一提交发送请求
+	 * @param send_handle
+	 */
+	void set_send_handler(const send_handler_t& send_handle) {
+		send_handler_ = send_handle;
+	}
+
+	/**
+	 * @brief 设置事件关注的回调 设置后send不会阻塞也不会只发送一部分
+	 * socket写满时剩余的数据进入输出队列 由reactor在可写时调用flush_output继续发送
+	 * 需要在连接交给其他线程之前设置
+	 * @param interest_handle
+	 */
+	void set_interest_handler(const interest_handler_t& interest_handle) {
+		interest_handler_ = interest_handle;
+	}
+
+	/**
+	 * @brief 设置输出队列的高低水位 用于上层做背压
+	 * 待发送的数据达到high时回调handler(client, true)
+	 * 之后回落到low以下时回调handler(client, false)
+	 * @param high 为0时不检测
+	 * @param low
+	 * @param handler
+	 */
+	void set_watermark(size_t high, size_t low,
+	                   const watermark_handler_t& handler);
+
+	/**
+	 * @brief 按长度字段分帧 设置后INCOMING_MSG只携带完整的帧
+	 * 一次读取到的多个帧放在同一个ByteArray中 需要在连接开始收数据之前设置
+	 * @param options
+	 */
+	void set_frame_decoder(const FrameDecoder::Options& options) {
+		decoder_ = std::make_unique<FrameDecoder>(options);
+	}
+
+	/**
+	 * @brief 处理收到的数据并发布INCOMING_MSG 由reactor线程调用
+	 *
+	 * @param data
+	 * @param size
+	 * @return true
+	 * @return false 分帧出错 已经发布了断开事件
+	 */
+	bool handle_data(const char* data, size_t size);
+
 	void publishEvent(ClientEvent clientEvent, const std::string& msg = "");
 	void publishEvent(ClientEvent clientEvent, ByteArray::ptr bt);
 
+	/**
+	 * @brief 标记连接断开 并发布DISCONNECTED事件
+	 *
+	 * @param reason 断开的原因
+	 */
+	void handle_disconnected(const std::string& reason);
+
 	bool is_connected() const { return is_connected_; }
 	/**
 	 * @brief 设置对象的连接情况
@@ -55,6 +124,14 @@ public:
 	 */
 	void set_connected(bool flag) { is_connected_ = flag; }
 
+	/**
+	 * @brief 记录连接最近一次活跃(收到数据)的时间 由所属reactor线程调用
+	 */
+	void touch() { last_active_ = std::chrono::steady_clock::now(); }
+	std::chrono::steady_clock::time_point last_active() const {
+		return last_active_;
+	}
+
 	/**
 	 * @brief 接收来自客户端的数据
 	 * 目前未加入处理数据的过程，只要来数据就进行接收，直到缓冲区没有数据
@@ -66,11 +143,61 @@ public:
 	ssize_t recv(void* buffer, size_t length, int flag = 0);
 	ssize_t recv(iovec* buffers, size_t length, int flags = 0);
 
-	ssize_t send(const void* buffer, size_t length,int flag=0) const;
-	ssize_t send(const iovec* buffers, size_t length, int flag = 0) const;
+	ssize_t send(const void* buffer, size_t length,int flag=0);
+	ssize_t send(const iovec* buffers, size_t length, int flag = 0);
 
 	// 向客户端发送消息
-	void send(const char* msg, size_t msgSize) const;
+	void send(const char* msg, size_t msgSize);
+
+	/**
+	 * @brief 把输出队列中的数据写入socket 由reactor在可写时调用
+	 * 队列清空后回调interest_handler_ 不再关注可写事件
+	 * @return true 写完或者socket已满
+	 * @return false 出错 errno为对应的错误
+	 */
+	bool flush_output();
+
+	/**
+	 * @brief 发送代理完成了bytes字节的发送 用于统计待发送的数据量
+	 *
+	 * @param bytes
+	 */
+	void on_output_sent(size_t bytes);
+
+	/**
+	 * @brief 已经交给send但还没有写入socket的字节数
+	 */
+	size_t pending_output() const { return output_bytes_; }
+	bool has_pending_output() const { return output_bytes_ > 0; }
+
+	/**
+	 * @brief 暂停或恢复读取该连接 用于上层做背压
+	 *
+	 * @param enable
+	 */
+	void set_reading(bool enable);
+	bool is_reading() const { return reading_; }
+
+	/**
+	 * @brief 发布接收缓冲区中的数据 设置了分帧时只发布完整的帧
+	 * 暂停读取期间不发布 已经收到的数据留在缓冲区中 恢复后由reactor再次调用
+	 *
+	 * @return false 分帧出错 已经发布了断开事件
+	 */
+	bool publish_input();
+
+	/**
+	 * @brief 设置连接的串行执行器 需要在连接交给其他线程之前设置
+	 * @param strand
+	 */
+	void set_strand(strand_t::ptr strand) { strand_ = std::move(strand); }
+
+	/**
+	 * @brief 连接的串行执行器 投递到这里的写入按顺序逐个执行
+	 * 多个线程写入同一连接时数据不会交错 也不会互相阻塞
+	 * @return const strand_t::ptr& 未设置时为空
+	 */
+	const strand_t::ptr& strand() const { return strand_; }
 
 	/**
 	 * @brief 关闭当前连接
@@ -78,14 +205,44 @@ public:
 	 */
 	void close();
 	void print() const;
+private:
+	/**
+	 * @brief 先尝试直接写socket 写不完的部分进入输出队列
+	 *
+	 * @return ssize_t 接受的字节数 出错时返回-1
+	 */
+	ssize_t send_or_queue(const iovec* buffers, size_t length, int flag);
+
+	// 以下两个函数需持有output_mtx_ 返回是否需要回调watermark_handler_
+	bool add_output(size_t bytes);
+	bool consume_output(size_t bytes);
+
 private:
 	FileDescriptor sock_fd_{};        // sock 句柄
 	std::string ip_{""};              // 客户端ip地址
 	std::atomic_bool is_connected_{}; // 判断是否连接
+	strand_t::ptr strand_;            // 串行执行写入
+	std::chrono::steady_clock::time_point last_active_{
+	    std::chrono::steady_clock::now()}; // 最近一次收到数据的时间
 
 
 	// 针对当前客户端的回调 即如何处理获取的消息
 	client_event_handler_t handler_callback_;
+	send_handler_t send_handler_; // 为空时直接写socket
+	FrameDecoder::ptr decoder_;   // 为空时每次读取到的数据作为一条消息
+	putils::RingBuffer input_;    // 接收缓冲区 在多次读取之间复用 只在reactor线程中访问
+	interest_handler_t interest_handler_; // 为空时send直接写socket 不使用输出队列
+
+	// 输出队列 由send写入 reactor线程在可写时发送
+	std::mutex output_mtx_;
+	std::deque<std::string> output_; // 首个元素可能已经发送了一部分
+	size_t output_offset_{0};        // 首个元素已发送的字节数
+	std::atomic<size_t> output_bytes_{0};
+	size_t high_watermark_{0};
+	size_t low_watermark_{0};
+	bool above_high_{false};
+	watermark_handler_t watermark_handler_;
+	std::atomic_bool reading_{true};
 }; // Client
 
 #endif // CLIENT_H
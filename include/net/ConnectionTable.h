@@ -0,0 +1,152 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/15 10:18:06
+ * @version: 1.0
+ * @description: 以fd为下标的连接表 替代 unordered_map<FileDescriptor, Client::ptr>
+ * 槽按块分配 块的地址一旦发布便不再改变 每个槽带有代数 用于识别过期的句柄
+ ********************************************************************************/
+#ifndef CONNECTIONTABLE_H
+#define CONNECTIONTABLE_H
+
+#include "Client.h"
+#include "TimerService.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+class ConnectionTable {
+public:
+	/**
+	 * @brief 连接句柄 高位为代数(24位) 低32位为fd
+	 * 代数从1开始 因此0不会是有效句柄 可用于区分监听socket等非连接句柄
+	 */
+	using handle_t = uint64_t;
+	static constexpr uint32_t GENERATION_MASK = 0xFFFFFF;
+
+	/**
+	 * @brief 槽 除shared外只由所属reactor线程访问
+	 */
+	struct Slot {
+		std::atomic<uint32_t> generation{0};
+		Client* client{nullptr}; // reactor线程使用 无需原子操作与引用计数
+		std::atomic<std::shared_ptr<Client>> shared; // 持有连接 供其他线程读取
+		TimerService::TimerId idle_timer{0};  // 空闲检测的定时任务
+	};
+
+	/**
+	 * @brief
+	 *
+	 * @param max_fds 可容纳的最大fd 为0时取 RLIMIT_NOFILE 的硬限制
+	 */
+	explicit ConnectionTable(size_t max_fds = 0);
+	~ConnectionTable();
+
+	ConnectionTable(const ConnectionTable&) = delete;
+	ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+	static handle_t make_handle(int fd, uint32_t generation) {
+		return (static_cast<uint64_t>(generation) << 32) |
+		       static_cast<uint32_t>(fd);
+	}
+	static int fd_of(handle_t handle) {
+		return static_cast<int>(handle & 0xFFFFFFFF);
+	}
+	static uint32_t generation_of(handle_t handle) {
+		return static_cast<uint32_t>(handle >> 32);
+	}
+
+	/**
+	 * @brief 加入连接 只能在reactor线程中调用
+	 *
+	 * @param client
+	 * @return handle_t fd超出容量或已被占用时返回0
+	 */
+	handle_t insert(const Client::ptr& client);
+
+	/**
+	 * @brief 移除连接 之前的句柄随之失效 只能在reactor线程中调用
+	 *
+	 * @param fd
+	 */
+	void remove(int fd);
+
+	/**
+	 * @brief 按句柄查找连接 只能在reactor线程中调用
+	 * O(1) 不加锁也不修改引用计数
+	 * @param handle
+	 * @return Client* 句柄过期时返回nullptr
+	 */
+	Client* get(handle_t handle) const {
+		const Slot* s = slot(fd_of(handle));
+		if (!s || !s->client ||
+		    s->generation.load(std::memory_order_relaxed) !=
+		        generation_of(handle))
+			return nullptr;
+		return s->client;
+	}
+
+	/**
+	 * @brief fd对应的槽 只能在reactor线程中调用
+	 *
+	 * @param fd
+	 * @return Slot* 未分配时返回nullptr
+	 */
+	Slot* slot(int fd) const {
+		if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+			return nullptr;
+		Chunk* chunk = chunks_[fd / CHUNK_SIZE].load(std::memory_order_acquire);
+		return chunk ? &chunk->slots[fd % CHUNK_SIZE] : nullptr;
+	}
+
+	/**
+	 * @brief fd当前连接的句柄 只能在reactor线程中调用
+	 *
+	 * @param fd
+	 * @return handle_t 没有连接时返回0
+	 */
+	handle_t handle_of(int fd) const;
+
+	/**
+	 * @brief 读取fd上的连接 可跨线程调用
+	 *
+	 * @param fd
+	 * @return Client::ptr
+	 */
+	Client::ptr load(int fd) const;
+
+	/**
+	 * @brief 遍历所有连接 可跨线程调用
+	 *
+	 * @param func 返回false时停止遍历
+	 */
+	void for_each(const std::function<bool(const Client::ptr&)>& func) const;
+
+	/**
+	 * @brief 移除全部连接 只能在reactor线程中调用
+	 *
+	 * @param func 移除前对每个连接的回调
+	 */
+	void clear(const std::function<void(const Client::ptr&)>& func);
+
+	size_t size() const { return size_.load(std::memory_order_relaxed); }
+	size_t capacity() const { return capacity_; }
+
+private:
+	static constexpr size_t CHUNK_SIZE = 1024;
+	struct Chunk {
+		Slot slots[CHUNK_SIZE];
+	};
+
+	Slot* ensure_slot(int fd);
+
+private:
+	size_t capacity_;
+	std::unique_ptr<std::atomic<Chunk*>[]> chunks_;
+	size_t chunk_nums_;
+	std::atomic<size_t> size_{0};
+};
+
+#endif // CONNECTIONTABLE_H
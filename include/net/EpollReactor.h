@@ -0,0 +1,73 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/09 10:05:21
+ * @version: 1.0
+ * @description: 基于epoll(边缘触发)的reactor
+ ********************************************************************************/
+#ifndef EPOLLREACTOR_H
+#define EPOLLREACTOR_H
+
+#include "FileDescriptor.h"
+#include "Reactor.h"
+#include <cstdint>
+#include <sys/epoll.h>
+#define MAX_EVENT_NUMBER 1024
+
+class EpollReactor : public Reactor {
+public:
+	explicit EpollReactor(int id);
+	~EpollReactor() override;
+
+	IoBackend backend() const override { return IoBackend::EPOLL; }
+
+protected:
+	void init_backend() override;
+	void close_backend() override;
+	void loop() override;
+	void on_client_added(const Client::ptr& client,
+	                     ConnectionTable::handle_t handle) override;
+
+private:
+	void handle_events(int number);
+
+	/**
+	 * @brief 处理连接上的事件 对端关闭或出错时立即关闭连接
+	 *
+	 * @param handle
+	 * @param client
+	 * @param events
+	 */
+	void handle_client_event(ConnectionTable::handle_t handle, Client& client,
+	                         uint32_t events);
+
+	/**
+	 * @brief 接收监听队列中所有等待的连接 连接此后的读写都由当前reactor负责
+	 */
+	void accept_clients();
+
+	/**
+	 * @brief 注册到epoll 事件数据中保存连接句柄
+	 *
+	 * @param file_desc
+	 * @param events
+	 * @param handle 连接的句柄 为0时表示不在连接表中的句柄(代数为0)
+	 */
+	void add_fd(FileDescriptor file_desc, uint32_t events,
+	            ConnectionTable::handle_t handle = 0);
+
+	/**
+	 * @brief 按连接当前的状态(是否暂停读取、是否有待发送的数据)修改关注的事件
+	 *
+	 * @param handle
+	 */
+	void update_events(ConnectionTable::handle_t handle);
+
+	static uint32_t client_events(const Client& client);
+
+private:
+	FileDescriptor epoll_fd_;              // epoll 句柄
+	epoll_event events_[MAX_EVENT_NUMBER]; // 事件集
+};
+
+#endif // EPOLLREACTOR_H
@@ -0,0 +1,63 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/20 09:44:51
+ * @version: 1.0
+ * @description: 基于长度字段的分帧 帧 = 固定长度的头部 + 头部中长度字段指定的内容
+ * 一次读取可能包含多个帧 一个帧也可能分多次到达 不完整的部分留在接收缓冲区中
+ ********************************************************************************/
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include "base/ByteArray.h"
+#include "base/RingBuffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class FrameDecoder {
+public:
+	using ptr = std::unique_ptr<FrameDecoder>;
+
+	struct Options {
+		uint32_t header_length{0};   // 头部长度 包含长度字段
+		uint32_t length_offset{0};   // 长度字段(4字节 大端)在头部中的偏移
+		uint32_t max_frame_length{16 * 1024 * 1024}; // 超过时认为数据有误
+	};
+
+	explicit FrameDecoder(const Options& options);
+
+	/**
+	 * @brief 从接收缓冲区中取出目前所有完整的帧
+	 * 多个帧首尾相连拷贝到同一个ByteArray中 使用者按顺序逐个解析即可
+	 * 不完整的帧继续留在缓冲区中
+	 * @param input
+	 * @return ByteArray::ptr 没有完整的帧时返回nullptr
+	 * @exception 帧长度超过max_frame_length时抛出 std::runtime_error
+	 */
+	ByteArray::ptr decode(putils::RingBuffer& input) const;
+
+	/**
+	 * @brief 从接收缓冲区中取出size字节 拷贝到新的ByteArray中
+	 *
+	 * @param input
+	 * @param size 需保证 size <= input.readable()
+	 * @return ByteArray::ptr
+	 */
+	static ByteArray::ptr take(putils::RingBuffer& input, size_t size);
+
+private:
+	/**
+	 * @brief 从可读位置偏移offset开始的帧的总长度
+	 *
+	 * @param input
+	 * @param offset
+	 * @return size_t 头部还不完整时返回0
+	 */
+	size_t frame_length(const putils::RingBuffer& input, size_t offset) const;
+
+private:
+	Options options_;
+};
+
+#endif // FRAMEDECODER_H
@@ -0,0 +1,104 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/24 09:12:37
+ * @version: 1.0
+ * @description: 客户端连接的心跳状态 统计连续未回复的心跳与平滑往返时延(RTT)
+ * 只负责记账 心跳的发送与接收由使用者按各自的协议完成
+ ********************************************************************************/
+#ifndef HEARTBEATMONITOR_H
+#define HEARTBEATMONITOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+class HeartbeatMonitor {
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Options {
+		std::chrono::milliseconds interval{0}; // 发送间隔 为0时不发送心跳
+		int max_missed{3}; // 连续这么多次未收到回复时判定连接失效
+	};
+
+	enum class Action {
+		SEND,    // 发送序号为seq的心跳
+		EXPIRED, // 连接失效 需要关闭
+	};
+
+	HeartbeatMonitor() = default;
+	explicit HeartbeatMonitor(const Options& options)
+	    : options_(options) {}
+
+	void set_options(const Options& options) { options_ = options; }
+	const Options& options() const { return options_; }
+	bool enabled() const { return options_.interval.count() > 0; }
+
+	/**
+	 * @brief 每个发送间隔调用一次 上一个心跳仍未回复时记为丢失一次
+	 *
+	 * @param now
+	 * @param seq 返回SEND时为需要发送的心跳序号
+	 * @return Action
+	 */
+	Action on_timer(clock::time_point now, uint32_t& seq);
+
+	/**
+	 * @brief 收到序号为seq的心跳回复 只有最近一次发送的心跳参与RTT的计算
+	 *
+	 * @param seq
+	 * @param now
+	 * @return true 是最近一次发送的心跳的回复
+	 */
+	bool on_reply(uint32_t seq, clock::time_point now);
+
+	/**
+	 * @brief 协议中没有序号时 收到的任何数据都视为最近一次心跳的回复
+	 * 得到的RTT包含对端处理其他请求的时间 只能作为近似值
+	 * @param now
+	 */
+	void on_reply(clock::time_point now);
+
+	/**
+	 * @brief 收到了其他数据 对端仍然存活 清零丢失次数
+	 */
+	void on_activity();
+
+	/**
+	 * @brief 重新连接后清除之前的状态 保留已有的RTT
+	 */
+	void reset();
+
+	/**
+	 * @brief 平滑后的往返时延 还没有样本时为0
+	 */
+	std::chrono::microseconds rtt() const {
+		return std::chrono::microseconds(srtt_us_.load(std::memory_order_relaxed));
+	}
+
+	/**
+	 * @brief RTT的平均偏差
+	 */
+	std::chrono::microseconds rtt_var() const {
+		return std::chrono::microseconds(
+		    rttvar_us_.load(std::memory_order_relaxed));
+	}
+
+private:
+	// 按RFC 6298平滑 需持有mtx_
+	void add_sample(clock::duration sample);
+
+private:
+	Options options_;
+	std::mutex mtx_;
+	uint32_t seq_{0};        // 最近一次发送的心跳序号
+	bool outstanding_{false}; // 最近一次发送的心跳还没有回复
+	clock::time_point sent_at_;
+	int missed_{0}; // 连续未回复的次数
+	std::atomic<int64_t> srtt_us_{0};
+	std::atomic<int64_t> rttvar_us_{0};
+};
+
+#endif // HEARTBEATMONITOR_H
@@ -0,0 +1,150 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/09 14:21:05
+ * @version: 1.0
+ * @description: io_uring 的最小封装 直接使用系统调用 不依赖liburing
+ ********************************************************************************/
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <linux/io_uring.h>
+
+class IoUring {
+public:
+	IoUring() = default;
+	~IoUring();
+
+	// 禁止拷贝
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+
+	/**
+	 * @brief 创建io_uring实例并映射提交/完成队列
+	 *
+	 * @param entries 提交队列长度
+	 * @return int 成功返回0 失败返回-errno
+	 */
+	int init(unsigned entries);
+
+	/**
+	 * @brief 释放映射的内存及io_uring句柄(包括注册的缓冲区环)
+	 */
+	void destroy();
+
+	bool is_valid() const { return ring_fd_ != -1; }
+
+	/**
+	 * @brief 获取一个已清零的提交项 队列已满时先提交已有的提交项
+	 *
+	 * @return io_uring_sqe* 仍然失败时返回nullptr
+	 */
+	io_uring_sqe* get_sqe();
+
+	/**
+	 * @brief 一次系统调用提交所有未提交的提交项 并等待至少wait_nr个完成项
+	 *
+	 * @param wait_nr
+	 * @return int 成功返回提交的数目 失败返回-errno
+	 */
+	int submit_and_wait(unsigned wait_nr);
+	int submit() { return submit_and_wait(0); }
+
+	/**
+	 * @brief 提交队列中剩余的空位
+	 *
+	 * @return unsigned
+	 */
+	unsigned sq_space_left() const {
+		return sq_entries_ -
+		       (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE));
+	}
+
+	/**
+	 * @brief 依次处理所有已经到达的完成项 处理完毕后统一推进队头
+	 *
+	 * @param func void(const io_uring_cqe*)
+	 * @return unsigned 处理的完成项数目
+	 */
+	template <class Func> unsigned for_each_cqe(Func&& func) {
+		unsigned head = *cq_head_;
+		unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+		unsigned count = 0;
+		for (; head != tail; ++head, ++count) {
+			func(&cqes_[head & cq_mask_]);
+		}
+		__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+		return count;
+	}
+
+	/**
+	 * @brief 注册一组由内核挑选的接收缓冲区(provided buffer ring)
+	 * 缓冲区归本对象所有 每块大小为buf_size
+	 * @param group_id 缓冲区组号 recv时通过buf_group指定
+	 * @param entries 缓冲区数目 必须是2的幂
+	 * @param buf_size 每块缓冲区的大小
+	 * @return int 成功返回0 失败返回-errno
+	 */
+	int register_buf_ring(uint16_t group_id, unsigned entries, unsigned buf_size);
+
+	/**
+	 * @brief 缓冲区的起始地址
+	 *
+	 * @param buf_id 完成项flags中携带的缓冲区编号
+	 * @return char*
+	 */
+	char* buffer(uint16_t buf_id) const {
+		return buffers_ + static_cast<size_t>(buf_id) * buf_size_;
+	}
+
+	/**
+	 * @brief 把用完的缓冲区还给内核 只修改共享内存 无系统调用
+	 *
+	 * @param buf_id
+	 */
+	void recycle_buffer(uint16_t buf_id);
+
+	/**
+	 * @brief 检查内核是否支持给定的操作码
+	 *
+	 * @param ops
+	 * @return true 全部支持
+	 */
+	bool probe(std::initializer_list<int> ops) const;
+
+private:
+	int ring_fd_{-1};
+
+	// 提交队列
+	void* sq_ptr_{nullptr};
+	size_t sq_size_{0};
+	unsigned* sq_head_{nullptr};
+	unsigned* sq_tail_{nullptr};
+	unsigned sq_mask_{0};
+	unsigned sq_entries_{0};
+	io_uring_sqe* sqes_{nullptr};
+	size_t sqes_size_{0};
+	unsigned sqe_tail_{0};      // 本地已填写的提交项位置
+	unsigned sqe_submitted_{0}; // 已经交给内核的位置
+
+	// 完成队列
+	void* cq_ptr_{nullptr};
+	size_t cq_size_{0};
+	unsigned* cq_head_{nullptr};
+	unsigned* cq_tail_{nullptr};
+	unsigned cq_mask_{0};
+	io_uring_cqe* cqes_{nullptr};
+
+	// 接收缓冲区环
+	io_uring_buf_ring* buf_ring_{nullptr};
+	size_t buf_ring_size_{0};
+	unsigned buf_ring_mask_{0};
+	char* buffers_{nullptr};
+	unsigned buf_size_{0};
+	unsigned buf_entries_{0};
+};
+
+#endif // IOURING_H
@@ -0,0 +1,307 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/06 10:12:37
+ * @version: 1.0
+ * @description: 单个事件循环 每个reactor独占一个线程和一个监听socket
+ * 具体的IO多路复用方式(epoll/io_uring)由子类实现
+ ********************************************************************************/
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "Client.h"
+#include "ConnectionTable.h"
+#include "FileDescriptor.h"
+#include "TimerService.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief reactor使用的IO后端
+ */
+enum class IoBackend {
+	EPOLL,   // epoll + 非阻塞读写
+	IO_URING // io_uring 多次触发的accept/recv 内核提供接收缓冲区
+};
+
+/**
+ * @brief 由配置字符串得到IO后端 无法识别时返回EPOLL
+ *
+ * @param name "epoll" 或 "io_uring"
+ * @return IoBackend
+ */
+IoBackend io_backend_from_string(const std::string& name);
+
+/**
+ * @brief 接收连接的统计
+ */
+struct AcceptStats {
+	uint64_t accepted{0}; // 成功建立的连接
+	uint64_t rejected{0}; // fd耗尽或超出连接表 accept后被立即关闭的连接
+	uint64_t errors{0};   // 其他accept错误
+	// 内核监听队列已满而丢弃的连接 整个网络命名空间的计数 只由TcpServer填写
+	uint64_t listen_overflows{0};
+
+	AcceptStats& operator+=(const AcceptStats& rhs) {
+		accepted += rhs.accepted;
+		rejected += rhs.rejected;
+		errors += rhs.errors;
+		listen_overflows += rhs.listen_overflows;
+		return *this;
+	}
+};
+
+class Reactor {
+public:
+	using ptr = std::unique_ptr<Reactor>;
+	using accept_handler_t = std::function<void(Client::ptr)>;
+	using functor_t = std::function<void()>;
+
+	/**
+	 * @brief reactor的弱引用 可由连接等生命周期更长的对象持有
+	 * reactor停止后投递的任务被直接丢弃
+	 */
+	class LoopRef {
+	public:
+		void run_in_loop(functor_t cb);
+
+	private:
+		friend class Reactor;
+		std::mutex mtx_;
+		Reactor* owner_{nullptr};
+	};
+
+	/**
+	 * @brief 创建指定后端的reactor 当前内核不支持io_uring时退回epoll
+	 *
+	 * @param backend
+	 * @param id
+	 * @return Reactor::ptr
+	 */
+	static ptr create(IoBackend backend, int id);
+
+	explicit Reactor(int id);
+	virtual ~Reactor();
+
+	// 禁止拷贝
+	Reactor(const Reactor&) = delete;
+	Reactor& operator=(const Reactor&) = delete;
+
+	/**
+	 * @brief 设置空闲超时 连接超过该时间没有收到数据时被关闭 需要在start()之前调用
+	 *
+	 * @param seconds <= 0 表示不检测空闲连接
+	 */
+	void set_idle_timeout(int seconds) { idle_timeout_ = std::chrono::seconds(seconds); }
+
+	/**
+	 * @brief 创建监听socket(SO_REUSEPORT)与IO后端 并启动事件循环线程
+	 * 多个reactor绑定同一端口 由内核负责把新连接分发到不同的监听socket上
+	 * @param port 监听端口
+	 * @param backlog 内核监听队列长度
+	 * @param handler 新连接建立时的回调(在reactor线程中执行)
+	 * @exception 初始化失败时抛出 std::runtime_error
+	 */
+	void start(int port, int backlog, const accept_handler_t& handler);
+
+	/**
+	 * @brief 停止事件循环 等待线程退出并关闭所有连接
+	 */
+	void stop();
+
+	/**
+	 * @brief 在reactor线程中执行cb 如果当前就是reactor线程则直接执行
+	 *
+	 * @param cb
+	 */
+	void run_in_loop(functor_t cb);
+
+	/**
+	 * @brief 把cb放入待执行队列 并唤醒reactor线程
+	 *
+	 * @param cb
+	 */
+	void queue_in_loop(functor_t cb);
+
+	bool is_in_loop_thread() const {
+		return thread_id_.load() == std::this_thread::get_id();
+	}
+
+	std::shared_ptr<LoopRef> loop_ref() const { return loop_ref_; }
+
+	/**
+	 * @brief 按ip查找本reactor持有的连接(可跨线程调用)
+	 *
+	 * @param ip
+	 * @return Client::ptr 未找到返回nullptr
+	 */
+	Client::ptr find_client(const std::string& ip);
+
+	/**
+	 * @brief 遍历本reactor持有的连接(可跨线程调用)
+	 *
+	 * @param func
+	 */
+	void for_each_client(const std::function<void(const Client::ptr&)>& func);
+
+	/**
+	 * @brief 立即关闭并移除连接 只能在reactor线程中调用
+	 * 对端关闭、读写出错或空闲超时时由reactor自身调用
+	 * @param client
+	 */
+	void close_client(const Client::ptr& client);
+
+	int id() const { return id_; }
+
+	/**
+	 * @brief 本reactor的定时器 回调在reactor线程中执行 添加与取消可跨线程调用
+	 *
+	 * @return TimerService&
+	 */
+	TimerService& timers() { return timers_; }
+
+	/**
+	 * @brief 本reactor接收连接的统计(可跨线程调用)
+	 *
+	 * @return AcceptStats
+	 */
+	AcceptStats accept_stats() const {
+		AcceptStats stats;
+		stats.accepted = accepted_.load(std::memory_order_relaxed);
+		stats.rejected = rejected_.load(std::memory_order_relaxed);
+		stats.errors = accept_errors_.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	virtual IoBackend backend() const = 0;
+
+protected:
+	/**
+	 * @brief 创建IO后端并注册监听socket与唤醒句柄
+	 */
+	virtual void init_backend() = 0;
+
+	/**
+	 * @brief 释放IO后端 事件循环线程已经退出
+	 */
+	virtual void close_backend() = 0;
+
+	/**
+	 * @brief 事件循环 退出前需调用close_all_clients()
+	 */
+	virtual void loop() = 0;
+
+	/**
+	 * @brief 连接被移除、关闭之前的回调 用于释放后端为该连接保存的状态
+	 *
+	 * @param client
+	 */
+	virtual void on_client_removed(const Client::ptr& /*client*/,
+	                               ConnectionTable::handle_t /*handle*/) {}
+
+	/**
+	 * @brief 连接加入连接表之后、回调accept_handler_之前的回调
+	 * 用于为连接准备后端的状态
+	 * @param client
+	 * @param handle
+	 */
+	virtual void on_client_added(const Client::ptr& /*client*/,
+	                             ConnectionTable::handle_t /*handle*/) {}
+
+	/**
+	 * @brief 新连接建立 加入连接表并回调accept_handler_
+	 * fd超出连接表容量时直接关闭连接
+	 * @param client
+	 * @return ConnectionTable::handle_t 连接的句柄 失败时返回0
+	 */
+	ConnectionTable::handle_t add_client(const Client::ptr& client);
+
+	/**
+	 * @brief accept失败时的处理
+	 * fd耗尽(EMFILE/ENFILE)时借助预留的fd取出并关闭一个等待中的连接
+	 * 否则该连接一直留在监听队列中 水平触发下事件循环会空转
+	 * @param error errno
+	 * @return true 可以继续accept
+	 */
+	bool on_accept_error(int error);
+
+	/**
+	 * @brief 按句柄查找连接 只能在reactor线程中调用
+	 * 不加锁也不增加引用计数 返回的指针在连接被关闭前有效
+	 * @param handle
+	 * @return Client* 句柄已过期时返回nullptr
+	 */
+	Client* get_client(ConnectionTable::handle_t handle) const {
+		return connections_.get(handle);
+	}
+
+	/**
+	 * @brief 按句柄关闭连接 句柄已过期时忽略 只能在reactor线程中调用
+	 *
+	 * @param handle
+	 */
+	void close_client(ConnectionTable::handle_t handle);
+
+	/**
+	 * @brief 连接收到数据 刷新其空闲时间
+	 *
+	 * @param client
+	 */
+	void on_client_active(Client& client) {
+		if (idle_timeout_.count() > 0)
+			client.touch();
+	}
+
+	void wakeup();
+	void handle_wakeup();
+	void do_pending_functors();
+	void close_all_clients();
+
+protected:
+	int id_;
+	FileDescriptor listen_fd_; // 监听socket
+	FileDescriptor wakeup_fd_; // eventfd 用于跨线程唤醒
+	FileDescriptor spare_fd_;  // 预留的fd fd耗尽时用于拒绝连接
+	TimerService timers_;      // timerfd由子类注册到IO后端
+
+	std::atomic<std::thread::id> thread_id_{};
+	std::atomic_bool running_{false};
+
+private:
+	void initialize_socket(int port, int backlog);
+
+	/**
+	 * @brief 为连接安排空闲检测 到期时若期间有数据则按剩余时间重新安排
+	 *
+	 * @param handle
+	 * @param timeout 距离到期的时间
+	 */
+	void schedule_idle_check(ConnectionTable::handle_t handle,
+	                         std::chrono::steady_clock::duration timeout);
+
+private:
+	std::unique_ptr<std::thread> thread_{nullptr};
+	accept_handler_t accept_handler_;
+
+	// 只在reactor线程中修改 其他线程通过原子的shared_ptr读取
+	ConnectionTable connections_;
+
+	std::vector<functor_t> pending_functors_; // 其他线程投递的任务
+	std::mutex pending_mtx_;
+	std::shared_ptr<LoopRef> loop_ref_;
+
+	std::atomic<uint64_t> accepted_{0};
+	std::atomic<uint64_t> rejected_{0};
+	std::atomic<uint64_t> accept_errors_{0};
+
+	std::chrono::seconds idle_timeout_{0}; // 空闲连接检测
+};
+
+#endif // REACTOR_H
@@ -10,10 +10,13 @@
 
 #include "ClientObserver.h"
 #include "FileDescriptor.h"
+#include "HeartbeatMonitor.h"
 #include "ResultType.h"
+#include "TimerService.h"
 #include "base/Buffer.hpp"
 #include "inicpp.h"
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <memory>
 #include <mutex>
@@ -31,6 +34,21 @@ public:
 	void subscribe(const ClientObserver& observer);
 	ResultType send_msg(const char* msg, size_t size);
     virtual ResultType close();
+
+	/**
+	 * @brief 设置心跳 需要在connect_server之前调用
+	 * 每隔interval发送一次payload 收到的任何数据都视为回复
+	 * 连续max_missed次未收到数据时断开连接并发布断开事件
+	 * @param options interval为0时不发送心跳
+	 * @param payload 对端能够应答的数据 为空时不发送心跳
+	 */
+	void set_heartbeat(const HeartbeatMonitor::Options& options,
+	                   const std::string& payload);
+
+	/**
+	 * @brief 由心跳测得的平滑往返时延 对端处理其他数据的时间也计算在内
+	 */
+	std::chrono::microseconds rtt() const { return heartbeat_.rtt(); }
 protected:
 	// 处理接收的消息
 	virtual void publish_server_msg(const char* msg, size_t msg_size);
@@ -45,6 +63,7 @@ private:
      */
     void start_worker();
     void terminate_worker();
+    void send_heartbeat(); // 在TimerService::shared()的线程中执行 不会阻塞
 
 private:
 	std::string ip_{"127.0.0.1"};
@@ -61,6 +80,11 @@ private:
 	std::unique_ptr<std::thread> worker_ptr{nullptr};
 	std::mutex sub_mutex;
     std::mutex buffer_mutex;
+
+	HeartbeatMonitor heartbeat_;
+	std::string heartbeat_payload_;
+	std::atomic<TimerService::TimerId> heartbeat_timer_{0}; // 回调中会读取
+	std::atomic_bool heartbeat_expired_{false};
 };
 
 #endif // TCPCLIENT_H
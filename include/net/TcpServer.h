@@ -10,24 +10,21 @@
 
 #include "Client.h"
 #include "FileDescriptor.h"
+#include "FrameDecoder.h"
+#include "Reactor.h"
 #include "ResultType.h"
 #include "ServerObserver.h"
 #include "base/ByteArray.h"
-#include "base/ThreadPool.hpp"
-#include <arpa/inet.h>
+#include "base/WorkStealingPool.hpp"
 #include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <memory>
 #include <mutex>
-#include <netinet/in.h>
 #include <string>
-#include <sys/epoll.h>
-#include <sys/select.h>
 #include <sys/socket.h>
-#include <sys/types.h>
-#include <unordered_map>
+#include <thread>
 #include <vector>
-#define MAX_EVENT_NUMBER 1024
 
 class TcpServer {
 public:
@@ -35,27 +32,51 @@ public:
 
 	virtual ~TcpServer();
 
-	ResultType start(int port, int max_num_of_clients = 5,
-	                 bool remove_dead_client_auto = true);
+	/**
+	 * @brief 启动服务器 创建reactor_nums个reactor线程
+	 * 每个reactor拥有独立的IO后端(epoll/io_uring)和监听socket(SO_REUSEPORT)
+	 * 连接从accept到关闭都只由一个reactor负责
+	 * 连接在对端关闭、出错或空闲超时时由所属reactor立即关闭
+	 * @param port 监听端口
+	 * @param backlog 每个监听socket的内核监听队列长度 受net.core.somaxconn限制
+	 * @param reactor_nums reactor的数目 <= 0 时取CPU核数
+	 * @return ResultType
+	 */
+	ResultType start(int port, int backlog = SOMAXCONN, int reactor_nums = 1);
 
 	/**
-	 * @brief 初始化 创建socket
+	 * @brief 设置reactor使用的IO后端 需要在start()之前调用
+	 * 内核不支持io_uring时自动退回epoll
+	 * @param backend
 	 */
-	void initialize_socket();
+	void set_io_backend(IoBackend backend) { io_backend_ = backend; }
 
 	/**
-	 * @brief 绑定对应的端口
-	 * @param port 端口地址
+	 * @brief 设置空闲超时 需要在start()之前调用
+	 *
+	 * @param seconds 连接超过该时间没有收到数据即被关闭 <= 0 表示不检测
 	 */
-	void bind_addres(int port);
+	void set_idle_timeout(int seconds) { idle_timeout_ = seconds; }
 
 	/**
-	 * @brief 配置监听的信息
-	 * @param max_num_of_clients 最大的客户端监听数目
+	 * @brief 设置连接输出队列的高低水位(字节) 需要在start()之前调用
+	 * 越过水位时回调publish_client_watermark
+	 * @param high 为0时不检测
+	 * @param low
 	 */
-	void listen_client(int max_num_of_clients);
+	void set_output_watermark(size_t high, size_t low) {
+		output_high_watermark_ = high;
+		output_low_watermark_ = low;
+	}
 
-	void init_epoll(int size);
+	/**
+	 * @brief 按长度字段对收到的数据分帧 需要在start()之前调用
+	 * 设置后publish_client_msg收到的是一个或多个完整的帧
+	 * @param options header_length为0时不分帧
+	 */
+	void set_frame_decoder(const FrameDecoder::Options& options) {
+		frame_options_ = options;
+	}
 
 	/**
 	 * @brief 向服务器添加对应ip的订阅者 即针对某一客户端做处理
@@ -86,8 +107,8 @@ public:
 	                          size_t size);
 
 	/**
-	 * @brief 采用epoll处理连接请求
-	 *
+	 * @brief 阻塞等待 直到服务器被关闭
+	 * 事件处理已经在start()创建的reactor线程中进行
 	 */
 	void run();
 
@@ -100,53 +121,23 @@ public:
 
 	void printClients();
 
-private:
-	/**
-	 * @brief 终止正在运行的后台线程
-	 *
-	 */
-	void terminate_dead_clients_remover();
-
-	/**
-	 * @brief 移动失去链接的线程
-	 *
-	 */
-	void remove_dead_clients();
-
 	/**
-	 * @brief 将对应的socket句柄设置为非阻塞的
+	 * @brief 所有reactor接收连接的统计 以及启动以来内核监听队列溢出的次数
+	 * 溢出次数来自/proc/net/netstat 包含同一网络命名空间中其他监听socket的溢出
 	 *
-	 * @param file_desc
-	 * @return int
-	 */
-	int set_nonblock(FileDescriptor file_desc);
-	/**
-	 * @brief 将对应的文件描述符注册到epollfd指示的epoll内核事件表中
-	 *  采用ET的触发模式 同时默认启用one_shot（某个时刻只能被一个线程解析）
-	 * @param file_desc
-	 * @param one_shot 默认为 true
+	 * @return AcceptStats
 	 */
-	void add_fd(FileDescriptor file_desc, bool oneshot = true);
-
-	/**
-	 * @brief
-	 * 重置指定的fd的状态
-	 * @param file_desc
-	 */
-	void reset_oneshot(FileDescriptor file_desc);
-
-	void handle_et_event(int number);
+	AcceptStats accept_stats() const;
 
+private:
 	/**
-	 * @brief 等待客户端的连接
+	 * @brief 新连接建立时由reactor线程回调 配置连接的事件处理
 	 *
-	 * @param timeout
-	 * @return std::string
+	 * @param client
 	 */
-	std::string accept_client();
+	void on_new_client(Client::ptr client);
 
 protected:
-	using unique_mtx_ptr = std::unique_ptr<std::mutex>;
 	/**
 	 * @brief 客户端发来消息时 处理对应的消息
 	 *
@@ -166,6 +157,14 @@ protected:
 	virtual void publish_client_disconnected(Client::ptr client,
 	                                         ByteArray::ptr bt);
 
+	/**
+	 * @brief 连接待发送的数据越过水位时的处理 默认只记录日志
+	 * 子类可以据此暂停读取该连接 避免响应堆积
+	 * @param client
+	 * @param high true 超过高水位 false 回落到低水位
+	 */
+	virtual void publish_client_watermark(Client::ptr client, bool high);
+
 	/**
 	 * @brief 负责处理来自客户端的情况
 	 *
@@ -187,29 +186,25 @@ protected:
 	static ResultType send_to_client(Client::ptr client, const char* msg,
 	                                 size_t size);
 
-	std::unique_ptr<putils::ThreadPool> threadpool; // 引入线程池
-	                                                // 增加写锁的支持
-	std::unordered_map<FileDescriptor, unique_mtx_ptr> client_write_mtx_;
+	std::unique_ptr<putils::WorkStealingPool> threadpool; // 引入线程池(工作窃取)
 
 private:
-	struct sockaddr_in server_addr_; // 服务器端socket地址
-	struct sockaddr_in client_addr_; // 客户端socket地址
-
-	FileDescriptor sock_fd_; // scoket 句柄
-	fd_set fds_;             // 用于轮询
-
-	std::unordered_map<FileDescriptor, Client::ptr> clients_idx_; //
+	std::vector<Reactor::ptr> reactors_; // 每个reactor各自持有自己的连接
+	IoBackend io_backend_{IoBackend::EPOLL};
+	int idle_timeout_{0}; // 空闲超时(秒)
+	size_t output_high_watermark_{4 * 1024 * 1024}; // 输出队列高水位(字节)
+	size_t output_low_watermark_{1024 * 1024};      // 输出队列低水位(字节)
+	FrameDecoder::Options frame_options_{};          // 默认不分帧
+	uint64_t listen_overflows_at_start_{0};          // 启动时内核的ListenOverflows
 	std::vector<ServerObserver> subscribers_;
 
 	std::mutex subscribers_mtx; // 订阅者的互斥
-	std::mutex client_mtx;      // 客户端的互斥
 
-	std::unique_ptr<std::thread>
-	    _clients_remove_thread; // 负责处理失去连接的客户端
-	std::atomic_bool stop_remove_clients_task_;
 
-	int epoll_fd;                          // epoll 句柄
-	epoll_event events_[MAX_EVENT_NUMBER]; // 事件集
+	// run() 阻塞等待close()
+	std::mutex run_mtx_;
+	std::condition_variable run_cond_;
+	bool closed_{false};
 };
 
 #endif // TCPSERVER_H
\ No newline at end of file
@@ -0,0 +1,123 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/23 09:41:26
+ * @version: 1.0
+ * @description: 事件循环的定时器 分层时间轮(1ms一格) + 一个timerfd
+ * timerfd只按最近的到期时刻设置 事件循环在其可读时调用handle_read()
+ * 添加与取消可以在任意线程调用 回调只在驱动它的线程中执行
+ ********************************************************************************/
+#ifndef TIMERSERVICE_H
+#define TIMERSERVICE_H
+
+#include "FileDescriptor.h"
+#include "base/TimingWheel.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TimerService {
+public:
+	using TimerId = putils::TimingWheel::TimerId;
+	using callback_t = std::function<void()>;
+	using clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief 创建timerfd
+	 * @exception 失败时抛出 std::runtime_error
+	 */
+	TimerService();
+	~TimerService();
+
+	// 禁止拷贝
+	TimerService(const TimerService&) = delete;
+	TimerService& operator=(const TimerService&) = delete;
+
+	/**
+	 * @brief 没有事件循环的使用者(TcpClient、RPCClient等)共用的定时器
+	 * 第一次调用时创建 由一个后台线程驱动
+	 * @return TimerService&
+	 */
+	static TimerService& shared();
+
+	/**
+	 * @brief 需要注册到事件循环中的timerfd 到期时可读
+	 */
+	const FileDescriptor& get_filedesc() const { return timer_fd_; }
+
+	/**
+	 * @brief delay之后执行一次cb
+	 *
+	 * @param delay 向上取整到毫秒
+	 * @param cb
+	 * @return TimerId 用于取消 不会为0
+	 */
+	TimerId run_after(clock::duration delay, callback_t cb);
+
+	/**
+	 * @brief 每隔interval执行一次cb 直到被取消
+	 * 事件循环阻塞期间错过的多次执行只补一次
+	 * @param interval
+	 * @param cb
+	 * @return TimerId
+	 */
+	TimerId run_every(clock::duration interval, callback_t cb);
+
+	/**
+	 * @brief 取消定时任务 已执行或已取消时忽略
+	 * 在其他线程中取消时若任务正在执行 等待其执行完毕后返回
+	 * 因此回调中可以安全地使用取消者持有的对象 取消者不能持有回调需要的锁
+	 * @param id
+	 * @return true 取消成功
+	 */
+	bool cancel(TimerId id);
+
+	/**
+	 * @brief timerfd可读时由驱动的线程调用 执行所有到期的回调
+	 */
+	void handle_read();
+
+	size_t size() const;
+
+private:
+	TimerId add(clock::duration delay, callback_t cb, bool periodic);
+
+	// 当前时刻对应的tick 从创建时开始计数
+	uint64_t now_ticks() const;
+
+	/**
+	 * @brief 按时间轮最近需要推进的时刻重新设置timerfd 需持有mtx_
+	 */
+	void rearm();
+
+	/**
+	 * @brief shared()使用的后台线程 等待timerfd或停止信号
+	 */
+	void run_thread();
+
+private:
+	FileDescriptor timer_fd_;
+	clock::time_point start_;
+
+	mutable std::mutex mtx_;
+	putils::TimingWheel wheel_;
+	uint64_t armed_tick_{putils::TimingWheel::NEVER}; // timerfd当前设置的到期tick
+	std::vector<putils::TimingWheel::Expired> expired_; // 复用 避免每次分配
+	bool dispatching_{false};        // handle_read()正在执行expired_中的回调
+	TimerId running_{0};             // 正在执行的任务
+	std::thread::id driver_;         // 执行回调的线程
+	std::condition_variable idle_cv_; // 回调执行完毕
+
+	// 仅shared()使用
+	std::unique_ptr<std::thread> thread_{nullptr};
+	FileDescriptor stop_fd_; // eventfd 通知后台线程退出
+};
+
+#endif // TIMERSERVICE_H
@@ -0,0 +1,146 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/10 09:31:16
+ * @version: 1.0
+ * @description: 基于io_uring的reactor
+ * 监听socket使用多次触发的accept 连接使用多次触发的recv并由内核从缓冲区环中挑选缓冲区
+ * 同一连接的发送请求串成链一起提交 每轮循环只调用一次io_uring_enter
+ ********************************************************************************/
+#ifndef URINGREACTOR_H
+#define URINGREACTOR_H
+
+#include "IoUring.h"
+#include "Reactor.h"
+#include <bits/types/struct_iovec.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+class UringReactor : public Reactor {
+public:
+	explicit UringReactor(int id);
+	~UringReactor() override;
+
+	/**
+	 * @brief 当前内核是否支持本reactor用到的全部特性
+	 * 多次触发的recv需要 6.0 以上的内核 结果只检测一次
+	 * @return true
+	 */
+	static bool is_supported();
+
+	IoBackend backend() const override { return IoBackend::IO_URING; }
+
+protected:
+	void init_backend() override;
+	void close_backend() override;
+	void loop() override;
+	void on_client_added(const Client::ptr& client,
+	                     ConnectionTable::handle_t handle) override;
+	void on_client_removed(const Client::ptr& client,
+	                       ConnectionTable::handle_t handle) override;
+
+private:
+	enum Op : uint8_t {
+		OP_ACCEPT = 1,
+		OP_WAKEUP,
+		OP_RECV,
+		OP_SEND,
+		OP_TIMER,
+		OP_CANCEL,
+		OP_LISTEN_POLL, // fd耗尽时等待监听socket可读
+	};
+
+	/**
+	 * @brief 连接在io_uring中的状态 只在reactor线程中访问
+	 * 仍有未完成的请求时不能释放 发送中的数据必须保持有效
+	 */
+	struct Connection {
+		Client::ptr client;
+		bool recv_armed{false};
+		bool recv_canceling{false}; // 暂停读取 已提交取消recv的请求
+		bool closing{false};
+		std::deque<std::string> outbox;   // 等待提交的数据
+		std::deque<std::string> inflight; // 已提交 等待完成的数据
+	};
+
+	/**
+	 * @brief 其他线程投递的发送数据 连接通过send_handler持有它
+	 * reactor停止后owner置空 之后的发送直接失败
+	 */
+	struct SendQueue {
+		std::mutex mtx;
+		UringReactor* owner{nullptr};
+		std::vector<std::pair<uint64_t, std::string>> sends;
+	};
+
+	static ssize_t queue_send(const std::shared_ptr<SendQueue>& queue,
+	                          uint64_t token, const iovec* iov, size_t len);
+
+	void arm_accept();
+
+	/**
+	 * @brief fd耗尽时多次触发的accept会立即失败 改为等待监听socket可读
+	 * 有连接到达后同步地accept 避免反复提交accept空转
+	 */
+	void arm_listen_poll();
+	void arm_wakeup();
+	void arm_timer();
+	void arm_recv(uint64_t token, Connection& conn);
+
+	/**
+	 * @brief 连接暂停或恢复读取 取消或重新注册recv
+	 *
+	 * @param token
+	 */
+	void update_recv(uint64_t token);
+
+	void handle_completion(const io_uring_cqe* cqe);
+	void handle_accept(const io_uring_cqe* cqe);
+	void handle_listen_poll();
+
+	/**
+	 * @brief 为accept得到的fd创建连接并注册recv
+	 *
+	 * @param client_desc
+	 */
+	void add_accepted(int client_desc);
+	void handle_recv(uint64_t token, const io_uring_cqe* cqe);
+	void handle_send(uint64_t token, const io_uring_cqe* cqe);
+
+	/**
+	 * @brief 把其他线程投递的数据转入各连接的outbox并提交
+	 */
+	void flush_sends();
+
+	/**
+	 * @brief 把outbox中的数据作为一条发送链提交 同一连接同时只有一条链
+	 *
+	 * @param token
+	 * @param conn
+	 */
+	void submit_sends(uint64_t token, Connection& conn);
+
+	void fail_connection(Connection& conn, const std::string& reason);
+
+	/**
+	 * @brief 连接已关闭且没有未完成的请求时释放状态
+	 *
+	 * @param token
+	 */
+	void try_release(uint64_t token);
+
+private:
+	IoUring ring_;
+	// token(连接表的句柄) -> 连接状态 同一fd复用时以代数区分
+	// 连接移出连接表后仍需保留到所有请求完成 因此不放在连接表的槽中
+	std::unordered_map<uint64_t, Connection> conns_;
+	std::shared_ptr<SendQueue> send_queue_;
+};
+
+#endif // URINGREACTOR_H
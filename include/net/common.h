@@ -12,6 +12,7 @@
 #include "FileDescriptor.h"
 #include "base/Logger.h"
 #include <arpa/inet.h>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <net/if.h>
@@ -30,6 +31,11 @@ enum class Result {
 Result wait_for_read(const FileDescriptor& file_desc, uint32_t timeout_sec = 3);
 Result wait_for_write(const FileDescriptor& file_desc,
                       uint32_t timeout_sec = 3);
+/**
+ * @brief 毫秒精度的等待 使用poll 不受FD_SETSIZE的限制
+ */
+Result wait_for_read(const FileDescriptor& file_desc,
+                     std::chrono::milliseconds timeout);
 
 } // namespace fd_wait
 
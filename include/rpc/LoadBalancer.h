@@ -0,0 +1,153 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/07 09:31:05
+ * @version: 1.0
+ * @description: 客户端在多个服务提供者之间选择连接的策略
+ * round_robin: 依次轮流
+ * p2c_outstanding / p2c_latency: 随机取两个 选未完成调用少的 / 延迟与负载之积小的
+ * consistent_hash: 按调用者给出的键在哈希环上选择 同一个键总是落在同一个提供者
+ * 所有提供者都发布了权重(ProviderRecord)时 各个策略按权重分配:
+ * round_robin与p2c按考虑负载后的权重 consistent_hash按容量权重分配虚拟节点
+ ********************************************************************************/
+#ifndef LOADBALANCER_H
+#define LOADBALANCER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class LoadBalancer {
+public:
+	using ptr = std::unique_ptr<LoadBalancer>;
+
+	/**
+	 * @brief 负载均衡看到的服务提供者 由连接实现
+	 */
+	class Endpoint {
+	public:
+		virtual ~Endpoint() = default;
+		virtual const std::string& endpoint() const = 0; // ip:port
+		virtual bool is_connected() const = 0;
+		virtual size_t outstanding() const = 0;                 // 未完成的调用
+		virtual std::chrono::microseconds latency() const = 0; // 没有样本时为0
+		/**
+		 * @brief 提供者发布的容量权重 未发布时为0
+		 */
+		virtual double weight() const { return 0; }
+		/**
+		 * @brief 考虑提供者发布的负载之后的权重 过载时低于weight
+		 */
+		virtual double effective_weight() const { return weight(); }
+	};
+	using Endpoints = std::vector<Endpoint*>;
+
+	enum class Policy {
+		ROUND_ROBIN,
+		P2C_OUTSTANDING,
+		P2C_LATENCY,
+		CONSISTENT_HASH
+	};
+
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	static ptr create(Policy policy);
+
+	/**
+	 * @brief 由配置字符串得到策略 无法识别时返回ROUND_ROBIN
+	 *
+	 * @param name "round_robin" "p2c_outstanding" "p2c_latency" "consistent_hash"
+	 */
+	static Policy policy_from_string(const std::string& name);
+
+	virtual ~LoadBalancer() = default;
+
+	/**
+	 * @brief 提供者列表变化后调用 与select互斥
+	 */
+	virtual void update(const Endpoints& endpoints) { (void)endpoints; }
+
+	/**
+	 * @brief 选择一个已连接的提供者 可以在多个线程中同时调用
+	 * @param key 调用者给出的键 只有consistent_hash使用 为空时轮流选择
+	 * @return size_t endpoints中的下标 都未连接时返回npos
+	 */
+	virtual size_t select(const Endpoints& endpoints, const std::string& key) = 0;
+
+protected:
+	/**
+	 * @brief 所有提供者都有权重时才按权重分配 否则与没有权重时相同
+	 */
+	static bool weighted(const Endpoints& endpoints);
+};
+
+/**
+ * @brief 有权重时按平滑加权轮询(smooth weighted round robin)预先排好顺序
+ * 权重大的提供者分散在一轮之中 而不是连续被选中
+ */
+class RoundRobinBalancer : public LoadBalancer {
+public:
+	/**
+	 * @brief 权重按比例缩放到1~MAX_SLOTS的整数
+	 */
+	static constexpr size_t MAX_SLOTS = 32;
+
+	void update(const Endpoints& endpoints) override;
+	size_t select(const Endpoints& endpoints, const std::string& key) override;
+
+private:
+	std::atomic<size_t> next_{0};
+	std::vector<size_t> schedule_; // 一轮中依次选择的下标 没有权重时为空
+};
+
+/**
+ * @brief power of two choices 两个候选中负载小的 避免所有调用者同时涌向最空闲的一个
+ */
+class P2CBalancer : public LoadBalancer {
+public:
+	/**
+	 * @param by_latency false时比较未完成的调用数
+	 * true时比较 latency * (outstanding + 1) 还没有延迟样本的优先被选中
+	 * 有权重时再除以考虑负载后的权重 相同时按权重随机选择
+	 */
+	explicit P2CBalancer(bool by_latency)
+	    : by_latency_(by_latency) {}
+
+	void update(const Endpoints& endpoints) override;
+	size_t select(const Endpoints& endpoints, const std::string& key) override;
+
+private:
+	double load(const Endpoint& endpoint) const;
+
+	bool by_latency_;
+	bool weighted_{false};
+};
+
+/**
+ * @brief 每个提供者在环上有VIRTUAL_NODES个虚拟节点 增减提供者只影响相邻区间的键
+ * 有权重时虚拟节点数与权重成正比(平均为VIRTUAL_NODES) 负载变化不改变环
+ * 键落到的提供者未连接时沿环继续找下一个
+ */
+class ConsistentHashBalancer : public LoadBalancer {
+public:
+	static constexpr size_t VIRTUAL_NODES = 160;
+
+	void update(const Endpoints& endpoints) override;
+	size_t select(const Endpoints& endpoints, const std::string& key) override;
+
+	/**
+	 * @brief 64位FNV-1a 进程之间结果相同
+	 */
+	static uint64_t hash(const std::string& key);
+
+private:
+	std::vector<std::pair<uint64_t, size_t>> ring_; // (哈希值, 下标) 按哈希值排序
+	RoundRobinBalancer fallback_; // 没有键时使用
+};
+
+#endif // LOADBALANCER_H
@@ -0,0 +1,291 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/31 10:05:19
+ * @version: 1.0
+ * @description: 方法级别的执行策略与独立线程池(舱壁隔离)
+ * 耗时的方法放入自己的线程池 不会占满共享线程池而拖慢其他方法
+ * 每个线程池有高低两个优先级的队列 队列总长度有上限 超过时拒绝请求
+ * 排队时间持续超过目标时由CoDel控制器丢弃请求 避免过载时处理调用者已放弃的请求
+ ********************************************************************************/
+#ifndef METHODPOOL_H
+#define METHODPOOL_H
+
+#include "base/SmallFunction.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 方法的执行策略 注册方法时指定
+ */
+struct ExecutionPolicy {
+	enum class Mode {
+		SHARED, // 共享的工作窃取线程池(默认)
+		POOL,   // 指定名称的独立线程池
+		INLINE, // 在reactor线程中直接执行 只适用于不会阻塞的短方法
+	};
+	enum class Lane {
+		HIGH,   // 优先于同一线程池中NORMAL的请求执行
+		NORMAL,
+	};
+
+	Mode mode{Mode::SHARED};
+	std::string pool; // mode为POOL时的线程池名称
+	Lane lane{Lane::NORMAL};
+
+	static ExecutionPolicy shared() { return {}; }
+
+	static ExecutionPolicy isolated(const std::string& pool,
+	                                Lane lane = Lane::NORMAL) {
+		ExecutionPolicy policy;
+		policy.mode = Mode::POOL;
+		policy.pool = pool;
+		policy.lane = lane;
+		return policy;
+	}
+
+	/**
+	 * @brief 线程池中的高优先级队列
+	 */
+	static ExecutionPolicy priority(const std::string& pool) {
+		return isolated(pool, Lane::HIGH);
+	}
+
+	static ExecutionPolicy io_thread() {
+		ExecutionPolicy policy;
+		policy.mode = Mode::INLINE;
+		return policy;
+	}
+};
+
+/**
+ * @brief 队列长度与排队时间的统计 可以在任意线程中读取
+ */
+class QueueMeter {
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Stats {
+		std::string name;
+		size_t threads{0};
+		size_t queue_limit{0}; // 0表示不限制
+		size_t queued{0};      // 当前排队的请求数
+		uint64_t executed{0}; // 出队的请求数 包括expired与shed
+		uint64_t rejected{0};
+		uint64_t expired{0}; // 开始执行时已超过客户端的期限
+		uint64_t shed{0};    // 被CoDel丢弃
+		std::chrono::microseconds avg_wait{0}; // 从入队到开始执行
+		std::chrono::microseconds max_wait{0};
+	};
+
+	/**
+	 * @param count 一起入队的请求数
+	 */
+	void on_enqueue(size_t count = 1) {
+		queued_.fetch_add(count, std::memory_order_relaxed);
+	}
+	void on_reject() { rejected_.fetch_add(1, std::memory_order_relaxed); }
+	void on_expire() { expired_.fetch_add(1, std::memory_order_relaxed); }
+	void on_shed() { shed_.fetch_add(1, std::memory_order_relaxed); }
+
+	/**
+	 * @brief 开始执行时调用
+	 * @param enqueued 入队的时间
+	 * @param count 与on_enqueue相同
+	 */
+	void on_dequeue(clock::time_point enqueued, size_t count = 1) {
+		auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+		                clock::now() - enqueued)
+		                .count();
+		queued_.fetch_sub(count, std::memory_order_relaxed);
+		executed_.fetch_add(count, std::memory_order_relaxed);
+		total_wait_us_.fetch_add(wait * count, std::memory_order_relaxed);
+		uint64_t max = max_wait_us_.load(std::memory_order_relaxed);
+		while (static_cast<uint64_t>(wait) > max &&
+		       !max_wait_us_.compare_exchange_weak(max, wait,
+		                                           std::memory_order_relaxed)) {
+		}
+	}
+
+	size_t queued() const { return queued_.load(std::memory_order_relaxed); }
+
+	void fill(Stats& stats) const {
+		stats.queued = queued();
+		stats.executed = executed_.load(std::memory_order_relaxed);
+		stats.rejected = rejected_.load(std::memory_order_relaxed);
+		stats.expired = expired_.load(std::memory_order_relaxed);
+		stats.shed = shed_.load(std::memory_order_relaxed);
+		if (stats.executed > 0) {
+			stats.avg_wait = std::chrono::microseconds(
+			    total_wait_us_.load(std::memory_order_relaxed) / stats.executed);
+		}
+		stats.max_wait =
+		    std::chrono::microseconds(max_wait_us_.load(std::memory_order_relaxed));
+	}
+
+private:
+	std::atomic<size_t> queued_{0};
+	std::atomic<uint64_t> executed_{0};
+	std::atomic<uint64_t> rejected_{0};
+	std::atomic<uint64_t> expired_{0};
+	std::atomic<uint64_t> shed_{0};
+	std::atomic<uint64_t> total_wait_us_{0};
+	std::atomic<uint64_t> max_wait_us_{0};
+};
+
+/**
+ * @brief CoDel(Controlled Delay)队列管理 在请求开始执行时判断是否丢弃
+ * 排队时间在interval内始终高于target说明队列持续积压(而不是短暂的突发)
+ * 此时开始丢弃 丢弃间隔按interval/sqrt(丢弃次数)缩短 直到排队时间回落到target以下
+ * 可以在多个工作线程中同时调用
+ */
+class CoDel {
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Options {
+		std::chrono::milliseconds target{0};     // 可接受的排队时间 0表示不丢弃
+		std::chrono::milliseconds interval{100}; // 持续积压多久后开始丢弃
+	};
+
+	void set_options(const Options& options) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		options_ = options;
+		first_above_ = {};
+		dropping_ = false;
+		count_ = 0;
+		enabled_.store(options.target.count() > 0, std::memory_order_release);
+	}
+
+	bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief 未启用时不加锁直接返回 只有启用后才经过状态机的锁
+	 * @param sojourn 请求从到达到现在的排队时间
+	 * @param now
+	 * @return true 丢弃该请求
+	 */
+	bool should_drop(clock::duration sojourn, clock::time_point now) {
+		if (!enabled())
+			return false;
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (options_.target.count() <= 0)
+			return false;
+		if (sojourn < options_.target) {
+			first_above_ = {};
+			dropping_ = false;
+			return false;
+		}
+		if (!dropping_) {
+			if (first_above_ == clock::time_point{}) {
+				first_above_ = now + options_.interval;
+				return false;
+			}
+			if (now < first_above_)
+				return false;
+			// 上次丢弃结束不久又进入积压 沿用之前的丢弃频率
+			dropping_ = true;
+			count_ = (count_ > 2 && now - drop_next_ < 16 * options_.interval)
+			             ? count_ - 2
+			             : 1;
+			drop_next_ = next_drop(now);
+			return true;
+		}
+		if (now < drop_next_)
+			return false;
+		++count_;
+		drop_next_ = next_drop(now);
+		return true;
+	}
+
+private:
+	clock::time_point next_drop(clock::time_point now) const {
+		return now + std::chrono::duration_cast<clock::duration>(
+		                 options_.interval / std::sqrt(static_cast<double>(count_)));
+	}
+
+private:
+	std::atomic<bool> enabled_{false}; // target大于0
+	std::mutex mtx_;
+	Options options_;
+	clock::time_point first_above_{}; // 排队时间高于target后 开始丢弃的时刻
+	clock::time_point drop_next_{};
+	bool dropping_{false};
+	uint32_t count_{0}; // 本轮丢弃的次数
+};
+
+class MethodPool {
+public:
+	using ptr = std::unique_ptr<MethodPool>;
+	using TaskType = putils::SmallFunction<void()>;
+	using Lane = ExecutionPolicy::Lane;
+
+	/**
+	 * @param name
+	 * @param threads 线程数 至少为1
+	 * @param queue_limit 两个队列中排队请求的总数上限 0表示不限制
+	 */
+	MethodPool(std::string name, size_t threads, size_t queue_limit);
+
+	/**
+	 * @brief 执行完已经排队的请求后退出
+	 */
+	~MethodPool();
+
+	MethodPool(const MethodPool&) = delete;
+	MethodPool& operator=(const MethodPool&) = delete;
+
+	/**
+	 * @brief 放入对应优先级的队列 不会阻塞
+	 * @param on_shed 被CoDel丢弃时代替task执行 可以为空
+	 * @return false 排队的请求已达上限 或者线程池已停止
+	 */
+	bool try_execute(Lane lane, TaskType task, TaskType on_shed = nullptr);
+
+	/**
+	 * @brief 开启排队时间的CoDel控制 默认不丢弃
+	 */
+	void set_codel(const CoDel::Options& options) { codel_.set_options(options); }
+
+	const std::string& name() const { return name_; }
+
+	/**
+	 * @brief 用于记录任务中判断的结果 例如请求已超过期限
+	 */
+	QueueMeter& meter() { return meter_; }
+
+	QueueMeter::Stats stats() const;
+
+private:
+	struct Job {
+		TaskType fn;
+		TaskType on_shed;
+		QueueMeter::clock::time_point enqueued;
+	};
+
+	void run();
+
+private:
+	std::string name_;
+	size_t queue_limit_;
+	std::mutex mtx_;
+	std::condition_variable cond_;
+	std::deque<Job> high_;   // 先取这个队列
+	std::deque<Job> normal_;
+	bool stop_{false};
+	QueueMeter meter_;
+	CoDel codel_;
+	std::vector<std::thread> workers_;
+};
+
+#endif // METHODPOOL_H
@@ -10,6 +10,7 @@
 
 #include "base/ByteArray.h"
 #include "base/Logger.h"
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <memory>
@@ -18,15 +19,18 @@
 #include <utility>
 /**
  * @brief 协议规定
-    | magic | version | type | sequence id | content length | content byte[]
+    | magic | version | type | sequence id | timeout | content length | content byte[]
+    timeout为请求剩余的期限(毫秒) 0表示没有期限 服务端据此跳过客户端已经放弃的请求
  */
 class Protocol {
 
 public:
 	using ptr = std::shared_ptr<Protocol>;
 	static constexpr uint8_t MAGIC = 0x09;
-	static constexpr uint8_t DEFAULT_VERSION = 0X01;
-	static constexpr uint8_t BASE_LENGTH = 11;
+	static constexpr uint8_t DEFAULT_VERSION = 0X02; // 0x02起头部带有timeout
+	static constexpr uint8_t BASE_LENGTH = 15;
+	static constexpr uint8_t LENGTH_OFFSET = 11; // content length 在头部中的偏移
+	using clock = std::chrono::steady_clock;
 
 	enum class MsgType : uint8_t {
 		HEARTBEAT_PACKET, // 心跳包
@@ -63,22 +67,26 @@ public:
 	}
 
 	ByteArray::ptr encodeMeta() {
-		ByteArray::ptr bt = std::make_shared<ByteArray>();
+		ByteArray::ptr bt =
+		    std::make_shared<ByteArray>(ByteArray::Layout::Contiguous, BASE_LENGTH);
 		bt->writeFuint8(magic_);
 		bt->writeFuint8(version_);
 		bt->writeFuint8(type_);
 		bt->writeFuint32(sequence_id_);
+		bt->writeFuint32(timeout_);
 		bt->writeFuint32(content_.size());
 		bt->setPosition(0);
 		return bt;
 	}
 
 	ByteArray::ptr encode() {
-		ByteArray::ptr bt = std::make_shared<ByteArray>();
+		ByteArray::ptr bt = std::make_shared<ByteArray>(
+		    ByteArray::Layout::Contiguous, BASE_LENGTH + content_.size());
 		bt->writeFuint8(magic_);
 		bt->writeFuint8(version_);
 		bt->writeFuint8(type_);
 		bt->writeFuint32(sequence_id_);
+		bt->writeFuint32(timeout_);
 		bt->writeStringF32(content_);
 		bt->setPosition(0);
 		return bt;
@@ -88,6 +96,7 @@ public:
 		version_ = bt->readFuint8();
 		type_ = bt->readFuint8();
 		sequence_id_ = bt->readFuint32();
+		timeout_ = bt->readFuint32();
 		content_length_ = bt->readFuint32();
 	}
 	void decode(ByteArray::ptr bt) {
@@ -95,6 +104,7 @@ public:
 		version_ = bt->readFuint8();
 		type_ = bt->readFuint8();
 		sequence_id_ = bt->readFuint32();
+		timeout_ = bt->readFuint32();
 		content_ = bt->readStringF32();
 		content_length_ = content_.size();
 	}
@@ -104,6 +114,15 @@ public:
 	void setVersion(uint8_t version) { version_ = version; }
 	void setMsgType(MsgType type) { type_ = static_cast<uint8_t>(type); }
 	void setSequenceId(uint32_t id) { sequence_id_ = id; }
+	void setTimeout(uint32_t ms) { timeout_ = ms; }
+	/**
+	 * @brief 接收方记录的到达时刻 用于计算排队时间 不参与编码
+	 */
+	void setArrival(clock::time_point arrival) { arrival_ = arrival; }
+	/**
+	 * @brief 接收方按timeout换算的本地期限 不参与编码
+	 */
+	void setDeadline(clock::time_point deadline) { deadline_ = deadline; }
 	void setContentLength(uint32_t len) { content_length_ = len; }
 	void setContent(std::string content) { content_ = std::move(content); }
 
@@ -114,6 +133,14 @@ public:
 	uint8_t getVersion() { return version_; }
 	MsgType getMsgType() { return static_cast<MsgType>(type_); }
 	uint32_t getSequenceId() { return sequence_id_; }
+	uint32_t getTimeout() { return timeout_; }
+	clock::time_point getArrival() { return arrival_; }
+	/**
+	 * @brief 设置了期限且已经超过
+	 */
+	bool expired(clock::time_point now) {
+		return deadline_ != clock::time_point{} && now >= deadline_;
+	}
 	uint32_t getContentLength() { return content_length_; }
 	const std::string& getContent() { return content_; }
 
@@ -121,6 +148,7 @@ public:
 		std::stringstream ss;
 		ss << "magic:" << magic_ << ", version:" << version_
 		   << ", type:" << type_ << ", id:" << sequence_id_
+		   << ", timeout:" << timeout_
 		   << ", length:" << content_length_ << ", content:" << content_;
 		return ss.str();
 	}
@@ -130,8 +158,11 @@ private:
 	uint8_t version_ = DEFAULT_VERSION;
 	uint8_t type_ = 0;
 	uint32_t sequence_id_ = 0;
+	uint32_t timeout_ = 0;
 	uint32_t content_length_ = 0;
 	std::string content_;
+	clock::time_point arrival_{};
+	clock::time_point deadline_{};
 };
 
 #endif // PROTOCOL_H
\ No newline at end of file
@@ -0,0 +1,85 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/13 09:52:10
+ * @version: 1.0
+ * @description: 服务提供者在注册中心中发布的记录 地址之外带有容量与负载
+ * 格式为 ip:port;w=权重;c=核数;i=执行中;q=排队;p99=微秒
+ * 只有ip:port的旧记录同样可以解析 其余各项为0(未知)
+ ********************************************************************************/
+#ifndef PROVIDERRECORD_H
+#define PROVIDERRECORD_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct ProviderRecord {
+	std::string endpoint; // ip:port
+	uint32_t weight{0};   // 配置的权重 0表示未配置 取核数
+	uint32_t cores{0};
+	uint32_t inflight{0};             // 正在执行的请求
+	uint32_t queued{0};               // 在线程池中排队的请求
+	std::chrono::microseconds p99{0}; // 最近一个周期从收到请求到执行完毕的p99
+
+	std::string encode() const;
+
+	/**
+	 * @brief 无法识别的项被忽略
+	 * @return false 地址不是host:port(端口为1~65535) 不能使用这条记录
+	 */
+	static bool parse(const std::string& data, ProviderRecord& record);
+
+	/**
+	 * @brief 拆分ip:port 主机名为空或者端口不在1~65535之间时返回false
+	 */
+	static bool split_endpoint(const std::string& endpoint, std::string& host,
+	                           int& port);
+
+	/**
+	 * @brief 容量权重 配置的权重或者核数 都未知时为0
+	 */
+	uint32_t capacity() const { return weight ? weight : cores; }
+
+	/**
+	 * @brief 考虑负载后的权重 执行与排队的请求超过核数时按超出的比例降低
+	 * 最低为容量的1/16 过载的提供者仍有少量请求 恢复后可以及时发现
+	 */
+	double effective_weight() const;
+
+	bool operator==(const ProviderRecord& rhs) const = default;
+};
+
+/**
+ * @brief 延迟的对数分桶直方图 每个2的幂之间分4个桶 误差不超过25%
+ * 记录不加锁 可以在多个线程中同时调用
+ */
+class LatencyHistogram {
+public:
+	static constexpr size_t BUCKETS = 160;
+
+	void record(std::chrono::microseconds latency) {
+		buckets_[index(latency.count())].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief 取出上一次调用之后记录的分位数 并清空 没有记录时为0
+	 * 取出期间的记录可能计入下一个周期
+	 */
+	std::chrono::microseconds take_percentile(double q);
+
+	static size_t index(int64_t us);
+
+	/**
+	 * @brief 桶中的最大值
+	 */
+	static int64_t upper_bound(size_t index);
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+};
+
+#endif // PROVIDERRECORD_H
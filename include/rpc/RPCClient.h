@@ -9,32 +9,101 @@
 #define RPCCLIENT_H
 
 #include "base/Logger.h"
-#include "net/Client.h"
-#include "net/FileDescriptor.h"
+#include "net/HeartbeatMonitor.h"
 #include "net/ResultType.h"
+#include "rpc/LoadBalancer.h"
 #include "rpc/Protocol.h"
 #include "rpc/RPCCommon.h"
-#include "rpc/RPCSession.h"
+#include "rpc/RPCConnection.h"
+#include "rpc/ServiceDirectory.h"
 #include "rpc/Serializer.h"
+#include "rpc/Task.h"
+#include "base/SmallFunction.hpp"
 #include "inicpp.h"
-#include "rpc/ZKClient.h"
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <coroutine>
+#include <cstdint>
+#include <future>
 #include <memory>
-#include <netinet/in.h>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 
+/**
+ * 连接服务的所有提供者 每次调用由负载均衡策略选择一个连接
+ * 提供者列表来自ServiceDirectory 增减或者发布的负载变化时连接池随之更新
+ * 同一连接上请求带有递增的序号 由读取线程按序号把响应交给对应的调用
+ * 同步调用与异步调用可以在多个线程中同时进行
+ */
 class RPCClient {
 public:
+	template <typename R>
+	class AsyncCall;
+
+	/**
+	 * @brief 使用进程内共用的ServiceDirectory::shared()
+	 * 注册中心由配置文件中的[registry]指定 未配置时为本机的zookeeper
+	 */
 	RPCClient(ini::IniFile ini_file);
+	/**
+	 * @param directory 需要比客户端存在更久
+	 * @exception 未配置[rpc_client]的provider_service_name时抛出
+	 * std::runtime_error
+	 */
+	RPCClient(ini::IniFile ini_file, ServiceDirectory& directory);
 	~RPCClient();
+
+	/**
+	 * @brief 连接所有未连接的提供者 至少一个连接成功时返回成功
+	 * 之后可以再次调用 重新连接失效的提供者 之后新增的提供者自动连接
+	 */
 	ResultType connect_server();
 
 	/**
-	 * @brief 有参调用【同步】
+	 * @brief 设置心跳 需要在connect_server之前调用
+	 * 连续max_missed次未收到回复时关闭连接 之后不再选择该提供者
+	 * @param options interval为0时不发送心跳
+	 */
+	void set_heartbeat(const HeartbeatMonitor::Options& options);
+
+	/**
+	 * @brief 选择提供者的策略 默认round_robin
+	 * 也可以通过配置文件中[rpc_client]的load_balance设置
+	 */
+	void set_load_balance(LoadBalancer::Policy policy);
+
+	/**
+	 * @brief 已连接提供者心跳RTT的平均值 没有样本时为0
+	 */
+	std::chrono::microseconds rtt() const;
+
+	/**
+	 * @brief 是否至少有一个提供者已连接
+	 */
+	bool is_connected() const;
+
+	/**
+	 * @brief 每个提供者的连接状态、未完成的调用与延迟
+	 */
+	std::vector<RPCConnection::Stats> endpoint_stats() const;
+
+	/**
+	 * @brief 调用的默认期限 超过时以RPC_TIMEOUT结束调用 之后到达的响应被丢弃
+	 * 剩余的期限随请求发给服务端 服务端不再执行已经超时的请求
+	 * 也可以通过配置文件中[rpc_client]的call_timeout(毫秒)设置
+	 * @param timeout 为0时不限制(默认)
+	 */
+	void set_timeout(std::chrono::milliseconds timeout) {
+		default_timeout_ = timeout;
+	}
+	std::chrono::milliseconds timeout() const { return default_timeout_; }
+
+	/**
+	 * @brief 有参调用【同步】 使用默认期限
 	 *
 	 * @tparam R
 	 * @tparam Params
@@ -44,15 +113,10 @@ public:
 	 */
 	template <typename R, typename... Params>
 	RPCResult<R> call(const std::string& name, Params... ps) {
-		using args_type = std::tuple<typename std::decay_t<Params>...>;
-		args_type args = std::make_tuple(ps...);
-		Serializer s;
-		s << name << args;
-		s.reset();
-		return call<R>(s);
+		return call_for<R>(default_timeout_, name, ps...);
 	}
 	/**
-	 * @brief 无参调用【同步】
+	 * @brief 无参调用【同步】 使用默认期限
 	 *
 	 * @tparam R
 	 * @param name
@@ -60,40 +124,195 @@ public:
 	 */
 	template <typename R>
 	RPCResult<R> call(const std::string& name) {
+		return call_for<R>(default_timeout_, name);
+	}
+
+	/**
+	 * @brief 指定期限的有参调用【同步】
+	 * @param timeout 为0时不限制
+	 */
+	template <typename R, typename... Params>
+	RPCResult<R> call_for(std::chrono::milliseconds timeout,
+	                      const std::string& name, Params... ps) {
+		using args_type = std::tuple<typename std::decay_t<Params>...>;
+		args_type args = std::make_tuple(ps...);
+		Serializer s;
+		s << name << args;
+		s.reset();
+		return sync_call<R>(s, timeout);
+	}
+	/**
+	 * @brief 指定期限的无参调用【同步】
+	 */
+	template <typename R>
+	RPCResult<R> call_for(std::chrono::milliseconds timeout,
+	                      const std::string& name) {
 		Serializer s;
 		s << name;
 		s.reset();
-		return call<R>(s);
+		return sync_call<R>(s, timeout);
+	}
+
+	/**
+	 * @brief 按键选择提供者的有参调用【同步】 使用默认期限
+	 * 负载均衡为consistent_hash时 同一个键总是发给同一个提供者(它可用时)
+	 * 其他策略忽略key
+	 */
+	template <typename R, typename... Params>
+	RPCResult<R> call_with_key(const std::string& key, const std::string& name,
+	                           Params... ps) {
+		using args_type = std::tuple<typename std::decay_t<Params>...>;
+		args_type args = std::make_tuple(ps...);
+		Serializer s;
+		s << name << args;
+		s.reset();
+		return sync_call<R>(s, default_timeout_, key);
 	}
 
+	/**
+	 * @brief 有参调用【异步】 同一连接上可以同时有大量未完成的调用
+	 * 协程中 co_await client.async_call<R>(name, ps...)
+	 * 其他地方 client.async_call<R>(name, ps...).future() 或者 .then(callback)
+	 * co_await时等待响应期间挂起协程 不阻塞线程 在挂起时所在的执行器中恢复
+	 * 不在执行器中时(例如spawn时executor为空)在读取线程中恢复
+	 * 此时不能在协程中进行同步调用 否则返回RPC_FAIL
+	 * @return AsyncCall<R> co_await的结果为RPCResult<R>
+	 */
+	template <typename R, typename... Params>
+	AsyncCall<R> async_call(const std::string& name, Params... ps) {
+		using args_type = std::tuple<typename std::decay_t<Params>...>;
+		args_type args = std::make_tuple(ps...);
+		Serializer s;
+		s << name << args;
+		s.reset();
+		return AsyncCall<R>(*this, s);
+	}
+	/**
+	 * @brief 无参调用【异步】
+	 */
+	template <typename R>
+	AsyncCall<R> async_call(const std::string& name) {
+		Serializer s;
+		s << name;
+		s.reset();
+		return AsyncCall<R>(*this, s);
+	}
+
+	/**
+	 * @brief async_call返回的调用 以下三种方式选一种 之后才发送请求:
+	 * co_await call; call.future(); call.then(callback)
+	 * 超时的调用在定时器线程中完成
+	 */
+	template <typename R>
+	class AsyncCall {
+	public:
+		AsyncCall(RPCClient& client, Serializer request)
+		    : client_(client)
+		    , request_(request)
+		    , timeout_(client.default_timeout_) {}
+
+		/**
+		 * @brief 替换客户端的默认期限 为0时不限制
+		 */
+		AsyncCall& timeout(std::chrono::milliseconds timeout) {
+			timeout_ = timeout;
+			return *this;
+		}
+
+		/**
+		 * @brief 按键选择提供者 见call_with_key
+		 */
+		AsyncCall& key(std::string key) {
+			key_ = std::move(key);
+			return *this;
+		}
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle) {
+			auto* executor = rpc::current_executor();
+			// 回调可能在send_request返回之前执行 之后不能再访问this
+			client_.send_request(
+			    request_, timeout_, key_,
+			    [this, executor, handle](Protocol::ptr resp, RPCState state) {
+				    result_ = RPCClient::decode<R>(resp, state);
+				    rpc::resume_on(executor, handle);
+			    });
+		}
+
+		RPCResult<R> await_resume() { return std::move(result_); }
+
+		/**
+		 * @brief 发送请求 收到响应时在读取线程中调用callback(RPCResult<R>)
+		 * 回调中不能进行同步调用 耗时的处理需要交给其他线程
+		 */
+		template <typename F>
+		void then(F callback) {
+			client_.send_request(
+			    request_, timeout_, key_,
+			    [callback = std::move(callback)](Protocol::ptr resp,
+			                                     RPCState state) mutable {
+				    callback(RPCClient::decode<R>(resp, state));
+			    });
+		}
+
+		/**
+		 * @brief 发送请求 通过future等待结果
+		 */
+		std::future<RPCResult<R>> future() {
+			std::promise<RPCResult<R>> promise;
+			auto result = promise.get_future();
+			then([promise = std::move(promise)](RPCResult<R> val) mutable {
+				promise.set_value(std::move(val));
+			});
+			return result;
+		}
+
+	private:
+		RPCClient& client_;
+		Serializer request_;
+		std::chrono::milliseconds timeout_;
+		std::string key_;
+		RPCResult<R> result_;
+	};
+
 private:
-	int initialize_socket();
-	void set_address(const std::string& address, int port);
+	using ResponseHandler = RPCConnection::ResponseHandler;
 
 	template <typename R>
-	RPCResult<R> call(Serializer s) {
+	RPCResult<R> sync_call(Serializer s, std::chrono::milliseconds timeout,
+	                       const std::string& key = std::string()) {
 		RPCResult<R> val;
-		if (is_closed_) {
+		auto connection = select(key);
+		if (!connection) {
 			val.setCode(RPC_CLOSED);
-			val.setMsg("socket closed");
+			val.setMsg("no provider available");
 			return val;
 		}
-		auto data = Protocol::Create(Protocol::MsgType::RPC_METHOD_REQUEST,
-		                             s.toString());
-
-		auto ret = session_->sendProtocol(data);
-
-		if (ret < 0) {
-			val.setCode(RPC_FAIL);
-			val.setMsg("have not sent data");
+		if (connection->in_reader_thread()) {
+			val.setCode(RPC_FAIL); // 读取线程等待自己会死锁
+			val.setMsg("synchronous call in reader thread");
 			return val;
 		}
+		RPCState state = RPC_SUCCESS;
+		auto resp = connection->request(s, timeout, state);
+		return decode<R>(resp, state);
+	}
 
-		// 接收数据
-		auto resp = session_->recvProtocol();
+	/**
+	 * @brief 把响应解析为调用结果
+	 */
+	template <typename R>
+	static RPCResult<R> decode(const Protocol::ptr& resp, RPCState state) {
+		RPCResult<R> val;
+		if (state == RPC_TIMEOUT) {
+			val.setCode(RPC_TIMEOUT);
+			val.setMsg("deadline exceeded");
+			return val;
+		}
 		if (!resp) {
-			val.setCode(RPC_FAIL);
-			val.setMsg("The parsed data is empty");
+			val.setCode(RPC_CLOSED);
+			val.setMsg("connection lost");
 			return val;
 		}
 		INFO_LOG << resp->encode()->toHexString();
@@ -112,25 +331,52 @@ private:
 		}
 		return val;
 	}
-	void update_ip_info();
-	
+
+	/**
+	 * @brief 由负载均衡选择一个已连接的提供者 都不可用时为空 不加锁
+	 */
+	RPCConnection::ptr select(const std::string& key);
+
+	/**
+	 * @brief 选择提供者并发送请求 响应到达、超时或者连接失效时调用handler
+	 * 没有可用的提供者时在当前线程中立即以RPC_CLOSED调用
+	 * @param timeout 为0时不限制
+	 */
+	void send_request(Serializer s, std::chrono::milliseconds timeout,
+	                  const std::string& key, ResponseHandler handler);
+
+	/**
+	 * @brief 按提供者的记录(ProviderRecord)替换连接池 保留地址仍然存在的连接
+	 * 记录中的权重交给负载均衡 已经调用过connect_server时在后台线程中连接新增的提供者
+	 * 不等待连接建立 在目录的后台线程中调用 不能阻塞
+	 */
+	void update_endpoints(const ServiceDirectory::Endpoints& endpoints);
 
 private:
-	std::string ip_; // ip地址
-	int port_;       // 端口地址	
-	FileDescriptor sock_fd_;
-	std::shared_ptr<Client> client_;
-	std::shared_ptr<RPCSession> session_;
-	std::atomic_bool is_connected_{false};
-	std::atomic_bool is_closed_{true};
-	struct sockaddr_in server_; // 服务器
-
-	/**引入注册中心，订阅对应的服务**/
-	ZKClient zkclient_{}; // 注册中心
-	std::string service_name_{};
-	std::vector<std::string> service_info; // 每一项都是 ip:port
+	/**
+	 * @brief 不可变的连接池 更新时整体替换 调用只读取原子指针
+	 */
+	struct Pool {
+		std::vector<RPCConnection::ptr> connections;
+		LoadBalancer::Endpoints endpoints; // 与connections一一对应 供负载均衡使用
+		LoadBalancer::ptr balancer;
+	};
 
+	/**
+	 * @brief 以新的连接列表与策略替换连接池 调用者持有update_mtx_
+	 */
+	void publish(std::vector<RPCConnection::ptr> connections);
+
+	std::atomic<std::shared_ptr<Pool>> pool_;
+	std::mutex update_mtx_; // 串行化连接池的替换 保护下面三项
+	LoadBalancer::Policy policy_{LoadBalancer::Policy::ROUND_ROBIN};
+	HeartbeatMonitor::Options heartbeat_;
+	bool started_{false}; // 已经调用过connect_server
+	std::chrono::milliseconds default_timeout_{0};
 
+	ServiceDirectory& directory_;
+	ServiceDirectory::ListenerId watch_id_{0};
+	std::string service_name_{};
 };
 
 #endif // RPCCLIENT_H
\ No newline at end of file
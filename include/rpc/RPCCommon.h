@@ -36,6 +36,8 @@ enum RPCState {
 	RPC_NO_METHOD,   // 没有找到调用函数
 	RPC_CLOSED,      // RPC连接被关闭
 	RPC_TIMEOUT,     // RPC调用超时
+	RPC_BUSY,        // 方法所在线程池的队列已满 请求被拒绝
+	RPC_EXPIRED,     // 请求在服务端排队时超过了客户端的期限 没有执行
 };
 template <typename T = void>
 class RPCResult {
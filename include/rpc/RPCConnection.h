@@ -0,0 +1,255 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/07 10:12:46
+ * @version: 1.0
+ * @description: 客户端到一个服务提供者的连接
+ * 请求带有递增的序号 由读取线程按序号把响应交给对应的调用
+ * 记录未完成的调用数与平滑延迟 供负载均衡选择连接
+ ********************************************************************************/
+#ifndef RPCCONNECTION_H
+#define RPCCONNECTION_H
+
+#include "base/SmallFunction.hpp"
+#include "net/Client.h"
+#include "net/FileDescriptor.h"
+#include "net/HeartbeatMonitor.h"
+#include "net/ResultType.h"
+#include "net/TimerService.h"
+#include "rpc/LoadBalancer.h"
+#include "rpc/Protocol.h"
+#include "rpc/ProviderRecord.h"
+#include "rpc/RPCCommon.h"
+#include "rpc/RPCSession.h"
+#include "rpc/Serializer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class RPCConnection : public LoadBalancer::Endpoint {
+public:
+	using ptr = std::shared_ptr<RPCConnection>;
+	using clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief 调用结束时调用 state为RPC_SUCCESS时resp是收到的响应
+	 * 否则resp为空 state为RPC_CLOSED或者RPC_TIMEOUT
+	 */
+	using ResponseHandler = putils::SmallFunction<void(Protocol::ptr, RPCState)>;
+
+	struct Stats {
+		std::string endpoint;
+		bool connected{false};
+		size_t outstanding{0};                  // 未完成的调用
+		std::chrono::microseconds latency{0};   // 调用的平滑延迟
+		std::chrono::microseconds rtt{0};       // 心跳测得的平滑往返时延
+		uint64_t calls{0};                      // 已经结束的调用
+		uint64_t failures{0};                   // 其中超时或者连接失效的
+		ProviderRecord record;                  // 提供者最近一次发布的记录
+	};
+
+	RPCConnection(std::string ip, int port);
+	~RPCConnection();
+
+	RPCConnection(const RPCConnection&) = delete;
+	RPCConnection& operator=(const RPCConnection&) = delete;
+
+	/**
+	 * @brief 连接服务端 成功后启动读取线程与心跳 可以在多个线程中同时调用
+	 * 已经连接时直接返回成功 连接失效后再次调用时重新连接
+	 */
+	ResultType connect();
+
+	/**
+	 * @brief 设置心跳 在connect之前调用
+	 */
+	void set_heartbeat(const HeartbeatMonitor::Options& options) {
+		heartbeat_.set_options(options);
+	}
+
+	/**
+	 * @brief ip:port
+	 */
+	const std::string& endpoint() const override { return endpoint_; }
+	bool is_connected() const override { return is_connected_; }
+	size_t outstanding() const override {
+		return outstanding_.load(std::memory_order_relaxed);
+	}
+	/**
+	 * @brief 调用延迟的指数加权平均(1/8) 超时的调用以期限计入 没有样本时为0
+	 */
+	std::chrono::microseconds latency() const override {
+		return std::chrono::microseconds(
+		    latency_us_.load(std::memory_order_relaxed));
+	}
+	std::chrono::microseconds rtt() const { return heartbeat_.rtt(); }
+	Stats stats() const;
+
+	/**
+	 * @brief 提供者发布了新的记录 负载均衡在下一次更新时使用其中的权重
+	 */
+	void set_record(const ProviderRecord& record);
+	double weight() const override {
+		return weight_.load(std::memory_order_relaxed);
+	}
+	double effective_weight() const override {
+		return effective_weight_.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief 当前线程是否是该连接的读取线程 读取线程中的同步调用会死锁
+	 */
+	bool in_reader_thread() const {
+		return std::this_thread::get_id() == reader_.get_id();
+	}
+
+	/**
+	 * @brief 分配序号后交给写线程发送 不会阻塞在socket上
+	 * 响应到达、超时或者连接失效时调用handler
+	 * 未连接时在当前线程中立即以RPC_CLOSED调用
+	 * @param timeout 为0时不限制
+	 */
+	void send_request(Serializer s, std::chrono::milliseconds timeout,
+	                  ResponseHandler handler);
+
+	/**
+	 * @brief 发送请求并等待响应【同步】 不能在读取线程中调用
+	 * @param state 调用结束的原因
+	 * @return Protocol::ptr 没有收到响应时为空
+	 */
+	Protocol::ptr request(Serializer s, std::chrono::milliseconds timeout,
+	                      RPCState& state);
+
+private:
+	struct PendingCall {
+		ResponseHandler handler;
+		TimerService::TimerId timer{0}; // 期限的定时器 没有期限时为0
+		clock::time_point start;
+	};
+
+	int initialize_socket();
+	void set_address(const std::string& address, int port);
+
+	/**
+	 * @brief 结束一个已经从等待表中取出的调用 更新统计后调用handler
+	 */
+	void complete(PendingCall& call, Protocol::ptr resp, RPCState state);
+
+	/**
+	 * @brief 期限的定时器到期 在定时器线程中以RPC_TIMEOUT结束调用
+	 */
+	void expire_call(uint32_t seq);
+
+	/**
+	 * @brief 连接成功后启动读取线程与心跳
+	 */
+	void on_connected(int fdopt);
+
+	/**
+	 * @brief 连接成功后启动读取线程
+	 */
+	void start_reader();
+
+	/**
+	 * @brief 读取线程 把响应交给序号对应的调用 直到连接关闭
+	 */
+	void read_loop();
+
+	/**
+	 * @brief 连接成功后启动写线程
+	 */
+	void start_writer();
+
+	/**
+	 * @brief 写线程 按顺序发送队列中的帧 对端不读取时只有写线程阻塞
+	 * 调用方只入队后等待 期限到达时照常以RPC_TIMEOUT结束
+	 */
+	void write_loop();
+
+	/**
+	 * @brief 关闭连接并等待写线程退出 写线程可能阻塞在写满的socket上
+	 */
+	void stop_writer();
+
+	/**
+	 * @brief 交给写线程发送 写线程未运行时返回false
+	 */
+	bool enqueue(Protocol::ptr proto);
+
+	/**
+	 * @brief 连接失效后以空响应结束所有等待中的调用 之后的请求不再排队
+	 */
+	void fail_pending();
+
+	/**
+	 * @brief 关闭读取方向并等待读取线程退出
+	 */
+	void stop_reader();
+
+	/**
+	 * @brief 读取一个协议并更新心跳状态 只由读取线程调用
+	 */
+	Protocol::ptr recv_frame();
+
+	/**
+	 * @brief 连接成功后开始发送心跳
+	 */
+	void start_heartbeat();
+
+	/**
+	 * @brief 心跳定时器的回调 在TimerService::shared()的线程中执行
+	 * 不做socket读写 只把心跳交给写线程 回复由读取线程处理
+	 * 上一个心跳还在队列中时跳过这一次 没有回复计为丢失
+	 */
+	void send_heartbeat();
+
+	/**
+	 * @brief 判定连接失效 唤醒阻塞在读取上的调用
+	 */
+	void expire_connection(const std::string& reason);
+
+private:
+	std::string ip_; // ip地址
+	int port_;       // 端口地址
+	std::string endpoint_;
+	FileDescriptor sock_fd_;
+	std::shared_ptr<Client> client_;
+	std::shared_ptr<RPCSession> session_;
+	std::atomic_bool is_connected_{false};
+	std::atomic_bool is_closed_{true};
+	std::mutex connect_mtx_;    // 串行化connect
+	struct sockaddr_in server_; // 服务器
+	std::thread reader_; // 读取响应与心跳回复
+	std::thread writer_; // 唯一写socket的线程 发送请求与心跳
+	std::mutex output_mtx_;
+	std::condition_variable output_cond_;
+	std::vector<Protocol::ptr> output_; // 等待写线程发送的帧
+	bool writing_{false};          // 写线程在运行 由output_mtx_保护
+	bool heartbeat_queued_{false}; // 队列中有未取走的心跳 由output_mtx_保护
+	std::atomic<uint32_t> next_seq_{1};
+	std::mutex pending_mtx_;
+	std::unordered_map<uint32_t, PendingCall> pending_; // 等待响应的调用
+	bool accepting_{false}; // 读取线程在运行 由pending_mtx_保护
+	HeartbeatMonitor heartbeat_;
+	std::atomic<TimerService::TimerId> heartbeat_timer_{0}; // 回调中会读取
+
+	std::atomic<size_t> outstanding_{0};
+	std::atomic<int64_t> latency_us_{0};
+	std::atomic<uint64_t> calls_{0};
+	std::atomic<uint64_t> failures_{0};
+
+	mutable std::mutex record_mtx_;
+	ProviderRecord record_;
+	std::atomic<double> weight_{0};
+	std::atomic<double> effective_weight_{0};
+};
+
+#endif // RPCCONNECTION_H
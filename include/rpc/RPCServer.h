@@ -14,19 +14,27 @@
 #include "base/traits.h"
 #include "net/Client.h"
 #include "net/FileDescriptor.h"
+#include "net/TimerService.h"
 #include "net/TcpServer.h"
 #include "rpc/Protocol.h"
 #include "rpc/Serializer.h"
 #include "inicpp.h"
-#include "rpc/ZKClient.h"
+#include "rpc/MethodPool.h"
+#include "rpc/ProviderRecord.h"
+#include "rpc/Task.h"
+#include "rpc/Registry.h"
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <map>
 #include <mutex>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 class RPCServer : public TcpServer {
 public:
@@ -40,23 +48,81 @@ public:
 	 *
 	 * @tparam Func
 	 * @param name 注册的函数名称
-	 * @param func 注册的函数
+	 * @param func 注册的函数 返回rpc::Task<T>的协程在连接的strand中执行
+	 * 等待期间不占用线程 协程结束时写回响应 这类方法忽略policy
+	 * @param policy 执行策略 默认在共享线程池中执行
+	 * 使用独立线程池时需要先调用add_method_pool 否则抛出std::runtime_error
 	 */
 	template <typename Func>
-	void registerMethod(const std::string& name, Func func) {
+	void registerMethod(const std::string& name, Func func,
+	                    const ExecutionPolicy& policy = ExecutionPolicy::shared()) {
 		DEBUG_LOG << "rpc server register method: " << name;
-		handlers_[name] = [func, this](Serializer serializer,
-		                               const std::string& arg) {
-			proxy(func, serializer, arg);
-		};
+		using Return = typename function_traits<Func>::return_type;
+		if constexpr (rpc::is_task_v<Return>) {
+			coroutine_handlers_[name] = [func](const std::string& arg) {
+				return proxy_task(func, arg);
+			};
+			handlers_.erase(name);
+			policies_.erase(name);
+		} else {
+			if (policy.mode == ExecutionPolicy::Mode::POOL &&
+			    pools_.count(policy.pool) == 0) {
+				throw std::runtime_error("method pool not found: " + policy.pool);
+			}
+			handlers_[name] = [func, this](Serializer serializer,
+			                               const std::string& arg) {
+				proxy(func, serializer, arg);
+			};
+			policies_[name] = policy;
+			coroutine_handlers_.erase(name);
+		}
 	}
+
+	/**
+	 * @brief 添加独立线程池 其中的方法不占用共享线程池
+	 * 也可以通过配置文件中[rpc_server]的method_pools添加
+	 * @param name
+	 * @param threads 线程数
+	 * @param queue_limit 排队请求数的上限 超过时返回RPC_BUSY 0表示不限制
+	 * @return ResultType 名称已存在时失败
+	 */
+	ResultType add_method_pool(const std::string& name, size_t threads,
+	                           size_t queue_limit);
+
+	/**
+	 * @brief 共享线程池与所有独立线程池的排队时间控制 默认不丢弃
+	 * 排队时间持续高于target时丢弃请求 回复RPC_BUSY
+	 * 也可以通过配置文件中[rpc_server]的codel_target与codel_interval(毫秒)设置
+	 * 需要在请求到来之前调用
+	 */
+	void set_codel(const CoDel::Options& options);
+
+	/**
+	 * @brief 共享线程池(名称为shared)与各个独立线程池的排队统计
+	 */
+	std::vector<QueueMeter::Stats> pool_stats() const;
 	
 	/**
-	 * @brief 作为服务提供者，向zk注册服务
+	 * @brief 作为服务提供者，向注册中心注册服务
 	 * @param service_name 注册的服务名称 这个永久的服务名称
 	 */
 	void registerService(std::string service_name);
 
+	/**
+	 * @brief 一次注册多个服务
+	 * zookeeper的所有节点创建请求连续发送后只等待一次
+	 * 启动时注册大量服务用这个接口 耗时接近一次往返而不是服务数乘以往返
+	 * @param service_names 服务名称 可以有共同的前缀
+	 * @return ResultType 注册中心拒绝或者不可用时失败
+	 */
+	ResultType registerServices(const std::vector<std::string>& service_names);
+
+	/**
+	 * @brief 当前的负载记录 注册时发布 之后每个load_report_interval检查一次
+	 * 与上一次发布的相比有明显变化时才更新注册中心
+	 */
+	ProviderRecord provider_record();
+
 protected:
 	/**
 	 * @brief 代理函数接口
@@ -102,9 +168,58 @@ protected:
 		serializer << val;
 	}
 
+	/**
+	 * @brief 协程方法的代理 参数与函数对象保存在协程帧中 直到方法结束
+	 *
+	 * @tparam F 返回rpc::Task<T>的函数类型
+	 * @param fun
+	 * @param arg
+	 * @return rpc::Task<Serializer> 序列化的RPCResult<T> 不会抛出异常
+	 */
+	template <typename F>
+	static rpc::Task<Serializer> proxy_task(F fun, std::string arg) {
+		using Return = typename function_traits<F>::return_type::value_type;
+		using Args = typename function_traits<F>::tuple_type;
+		Serializer serializer;
+		RPCResult<Return> val;
+		Serializer s(arg);
+		Args args;
+		try {
+			s >> args;
+		} catch (...) {
+			val.setCode(RPC_NO_MATCH);
+			val.setMsg("params not match");
+			serializer << val;
+			serializer.reset();
+			co_return serializer;
+		}
+
+		try {
+			if constexpr (std::is_same_v<Return, void>) {
+				co_await std::apply(fun, std::move(args));
+			} else {
+				val.setVal(co_await std::apply(fun, std::move(args)));
+			}
+			val.setCode(RPC_SUCCESS);
+		} catch (const std::exception& err) {
+			val.setCode(RPC_FAIL);
+			val.setMsg(err.what());
+		} catch (...) {
+			val.setCode(RPC_FAIL);
+			val.setMsg("unknown exception");
+		}
+		serializer << val;
+		serializer.reset();
+		co_return serializer;
+	}
+
 	void publish_client_msg(Client::ptr client, ByteArray::ptr) override;
 	void publish_client_disconnected(Client::ptr client,
 	                                 ByteArray::ptr) override;
+	/**
+	 * @brief 响应堆积超过高水位时暂停读取该连接的请求 回落到低水位后恢复
+	 */
+	void publish_client_watermark(Client::ptr client, bool high) override;
 	/**
 	 * @brief 调用服务端注册的函数，返回序列化的结果
 	 *
@@ -120,11 +235,80 @@ protected:
 	 */
 	Protocol::ptr handleMethodCall(Protocol::ptr proto);
 
+	/**
+	 * @brief 经由连接的strand写回一批协议 连接空闲时直接在当前线程写入
+	 * 否则排在正在进行的写入之后 调用线程不会阻塞
+	 * @param client
+	 * @param protos
+	 * @param what 写入失败时记录的日志
+	 */
+	static void send_protocols(Client::ptr client,
+	                           std::vector<Protocol::ptr> protos,
+	                           const char* what);
+
+	/**
+	 * @brief 按方法的执行策略分发一批请求 在reactor线程中调用
+	 * 共享线程池中的请求分成至多线程数个任务 独立线程池中的请求各自排队
+	 */
+	void dispatch_requests(Client::ptr client,
+	                       std::vector<Protocol::ptr> requests);
+
+	/**
+	 * @brief 执行一批请求并写回 回复合并后一次写入
+	 * @param queued 请求在共享线程池中排过队 执行前经过admit检查
+	 */
+	void execute_requests(const Client::ptr& client,
+	                      const std::vector<Protocol::ptr>& requests,
+	                      bool queued = false);
+
+	/**
+	 * @brief 在连接的strand中开始执行协程方法 结束时写回响应
+	 * @param task proxy_task返回的协程
+	 */
+	void start_coroutine(const Client::ptr& client, const Protocol::ptr& proto,
+	                     rpc::Task<Serializer> task);
+
+	/**
+	 * @brief 排队的请求开始执行前的检查 结果计入meter
+	 * 已超过客户端的期限时回复RPC_EXPIRED 被CoDel丢弃时回复RPC_BUSY
+	 * @param codel 为空时不检查排队时间
+	 * @return Protocol::ptr 需要执行时为空 否则是代替执行结果的回复
+	 */
+	static Protocol::ptr admit(const Protocol::ptr& proto, QueueMeter& meter,
+	                           CoDel* codel);
+
+	/**
+	 * @brief 没有执行的请求的回复 例如被拒绝时code为RPC_BUSY
+	 */
+	static Protocol::ptr status_response(const Protocol::ptr& proto,
+	                                     RPCState code, const std::string& msg);
+
 private:
 	int port_; // 开放服务端口
 	std::map<std::string, std::function<void(Serializer, const std::string&)>>
 	    handlers_; // 注册的函数
-	ZKClient zkclient_{}; // 客户端 只要会话存在 则保证 下线自动销毁对应的节点
+	std::map<std::string, std::function<rpc::Task<Serializer>(const std::string&)>>
+	    coroutine_handlers_; // 注册的协程函数
+	std::unordered_map<std::string, ExecutionPolicy> policies_; // 函数的执行策略
+	std::map<std::string, MethodPool::ptr> pools_;              // 独立线程池
+	QueueMeter shared_meter_; // 共享线程池中方法调用的排队统计
+	CoDel shared_codel_;      // 共享线程池的排队时间控制
+	CoDel::Options codel_options_; // 之后添加的独立线程池也使用
+	Registry::ptr registry_; // 服务器销毁或者进程退出后登记的服务自动注销
+
+	/**
+	 * @brief 定时器回调 负载有明显变化时更新注册中心中的记录
+	 */
+	void report_load();
+
+	std::string endpoint_;  // 登记的ip:port
+	uint32_t weight_{0};    // 发布的权重 0表示取核数
+	std::chrono::milliseconds load_report_interval_{1000}; // 0表示只在注册时发布
+	std::atomic<uint32_t> inflight_{0}; // 正在执行的请求
+	LatencyHistogram latency_;          // 从收到请求到执行完毕
+	std::mutex report_mtx_;             // 保护以下两项
+	ProviderRecord published_;
+	TimerService::TimerId report_timer_{0};
 };
 
 #endif // RPCSERVER_H
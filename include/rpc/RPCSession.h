@@ -13,6 +13,7 @@
 #include "base/ByteArray.h"
 #include "Protocol.h"
 #include <memory>
+#include <vector>
 class RPCSession{
     
 public:
@@ -24,6 +25,9 @@ public:
 
     // 发送协议
     ssize_t sendProtocol(Protocol::ptr proto);
+
+    // 一次写入多个协议 用于批量回复流水线上的请求
+    ssize_t sendProtocols(const std::vector<Protocol::ptr>& protos);
 private:
     // 读取数据
      ssize_t read(void* buffer, size_t length);
@@ -39,6 +43,9 @@ private:
     ssize_t writeFixSize(const void* buffer, size_t length);
     ssize_t writeFixSize(ByteArray::ptr buffer, size_t length);
 
+    // 写失败后判断能否重试 EAGAIN时等待socket可写
+    bool wait_writable();
+
 private:
     std::shared_ptr<Client> client_; // 保存client的信息
 };
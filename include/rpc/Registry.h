@@ -0,0 +1,167 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/12 09:41:23
+ * @version: 1.0
+ * @description: 注册中心 服务提供者在其中登记 客户端从中发现
+ * 登记的内容是ProviderRecord 之后可以定期更新其中的负载
+ * zookeeper: 可以跨主机 提供者是临时节点 会话结束后自动删除
+ * file: 本机的共享目录 每个服务是一个子目录 每个提供者是其中的一个文件
+ * 文件先写入临时文件再rename 读取时总是完整的 变化由inotify通知
+ * 不依赖zookeeper 适合sidecar与单机部署
+ ********************************************************************************/
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "inicpp.h"
+#include "net/FileDescriptor.h"
+#include "net/ResultType.h"
+#include "rpc/ZKClient.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 服务提供者列表的来源
+ */
+class DiscoverySource {
+public:
+	using ptr = std::shared_ptr<DiscoverySource>;
+	using ChangeCallback = std::function<void(const std::string& service)>;
+
+	virtual ~DiscoverySource() = default;
+
+	/**
+	 * @brief 设置变化的回调 在第一次fetch之前调用
+	 * 回调可以在任意线程中执行 不能在其中调用fetch
+	 * 替换(包括设为空)时等待正在执行的回调结束 之后不再调用旧的回调
+	 */
+	virtual void set_listener(ChangeCallback callback) = 0;
+
+	/**
+	 * @brief 读取服务当前的提供者(ProviderRecord 以ip:port开头) 之后有变化时调用一次回调
+	 * 地址无效的记录被跳过 服务还不存在时返回空 创建后同样会调用回调
+	 */
+	virtual std::vector<std::string> fetch(const std::string& service) = 0;
+};
+
+/**
+ * @brief 在发现之外还可以登记提供者
+ */
+class Registry : public DiscoverySource {
+public:
+	using ptr = std::shared_ptr<Registry>;
+
+	struct Options {
+		std::string type{"zookeeper"};                 // zookeeper 或 file
+		std::string address{"127.0.0.1:2181"};         // zookeeper的地址
+		std::chrono::milliseconds timeout{30000};      // 会话超时与等待连接的时间
+		std::string path{"/tmp/trivialrpc-registry"}; // file的共享目录
+	};
+
+	/**
+	 * @brief 读取配置文件中的[registry] 没有配置的项取默认值
+	 */
+	static Options options_from_ini(ini::IniFile& ini);
+
+	/**
+	 * @brief 按type创建 type未知、连接失败时抛出std::runtime_error
+	 */
+	static ptr create(const Options& options);
+
+	/**
+	 * @brief 登记服务的提供者 进程退出或者该对象销毁后自动注销
+	 * @param services 服务名称 例如/calc 可以有共同的前缀
+	 * @param data 提供者的信息 即ProviderRecord编码后的内容
+	 */
+	virtual ResultType register_services(const std::vector<std::string>& services,
+	                                      const std::string& data) = 0;
+
+	/**
+	 * @brief 替换已经登记的所有提供者的信息 订阅者随之收到变化
+	 * 不等待注册中心确认 可以在定时器线程中调用
+	 */
+	virtual ResultType update_services(const std::string& data) = 0;
+};
+
+/**
+ * @brief 以zookeeper为注册中心 服务节点设置子节点监视 每个提供者节点设置数据监视
+ */
+class ZKRegistry : public Registry {
+public:
+	explicit ZKRegistry(const Options& options);
+
+	void set_listener(ChangeCallback callback) override;
+	std::vector<std::string> fetch(const std::string& service) override;
+	ResultType register_services(const std::vector<std::string>& services,
+	                             const std::string& data) override;
+	ResultType update_services(const std::string& data) override;
+
+private:
+	ZKClient zkclient_; // 只要会话存在 登记的临时节点就存在
+	std::mutex created_mtx_;
+	std::vector<std::string> created_; // 登记的临时节点
+};
+
+/**
+ * @brief 以本机目录为注册中心
+ * 目录结构为 <path>/<服务名称 /替换为%2F>/provider-<pid>-<序号>
+ * 进程崩溃时来不及删除的文件 读取时按pid判断后跳过
+ */
+class FileRegistry : public Registry {
+public:
+	/**
+	 * @brief 目录不存在时创建 失败时抛出std::runtime_error
+	 */
+	explicit FileRegistry(std::string path);
+	~FileRegistry();
+
+	FileRegistry(const FileRegistry&) = delete;
+	FileRegistry& operator=(const FileRegistry&) = delete;
+
+	void set_listener(ChangeCallback callback) override;
+	std::vector<std::string> fetch(const std::string& service) override;
+	ResultType register_services(const std::vector<std::string>& services,
+	                             const std::string& data) override;
+	ResultType update_services(const std::string& data) override;
+
+	/**
+	 * @brief 服务名称与目录名称的转换 /a/b <-> a%2Fb
+	 */
+	static std::string encode(const std::string& service);
+	static std::string decode(const std::string& name);
+
+private:
+	/**
+	 * @brief 后台线程 读取inotify事件并通知变化的服务
+	 */
+	void watch_loop();
+
+	void handle_events();
+
+	void notify(const std::string& service);
+
+private:
+	std::string path_;
+	FileDescriptor inotify_fd_;
+	FileDescriptor stop_fd_;
+	int root_watch_{-1}; // 监视服务目录的创建与删除
+
+	std::mutex listener_mtx_; // 回调在持有该锁时执行
+	ChangeCallback listener_;
+
+	std::mutex watch_mtx_;
+	std::unordered_map<int, std::string> watches_; // 服务目录的监视 -> 服务
+
+	std::mutex files_mtx_;
+	std::vector<std::string> files_; // 本对象登记的文件 销毁时删除
+
+	std::thread watcher_;
+};
+
+#endif // REGISTRY_H
@@ -20,16 +20,20 @@
 class Serializer {
 public:
 	using ptr = std::shared_ptr<ByteArray>;
-	Serializer() { byte_array_ = std::make_shared<ByteArray>(); }
+	Serializer() {
+		byte_array_ = std::make_shared<ByteArray>(ByteArray::Layout::Contiguous);
+	}
 	Serializer(ByteArray::ptr byte_array) { byte_array_ = byte_array; }
 	Serializer(const std::string& in) {
-		byte_array_ = std::make_shared<ByteArray>();
+		byte_array_ = std::make_shared<ByteArray>(ByteArray::Layout::Contiguous,
+		                                          in.size());
 		writeRowData(&in[0], in.size());
 		reset();
 	}
 
 	Serializer(const char* in, int len) {
-		byte_array_ = std::make_shared<ByteArray>();
+		byte_array_ =
+		    std::make_shared<ByteArray>(ByteArray::Layout::Contiguous, len);
 		writeRowData(in, len);
 		reset();
 	}
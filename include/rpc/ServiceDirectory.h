@@ -0,0 +1,126 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/10 09:20:41
+ * @version: 1.0
+ * @description: 进程内共享的服务发现缓存
+ * 每个服务的提供者列表是一个不可变的快照 更新时整体替换(RCU)
+ * 查询只读取原子指针 不加锁也不访问注册中心
+ * 来源(Registry)通知变化后 后台线程重新读取并推送给订阅者
+ ********************************************************************************/
+#ifndef SERVICEDIRECTORY_H
+#define SERVICEDIRECTORY_H
+
+#include "rpc/Registry.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ServiceDirectory {
+public:
+	using Endpoints = std::vector<std::string>;
+	using Snapshot = std::shared_ptr<const Endpoints>;
+	using Listener = std::function<void(const Snapshot&)>;
+	using ListenerId = uint64_t;
+
+	explicit ServiceDirectory(DiscoverySource::ptr source);
+	~ServiceDirectory();
+
+	ServiceDirectory(const ServiceDirectory&) = delete;
+	ServiceDirectory& operator=(const ServiceDirectory&) = delete;
+
+	/**
+	 * @brief 进程内共用的目录 同一个注册中心只有一个 第一次调用时连接
+	 * 连接失败时抛出std::runtime_error
+	 */
+	static ServiceDirectory& shared(const Registry::Options& options);
+
+	/**
+	 * @brief 默认的注册中心 即127.0.0.1:2181的zookeeper
+	 */
+	static ServiceDirectory& shared();
+
+	/**
+	 * @brief 服务当前的提供者 已经订阅过的服务不加锁直接返回缓存的快照
+	 * 第一次查询某个服务时从来源读取并开始监视它
+	 * @exception 名称为空或者只有'/'时抛出 std::invalid_argument
+	 * @return Snapshot 不会为空 没有提供者时是空列表
+	 */
+	Snapshot lookup(const std::string& service);
+
+	/**
+	 * @brief 订阅服务的变化 提供者列表改变后在后台线程中以新快照调用listener
+	 * 返回前以当前快照调用一次 这一次抛出的异常不订阅并原样抛出
+	 * 名称无效时与lookup一样抛出异常
+	 * @return ListenerId 用于unwatch
+	 */
+	ListenerId watch(const std::string& service, Listener listener);
+
+	/**
+	 * @brief 取消订阅 回调正在执行时等待其结束 之后不会再被调用
+	 * 不能在回调中调用
+	 */
+	void unwatch(ListenerId id);
+
+	/**
+	 * @brief 快照被替换的次数 用于测试与监控
+	 */
+	uint64_t version() const { return version_.load(std::memory_order_relaxed); }
+
+private:
+	struct Entry {
+		std::atomic<Snapshot> snapshot;
+	};
+	using EntryMap = std::unordered_map<std::string, std::shared_ptr<Entry>>;
+
+	/**
+	 * @brief 找到或者创建服务的条目 创建时从来源读取
+	 */
+	std::shared_ptr<Entry> subscribe(const std::string& service);
+
+	/**
+	 * @brief 来源通知变化 交给后台线程处理
+	 */
+	void mark_dirty(const std::string& service);
+
+	/**
+	 * @brief 后台线程 重新读取有变化的服务 替换快照并通知订阅者
+	 */
+	void refresh_loop();
+
+	void refresh(const std::string& service);
+
+private:
+	DiscoverySource::ptr source_;
+
+	std::atomic<std::shared_ptr<const EntryMap>> entries_; // 读取不加锁
+	std::mutex subscribe_mtx_;                             // 串行化新服务的订阅
+
+	struct Subscriber {
+		std::string service;
+		Listener listener;
+		std::mutex call_mtx; // 回调在持有该锁时执行 unwatch借此等待回调结束
+		bool active{true};   // 由call_mtx保护 unwatch之后不再调用
+	};
+	std::mutex listener_mtx_; // 只保护listeners_ 回调在锁外执行
+	std::map<ListenerId, std::shared_ptr<Subscriber>> listeners_;
+	ListenerId next_listener_{1};
+
+	std::mutex dirty_mtx_;
+	std::condition_variable dirty_cond_;
+	std::set<std::string> dirty_;
+	bool stopping_{false};
+	std::atomic<uint64_t> version_{0};
+	std::thread refresher_;
+};
+
+#endif // SERVICEDIRECTORY_H
@@ -0,0 +1,274 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/03 09:42:15
+ * @version: 1.0
+ * @description: C++20协程 用于异步的RPC方法与客户端调用
+ * Task<T>是惰性的 被co_await时才在当前线程开始执行 结束后继续执行等待它的协程
+ * 在其他线程完成的等待(例如下游调用的响应)通过Executor回到协程原来所在的执行器
+ ********************************************************************************/
+#ifndef TASK_H
+#define TASK_H
+
+#include "base/SmallFunction.hpp"
+#include "net/TimerService.h"
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace rpc {
+
+/**
+ * @brief 协程恢复执行的位置 例如服务端连接的strand
+ */
+class Executor {
+public:
+	virtual ~Executor() = default;
+	virtual void post(putils::SmallFunction<void()> fn) = 0;
+};
+
+namespace detail {
+inline thread_local Executor* current_executor = nullptr;
+} // namespace detail
+
+/**
+ * @brief 当前线程正在执行的协程所属的执行器 不在执行器中时为空
+ */
+inline Executor* current_executor() { return detail::current_executor; }
+
+/**
+ * @brief 在作用域内把executor设为当前执行器
+ */
+class ExecutorScope {
+public:
+	explicit ExecutorScope(Executor* executor)
+	    : prev_(detail::current_executor) {
+		detail::current_executor = executor;
+	}
+	~ExecutorScope() { detail::current_executor = prev_; }
+
+	ExecutorScope(const ExecutorScope&) = delete;
+	ExecutorScope& operator=(const ExecutorScope&) = delete;
+
+private:
+	Executor* prev_;
+};
+
+/**
+ * @brief 在executor中恢复协程 executor为空时直接在当前线程恢复
+ * 可以在任意线程中调用 等待方在挂起时用current_executor()记下executor
+ */
+inline void resume_on(Executor* executor, std::coroutine_handle<> handle) {
+	if (!executor) {
+		handle.resume();
+		return;
+	}
+	executor->post([executor, handle]() {
+		ExecutorScope scope(executor);
+		handle.resume();
+	});
+}
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+	// 等待者已经挂起时在这里恢复它 否则由等待者发现任务已完成后继续执行
+	struct FinalAwaiter {
+		bool await_ready() const noexcept { return false; }
+		template <typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+			auto& promise = handle.promise();
+			if (promise.ready.exchange(true, std::memory_order_acq_rel))
+				promise.continuation.resume();
+		}
+		void await_resume() const noexcept {}
+	};
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	FinalAwaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() noexcept { error = std::current_exception(); }
+
+	/**
+	 * @brief 任务开始执行后由等待者调用
+	 * @return false 任务已经完成 等待者不需要挂起
+	 */
+	bool set_continuation(std::coroutine_handle<> caller) noexcept {
+		continuation = caller;
+		return !ready.exchange(true, std::memory_order_acq_rel);
+	}
+
+	// 任务完成与等待者挂起 先发生的一方置位 后发生的一方负责继续执行
+	std::atomic<bool> ready{false};
+	std::coroutine_handle<> continuation;
+	std::exception_ptr error;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+	Task<T> get_return_object() noexcept;
+
+	template <typename U>
+	void return_value(U&& value) {
+		value_.emplace(std::forward<U>(value));
+	}
+
+	T result() {
+		if (error)
+			std::rethrow_exception(error);
+		return std::move(*value_);
+	}
+
+private:
+	std::optional<T> value_;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+	Task<void> get_return_object() noexcept;
+
+	void return_void() const noexcept {}
+
+	void result() {
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
+
+/**
+ * @brief spawn使用的协程 立即开始 结束时自行销毁
+ */
+struct DetachedTask {
+	struct promise_type {
+		DetachedTask get_return_object() noexcept {
+			return {std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		std::suspend_never final_suspend() const noexcept { return {}; }
+		void return_void() const noexcept {}
+		void unhandled_exception() const noexcept { std::terminate(); }
+	};
+	std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T, typename F>
+DetachedTask run_detached(Task<T> task, F on_done) {
+	if constexpr (std::is_void_v<T>) {
+		co_await std::move(task);
+		on_done();
+	} else {
+		on_done(co_await std::move(task));
+	}
+}
+
+} // namespace detail
+
+/**
+ * @brief 协程的返回类型 用法:
+ * rpc::Task<int> f() { int v = co_await g(); co_return v + 1; }
+ * 只能被co_await一次 异常在co_await处重新抛出
+ */
+template <typename T>
+class [[nodiscard]] Task {
+public:
+	using promise_type = detail::TaskPromise<T>;
+	using value_type = T;
+	using handle_type = std::coroutine_handle<promise_type>;
+
+	Task() = default;
+	explicit Task(handle_type handle)
+	    : handle_(handle) {}
+	Task(Task&& other) noexcept
+	    : handle_(std::exchange(other.handle_, nullptr)) {}
+	Task& operator=(Task&& other) noexcept {
+		if (this != &other) {
+			if (handle_)
+				handle_.destroy();
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+	~Task() {
+		if (handle_)
+			handle_.destroy();
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	bool valid() const { return static_cast<bool>(handle_); }
+
+	auto operator co_await() && noexcept {
+		struct Awaiter {
+			handle_type handle;
+
+			bool await_ready() const noexcept { return false; }
+			// 在当前线程中开始任务 同步完成时直接继续 长链的co_await不会加深调用栈
+			bool await_suspend(std::coroutine_handle<> caller) noexcept {
+				handle.resume();
+				return handle.promise().set_continuation(caller);
+			}
+			T await_resume() { return handle.promise().result(); }
+		};
+		return Awaiter{handle_};
+	}
+
+private:
+	handle_type handle_;
+};
+
+namespace detail {
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+	return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+	return Task<void>(
+	    std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+} // namespace detail
+
+template <typename T>
+struct is_task : std::false_type {};
+template <typename T>
+struct is_task<Task<T>> : std::true_type {};
+template <typename T>
+inline constexpr bool is_task_v = is_task<T>::value;
+
+/**
+ * @brief 在executor中开始执行task 不等待其结束
+ * 结束时以返回值调用on_done(void时无参数) task中未处理的异常会终止程序
+ * @param executor 为空时在当前线程开始执行
+ */
+template <typename T, typename F>
+void spawn(Executor* executor, Task<T> task, F on_done) {
+	auto detached = detail::run_detached(std::move(task), std::move(on_done));
+	resume_on(executor, detached.handle);
+}
+
+/**
+ * @brief 挂起协程 到期后在原来的执行器中恢复 不占用线程
+ */
+inline auto sleep_for(TimerService::clock::duration delay) {
+	struct Awaiter {
+		TimerService::clock::duration delay;
+
+		bool await_ready() const noexcept { return delay.count() <= 0; }
+		void await_suspend(std::coroutine_handle<> handle) {
+			auto* executor = current_executor();
+			TimerService::shared().run_after(
+			    delay, [executor, handle]() { resume_on(executor, handle); });
+		}
+		void await_resume() const noexcept {}
+	};
+	return Awaiter{delay};
+}
+
+} // namespace rpc
+
+#endif // TASK_H
@@ -8,6 +8,10 @@
 #ifndef ZKCLIENT_H
 #define ZKCLIENT_H
 
+#include "net/ResultType.h"
+#include <functional>
+#include <mutex>
+#include <string>
 #include <vector>
 #define THREADED
 #include <iostream>
@@ -15,8 +19,41 @@
 
 class ZKClient{
 public:
+    /**
+     * @brief 监视触发时调用 type为ZOO_CHILD_EVENT等 path是被监视的节点
+     * 在zookeeper的事件线程中执行 不能在其中进行同步调用 否则会死锁
+     */
+    using WatchCallback = std::function<void(int type, const std::string& path)>;
+
+    /**
+     * @brief 异步操作完成时在zookeeper的完成线程中调用 rc为ZOK或者错误码
+     * 同样不能在其中进行同步调用
+     */
+    using CreateCallback = std::function<void(int rc, const std::string& path)>;
+    using ExistsCallback = std::function<void(int rc)>; // ZOK 或 ZNONODE
+    using SetCallback = std::function<void(int rc)>;
+    using DataCallback = std::function<void(int rc, const std::string& data)>;
+    using MultiCallback =
+        std::function<void(int rc, const std::vector<std::string>& paths)>;
+
+    /**
+     * @brief 批量创建中的一项
+     */
+    struct CreateRequest {
+        std::string path;
+        std::string data;
+        int flags{0}; // 0为永久节点 或者ZOO_EPHEMERAL等
+    };
+
     ~ZKClient();
-    void start();
+    /**
+     * @brief 连接zookeeper 等待会话建立
+     * @param hosts 地址 多个之间用逗号分隔
+     * @param timeout_ms 会话超时 同时也是等待连接的最长时间
+     * @return ResultType 超时或者初始化失败时失败 之后不能再调用其他接口
+     */
+    ResultType start(const std::string& hosts = "127.0.0.1:2181",
+                     int timeout_ms = 30000);
     /**
      * @brief 创建一个节点
      * 默认是创建一个持久性的节点
@@ -24,8 +61,9 @@ public:
      * @param data 
      * @param data_len 
      * @param state 根据这个值进行考察
+     * @return int ZOK 或者错误码 节点已经存在时为ZNODEEXISTS
      */
-    void create(const char *path, const char *data,int data_len,int state = 0);
+    int create(const char *path, const char *data,int data_len,int state = 0);
     std::string get_data(const char *path);
     /**
      * @brief 用于检测节点是否存在
@@ -42,9 +80,69 @@ public:
      */
     std::vector<std::string> get_children(const char *path);
 
+    /**
+     * @brief 设置监视的回调 需要在带监视的读取之前调用
+     */
+    void set_watcher(WatchCallback callback);
+
+    /**
+     * @brief watch为true时在节点创建、删除或者数据变化后触发一次回调 节点不存在时也有效
+     */
+    bool check_znode_exists(const char *path, bool watch);
+
+    /**
+     * @brief 读取子节点 watch为true时在子节点增减后触发一次回调
+     */
+    std::vector<std::string> get_children(const char *path, bool watch);
+
+    /**
+     * @brief 读取数据 watch为true时在数据变化或者节点删除后触发一次回调
+     */
+    std::string get_data(const char *path, bool watch);
+
+    /**
+     * @brief 异步创建节点 callback的path是实际创建的路径(带序号时与参数不同)
+     */
+    void async_create(const std::string& path, const std::string& data, int flags,
+                      CreateCallback callback);
+
+    void async_exists(const std::string& path, ExistsCallback callback);
+
+    void async_get(const std::string& path, DataCallback callback);
+
+    /**
+     * @brief 异步覆盖节点的数据 不检查版本
+     */
+    void async_set(const std::string& path, const std::string& data,
+                   SetCallback callback);
+
+    /**
+     * @brief 以一个multi请求异步创建所有节点 全部成功或者全部失败
+     * callback的paths是实际创建的路径 失败时为空
+     */
+    void async_create_multi(const std::vector<CreateRequest>& requests,
+                            MultiCallback callback);
+
+    /**
+     * @brief 批量注册 只需要一轮往返
+     * 同一会话的请求按发送顺序执行 因此先依次异步创建parents(已经存在视为成功)
+     * 紧接着以一个multi创建nodes 之后才等待全部完成
+     * @param parents 永久节点 父节点排在子节点之前
+     * @param nodes 例如提供者的临时节点 全部成功或者全部失败
+     * @param created 成功时为nodes实际创建的路径 可以为空
+     * @return int ZOK或者第一个失败的错误码
+     */
+    int create_batch(const std::vector<std::string>& parents,
+                     const std::vector<CreateRequest>& nodes,
+                     std::vector<std::string>* created = nullptr);
+
 private:
-    
+    static void watch_trampoline(zhandle_t *zh, int type, int state,
+                                 const char *path, void *context);
+
     zhandle_t *zhandle_{nullptr}; // 连接的句柄
+    std::mutex watcher_mtx_;
+    WatchCallback watcher_;
 };
 
 
@@ -1,6 +1,7 @@
 #include "base/ByteArray.h"
 #include "base/Logger.h"
 #include "base/util.h"
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cstdio>
@@ -30,7 +31,26 @@ ByteArray::ByteArray(size_t base_size)
     , size_(0)
     , endian_(std::endian::big)
     , root_(new Node(base_size))
-    , cur_(root_) {}
+    , cur_(root_)
+    , data_(nullptr) {}
+
+ByteArray::ByteArray(Layout layout, size_t size)
+    : ByteArray(layout == Layout::Chained ? size : 0) {
+	if (layout == Layout::Chained)
+		return;
+	// 委托构造的链表节点只是占位 换成连续内存
+	delete root_;
+	root_ = cur_ = nullptr;
+	if (size <= INLINE_SIZE) {
+		data_ = inline_;
+		capacity_ = INLINE_SIZE;
+	} else {
+		heap_.reset(new char[size]);
+		data_ = heap_.get();
+		capacity_ = size;
+	}
+	baseSize_ = capacity_;
+}
 ByteArray::~ByteArray() {
 	Node* tmp = root_;
 	while (tmp) {
@@ -55,6 +75,14 @@ void ByteArray::setIsLittleEndian(bool val) {
 void ByteArray::write(const void* buf, size_t size) {
 	if (size == 0)
 		return;
+	if (data_) {
+		reserve(position_ + size);
+		memcpy(data_ + position_, buf, size);
+		position_ += size;
+		if (position_ > size_)
+			size_ = position_;
+		return;
+	}
 	addCapacity(size);
 
 	size_t npos = position_ % baseSize_;
@@ -111,10 +139,30 @@ void ByteArray::addCapacity(size_t size) {
 	}
 }
 
+void ByteArray::reserve(size_t capacity) {
+	if (capacity <= capacity_)
+		return;
+	// 按倍数扩容 多次小写入的总拷贝量与数据量成正比
+	// 离开对象内存储时至少4KB 与链表节点一致 避免从小容量开始多次翻倍
+	capacity = std::max({capacity, capacity_ * 2, size_t(4096)});
+	std::unique_ptr<char[]> heap(new char[capacity]);
+	memcpy(heap.get(), data_, size_);
+	heap_ = std::move(heap);
+	data_ = heap_.get();
+	capacity_ = capacity;
+}
+
 void ByteArray::read(void* buf, size_t size) {
 	if (size > getReadSize()) {
 		throw std::out_of_range("not enough len");
 	}
+	if (size == 0) // 数据恰好填满最后一个节点时 cur_已为空
+		return;
+	if (data_) {
+		memcpy(buf, data_ + position_, size);
+		position_ += size;
+		return;
+	}
 
 	size_t npos = position_ % baseSize_;
 	size_t ncap = cur_->size_ - npos;
@@ -143,6 +191,12 @@ void ByteArray::read(void* buf, size_t size, size_t position) const {
 	if (size > (size_ - position)) {
 		throw std::out_of_range("not enough len");
 	}
+	if (size == 0)
+		return;
+	if (data_) {
+		memcpy(buf, data_ + position, size);
+		return;
+	}
 	size_t npos = position % baseSize_;
 	size_t ncap = cur_->size_ - npos;
 	size_t bpos = 0;
@@ -176,6 +230,8 @@ void ByteArray::setPosition(size_t v) {
 	if (position_ > size_) {
 		size_ = position_;
 	}
+	if (data_)
+		return;
 	cur_ = root_;
 	while (v > cur_->size_) {
 		v -= cur_->size_;
@@ -320,8 +376,46 @@ uint64_t ByteArray::readFuint64() { XX(uint64_t); }
 
 int32_t ByteArray::readInt32() { return DecodeZigzag32(readUint32()); }
 
+uint64_t ByteArray::readVarint(int bits) {
+	auto p = reinterpret_cast<const uint8_t*>(data_ + position_);
+	size_t available = getReadSize();
+	uint64_t result = 0;
+	size_t n = 0;
+	for (int i = 0; i < bits; i += 7) {
+		if (n == available) {
+			throw std::out_of_range("not enough len");
+		}
+		uint8_t b = p[n++];
+		result |= ((uint64_t)(b & 0x7f)) << i;
+		if (b < 0x80) {
+			break;
+		}
+	}
+	position_ += n;
+	return result;
+}
+
+std::string ByteArray::readString(size_t len) {
+	if (data_) {
+		if (len > getReadSize()) {
+			throw std::out_of_range("not enough len");
+		}
+		// 直接从连续内存构造 不需要先清零再拷贝
+		std::string buff(data_ + position_, len);
+		position_ += len;
+		return buff;
+	}
+	std::string buff;
+	buff.resize(len);
+	read(&buff[0], len);
+	return buff;
+}
+
 // 解码
 uint32_t ByteArray::readUint32() {
+	if (data_) {
+		return static_cast<uint32_t>(readVarint(32));
+	}
 	uint32_t result = 0;
 	for (int i = 0; i < 32; i += 7) {
 		uint8_t b = readFuint8();
@@ -336,6 +430,9 @@ uint32_t ByteArray::readUint32() {
 }
 
 uint64_t ByteArray::readUint64() {
+	if (data_) {
+		return readVarint(64);
+	}
 	uint64_t result = 0;
 	for (int i = 0; i < 64; i += 7) {
 		uint8_t b = readFuint8();
@@ -366,36 +463,22 @@ double ByteArray::readDouble() {
 }
 
 std::string ByteArray::readStringF16() {
-	uint16_t len = readFuint16();
-	std::string buff;
-	buff.resize(len);
-	read(&buff[0], len);
-	return buff;
+	return readString(readFuint16());
 }
 
 std::string ByteArray::readStringF32() {
-	uint32_t len = readFuint32();
-	std::string buff;
-	buff.resize(len);
-	read(&buff[0], len);
-	return buff;
+	return readString(readFuint32());
 }
 std::string ByteArray::readStringF64() {
-	uint64_t len = readFuint64();
-	std::string buff;
-	buff.resize(len);
-	read(&buff[0], len);
-	return buff;
+	return readString(readFuint64());
 }
 std::string ByteArray::readStringVint() {
-	uint64_t len = readUint64();
-	std::string buff;
-	buff.resize(len);
-	read(&buff[0], len);
-	return buff;
+	return readString(readUint64());
 }
 void ByteArray::clear() {
 	position_ = size_ = 0;
+	if (data_) // 连续内存保留容量 重复使用时不再分配
+		return;
 	capacity_ = baseSize_;
 	Node* tmp = root_->next_;
 	while (tmp) {
@@ -419,6 +502,10 @@ bool ByteArray::writeToFile(const std::string& name) const {
 		return false;
 	}
 
+	if (data_) {
+		ofs.write(data_ + position_, getReadSize());
+		return true;
+	}
 	int64_t read_size = getReadSize();
 	int64_t pos = position_;
 	Node* cur = cur_;
@@ -490,6 +577,10 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers,
 		return 0;
 	}
 
+	if (data_) {
+		buffers.push_back({data_ + position_, len});
+		return len;
+	}
 	uint64_t size = len;
 
 	size_t npos = position_ % baseSize_;
@@ -522,6 +613,10 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len,
 		return 0;
 	}
 
+	if (data_) {
+		buffers.push_back({data_ + position, len});
+		return len;
+	}
 	uint64_t size = len;
 
 	size_t npos = position % baseSize_;
@@ -556,6 +651,11 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len) {
 	if (len == 0) {
 		return 0;
 	}
+	if (data_) {
+		reserve(position_ + len);
+		buffers.push_back({data_ + position_, len});
+		return len;
+	}
 	addCapacity(len);
 	uint64_t size = len;
 
@@ -10,6 +10,7 @@
 #include "base/ByteArray.h"
 #include "base/Logger.h"
 #include "net/common.h"
+#include <algorithm>
 #include <asm-generic/errno-base.h>
 #include <asm-generic/errno.h>
 #include <cerrno>
@@ -17,12 +18,15 @@
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
 
+#define MAX_OUTPUT_IOV 64 // 一次sendmsg最多携带的缓冲区数目
+
 Client::Client(int file_desc) {
 	sock_fd_.set(file_desc);
 	set_connected(true);
@@ -33,8 +37,16 @@ void Client::publishEvent(ClientEvent clientEvent, ByteArray::ptr bt){
 }
 
 
-void Client::send(const char* msg, size_t msgSize) const {
-	const auto ret = ::send(sock_fd_.get(), msg, msgSize, 0);
+void Client::handle_disconnected(const std::string& reason) {
+	set_connected(false);
+	ByteArray::ptr byte = std::make_shared<ByteArray>();
+	byte->writeStringF32(reason);
+	byte->setPosition(0);
+	publishEvent(ClientEvent::DISCONNECTED, byte);
+}
+
+void Client::send(const char* msg, size_t msgSize) {
+	const auto ret = send(static_cast<const void*>(msg), msgSize);
 	if (ret < 0) {
 		throw std::runtime_error(strerror(errno));
 	}
@@ -47,24 +59,58 @@ void Client::send(const char* msg, size_t msgSize) const {
 	}
 }
 
-bool Client::receive_data() {
+bool Client::handle_data(const char* data, size_t size) {
+	if (!decoder_ && input_.empty() && is_reading()) {
+		// 不分帧时直接拷贝到要发布的ByteArray中
+		ByteArray::ptr byte =
+		    std::make_shared<ByteArray>(ByteArray::Layout::Contiguous, size);
+		byte->write(data, size);
+		byte->setPosition(0);
+		publishEvent(ClientEvent::INCOMING_MSG, byte);
+		return true;
+	}
+	input_.append(data, size);
+	return publish_input();
+}
 
-	ByteArray::ptr byte = std::make_shared<ByteArray>();
+bool Client::publish_input() {
+	// 暂停之后才读到的数据不处理 否则背压要晚一个读取周期才生效
+	if (!is_reading())
+		return true;
+	ByteArray::ptr bytes;
+	if (decoder_) {
+		try {
+			bytes = decoder_->decode(input_);
+		} catch (const std::runtime_error& err) {
+			handle_disconnected(err.what());
+			return false;
+		}
+	} else if (!input_.empty()) {
+		bytes = FrameDecoder::take(input_, input_.readable());
+	}
+	if (bytes) {
+		publishEvent(ClientEvent::INCOMING_MSG, bytes);
+	}
+	return true;
+}
+
+bool Client::receive_data() {
 	while (is_connected()) {
+		// 直接读入接收缓冲区的空闲空间 不再经过栈上的临时数组
+		input_.ensure_writable(MAX_PACKET_SIZE);
+		iovec iov[2];
+		size_t count = input_.write_buffers(iov);
+		// 空闲空间连续时用recv 绕回时才需要recvmsg
+		auto numofBytes_rec = count == 1 ? this->recv(iov[0].iov_base, iov[0].iov_len)
+		                                 : this->recv(iov, count);
 
-		char rec_buf[MAX_PACKET_SIZE] = {'\0'};
-		auto numofBytes_rec=this->recv(rec_buf,MAX_PACKET_SIZE);
-		
 		if (numofBytes_rec < 1) {
 			std::string disconnect_msg;
-			
+
 			if (numofBytes_rec < 0) {
 				// 读取完毕
 				if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-					byte->setPosition(0);
-					INFO_LOG << "data: "<< byte->toString() << " ";
-					publishEvent(ClientEvent::INCOMING_MSG, byte);
-					return true;
+					return publish_input();
 				} else {
 					// -1 发生错误
 					disconnect_msg = strerror(errno);
@@ -73,14 +119,13 @@ bool Client::receive_data() {
 				disconnect_msg = "Client has closed connection!";
 			}
 
-			set_connected(false);
-			byte->writeStringF32(disconnect_msg);
-			byte->setPosition(0);
-			publishEvent(ClientEvent::DISCONNECTED, byte);
+			// 对端关闭前发来的数据仍然需要处理
+			if (!publish_input())
+				return false;
+			handle_disconnected(disconnect_msg);
 			return false;
-		} else {
-			byte->write(rec_buf, numofBytes_rec);
 		}
+		input_.commit(numofBytes_rec);
 	}
 	return true;
 }
@@ -119,19 +164,171 @@ ssize_t Client::recv(iovec* buffers, size_t length, int flags) {
 	return -1;
 }
 
-ssize_t Client::send(const void* buffer, size_t length, int flag)const {
-	if (is_connected()) {
-		return ::send(sock_fd_.get(), buffer, length, flag);
+ssize_t Client::send(const void* buffer, size_t length, int flag) {
+	iovec iov{const_cast<void*>(buffer), length};
+	return send(&iov, 1, flag);
+}
+
+ssize_t Client::send(const iovec* buffers, size_t length, int flag) {
+	if (!is_connected())
+		return -1;
+	if (send_handler_) {
+		auto n = send_handler_(buffers, length);
+		if (n > 0) {
+			bool high = false;
+			{
+				std::lock_guard<std::mutex> lock(output_mtx_);
+				high = add_output(n);
+			}
+			if (high)
+				watermark_handler_(shared_from_this(), true);
+		}
+		return n;
 	}
-	return -1;
+	if (interest_handler_) {
+		return send_or_queue(buffers, length, flag);
+	}
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (iovec*)buffers;
+	msg.msg_iovlen = length;
+	return ::sendmsg(sock_fd_.get(), &msg, flag | MSG_NOSIGNAL);
 }
-ssize_t Client::send(const iovec* buffers, size_t length, int flag)const {
-	if (is_connected()) {
-		msghdr msg;
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_iov = (iovec*)buffers;
-		msg.msg_iovlen = length;
-		return ::sendmsg(sock_fd_.get(), &msg, flag);
+
+ssize_t Client::send_or_queue(const iovec* buffers, size_t length, int flag) {
+	size_t total = 0;
+	for (size_t i = 0; i < length; ++i) {
+		total += buffers[i].iov_len;
 	}
-	return -1;
+	bool need_writing = false;
+	bool high = false;
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		size_t written = 0;
+		// 队列中还有数据时必须排在后面 保证发送顺序
+		if (output_.empty()) {
+			msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = (iovec*)buffers;
+			msg.msg_iovlen = length;
+			auto n = ::sendmsg(sock_fd_.get(), &msg,
+			                   flag | MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					return -1;
+				n = 0;
+			}
+			written = n;
+			if (written == total)
+				return total;
+			need_writing = true;
+		}
+		std::string rest;
+		rest.reserve(total - written);
+		for (size_t i = 0; i < length; ++i) {
+			size_t len = buffers[i].iov_len;
+			if (written >= len) {
+				written -= len;
+				continue;
+			}
+			rest.append(static_cast<const char*>(buffers[i].iov_base) + written,
+			            len - written);
+			written = 0;
+		}
+		high = add_output(rest.size());
+		output_.push_back(std::move(rest));
+	}
+	if (need_writing)
+		interest_handler_(); // 开始关注可写事件
+	if (high)
+		watermark_handler_(shared_from_this(), true);
+	return total;
+}
+
+bool Client::flush_output() {
+	bool drained = false;
+	bool low = false;
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		while (!output_.empty()) {
+			iovec iovs[MAX_OUTPUT_IOV];
+			size_t count = 0;
+			for (auto iter = output_.begin();
+			     iter != output_.end() && count < MAX_OUTPUT_IOV;
+			     ++iter, ++count) {
+				size_t offset = count == 0 ? output_offset_ : 0;
+				iovs[count].iov_base = iter->data() + offset;
+				iovs[count].iov_len = iter->size() - offset;
+			}
+			msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iovs;
+			msg.msg_iovlen = count;
+			auto n = ::sendmsg(sock_fd_.get(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break; // 等待下一次可写
+				return false;
+			}
+			low = consume_output(n) || low;
+			size_t sent = n;
+			while (sent > 0) {
+				size_t left = output_.front().size() - output_offset_;
+				if (sent < left) {
+					output_offset_ += sent;
+					break;
+				}
+				sent -= left;
+				output_offset_ = 0;
+				output_.pop_front();
+			}
+		}
+		drained = output_.empty();
+	}
+	if (drained)
+		interest_handler_(); // 不再关注可写事件
+	if (low)
+		watermark_handler_(shared_from_this(), false);
+	return true;
+}
+
+void Client::on_output_sent(size_t bytes) {
+	bool low = false;
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		low = consume_output(bytes);
+	}
+	if (low)
+		watermark_handler_(shared_from_this(), false);
+}
+
+void Client::set_watermark(size_t high, size_t low,
+                           const watermark_handler_t& handler) {
+	std::lock_guard<std::mutex> lock(output_mtx_);
+	high_watermark_ = high;
+	low_watermark_ = std::min(low, high);
+	watermark_handler_ = handler;
+}
+
+void Client::set_reading(bool enable) {
+	if (reading_.exchange(enable) != enable && interest_handler_)
+		interest_handler_();
+}
+
+bool Client::add_output(size_t bytes) {
+	output_bytes_ += bytes;
+	if (high_watermark_ == 0 || above_high_ || output_bytes_ < high_watermark_)
+		return false;
+	above_high_ = true;
+	return static_cast<bool>(watermark_handler_);
+}
+
+bool Client::consume_output(size_t bytes) {
+	output_bytes_ -= std::min<size_t>(bytes, output_bytes_);
+	if (!above_high_ || output_bytes_ > low_watermark_)
+		return false;
+	above_high_ = false;
+	return static_cast<bool>(watermark_handler_);
 }
@@ -0,0 +1,121 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/15 10:47:29
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/ConnectionTable.h"
+#include <algorithm>
+#include <sys/resource.h>
+
+#define MAX_TABLE_FDS (1 << 22) // RLIMIT_NOFILE 无限制时的上限
+
+ConnectionTable::ConnectionTable(size_t max_fds) {
+	if (max_fds == 0) {
+		struct rlimit limit;
+		max_fds = MAX_TABLE_FDS;
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+		    limit.rlim_max != RLIM_INFINITY) {
+			max_fds = std::min<size_t>(limit.rlim_max, MAX_TABLE_FDS);
+		}
+	}
+	chunk_nums_ = (max_fds + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	capacity_ = chunk_nums_ * CHUNK_SIZE;
+	// 顶层数组一次分配完毕 其他线程遍历时不会遇到扩容
+	chunks_ = std::make_unique<std::atomic<Chunk*>[]>(chunk_nums_);
+	for (size_t i = 0; i < chunk_nums_; ++i) {
+		chunks_[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+ConnectionTable::~ConnectionTable() {
+	for (size_t i = 0; i < chunk_nums_; ++i) {
+		delete chunks_[i].load(std::memory_order_relaxed);
+	}
+}
+
+ConnectionTable::Slot* ConnectionTable::ensure_slot(int fd) {
+	if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+		return nullptr;
+	auto& chunk = chunks_[fd / CHUNK_SIZE];
+	Chunk* ptr = chunk.load(std::memory_order_acquire);
+	if (!ptr) {
+		ptr = new Chunk;
+		chunk.store(ptr, std::memory_order_release);
+	}
+	return &ptr->slots[fd % CHUNK_SIZE];
+}
+
+ConnectionTable::handle_t ConnectionTable::insert(const Client::ptr& client) {
+	int fd = client->get_filedesc().get();
+	Slot* s = ensure_slot(fd);
+	if (!s || s->client)
+		return 0;
+	uint32_t generation =
+	    (s->generation.load(std::memory_order_relaxed) + 1) & GENERATION_MASK;
+	if (generation == 0)
+		generation = 1;
+	s->generation.store(generation, std::memory_order_relaxed);
+	s->client = client.get();
+	s->idle_timer = 0;
+	s->shared.store(client, std::memory_order_release);
+	size_.fetch_add(1, std::memory_order_relaxed);
+	return make_handle(fd, generation);
+}
+
+void ConnectionTable::remove(int fd) {
+	Slot* s = slot(fd);
+	if (!s || !s->client)
+		return;
+	s->client = nullptr;
+	s->idle_timer = 0;
+	s->shared.store(nullptr, std::memory_order_release);
+	size_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+ConnectionTable::handle_t ConnectionTable::handle_of(int fd) const {
+	const Slot* s = slot(fd);
+	if (!s || !s->client)
+		return 0;
+	return make_handle(fd, s->generation.load(std::memory_order_relaxed));
+}
+
+Client::ptr ConnectionTable::load(int fd) const {
+	if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+		return nullptr;
+	Chunk* chunk = chunks_[fd / CHUNK_SIZE].load(std::memory_order_acquire);
+	if (!chunk)
+		return nullptr;
+	return chunk->slots[fd % CHUNK_SIZE].shared.load(std::memory_order_acquire);
+}
+
+void ConnectionTable::for_each(
+    const std::function<bool(const Client::ptr&)>& func) const {
+	for (size_t i = 0; i < chunk_nums_; ++i) {
+		Chunk* chunk = chunks_[i].load(std::memory_order_acquire);
+		if (!chunk)
+			continue;
+		for (auto& s : chunk->slots) {
+			auto client = s.shared.load(std::memory_order_acquire);
+			if (client && !func(client))
+				return;
+		}
+	}
+}
+
+void ConnectionTable::clear(const std::function<void(const Client::ptr&)>& func) {
+	for (size_t i = 0; i < chunk_nums_; ++i) {
+		Chunk* chunk = chunks_[i].load(std::memory_order_relaxed);
+		if (!chunk)
+			continue;
+		for (size_t j = 0; j < CHUNK_SIZE; ++j) {
+			if (!chunk->slots[j].client)
+				continue;
+			auto client = chunk->slots[j].shared.load(std::memory_order_relaxed);
+			func(client);
+			remove(static_cast<int>(i * CHUNK_SIZE + j));
+		}
+	}
+}
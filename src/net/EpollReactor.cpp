@@ -0,0 +1,183 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/09 10:21:48
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/EpollReactor.h"
+#include "base/Logger.h"
+#include "net/Client.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EpollReactor::EpollReactor(int id)
+    : Reactor(id) {}
+
+EpollReactor::~EpollReactor() { stop(); }
+
+void EpollReactor::init_backend() {
+	epoll_fd_.set(epoll_create1(EPOLL_CLOEXEC));
+	if (epoll_fd_.get() == -1)
+		throw std::runtime_error(strerror(errno));
+
+	add_fd(wakeup_fd_, EPOLLIN);
+	add_fd(timers().get_filedesc(), EPOLLIN);
+	// 监听socket使用水平触发 每次循环accept直到队列为空
+	// accept因出错中断时 剩余的连接在下一轮仍会通知
+	add_fd(listen_fd_, EPOLLIN);
+}
+
+void EpollReactor::close_backend() {
+	if (epoll_fd_.get() != -1) {
+		::close(epoll_fd_.get());
+		epoll_fd_.set(-1);
+	}
+}
+
+void EpollReactor::loop() {
+	thread_id_ = std::this_thread::get_id();
+	while (running_) {
+		// 定时任务由timerfd唤醒 无需设置超时
+		auto ret = epoll_wait(epoll_fd_.get(), events_, MAX_EVENT_NUMBER, -1);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			ERROR_LOG << "reactor[" << id_ << "] epoll_wait: " << strerror(errno);
+			break;
+		}
+		handle_events(ret);
+		do_pending_functors();
+	}
+	close_all_clients();
+	thread_id_ = std::thread::id{};
+}
+
+void EpollReactor::handle_events(int number) {
+	for (int i = 0; i < number; i++) {
+		auto handle = events_[i].data.u64;
+		if (ConnectionTable::generation_of(handle) == 0) {
+			// 监听socket、eventfd与timerfd不在连接表中 代数为0
+			auto socket_fd = ConnectionTable::fd_of(handle);
+			if (socket_fd == listen_fd_.get()) { // 客户端连接
+				accept_clients();
+			} else if (socket_fd == wakeup_fd_.get()) {
+				handle_wakeup();
+			} else if (socket_fd == timers().get_filedesc().get()) {
+				timers().handle_read();
+			}
+			continue;
+		}
+		// 代数不一致说明fd已被复用 事件属于已经关闭的连接
+		Client* client = get_client(handle);
+		if (client)
+			handle_client_event(handle, *client, events_[i].events);
+	}
+}
+
+void EpollReactor::handle_client_event(ConnectionTable::handle_t handle,
+                                       Client& client, uint32_t events) {
+	bool alive = true;
+	if (events & (EPOLLIN | EPOLLRDHUP)) { // 可读事件
+		// 连接只属于当前reactor 直接读取 不再需要EPOLLONESHOT的重置
+		// 对端关闭时会读到0 receive_data发布断开事件并返回false
+		alive = client.receive_data();
+		on_client_active(client);
+	}
+	if (alive && (events & (EPOLLHUP | EPOLLERR))) {
+		int error = 0;
+		socklen_t len = sizeof(error);
+		getsockopt(client.get_filedesc().get(), SOL_SOCKET, SO_ERROR, &error,
+		           &len);
+		client.handle_disconnected(error ? strerror(error)
+		                                 : "Client has closed connection!");
+		alive = false;
+	}
+	if (alive && (events & EPOLLOUT)) { // 输出队列中有数据 socket可写
+		if (!client.flush_output()) {
+			client.handle_disconnected(strerror(errno));
+			alive = false;
+		}
+	}
+	if (!alive) {
+		close_client(handle); // 由所属reactor立即关闭 不再等待后台扫描
+	}
+}
+
+void EpollReactor::accept_clients() {
+	while (running_) {
+		struct sockaddr_in client_addr;
+		socklen_t socket_size = sizeof(client_addr);
+		// 一次系统调用得到非阻塞的连接 不再需要单独的fcntl
+		auto client_desc =
+		    accept4(listen_fd_.get(), (struct sockaddr*)&client_addr,
+		            &socket_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_desc == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return; // 监听队列已经取空
+			if (!on_accept_error(errno))
+				return;
+			continue;
+		}
+
+		auto client = std::make_shared<Client>(client_desc); // 新的连接信息
+		char ip[INET_ADDRSTRLEN] = {'\0'};
+		// 多个reactor并发accept inet_ntoa 不可重入
+		inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+		client->set_ip(ip);
+		auto handle = add_client(client);
+		if (handle == 0)
+			continue;
+		// 采用边缘触发模式 同时关注对端关闭
+		add_fd(FileDescriptor(client_desc), client_events(*client), handle);
+	}
+}
+
+void EpollReactor::on_client_added(const Client::ptr& client,
+                                   ConnectionTable::handle_t handle) {
+	// 输出队列有无数据、是否暂停读取变化时 回到reactor线程修改关注的事件
+	auto loop = loop_ref();
+	client->set_interest_handler([loop, this, handle]() {
+		loop->run_in_loop([this, handle]() { update_events(handle); });
+	});
+}
+
+uint32_t EpollReactor::client_events(const Client& client) {
+	uint32_t events = EPOLLRDHUP | EPOLLET;
+	if (client.is_reading())
+		events |= EPOLLIN;
+	if (client.has_pending_output())
+		events |= EPOLLOUT;
+	return events;
+}
+
+void EpollReactor::update_events(ConnectionTable::handle_t handle) {
+	Client* client = get_client(handle);
+	if (!client)
+		return; // 连接已经关闭
+	// 恢复读取时先处理暂停期间留在缓冲区中的数据
+	if (client->is_reading() && !client->publish_input()) {
+		close_client(handle);
+		return;
+	}
+	epoll_event event;
+	event.data.u64 = handle;
+	event.events = client_events(*client);
+	epoll_ctl(epoll_fd_.get(), EPOLL_CTL_MOD, client->get_filedesc().get(),
+	          &event);
+}
+
+void EpollReactor::add_fd(FileDescriptor file_desc, uint32_t events,
+                          ConnectionTable::handle_t handle) {
+	epoll_event event;
+	event.data.u64 =
+	    handle ? handle : ConnectionTable::make_handle(file_desc.get(), 0);
+	event.events = events;
+	epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, file_desc.get(), &event);
+}
@@ -0,0 +1,64 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/20 10:12:37
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/FrameDecoder.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+FrameDecoder::FrameDecoder(const Options& options)
+    : options_(options) {
+	if (options_.length_offset + sizeof(uint32_t) > options_.header_length) {
+		throw std::runtime_error("length field is out of the frame header");
+	}
+}
+
+size_t FrameDecoder::frame_length(const putils::RingBuffer& input,
+                                  size_t offset) const {
+	if (input.readable() - offset < options_.header_length)
+		return 0;
+	uint8_t field[sizeof(uint32_t)];
+	input.peek(field, sizeof(field), offset + options_.length_offset);
+	uint32_t length = (static_cast<uint32_t>(field[0]) << 24) |
+	                  (static_cast<uint32_t>(field[1]) << 16) |
+	                  (static_cast<uint32_t>(field[2]) << 8) |
+	                  static_cast<uint32_t>(field[3]);
+	if (length > options_.max_frame_length) {
+		throw std::runtime_error("frame length " + std::to_string(length) +
+		                         " exceeds the limit");
+	}
+	return options_.header_length + length;
+}
+
+ByteArray::ptr FrameDecoder::decode(putils::RingBuffer& input) const {
+	size_t end = 0;
+	while (true) {
+		size_t length = frame_length(input, end);
+		if (length == 0 || input.readable() - end < length)
+			break;
+		end += length;
+	}
+	if (end == 0)
+		return nullptr;
+	return take(input, end);
+}
+
+ByteArray::ptr FrameDecoder::take(putils::RingBuffer& input, size_t size) {
+	// 连续内存与数据一样大 小消息在对象内 解析时定位与读取都不跨节点
+	auto bytes = std::make_shared<ByteArray>(ByteArray::Layout::Contiguous, size);
+	iovec iov[2];
+	size_t count = input.read_buffers(iov);
+	for (size_t i = 0; i < count && size > 0; ++i) {
+		size_t length = std::min(size, iov[i].iov_len);
+		bytes->write(iov[i].iov_base, length);
+		input.consume(length);
+		size -= length;
+	}
+	bytes->setPosition(0);
+	return bytes;
+}
@@ -0,0 +1,70 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/24 09:40:02
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/HeartbeatMonitor.h"
+#include <cstdlib>
+
+HeartbeatMonitor::Action HeartbeatMonitor::on_timer(clock::time_point now,
+                                                    uint32_t& seq) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	if (outstanding_ && ++missed_ >= options_.max_missed) {
+		return Action::EXPIRED;
+	}
+	seq = ++seq_;
+	outstanding_ = true;
+	sent_at_ = now;
+	return Action::SEND;
+}
+
+bool HeartbeatMonitor::on_reply(uint32_t seq, clock::time_point now) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	missed_ = 0;
+	// 更早的心跳迟到的回复只说明对端存活
+	if (!outstanding_ || seq != seq_)
+		return false;
+	outstanding_ = false;
+	add_sample(now - sent_at_);
+	return true;
+}
+
+void HeartbeatMonitor::on_reply(clock::time_point now) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	missed_ = 0;
+	if (!outstanding_)
+		return;
+	outstanding_ = false;
+	add_sample(now - sent_at_);
+}
+
+void HeartbeatMonitor::on_activity() {
+	std::lock_guard<std::mutex> lock(mtx_);
+	missed_ = 0;
+}
+
+void HeartbeatMonitor::reset() {
+	std::lock_guard<std::mutex> lock(mtx_);
+	outstanding_ = false;
+	missed_ = 0;
+}
+
+void HeartbeatMonitor::add_sample(clock::duration sample) {
+	int64_t rtt =
+	    std::chrono::duration_cast<std::chrono::microseconds>(sample).count();
+	int64_t srtt = srtt_us_.load(std::memory_order_relaxed);
+	int64_t rttvar = rttvar_us_.load(std::memory_order_relaxed);
+	if (srtt == 0) {
+		srtt = rtt;
+		rttvar = rtt / 2;
+	} else {
+		// rttvar = 3/4 rttvar + 1/4 |srtt - rtt|, srtt = 7/8 srtt + 1/8 rtt
+		rttvar = (3 * rttvar + std::llabs(srtt - rtt)) / 4;
+		srtt = (7 * srtt + rtt) / 8;
+	}
+	srtt_us_.store(srtt > 0 ? srtt : 1, std::memory_order_relaxed);
+	rttvar_us_.store(rttvar, std::memory_order_relaxed);
+}
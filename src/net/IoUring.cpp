@@ -0,0 +1,226 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/09 14:52:40
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/IoUring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+	return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+	return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+	                                min_complete, flags, nullptr, 0));
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, void* arg,
+                          unsigned nr_args) {
+	return static_cast<int>(
+	    syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+} // namespace
+
+IoUring::~IoUring() { destroy(); }
+
+int IoUring::init(unsigned entries) {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	// 完成项只在io_uring_enter时处理 避免打断reactor线程
+	params.flags = IORING_SETUP_COOP_TASKRUN;
+	int fd = sys_io_uring_setup(entries, &params);
+	if (fd < 0 && errno == EINVAL) { // 旧内核不支持该标志
+		memset(&params, 0, sizeof(params));
+		fd = sys_io_uring_setup(entries, &params);
+	}
+	if (fd < 0)
+		return -errno;
+	ring_fd_ = fd;
+
+	sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+	}
+
+	sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ptr_ == MAP_FAILED) {
+		sq_ptr_ = nullptr;
+		int err = -errno;
+		destroy();
+		return err;
+	}
+	if (single_mmap) {
+		cq_ptr_ = sq_ptr_;
+	} else {
+		cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+		               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_ptr_ == MAP_FAILED) {
+			cq_ptr_ = nullptr;
+			int err = -errno;
+			destroy();
+			return err;
+		}
+	}
+
+	sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		int err = -errno;
+		destroy();
+		return err;
+	}
+	sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+	auto* sq = static_cast<char*>(sq_ptr_);
+	sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+	// 提交项与索引一一对应 之后无需再修改索引数组
+	auto* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	for (unsigned i = 0; i < sq_entries_; ++i) {
+		array[i] = i;
+	}
+	sqe_tail_ = sqe_submitted_ = *sq_tail_;
+
+	auto* cq = static_cast<char*>(cq_ptr_);
+	cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	return 0;
+}
+
+void IoUring::destroy() {
+	// 先关闭句柄 内核会取消所有未完成的请求
+	if (ring_fd_ != -1) {
+		::close(ring_fd_);
+		ring_fd_ = -1;
+	}
+	if (sqes_) {
+		munmap(sqes_, sqes_size_);
+		sqes_ = nullptr;
+	}
+	if (cq_ptr_ && cq_ptr_ != sq_ptr_) {
+		munmap(cq_ptr_, cq_size_);
+	}
+	cq_ptr_ = nullptr;
+	if (sq_ptr_) {
+		munmap(sq_ptr_, sq_size_);
+		sq_ptr_ = nullptr;
+	}
+	if (buf_ring_) {
+		munmap(buf_ring_, buf_ring_size_);
+		buf_ring_ = nullptr;
+	}
+	free(buffers_);
+	buffers_ = nullptr;
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+	unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+	if (sqe_tail_ - head >= sq_entries_) {
+		// 提交队列已满 先把已有的提交给内核
+		submit();
+		head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+		if (sqe_tail_ - head >= sq_entries_)
+			return nullptr;
+	}
+	io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+	memset(sqe, 0, sizeof(*sqe));
+	++sqe_tail_;
+	return sqe;
+}
+
+int IoUring::submit_and_wait(unsigned wait_nr) {
+	unsigned to_submit = sqe_tail_ - sqe_submitted_;
+	if (to_submit == 0 && wait_nr == 0)
+		return 0;
+	__atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+	int ret = sys_io_uring_enter(ring_fd_, to_submit, wait_nr,
+	                             wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+	if (ret < 0)
+		return -errno;
+	sqe_submitted_ += ret;
+	return ret;
+}
+
+int IoUring::register_buf_ring(uint16_t group_id, unsigned entries,
+                               unsigned buf_size) {
+	void* buffers = nullptr;
+	if (posix_memalign(&buffers, 4096, static_cast<size_t>(entries) * buf_size))
+		return -ENOMEM;
+	buffers_ = static_cast<char*>(buffers);
+	buf_ring_size_ = entries * sizeof(io_uring_buf);
+	void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+	                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return -errno;
+	buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+	reg.ring_entries = entries;
+	reg.bgid = group_id;
+	if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) <
+	    0) {
+		int err = -errno;
+		munmap(buf_ring_, buf_ring_size_);
+		buf_ring_ = nullptr;
+		return err;
+	}
+
+	buf_size_ = buf_size;
+	buf_entries_ = entries;
+	buf_ring_mask_ = entries - 1;
+	buf_ring_->tail = 0;
+	for (unsigned i = 0; i < entries; ++i) {
+		recycle_buffer(static_cast<uint16_t>(i));
+	}
+	return 0;
+}
+
+void IoUring::recycle_buffer(uint16_t buf_id) {
+	unsigned short tail = buf_ring_->tail;
+	// 头文件中的柔性数组在C++下会因空结构体而偏移 这里按数组直接计算位置
+	io_uring_buf* buf =
+	    reinterpret_cast<io_uring_buf*>(buf_ring_) + (tail & buf_ring_mask_);
+	buf->addr = reinterpret_cast<uint64_t>(buffer(buf_id));
+	buf->len = buf_size_;
+	buf->bid = buf_id;
+	__atomic_store_n(&buf_ring_->tail, static_cast<unsigned short>(tail + 1),
+	                 __ATOMIC_RELEASE);
+}
+
+bool IoUring::probe(std::initializer_list<int> ops) const {
+	const size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+	std::vector<char> buf(len, 0);
+	auto* probe = reinterpret_cast<io_uring_probe*>(buf.data());
+	if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+		return false;
+	for (int op : ops) {
+		if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,314 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/06 10:40:12
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/Reactor.h"
+#include "base/Logger.h"
+#include "net/Client.h"
+#include "net/EpollReactor.h"
+#include "net/FileDescriptor.h"
+#include "net/UringReactor.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+IoBackend io_backend_from_string(const std::string& name) {
+	if (name == "io_uring" || name == "uring") {
+		return IoBackend::IO_URING;
+	}
+	if (name != "epoll") {
+		WARNING_LOG << "unknown io backend: " << name << ", use epoll";
+	}
+	return IoBackend::EPOLL;
+}
+
+Reactor::ptr Reactor::create(IoBackend backend, int id) {
+	if (backend == IoBackend::IO_URING) {
+		if (UringReactor::is_supported()) {
+			return std::make_unique<UringReactor>(id);
+		}
+		WARNING_LOG << "reactor[" << id
+		            << "] io_uring is not supported, fall back to epoll";
+	}
+	return std::make_unique<EpollReactor>(id);
+}
+
+Reactor::Reactor(int id)
+    : id_(id)
+    , loop_ref_(std::make_shared<LoopRef>()) {}
+
+// 子类析构时必须先调用stop() 此时事件循环已经退出
+Reactor::~Reactor() = default;
+
+void Reactor::initialize_socket(int port, int backlog) {
+	// 非阻塞 每次可读时循环accept直到EAGAIN
+	listen_fd_.set(socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+	if (listen_fd_.get() == -1) {
+		throw std::runtime_error(strerror(errno));
+	}
+	// 重用地址 避免等待
+	const int option = 1;
+	setsockopt(listen_fd_.get(), SOL_SOCKET, SO_REUSEADDR, &option,
+	           sizeof(option));
+	// 每个reactor都有自己的监听socket 由内核做连接的负载均衡
+	if (setsockopt(listen_fd_.get(), SOL_SOCKET, SO_REUSEPORT, &option,
+	               sizeof(option)) == -1) {
+		throw std::runtime_error(strerror(errno));
+	}
+
+	struct sockaddr_in server_addr;
+	bzero(&server_addr, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	server_addr.sin_port = htons(port);
+	if (bind(listen_fd_.get(), (struct sockaddr*)&server_addr,
+	         sizeof(server_addr)) == -1) {
+		throw std::runtime_error(strerror(errno));
+	}
+	if (listen(listen_fd_.get(), backlog) == -1) {
+		throw std::runtime_error(strerror(errno));
+	}
+}
+
+void Reactor::start(int port, int backlog, const accept_handler_t& handler) {
+	accept_handler_ = handler;
+	initialize_socket(port, backlog);
+	wakeup_fd_.set(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+	if (wakeup_fd_.get() == -1)
+		throw std::runtime_error(strerror(errno));
+	spare_fd_.set(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+	init_backend();
+	{
+		std::lock_guard<std::mutex> lock(loop_ref_->mtx_);
+		loop_ref_->owner_ = this;
+	}
+	running_ = true;
+	thread_ = std::make_unique<std::thread>(&Reactor::loop, this);
+	INFO_LOG << "reactor[" << id_ << "] start in " << port;
+}
+
+void Reactor::stop() {
+	{
+		std::lock_guard<std::mutex> lock(loop_ref_->mtx_);
+		loop_ref_->owner_ = nullptr;
+	}
+	if (thread_) {
+		running_ = false;
+		wakeup();
+		if (thread_->joinable()) {
+			thread_->join();
+		}
+		thread_.reset(nullptr);
+	}
+	close_backend();
+	for (auto* fd : {&listen_fd_, &wakeup_fd_, &spare_fd_}) {
+		if (fd->get() != -1) {
+			::close(fd->get());
+			fd->set(-1);
+		}
+	}
+}
+
+ConnectionTable::handle_t Reactor::add_client(const Client::ptr& client) {
+	auto handle = connections_.insert(client);
+	if (handle == 0) {
+		rejected_.fetch_add(1, std::memory_order_relaxed);
+		ERROR_LOG << "reactor[" << id_ << "] fd " << client->get_filedesc().get()
+		          << " exceeds the connection table";
+		try {
+			client->close();
+		} catch (const std::runtime_error& err) {
+			ERROR_LOG << err.what();
+		}
+		return 0;
+	}
+	accepted_.fetch_add(1, std::memory_order_relaxed);
+	// 回复与心跳都是小包 不能等待上一个包的确认(Nagle与延迟确认叠加可达40ms)
+	int nodelay = 1;
+	setsockopt(client->get_filedesc().get(), IPPROTO_TCP, TCP_NODELAY,
+	           &nodelay, sizeof(nodelay));
+	on_client_added(client, handle);
+	if (accept_handler_) {
+		accept_handler_(client);
+	}
+	if (idle_timeout_.count() > 0) {
+		client->touch();
+		schedule_idle_check(handle, idle_timeout_);
+	}
+	return handle;
+}
+
+void Reactor::close_client(const Client::ptr& client) {
+	close_client(connections_.handle_of(client->get_filedesc().get()));
+}
+
+void Reactor::close_client(ConnectionTable::handle_t handle) {
+	if (!connections_.get(handle))
+		return; // 已经关闭
+	auto* slot = connections_.slot(ConnectionTable::fd_of(handle));
+	// 移出连接表后只有这里持有连接
+	Client::ptr client = slot->shared.load(std::memory_order_relaxed);
+	if (slot->idle_timer != 0) {
+		timers_.cancel(slot->idle_timer);
+	}
+	on_client_removed(client, handle);
+	connections_.remove(ConnectionTable::fd_of(handle));
+	try {
+		client->close();
+	} catch (const std::runtime_error& err) {
+		ERROR_LOG << err.what();
+	}
+}
+
+void Reactor::schedule_idle_check(ConnectionTable::handle_t handle,
+                                  std::chrono::steady_clock::duration timeout) {
+	using namespace std::chrono;
+	auto* slot = connections_.slot(ConnectionTable::fd_of(handle));
+	slot->idle_timer = timers_.run_after(timeout, [this, handle]() {
+		Client* client = connections_.get(handle);
+		if (!client)
+			return;
+		connections_.slot(ConnectionTable::fd_of(handle))->idle_timer = 0;
+		auto idle = steady_clock::now() - client->last_active();
+		if (client->is_connected() && idle < idle_timeout_) {
+			// 期间收到过数据 只需按剩余时间重新安排 读路径上无需操作定时器
+			schedule_idle_check(handle, idle_timeout_ - idle);
+			return;
+		}
+		if (client->is_connected()) {
+			client->handle_disconnected("idle timeout");
+		}
+		close_client(handle);
+	});
+}
+
+bool Reactor::on_accept_error(int error) {
+	switch (error) {
+	case EINTR:
+	case ECONNABORTED: // 连接在accept之前已被对端重置
+		return true;
+	case EMFILE:
+	case ENFILE: {
+		if (spare_fd_.get() == -1) {
+			ERROR_LOG << "reactor[" << id_ << "] accept: " << strerror(error);
+			return false;
+		}
+		// 监听队列为空时accept同样因分配不到fd而失败 此时无需拒绝
+		::close(spare_fd_.get());
+		int fd = ::accept4(listen_fd_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd != -1) {
+			::close(fd);
+			rejected_.fetch_add(1, std::memory_order_relaxed);
+			WARNING_LOG << "reactor[" << id_ << "] accept: " << strerror(error)
+			            << ", reject a pending connection";
+		}
+		spare_fd_.set(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+		return fd != -1;
+	}
+	default:
+		accept_errors_.fetch_add(1, std::memory_order_relaxed);
+		ERROR_LOG << "reactor[" << id_ << "] accept: " << strerror(error);
+		return false;
+	}
+}
+
+void Reactor::run_in_loop(functor_t cb) {
+	if (is_in_loop_thread()) {
+		cb();
+	} else {
+		queue_in_loop(std::move(cb));
+	}
+}
+
+void Reactor::LoopRef::run_in_loop(functor_t cb) {
+	std::unique_lock<std::mutex> lock(mtx_);
+	if (!owner_)
+		return;
+	if (owner_->is_in_loop_thread()) {
+		// 事件循环线程退出前reactor不会被销毁 无需继续持有锁
+		lock.unlock();
+		cb();
+		return;
+	}
+	owner_->queue_in_loop(std::move(cb));
+}
+
+void Reactor::queue_in_loop(functor_t cb) {
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx_);
+		pending_functors_.push_back(std::move(cb));
+	}
+	wakeup();
+}
+
+void Reactor::wakeup() {
+	if (wakeup_fd_.get() == -1)
+		return;
+	uint64_t one = 1;
+	auto n = ::write(wakeup_fd_.get(), &one, sizeof(one));
+	if (n != sizeof(one)) {
+		ERROR_LOG << "reactor[" << id_ << "] wakeup writes " << n << " bytes";
+	}
+}
+
+void Reactor::handle_wakeup() {
+	uint64_t one = 0;
+	::read(wakeup_fd_.get(), &one, sizeof(one));
+}
+
+void Reactor::do_pending_functors() {
+	std::vector<functor_t> functors;
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx_);
+		functors.swap(pending_functors_);
+	}
+	for (const auto& functor : functors) {
+		functor();
+	}
+}
+
+Client::ptr Reactor::find_client(const std::string& ip) {
+	Client::ptr result;
+	connections_.for_each([&](const Client::ptr& client) {
+		if (client->get_ip() != ip)
+			return true;
+		result = client;
+		return false;
+	});
+	return result;
+}
+
+void Reactor::for_each_client(
+    const std::function<void(const Client::ptr&)>& func) {
+	connections_.for_each([&func](const Client::ptr& client) {
+		func(client);
+		return true;
+	});
+}
+
+void Reactor::close_all_clients() {
+	connections_.clear([this](const Client::ptr& client) {
+		int fd = client->get_filedesc().get();
+		if (connections_.slot(fd)->idle_timer != 0) {
+			timers_.cancel(connections_.slot(fd)->idle_timer);
+		}
+		on_client_removed(client, connections_.handle_of(fd));
+		try {
+			client->close();
+		} catch (const std::runtime_error& err) {
+			ERROR_LOG << err.what();
+		}
+	});
+}
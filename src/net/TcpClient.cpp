@@ -23,6 +23,7 @@
 #include <mutex>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
@@ -32,7 +33,25 @@
 TcpClient::TcpClient(ini::IniFile& ini_file){
 	ip_ = ini_file["tcp_client"]["server_ip"].as<std::string>();
 	port_ = ini_file["tcp_client"]["server_port"].as<int>();
+	// 心跳间隔(毫秒)与内容 未配置时不发送心跳
+	if (ini_file["tcp_client"].count("heartbeat_interval") &&
+	    ini_file["tcp_client"].count("heartbeat_payload")) {
+		HeartbeatMonitor::Options options;
+		options.interval = std::chrono::milliseconds(
+		    ini_file["tcp_client"]["heartbeat_interval"].as<int>());
+		if (ini_file["tcp_client"].count("heartbeat_max_missed")) {
+			options.max_missed =
+			    ini_file["tcp_client"]["heartbeat_max_missed"].as<int>();
+		}
+		set_heartbeat(options,
+		              ini_file["tcp_client"]["heartbeat_payload"].as<std::string>());
+	}
+}
 
+void TcpClient::set_heartbeat(const HeartbeatMonitor::Options& options,
+                              const std::string& payload) {
+	heartbeat_.set_options(options);
+	heartbeat_payload_ = payload;
 }
 
 
@@ -42,6 +61,10 @@ int TcpClient::initialize_socket() {
 	if (socket_failed) {
 		throw std::runtime_error(strerror(errno));
 	}
+	// 关闭Nagle算法 否则请求未被确认时 之后的心跳等小包会被推迟发送
+	int nodelay = 1;
+	setsockopt(sock_fd_.get(), IPPROTO_TCP, TCP_NODELAY, &nodelay,
+	           sizeof(nodelay));
 	// 非阻塞模式
 	int old_socket_flag = fcntl(sock_fd_.get(), F_GETFL, 0);
 	int new_socket_flag = old_socket_flag | O_NONBLOCK;
@@ -211,7 +234,9 @@ void TcpClient::recv_server(){
         auto nums_of_byte_recv = recv(sock_fd_.get(), &msg, MAX_PACKET_SIZE, 0);
         if(nums_of_byte_recv < 1){
             std::string error_msg;
-            if(nums_of_byte_recv == 0){
+            if (heartbeat_expired_) {
+                error_msg = "Heartbeat timeout";
+            } else if(nums_of_byte_recv == 0){
                 error_msg = "Server closed connection";
             }else{
                 error_msg = strerror(errno);
@@ -221,6 +246,7 @@ void TcpClient::recv_server(){
             return ;
         }
         else {
+            heartbeat_.on_reply(HeartbeatMonitor::clock::now());
             INFO_LOG << "recv from server data size:"<<nums_of_byte_recv;
             publish_server_msg(msg, nums_of_byte_recv);
         }    
@@ -229,10 +255,47 @@ void TcpClient::recv_server(){
 
 void TcpClient::start_worker(){
     worker_ptr = std::make_unique<std::thread>(&TcpClient::recv_server,this);
+    if (heartbeat_.enabled() && !heartbeat_payload_.empty()) {
+        heartbeat_.reset();
+        heartbeat_expired_ = false;
+        heartbeat_timer_ = TimerService::shared().run_every(
+            heartbeat_.options().interval, [this]() { send_heartbeat(); });
+    }
 }
 
+void TcpClient::send_heartbeat() {
+    if (!is_connected_)
+        return;
+    uint32_t seq = 0;
+    auto action = heartbeat_.on_timer(HeartbeatMonitor::clock::now(), seq);
+    if (action == HeartbeatMonitor::Action::SEND) {
+        // 定时器线程由整个进程共用 不能阻塞在写上
+        // 正在发送其他数据或者发送缓冲区已满时跳过这一次 没有回复计为丢失
+        std::unique_lock<std::mutex> lock(buffer_mutex, std::try_to_lock);
+        if (!lock.owns_lock() || buffer_.size() > 0)
+            return;
+        auto n = ::send(sock_fd_.get(), heartbeat_payload_.data(),
+                        heartbeat_payload_.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0 && static_cast<size_t>(n) < heartbeat_payload_.size()) {
+            // 与send_msg相同 剩余部分留到下次发送
+            buffer_.append(heartbeat_payload_.data() + n,
+                           static_cast<int>(heartbeat_payload_.size() - n));
+        }
+        return;
+    }
+    // 对端长时间没有数据 关闭读写 接收线程随即发布断开事件
+    WARNING_LOG << "server[" << ip_ << ":" << port_ << "] heartbeat timeout";
+    heartbeat_expired_ = true;
+    ::shutdown(sock_fd_.get(), SHUT_RDWR);
+    TimerService::shared().cancel(heartbeat_timer_); // 在回调中取消自身
+}
 
 void TcpClient::terminate_worker(){
+    // 等待正在执行的心跳结束
+    if (heartbeat_timer_ != 0) {
+        TimerService::shared().cancel(heartbeat_timer_);
+        heartbeat_timer_ = 0;
+    }
     is_connected_ = false;
     if(worker_ptr && worker_ptr->joinable())
     {
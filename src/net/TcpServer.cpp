@@ -11,73 +11,27 @@
 #include "base/Logger.h"
 #include "net/Client.h"
 #include "net/FileDescriptor.h"
+#include "net/Reactor.h"
 #include "net/ResultType.h"
 #include "net/common.h"
 #include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
-#include <fcntl.h>
+#include <fstream>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <netinet/in.h>
+#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <strings.h>
-#include <sys/epoll.h>
-#include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
-#include <unordered_map>
 #include <utility>
 
-TcpServer::TcpServer() {
-	subscribers_.reserve(10);
-	clients_idx_.reserve(10);
-	stop_remove_clients_task_ = false;
-}
-
-void TcpServer::initialize_socket() {
-	// PF_INET ipv4
-	sock_fd_.set(socket(PF_INET, SOCK_STREAM, 0));
-	const bool socket_failed = (sock_fd_.get() == -1);
-	if (socket_failed) {
-		throw std::runtime_error(strerror(errno));
-	}
-	// 重用地址 避免等待
-	const int option = 1;
-	setsockopt(sock_fd_.get(), SOL_SOCKET, SO_REUSEADDR, &option,
-	           sizeof(option));
-}
-
-void TcpServer::bind_addres(int port) {
-	bzero(&server_addr_, sizeof(server_addr_));
-	server_addr_.sin_family = AF_INET;
-	server_addr_.sin_addr.s_addr = htonl(INADDR_ANY);
-	server_addr_.sin_port = htons(port);
-
-	const auto ret = bind(sock_fd_.get(), (struct sockaddr*)&server_addr_,
-	                      sizeof(server_addr_));
-	if (ret == -1) {
-		throw std::runtime_error(strerror(errno));
-	}
-}
-
-void TcpServer::listen_client(int max_num_of_clients) {
-	const auto ret = listen(sock_fd_.get(), max_num_of_clients);
-	if (ret == -1) {
-		throw std::runtime_error(strerror(errno));
-	}
-}
-
-void TcpServer::init_epoll(int size) {
-	epoll_fd = epoll_create(size);
-	if (epoll_fd == -1)
-		throw std::runtime_error(strerror(errno));
-}
+TcpServer::TcpServer() { subscribers_.reserve(10); }
 
 void TcpServer::publish_client_msg(Client::ptr client, ByteArray::ptr bt) {
 	std::lock_guard<std::mutex> lock(subscribers_mtx);
@@ -104,6 +58,15 @@ void TcpServer::publish_client_disconnected(Client::ptr client,
 	}
 }
 
+void TcpServer::publish_client_watermark(Client::ptr client, bool high) {
+	if (high) {
+		WARNING_LOG << "[" << client->get_ip() << "] output queue exceeds "
+		            << client->pending_output() << " bytes";
+	} else {
+		INFO_LOG << "[" << client->get_ip() << "] output queue drained";
+	}
+}
+
 void TcpServer::client_event_handler(Client::ptr client, ClientEvent event,
                                      ByteArray::ptr bt) {
 	INFO_LOG << client->get_ip() << " client event handle.";
@@ -120,35 +83,24 @@ void TcpServer::client_event_handler(Client::ptr client, ClientEvent event,
 
 void TcpServer::run() {
 	INFO_LOG << "Server::run";
-	while (true) {
-		auto ret = epoll_wait(epoll_fd, events_, MAX_EVENT_NUMBER, -1);
-		if (ret == -1)
-			throw std::runtime_error(strerror(errno));
-		else
-			handle_et_event(ret);
-	}
+	std::unique_lock<std::mutex> lock(run_mtx_);
+	run_cond_.wait(lock, [this]() { return closed_; });
 }
 
-std::string TcpServer::accept_client() {
-
-	socklen_t socketSize = sizeof(client_addr_);
-	auto client_desc =
-	    accept(sock_fd_.get(), (struct sockaddr*)&client_addr_, &socketSize);
-	if (client_desc == -1)
-		throw std::runtime_error(strerror(errno));
-
-	auto client = std::make_shared<Client>(client_desc); // 新的连接信息
-	FileDescriptor client_file_desc(client_desc);
-	client->set_ip(inet_ntoa(client_addr_.sin_addr)); // inet_ntoa 不可重入
+void TcpServer::on_new_client(Client::ptr client) {
 	using namespace std::placeholders;
 	client->set_event_handler(
 	    std::bind(&TcpServer::client_event_handler, this, _1, _2, _3));
-	add_fd(client_file_desc);
-
-	std::lock_guard<std::mutex> lock(client_mtx);
-	clients_idx_.insert({client_file_desc, client});
-
-	return client->get_ip();
+	if (frame_options_.header_length > 0) {
+		client->set_frame_decoder(frame_options_);
+	}
+	// 同一连接的回复经由strand串行写入 不同连接在线程池中并行
+	client->set_strand(Client::strand_t::create(*threadpool));
+	if (output_high_watermark_ > 0) {
+		client->set_watermark(
+		    output_high_watermark_, output_low_watermark_,
+		    std::bind(&TcpServer::publish_client_watermark, this, _1, _2));
+	}
 }
 
 ResultType TcpServer::send_to_client(Client::ptr client, const char* msg,
@@ -163,179 +115,143 @@ ResultType TcpServer::send_to_client(Client::ptr client, const char* msg,
 }
 
 ResultType TcpServer::send_to_all_clients(const char* msg, size_t size) {
-	std::lock_guard<std::mutex> lock(client_mtx);
-
-	for (const auto [file_desc, client] : clients_idx_) {
-		const auto ret = send_to_client(client, msg, size);
+	ResultType ret = ResultType::SUCCESS();
+	for (const auto& reactor : reactors_) {
+		reactor->for_each_client([&](const Client::ptr& client) {
+			if (ret.is_successful()) {
+				ret = send_to_client(client, msg, size);
+			}
+		});
 		if (!ret.is_successful()) {
 			return ret;
 		}
 	}
-	return ResultType::SUCCESS();
+	return ret;
 }
 
 ResultType TcpServer::send_to_client(const std::string& client_ip,
                                      const char* msg, size_t size) {
-	std::lock_guard<std::mutex> lock(client_mtx);
-
-	auto iter = std::find_if(
-	    clients_idx_.begin(), clients_idx_.end(),
-	    [&client_ip](std::pair<FileDescriptor, Client::ptr> client) {
-		    return (client.second)->get_ip() == client_ip;
-	    });
-
-	if (iter == clients_idx_.end()) {
-		return ResultType::FAILURE("client not found!");
+	for (const auto& reactor : reactors_) {
+		auto client = reactor->find_client(client_ip);
+		if (client) {
+			return send_to_client(client, msg, size);
+		}
 	}
-
-	return send_to_client(iter->second, msg, size);
+	return ResultType::FAILURE("client not found!");
 }
 
-ResultType TcpServer::start(int port, int max_num_of_clients,
-                            bool remove_dead_client_auto) {
-	if (remove_dead_client_auto)
-		_clients_remove_thread = std::make_unique<std::thread>(
-		    &TcpServer::remove_dead_clients, this);
-
-	try {
-		initialize_socket(); // 初始化socket
-		bind_addres(port);
-		listen_client(max_num_of_clients);
-		init_epoll(10);
-	} catch (const std::runtime_error& err) {
-		return ResultType::FAILURE(err.what());
-	}
-	add_fd(sock_fd_, false);
-	// 其他初始化工作
-	threadpool.reset(new putils::ThreadPool{}); // 配置线程数目
-	INFO_LOG << "Server::start in " << port;
-	return ResultType::SUCCESS();
+/**
+ * @brief 读取/proc下的单个整数
+ *
+ * @return long 读取失败时返回-1
+ */
+static long read_proc_value(const char* path) {
+	std::ifstream file(path);
+	long value = -1;
+	if (!(file >> value))
+		return -1;
+	return value;
 }
 
-void TcpServer::terminate_dead_clients_remover() {
-	if (_clients_remove_thread && _clients_remove_thread->joinable()) {
-		stop_remove_clients_task_ = true;
-		_clients_remove_thread->join();
-
-		_clients_remove_thread = nullptr;
+/**
+ * @brief 内核因监听队列已满而丢弃连接的次数 /proc/net/netstat 中的TcpExt: ListenOverflows
+ *
+ * @return uint64_t 读取失败时返回0
+ */
+static uint64_t read_listen_overflows() {
+	std::ifstream file("/proc/net/netstat");
+	std::string names, values;
+	// 每组统计占两行 第一行是名称 第二行是对应的值
+	while (std::getline(file, names) && std::getline(file, values)) {
+		if (names.compare(0, 7, "TcpExt:") != 0)
+			continue;
+		std::istringstream name_in(names), value_in(values);
+		std::string name, value;
+		while (name_in >> name && value_in >> value) {
+			if (name == "ListenOverflows")
+				return std::stoull(value);
+		}
 	}
+	return 0;
 }
 
-void TcpServer::remove_dead_clients() {
-	std::unordered_map<FileDescriptor, Client::ptr>::iterator removed_client;
-	while (!stop_remove_clients_task_) {
-		{
-			std::lock_guard<std::mutex> lock(client_mtx);
-			removed_client = std::find_if(
-			    clients_idx_.begin(), clients_idx_.end(),
-			    [](const std::pair<FileDescriptor, Client::ptr>& client) {
-				    return !(client.second)->is_connected();
-			    });
-
-			while (removed_client != clients_idx_.end()) {
-
-				(removed_client->second)->close();
-				client_write_mtx_.erase(removed_client->first);
-				clients_idx_.erase(removed_client);
+ResultType TcpServer::start(int port, int backlog, int reactor_nums) {
+	if (reactor_nums <= 0) {
+		reactor_nums = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// 超过somaxconn的部分会被内核直接截断
+	auto somaxconn = read_proc_value("/proc/sys/net/core/somaxconn");
+	if (somaxconn > 0 && backlog > somaxconn) {
+		WARNING_LOG << "listen backlog " << backlog
+		            << " is truncated to net.core.somaxconn " << somaxconn;
+	}
+	listen_overflows_at_start_ = read_listen_overflows();
+	// 先配置线程池 reactor启动后可能马上就有消息需要处理
+	threadpool.reset(new putils::WorkStealingPool{}); // 配置线程数目
 
-				removed_client = std::find_if(
-				    clients_idx_.begin(), clients_idx_.end(),
-				    [](const std::pair<FileDescriptor, Client::ptr>& client) {
-					    return !(client.second)->is_connected();
-				    });
-			}
+	using namespace std::placeholders;
+	try {
+		for (int i = 0; i < reactor_nums; ++i) {
+			auto reactor = Reactor::create(io_backend_, i);
+			reactor->set_idle_timeout(idle_timeout_);
+			reactor->start(port, backlog,
+			               std::bind(&TcpServer::on_new_client, this, _1));
+			reactors_.push_back(std::move(reactor));
 		}
-
-		sleep(2); // 间隔2s检查一次
+	} catch (const std::runtime_error& err) {
+		reactors_.clear(); // 析构时停止已经启动的reactor
+		return ResultType::FAILURE(err.what());
 	}
+
+	INFO_LOG << "Server::start in " << port << " with " << reactor_nums
+	         << " reactors";
+	return ResultType::SUCCESS();
 }
 
 ResultType TcpServer::close() {
-	DEBUG_LOG << "close tcpserver";
-	terminate_dead_clients_remover(); //  终止线程的工作
-
 	{
-		std::lock_guard<std::mutex> lock(client_mtx);
-		for (const auto [file_desc, client] : clients_idx_) {
-			try {
-				client->close();
-			} catch (const std::runtime_error& err) {
-				return ResultType::FAILURE(err.what());
-			}
+		std::lock_guard<std::mutex> lock(run_mtx_);
+		if (closed_) {
+			return ResultType::FAILURE("server is already closed");
 		}
-		clients_idx_.clear();
+		closed_ = true;
 	}
-
-	{
-		auto ret = ::close(sock_fd_.get());
-		if (ret == -1) {
-			return ResultType::FAILURE(strerror(errno));
-		}
+	auto stats = accept_stats();
+	INFO_LOG << "close tcpserver, accepted: " << stats.accepted
+	         << ", rejected: " << stats.rejected << ", errors: " << stats.errors
+	         << ", listen overflows: " << stats.listen_overflows;
+
+	// 停止reactor 各自关闭自己持有的连接和监听socket
+	for (const auto& reactor : reactors_) {
+		reactor->stop();
 	}
+	reactors_.clear();
+	run_cond_.notify_all();
 	return ResultType::SUCCESS();
 }
 
 void TcpServer::printClients() {
-	std::lock_guard<std::mutex> lock(client_mtx);
-
-	if (clients_idx_.empty()) {
-		DEBUG_LOG << "no connected clients";
+	bool empty = true;
+	for (const auto& reactor : reactors_) {
+		reactor->for_each_client([&empty](const Client::ptr& client) {
+			empty = false;
+			client->print();
+		});
 	}
-	for (const auto [file_desc, client] : clients_idx_) {
-		client->print();
+	if (empty) {
+		DEBUG_LOG << "no connected clients";
 	}
 }
 
-TcpServer::~TcpServer() { close(); }
-
-int TcpServer::set_nonblock(FileDescriptor file_desc) {
-	int old_option = fcntl(file_desc.get(), F_GETFL);
-	int new_option = old_option | O_NONBLOCK;
-	fcntl(file_desc.get(), F_SETFL, new_option);
-	return old_option;
-}
-
-void TcpServer::add_fd(FileDescriptor file_desc, bool oneshot) {
-	epoll_event event;
-	event.data.fd = file_desc.get();
-	event.events = EPOLLIN | EPOLLET; // 采用边缘触发模式
-	// 一次只能有一个线程处理这个
-	if (oneshot) {
-		event.events |= EPOLLONESHOT;
+AcceptStats TcpServer::accept_stats() const {
+	AcceptStats stats;
+	for (const auto& reactor : reactors_) {
+		stats += reactor->accept_stats();
 	}
-	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, file_desc.get(), &event);
-	set_nonblock(file_desc);
+	auto overflows = read_listen_overflows();
+	if (overflows > listen_overflows_at_start_)
+		stats.listen_overflows = overflows - listen_overflows_at_start_;
+	return stats;
 }
 
-void TcpServer::reset_oneshot(FileDescriptor file_desc) {
-	epoll_event event;
-	event.data.fd = file_desc.get();
-	event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
-	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, file_desc.get(), &event);
-}
-
-void TcpServer::handle_et_event(int number) {
-	for (int i = 0; i < number; i++) {
-		auto socket_fd = events_[i].data.fd;
-		if (socket_fd == sock_fd_.get()) { // 客户端连接
-			auto clientIP = accept_client();
-			// printClients();
-
-		} else if (events_[i].events & EPOLLIN) { // 可读事件
-			FileDescriptor file_desc(socket_fd);
-			auto client = clients_idx_[file_desc];
-			if (client_write_mtx_.count(file_desc) == 0)
-				client_write_mtx_.insert(
-				    {file_desc,
-				     std::make_unique<std::mutex>()}); // 堆上维护 std::mutex
-
-			// 对客户端处理数据
-			threadpool->submit([this, &client, &file_desc]() {
-				auto ret = client->receive_data();
-				if (ret) {
-					reset_oneshot(file_desc);
-				}
-			});
-		}
-	}
-}
+TcpServer::~TcpServer() { close(); }
@@ -0,0 +1,197 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/23 10:15:08
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/TimerService.h"
+#include "base/Logger.h"
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define TICK_MS 1 // 时间轮每格的时长
+
+TimerService::TimerService()
+    : start_(clock::now()) {
+	timer_fd_.set(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+	if (timer_fd_.get() == -1)
+		throw std::runtime_error(strerror(errno));
+}
+
+TimerService::~TimerService() {
+	if (thread_) {
+		uint64_t one = 1;
+		::write(stop_fd_.get(), &one, sizeof(one));
+		if (thread_->joinable())
+			thread_->join();
+		::close(stop_fd_.get());
+	}
+	::close(timer_fd_.get());
+}
+
+TimerService& TimerService::shared() {
+	static TimerService service;
+	static std::once_flag started;
+	std::call_once(started, []() {
+		service.stop_fd_.set(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+		if (service.stop_fd_.get() == -1)
+			throw std::runtime_error(strerror(errno));
+		service.thread_ =
+		    std::make_unique<std::thread>(&TimerService::run_thread, &service);
+	});
+	return service;
+}
+
+void TimerService::run_thread() {
+	pollfd fds[2];
+	fds[0].fd = timer_fd_.get();
+	fds[0].events = POLLIN;
+	fds[1].fd = stop_fd_.get();
+	fds[1].events = POLLIN;
+	while (true) {
+		auto ret = ::poll(fds, 2, -1);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			ERROR_LOG << "timer service poll: " << strerror(errno);
+			return;
+		}
+		if (fds[1].revents & POLLIN)
+			return;
+		if (fds[0].revents & POLLIN)
+			handle_read();
+	}
+}
+
+uint64_t TimerService::now_ticks() const {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(clock::now() - start_).count() / TICK_MS;
+}
+
+TimerService::TimerId TimerService::run_after(clock::duration delay,
+                                              callback_t cb) {
+	return add(delay, std::move(cb), false);
+}
+
+TimerService::TimerId TimerService::run_every(clock::duration interval,
+                                              callback_t cb) {
+	return add(interval, std::move(cb), true);
+}
+
+TimerService::TimerId TimerService::add(clock::duration delay, callback_t cb,
+                                        bool periodic) {
+	using namespace std::chrono;
+	auto ms = duration_cast<milliseconds>(delay + milliseconds(TICK_MS) -
+	                                      nanoseconds(1))
+	              .count();
+	uint64_t ticks = ms > 0 ? static_cast<uint64_t>(ms) / TICK_MS : 1;
+	auto now = now_ticks();
+
+	std::lock_guard<std::mutex> lock(mtx_);
+	if (wheel_.size() == 0 && now > wheel_.now()) {
+		wheel_.advance(now - wheel_.now()); // 没有任务 直接对齐当前时刻
+	}
+	// 时间轮只在到期时推进 可能落后于当前时刻
+	auto id = wheel_.add(now + ticks - wheel_.now(), std::move(cb),
+	                     periodic ? ticks : 0);
+	rearm();
+	return id;
+}
+
+bool TimerService::cancel(TimerId id) {
+	std::unique_lock<std::mutex> lock(mtx_);
+	bool cancelled = wheel_.cancel(id);
+	if (!dispatching_)
+		return cancelled;
+	// 已经取出但还没有执行 不再执行
+	for (auto& timer : expired_) {
+		if (timer.id == id && timer.cb) {
+			timer.cb = nullptr;
+			cancelled = true;
+		}
+	}
+	// 正在执行 等待执行完毕 回调中取消自身时不能等待
+	if (running_ == id && driver_ != std::this_thread::get_id()) {
+		cancelled = true;
+		idle_cv_.wait(lock, [this, id]() { return running_ != id; });
+	}
+	return cancelled;
+}
+
+size_t TimerService::size() const {
+	std::lock_guard<std::mutex> lock(mtx_);
+	return wheel_.size();
+}
+
+void TimerService::handle_read() {
+	uint64_t expirations = 0;
+	::read(timer_fd_.get(), &expirations, sizeof(expirations));
+
+	auto now = now_ticks();
+	std::unique_lock<std::mutex> lock(mtx_);
+	if (now > wheel_.now()) {
+		wheel_.advance(now - wheel_.now(), expired_);
+	}
+	armed_tick_ = putils::TimingWheel::NEVER; // 已经触发
+	rearm();
+	if (expired_.empty())
+		return;
+	// 回调中可能添加或取消定时任务 执行时不能持有锁
+	dispatching_ = true;
+	driver_ = std::this_thread::get_id();
+	bool periodic = false;
+	for (size_t i = 0; i < expired_.size(); ++i) {
+		if (!expired_[i].cb)
+			continue; // 执行前已被取消
+		auto cb = std::move(expired_[i].cb);
+		running_ = expired_[i].id;
+		lock.unlock();
+		cb();
+		lock.lock();
+		running_ = 0;
+		periodic = periodic || expired_[i].periodic;
+	}
+	dispatching_ = false;
+	idle_cv_.notify_all();
+	if (periodic) {
+		for (const auto& timer : expired_) {
+			if (timer.periodic)
+				wheel_.restart(timer.id);
+		}
+		rearm();
+	}
+	expired_.clear();
+}
+
+void TimerService::rearm() {
+	auto next = wheel_.next_expiry();
+	uint64_t tick = next == putils::TimingWheel::NEVER ? next : wheel_.now() + next;
+	if (tick == armed_tick_)
+		return;
+	armed_tick_ = tick;
+
+	itimerspec spec{};
+	if (tick != putils::TimingWheel::NEVER) {
+		// 按绝对时刻设置 已经过去的时刻会立即触发
+		auto when = start_ + std::chrono::milliseconds(tick * TICK_MS);
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		              when.time_since_epoch())
+		              .count();
+		spec.it_value.tv_sec = ns / 1000000000;
+		spec.it_value.tv_nsec = ns % 1000000000;
+		if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+			spec.it_value.tv_nsec = 1; // 全0表示停止
+	}
+	if (timerfd_settime(timer_fd_.get(), TFD_TIMER_ABSTIME, &spec, nullptr) ==
+	    -1) {
+		ERROR_LOG << "timerfd_settime: " << strerror(errno);
+	}
+}
@@ -0,0 +1,502 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/10 10:02:53
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "net/UringReactor.h"
+#include "base/ByteArray.h"
+#include "base/Logger.h"
+#include "net/Client.h"
+#include "net/common.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 1024       // 提交队列长度
+#define RECV_BUF_GROUP 0         // 接收缓冲区组号
+#define RECV_BUF_COUNT 512       // 接收缓冲区数目 必须是2的幂
+#define MAX_SEND_CHAIN 16        // 一条发送链最多包含的请求数
+#define TOKEN_MASK ((1ULL << 56) - 1)
+
+namespace {
+
+uint64_t make_user_data(uint8_t op, uint64_t token) {
+	return (static_cast<uint64_t>(op) << 56) | token;
+}
+
+} // namespace
+
+UringReactor::UringReactor(int id)
+    : Reactor(id)
+    , send_queue_(std::make_shared<SendQueue>()) {}
+
+UringReactor::~UringReactor() { stop(); }
+
+bool UringReactor::is_supported() {
+	static const bool supported = []() {
+		struct utsname name;
+		int major = 0, minor = 0;
+		if (uname(&name) != 0 ||
+		    sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+			return false;
+		}
+		IoUring ring;
+		if (ring.init(8) < 0)
+			return false; // 例如 kernel.io_uring_disabled 被打开
+		if (!ring.probe({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+		                 IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL}))
+			return false;
+		return ring.register_buf_ring(RECV_BUF_GROUP, 8, 64) == 0;
+	}();
+	return supported;
+}
+
+void UringReactor::init_backend() {
+	int ret = ring_.init(URING_ENTRIES);
+	if (ret < 0)
+		throw std::runtime_error(strerror(-ret));
+	ret = ring_.register_buf_ring(RECV_BUF_GROUP, RECV_BUF_COUNT,
+	                              MAX_PACKET_SIZE);
+	if (ret < 0) {
+		ring_.destroy();
+		throw std::runtime_error(strerror(-ret));
+	}
+	std::lock_guard<std::mutex> lock(send_queue_->mtx);
+	send_queue_->owner = this;
+}
+
+void UringReactor::close_backend() {
+	{
+		std::lock_guard<std::mutex> lock(send_queue_->mtx);
+		send_queue_->owner = nullptr;
+		send_queue_->sends.clear();
+	}
+	// 先销毁io_uring 内核取消未完成的请求后才能释放发送中的数据
+	ring_.destroy();
+	conns_.clear();
+}
+
+void UringReactor::loop() {
+	thread_id_ = std::this_thread::get_id();
+	arm_wakeup();
+	arm_accept();
+	arm_timer();
+	while (running_) {
+		flush_sends();
+		// 本轮产生的所有提交项(重新注册、发送链)在这里一次提交
+		int ret = ring_.submit_and_wait(1);
+		if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+			ERROR_LOG << "reactor[" << id_
+			          << "] io_uring_enter: " << strerror(-ret);
+			break;
+		}
+		ring_.for_each_cqe(
+		    [this](const io_uring_cqe* cqe) { handle_completion(cqe); });
+		do_pending_functors();
+	}
+	close_all_clients();
+	thread_id_ = std::thread::id{};
+}
+
+void UringReactor::arm_accept() {
+	io_uring_sqe* sqe = ring_.get_sqe();
+	if (!sqe) {
+		ERROR_LOG << "reactor[" << id_ << "] submission queue is full";
+		return;
+	}
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listen_fd_.get();
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	// 与epoll后端一致 连接为非阻塞 直接写socket时不会阻塞reactor线程
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = make_user_data(OP_ACCEPT, 0);
+}
+
+void UringReactor::arm_listen_poll() {
+	io_uring_sqe* sqe = ring_.get_sqe();
+	if (!sqe) {
+		ERROR_LOG << "reactor[" << id_ << "] submission queue is full";
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = listen_fd_.get();
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = make_user_data(OP_LISTEN_POLL, 0);
+}
+
+void UringReactor::arm_wakeup() {
+	io_uring_sqe* sqe = ring_.get_sqe();
+	if (!sqe) {
+		ERROR_LOG << "reactor[" << id_ << "] submission queue is full";
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = wakeup_fd_.get();
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = make_user_data(OP_WAKEUP, 0);
+}
+
+void UringReactor::arm_timer() {
+	io_uring_sqe* sqe = ring_.get_sqe();
+	if (!sqe) {
+		ERROR_LOG << "reactor[" << id_ << "] submission queue is full";
+		return;
+	}
+	// 与eventfd一样使用多次触发的poll 到期的时刻由TimerService设置
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = timers().get_filedesc().get();
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = make_user_data(OP_TIMER, 0);
+}
+
+void UringReactor::arm_recv(uint64_t token, Connection& conn) {
+	io_uring_sqe* sqe = ring_.get_sqe();
+	if (!sqe) {
+		fail_connection(conn, "submission queue is full");
+		return;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn.client->get_filedesc().get();
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = RECV_BUF_GROUP;
+	sqe->user_data = make_user_data(OP_RECV, token);
+	conn.recv_armed = true;
+}
+
+void UringReactor::update_recv(uint64_t token) {
+	auto iter = conns_.find(token);
+	if (iter == conns_.end() || iter->second.closing)
+		return;
+	Connection& conn = iter->second;
+	if (conn.client->is_reading()) {
+		// 先处理暂停期间留在缓冲区中的数据
+		if (!conn.client->publish_input()) {
+			close_client(token);
+			return;
+		}
+		// 取消尚未完成时 等recv以ECANCELED结束后再重新注册
+		if (!conn.recv_armed) {
+			arm_recv(token, conn);
+			if (!conn.recv_armed)
+				close_client(token);
+		}
+		return;
+	}
+	if (!conn.recv_armed || conn.recv_canceling)
+		return;
+	io_uring_sqe* sqe = ring_.get_sqe();
+	if (!sqe)
+		return; // 之后收到的数据留在缓冲区 只是取消得晚一些
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = make_user_data(OP_RECV, token);
+	sqe->user_data = make_user_data(OP_CANCEL, token);
+	conn.recv_canceling = true;
+}
+
+void UringReactor::handle_completion(const io_uring_cqe* cqe) {
+	auto op = static_cast<uint8_t>(cqe->user_data >> 56);
+	uint64_t token = cqe->user_data & TOKEN_MASK;
+	switch (op) {
+	case OP_ACCEPT:
+		handle_accept(cqe);
+		break;
+	case OP_LISTEN_POLL:
+		handle_listen_poll();
+		break;
+	case OP_WAKEUP:
+		handle_wakeup();
+		if (!(cqe->flags & IORING_CQE_F_MORE) && running_)
+			arm_wakeup();
+		break;
+	case OP_TIMER:
+		timers().handle_read();
+		if (!(cqe->flags & IORING_CQE_F_MORE) && running_)
+			arm_timer();
+		break;
+	case OP_RECV:
+		handle_recv(token, cqe);
+		break;
+	case OP_SEND:
+		handle_send(token, cqe);
+		break;
+	default:
+		break;
+	}
+}
+
+void UringReactor::handle_accept(const io_uring_cqe* cqe) {
+	// accept先分配fd再取连接 fd耗尽时即使没有连接也会立即失败
+	bool exhausted = cqe->res == -EMFILE || cqe->res == -ENFILE;
+	if (!(cqe->flags & IORING_CQE_F_MORE) && running_) {
+		// 多次触发的accept已经终止 重新注册
+		if (exhausted)
+			arm_listen_poll();
+		else
+			arm_accept();
+	}
+	if (cqe->res < 0) {
+		if (!exhausted)
+			on_accept_error(-cqe->res);
+		return;
+	}
+	add_accepted(cqe->res);
+}
+
+void UringReactor::handle_listen_poll() {
+	if (!running_)
+		return;
+	// 取出队列中的所有连接 fd仍然耗尽时逐个拒绝
+	while (true) {
+		int client_desc = accept4(listen_fd_.get(), nullptr, nullptr,
+		                          SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_desc == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (!on_accept_error(errno))
+				break;
+			continue;
+		}
+		add_accepted(client_desc);
+	}
+	arm_accept();
+}
+
+void UringReactor::add_accepted(int client_desc) {
+	auto client = std::make_shared<Client>(client_desc); // 新的连接信息
+	struct sockaddr_in client_addr;
+	socklen_t socket_size = sizeof(client_addr);
+	char ip[INET_ADDRSTRLEN] = {'\0'};
+	if (getpeername(client_desc, (struct sockaddr*)&client_addr,
+	                &socket_size) == 0) {
+		inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+	}
+	client->set_ip(ip);
+
+	auto token = add_client(client);
+	if (token == 0)
+		return;
+	auto iter = conns_.find(token);
+	if (iter == conns_.end())
+		return; // accept_handler_中已经关闭
+	arm_recv(token, iter->second);
+	if (!iter->second.recv_armed)
+		close_client(token);
+}
+
+void UringReactor::on_client_added(const Client::ptr& client,
+                                   ConnectionTable::handle_t handle) {
+	// 连接表的句柄带有代数 直接作为请求的token
+	auto queue = send_queue_;
+	client->set_send_handler([queue, handle](const iovec* iov, size_t len) {
+		return queue_send(queue, handle, iov, len);
+	});
+	// 发送由send_handler负责 这里只需处理暂停/恢复读取
+	auto loop = loop_ref();
+	client->set_interest_handler([loop, this, handle]() {
+		loop->run_in_loop([this, handle]() { update_recv(handle); });
+	});
+	conns_[handle].client = client;
+}
+
+void UringReactor::handle_recv(uint64_t token, const io_uring_cqe* cqe) {
+	auto iter = conns_.find(token);
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+		auto buf_id = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		if (cqe->res > 0 && iter != conns_.end() && !iter->second.closing) {
+			Client::ptr client = iter->second.client;
+			on_client_active(*client);
+			// 数据在handle_data中被拷贝 分帧出错时连接已发布断开事件
+			if (!client->handle_data(ring_.buffer(buf_id), cqe->res))
+				close_client(token);
+		}
+		ring_.recycle_buffer(buf_id); // 立即归还缓冲区
+	}
+	if (iter == conns_.end())
+		return;
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return;
+
+	// 回调中可能已经关闭了连接 重新查找
+	iter = conns_.find(token);
+	if (iter == conns_.end())
+		return;
+	Connection& conn = iter->second;
+	Client::ptr client = conn.client;
+	conn.recv_armed = false;
+	conn.recv_canceling = false;
+	if (conn.closing) {
+		try_release(token);
+		return;
+	}
+	if (client->is_connected()) {
+		if (cqe->res > 0 || cqe->res == -ENOBUFS || cqe->res == -ECANCELED) {
+			if (!client->is_reading())
+				return; // 暂停读取 恢复时由update_recv重新注册
+			// 缓冲区暂时耗尽 重新注册即可
+			arm_recv(token, conn);
+			if (conn.recv_armed)
+				return;
+		} else if (cqe->res == 0) {
+			client->handle_disconnected("Client has closed connection!");
+		} else {
+			client->handle_disconnected(strerror(-cqe->res));
+		}
+	}
+	close_client(token); // 由所属reactor立即关闭 不再等待后台扫描
+}
+
+void UringReactor::handle_send(uint64_t token, const io_uring_cqe* cqe) {
+	auto iter = conns_.find(token);
+	if (iter == conns_.end())
+		return;
+	Connection& conn = iter->second;
+	size_t expected = conn.inflight.empty() ? 0 : conn.inflight.front().size();
+	if (!conn.inflight.empty())
+		conn.inflight.pop_front();
+	if (cqe->res > 0)
+		conn.client->on_output_sent(cqe->res);
+
+	if (cqe->res < 0 || static_cast<size_t>(cqe->res) < expected) {
+		// 链中后续的请求会以 ECANCELED 完成
+		fail_connection(conn, cqe->res < 0 ? strerror(-cqe->res)
+		                                   : "Only part of data was sent");
+	}
+	if (!conn.inflight.empty())
+		return;
+	if (conn.closing) {
+		try_release(token);
+		return;
+	}
+	if (conn.client->is_connected()) {
+		if (!conn.outbox.empty())
+			submit_sends(token, conn);
+		return;
+	}
+	close_client(token);
+}
+
+ssize_t UringReactor::queue_send(const std::shared_ptr<SendQueue>& queue,
+                                 uint64_t token, const iovec* iov,
+                                 size_t len) {
+	std::string data;
+	for (size_t i = 0; i < len; ++i) {
+		data.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+	}
+	auto size = static_cast<ssize_t>(data.size());
+
+	std::lock_guard<std::mutex> lock(queue->mtx);
+	if (!queue->owner) {
+		errno = ECONNRESET;
+		return -1;
+	}
+	bool need_wakeup = queue->sends.empty();
+	queue->sends.emplace_back(token, std::move(data));
+	// 已有待处理的数据时reactor必然会被唤醒 无需再次写eventfd
+	if (need_wakeup && !queue->owner->is_in_loop_thread()) {
+		queue->owner->wakeup();
+	}
+	return size;
+}
+
+void UringReactor::flush_sends() {
+	std::vector<std::pair<uint64_t, std::string>> sends;
+	{
+		std::lock_guard<std::mutex> lock(send_queue_->mtx);
+		sends.swap(send_queue_->sends);
+	}
+	if (sends.empty())
+		return;
+
+	std::vector<uint64_t> touched;
+	for (auto& [token, data] : sends) {
+		auto iter = conns_.find(token);
+		if (iter == conns_.end() || iter->second.closing)
+			continue;
+		if (iter->second.outbox.empty())
+			touched.push_back(token);
+		iter->second.outbox.push_back(std::move(data));
+	}
+	for (auto token : touched) {
+		auto& conn = conns_[token];
+		if (conn.inflight.empty())
+			submit_sends(token, conn);
+	}
+}
+
+void UringReactor::submit_sends(uint64_t token, Connection& conn) {
+	size_t count = std::min<size_t>(conn.outbox.size(), MAX_SEND_CHAIN);
+	// 一条链必须在同一次提交中 空间不足时先提交已有的提交项
+	if (ring_.sq_space_left() < count) {
+		ring_.submit();
+		count = std::min<size_t>(count, ring_.sq_space_left());
+		if (count == 0) {
+			fail_connection(conn, "submission queue is full");
+			close_client(token);
+			return;
+		}
+	}
+
+	int fd = conn.client->get_filedesc().get();
+	for (size_t i = 0; i < count; ++i) {
+		conn.inflight.push_back(std::move(conn.outbox.front()));
+		conn.outbox.pop_front();
+		const std::string& data = conn.inflight.back();
+
+		io_uring_sqe* sqe = ring_.get_sqe();
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = fd;
+		sqe->addr = reinterpret_cast<uint64_t>(data.data());
+		sqe->len = data.size();
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		if (i + 1 < count) {
+			sqe->flags = IOSQE_IO_LINK; // 保证同一连接的数据按顺序发送
+		}
+		sqe->user_data = make_user_data(OP_SEND, token);
+	}
+}
+
+void UringReactor::fail_connection(Connection& conn,
+                                   const std::string& reason) {
+	conn.outbox.clear();
+	if (!conn.closing && conn.client->is_connected()) {
+		conn.client->handle_disconnected(reason);
+	}
+}
+
+void UringReactor::try_release(uint64_t token) {
+	auto iter = conns_.find(token);
+	if (iter == conns_.end())
+		return;
+	const Connection& conn = iter->second;
+	if (conn.closing && !conn.recv_armed && conn.inflight.empty()) {
+		conns_.erase(iter);
+	}
+}
+
+void UringReactor::on_client_removed(const Client::ptr& client,
+                                     ConnectionTable::handle_t handle) {
+	auto iter = conns_.find(handle);
+	if (iter == conns_.end() || iter->second.closing)
+		return;
+	Connection& conn = iter->second;
+	conn.closing = true;
+	conn.outbox.clear();
+	// 关闭前先shutdown 使仍在等待的recv/send尽快完成
+	::shutdown(client->get_filedesc().get(), SHUT_RDWR);
+	try_release(handle);
+}
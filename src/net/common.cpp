@@ -10,6 +10,7 @@
 #include <arpa/inet.h>
 #include <cstddef>
 #include <net/if.h>
+#include <poll.h>
 #include <string>
 #include <sys/ioctl.h>
 #include <sys/select.h>
@@ -61,4 +62,19 @@ Result wait_for_write(const FileDescriptor& file_desc, uint32_t timeout_sec) {
 		return Result::SUCCESS;
 }
 
+Result wait_for_read(const FileDescriptor& file_desc,
+                     std::chrono::milliseconds timeout) {
+	struct pollfd pfd;
+	pfd.fd = file_desc.get();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	const auto ret = poll(&pfd, 1, static_cast<int>(timeout.count()));
+	if (ret == -1)
+		return Result::FAILURE;
+	else if (ret == 0)
+		return Result::TIMEOUT;
+	else
+		return Result::SUCCESS;
+}
+
 } // namespace fd_wait
@@ -0,0 +1,209 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/07 09:58:33
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "rpc/LoadBalancer.h"
+#include "base/Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+LoadBalancer::ptr LoadBalancer::create(Policy policy) {
+	switch (policy) {
+	case Policy::P2C_OUTSTANDING:
+		return std::make_unique<P2CBalancer>(false);
+	case Policy::P2C_LATENCY:
+		return std::make_unique<P2CBalancer>(true);
+	case Policy::CONSISTENT_HASH:
+		return std::make_unique<ConsistentHashBalancer>();
+	case Policy::ROUND_ROBIN:
+	default:
+		return std::make_unique<RoundRobinBalancer>();
+	}
+}
+
+LoadBalancer::Policy LoadBalancer::policy_from_string(const std::string& name) {
+	if (name == "p2c_outstanding" || name == "p2c") {
+		return Policy::P2C_OUTSTANDING;
+	}
+	if (name == "p2c_latency") {
+		return Policy::P2C_LATENCY;
+	}
+	if (name == "consistent_hash") {
+		return Policy::CONSISTENT_HASH;
+	}
+	if (name != "round_robin") {
+		WARNING_LOG << "unknown load balance policy: " << name
+		            << ", use round_robin";
+	}
+	return Policy::ROUND_ROBIN;
+}
+
+bool LoadBalancer::weighted(const Endpoints& endpoints) {
+	if (endpoints.empty())
+		return false;
+	for (const auto* endpoint : endpoints) {
+		if (endpoint->weight() <= 0)
+			return false;
+	}
+	return true;
+}
+
+void RoundRobinBalancer::update(const Endpoints& endpoints) {
+	schedule_.clear();
+	if (!weighted(endpoints))
+		return;
+	double max = 0;
+	for (const auto* endpoint : endpoints)
+		max = std::max(max, endpoint->effective_weight());
+	std::vector<int64_t> weights;
+	int64_t total = 0;
+	for (const auto* endpoint : endpoints) {
+		auto slots = std::llround(endpoint->effective_weight() / max * MAX_SLOTS);
+		weights.push_back(std::max<int64_t>(slots, 1));
+		total += weights.back();
+	}
+	if (std::all_of(weights.begin(), weights.end(),
+	                [&](int64_t w) { return w == weights.front(); }))
+		return; // 权重相同 与依次轮流一样
+	// 每一步所有提供者加上自身权重 选当前值最大的 再减去总权重
+	std::vector<int64_t> current(weights.size(), 0);
+	schedule_.reserve(total);
+	for (int64_t step = 0; step < total; ++step) {
+		size_t best = 0;
+		for (size_t i = 0; i < weights.size(); ++i) {
+			current[i] += weights[i];
+			if (current[i] > current[best])
+				best = i;
+		}
+		current[best] -= total;
+		schedule_.push_back(best);
+	}
+}
+
+size_t RoundRobinBalancer::select(const Endpoints& endpoints,
+                                  const std::string&) {
+	size_t n = endpoints.size();
+	size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+	if (!schedule_.empty()) {
+		start = schedule_[start % schedule_.size()];
+		if (start < n && endpoints[start]->is_connected())
+			return start;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		size_t index = (start + i) % n;
+		if (endpoints[index]->is_connected())
+			return index;
+	}
+	return npos;
+}
+
+void P2CBalancer::update(const Endpoints& endpoints) {
+	weighted_ = weighted(endpoints);
+}
+
+double P2CBalancer::load(const Endpoint& endpoint) const {
+	auto outstanding = static_cast<double>(endpoint.outstanding());
+	double load = outstanding;
+	if (by_latency_)
+		load = static_cast<double>(endpoint.latency().count()) * (outstanding + 1);
+	if (weighted_)
+		load /= endpoint.effective_weight();
+	return load;
+}
+
+size_t P2CBalancer::select(const Endpoints& endpoints, const std::string&) {
+	size_t n = endpoints.size();
+	if (n == 0)
+		return npos;
+	thread_local std::minstd_rand rng(std::random_device{}());
+	size_t a = rng() % n;
+	size_t b = n > 1 ? (a + 1 + rng() % (n - 1)) % n : a; // 与a不同
+	bool a_ok = endpoints[a]->is_connected();
+	bool b_ok = endpoints[b]->is_connected();
+	if (a_ok && b_ok) {
+		double load_a = load(*endpoints[a]);
+		double load_b = load(*endpoints[b]);
+		if (load_a != load_b || !weighted_)
+			return load_b < load_a ? b : a;
+		// 负载相同(例如都空闲)时按权重随机 使空闲时的流量也与权重成正比
+		double weight_a = endpoints[a]->effective_weight();
+		double weight_b = endpoints[b]->effective_weight();
+		return std::uniform_real_distribution<double>(0, weight_a + weight_b)(rng) <
+		               weight_a
+		           ? a
+		           : b;
+	}
+	if (a_ok)
+		return a;
+	if (b_ok)
+		return b;
+	// 两个都不可用 从a开始找第一个已连接的
+	for (size_t i = 1; i < n; ++i) {
+		size_t index = (a + i) % n;
+		if (endpoints[index]->is_connected())
+			return index;
+	}
+	return npos;
+}
+
+uint64_t ConsistentHashBalancer::hash(const std::string& key) {
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned char c : key) {
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	// FNV-1a 对只有末尾不同的短键分布较差 再做一次murmur3的fmix64
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+void ConsistentHashBalancer::update(const Endpoints& endpoints) {
+	ring_.clear();
+	ring_.reserve(endpoints.size() * VIRTUAL_NODES);
+	bool by_weight = weighted(endpoints);
+	double mean = 0;
+	if (by_weight) {
+		for (const auto* endpoint : endpoints)
+			mean += endpoint->weight();
+		mean /= endpoints.size();
+	}
+	for (size_t i = 0; i < endpoints.size(); ++i) {
+		const auto& name = endpoints[i]->endpoint();
+		size_t nodes = VIRTUAL_NODES;
+		if (by_weight) {
+			// 虚拟节点的名称与数目无关 权重变化时原有的虚拟节点位置不变
+			auto scaled = std::llround(VIRTUAL_NODES * endpoints[i]->weight() / mean);
+			nodes = std::clamp<size_t>(static_cast<size_t>(scaled),
+			                           VIRTUAL_NODES / 8, VIRTUAL_NODES * 8);
+		}
+		for (size_t v = 0; v < nodes; ++v) {
+			ring_.emplace_back(hash(name + "#" + std::to_string(v)), i);
+		}
+	}
+	std::sort(ring_.begin(), ring_.end());
+}
+
+size_t ConsistentHashBalancer::select(const Endpoints& endpoints,
+                                      const std::string& key) {
+	if (key.empty() || ring_.empty())
+		return fallback_.select(endpoints, key);
+	uint64_t h = hash(key);
+	auto it = std::lower_bound(ring_.begin(), ring_.end(),
+	                           std::make_pair(h, size_t(0)));
+	size_t pos = static_cast<size_t>(it - ring_.begin());
+	for (size_t i = 0; i < ring_.size(); ++i) {
+		size_t index = ring_[(pos + i) % ring_.size()].second;
+		if (index < endpoints.size() && endpoints[index]->is_connected())
+			return index;
+	}
+	return npos;
+}
@@ -0,0 +1,83 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/31 10:48:02
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+#include "rpc/MethodPool.h"
+
+MethodPool::MethodPool(std::string name, size_t threads, size_t queue_limit)
+    : name_(std::move(name))
+    , queue_limit_(queue_limit) {
+	if (threads == 0)
+		threads = 1;
+	for (size_t i = 0; i < threads; ++i) {
+		workers_.emplace_back([this]() { run(); });
+	}
+}
+
+MethodPool::~MethodPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		stop_ = true;
+	}
+	cond_.notify_all();
+	for (auto& worker : workers_) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+}
+
+bool MethodPool::try_execute(Lane lane, TaskType task, TaskType on_shed) {
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (stop_ ||
+		    (queue_limit_ > 0 && high_.size() + normal_.size() >= queue_limit_)) {
+			meter_.on_reject();
+			return false;
+		}
+		auto& queue = lane == Lane::HIGH ? high_ : normal_;
+		queue.push_back(
+		    Job{std::move(task), std::move(on_shed), QueueMeter::clock::now()});
+		meter_.on_enqueue();
+	}
+	cond_.notify_one();
+	return true;
+}
+
+QueueMeter::Stats MethodPool::stats() const {
+	QueueMeter::Stats stats;
+	stats.name = name_;
+	stats.threads = workers_.size();
+	stats.queue_limit = queue_limit_;
+	meter_.fill(stats);
+	return stats;
+}
+
+void MethodPool::run() {
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			cond_.wait(lock, [this]() {
+				return stop_ || !high_.empty() || !normal_.empty();
+			});
+			auto& queue = !high_.empty() ? high_ : normal_;
+			if (queue.empty())
+				return; // 已停止且没有剩余的请求
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+		meter_.on_dequeue(job.enqueued);
+		auto now = QueueMeter::clock::now();
+		if (codel_.should_drop(now - job.enqueued, now)) {
+			meter_.on_shed();
+			if (job.on_shed)
+				job.on_shed();
+			continue;
+		}
+		job.fn();
+	}
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/13 10:31:46
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "rpc/ProviderRecord.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+std::string ProviderRecord::encode() const {
+	std::ostringstream out;
+	out << endpoint << ";w=" << weight << ";c=" << cores << ";i=" << inflight
+	    << ";q=" << queued << ";p99=" << p99.count();
+	return out.str();
+}
+
+bool ProviderRecord::split_endpoint(const std::string& endpoint,
+                                    std::string& host, int& port) {
+	auto pos = endpoint.find(':');
+	if (pos == 0 || pos == std::string::npos)
+		return false;
+	const char* first = endpoint.data() + pos + 1;
+	const char* last = endpoint.data() + endpoint.size();
+	unsigned value = 0;
+	auto [ptr, ec] = std::from_chars(first, last, value);
+	if (ec != std::errc() || ptr != last || value == 0 || value > 65535)
+		return false;
+	host = endpoint.substr(0, pos);
+	port = static_cast<int>(value);
+	return true;
+}
+
+bool ProviderRecord::parse(const std::string& data, ProviderRecord& record) {
+	record = ProviderRecord{};
+	auto end = data.find(';');
+	record.endpoint = data.substr(0, end);
+	std::string host;
+	int port = 0;
+	if (!split_endpoint(record.endpoint, host, port))
+		return false;
+	while (end != std::string::npos) {
+		auto begin = end + 1;
+		end = data.find(';', begin);
+		auto item = data.substr(
+		    begin, end == std::string::npos ? std::string::npos : end - begin);
+		auto eq = item.find('=');
+		if (eq == std::string::npos)
+			continue;
+		auto key = item.substr(0, eq);
+		auto value = std::strtoull(item.c_str() + eq + 1, nullptr, 10);
+		if (key == "w") {
+			record.weight = static_cast<uint32_t>(value);
+		} else if (key == "c") {
+			record.cores = static_cast<uint32_t>(value);
+		} else if (key == "i") {
+			record.inflight = static_cast<uint32_t>(value);
+		} else if (key == "q") {
+			record.queued = static_cast<uint32_t>(value);
+		} else if (key == "p99") {
+			record.p99 = std::chrono::microseconds(value);
+		}
+	}
+	return true;
+}
+
+double ProviderRecord::effective_weight() const {
+	double base = capacity();
+	uint64_t load = uint64_t(inflight) + queued;
+	if (cores == 0 || load <= cores)
+		return base;
+	return std::max(base * cores / load, base / 16);
+}
+
+size_t LatencyHistogram::index(int64_t us) {
+	if (us < 8)
+		return us < 0 ? 0 : static_cast<size_t>(us);
+	auto value = static_cast<uint64_t>(us);
+	int exponent = std::bit_width(value) - 1; // 不小于3
+	size_t sub = (value >> (exponent - 2)) & 3;
+	return std::min(8 + size_t(exponent - 3) * 4 + sub, BUCKETS - 1);
+}
+
+int64_t LatencyHistogram::upper_bound(size_t index) {
+	if (index < 8)
+		return static_cast<int64_t>(index);
+	int exponent = static_cast<int>((index - 8) / 4) + 3;
+	int64_t sub = static_cast<int64_t>((index - 8) % 4);
+	return ((4 + sub + 1) << (exponent - 2)) - 1;
+}
+
+std::chrono::microseconds LatencyHistogram::take_percentile(double q) {
+	std::array<uint64_t, BUCKETS> counts;
+	uint64_t total = 0;
+	for (size_t i = 0; i < BUCKETS; ++i) {
+		counts[i] = buckets_[i].exchange(0, std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (total == 0)
+		return std::chrono::microseconds(0);
+	auto target = static_cast<uint64_t>(std::ceil(q * total));
+	target = std::clamp<uint64_t>(target, 1, total);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKETS; ++i) {
+		seen += counts[i];
+		if (seen >= target)
+			return std::chrono::microseconds(upper_bound(i));
+	}
+	return std::chrono::microseconds(upper_bound(BUCKETS - 1));
+}
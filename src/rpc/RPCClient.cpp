@@ -8,145 +8,232 @@
 
 #include "rpc/RPCClient.h"
 #include "base/Logger.h"
-#include "net/common.h"
-#include <arpa/inet.h>
-#include <fcntl.h>
-#include <iostream>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <random>
+#include "base/WorkStealingPool.hpp"
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
-RPCClient::RPCClient(ini::IniFile ini_file) {
+namespace {
+/**
+ * @brief 连接新提供者的线程 进程内的客户端共用
+ * 目录的后台线程只提交任务 不等待连接建立
+ */
+putils::WorkStealingPool& connector_pool() {
+	// 先于线程池构造 退出时晚于线程池析构 剩余的连接任务仍可以使用定时器
+	TimerService::shared();
+	static putils::WorkStealingPool pool(2);
+	return pool;
+}
+} // namespace
+
+RPCClient::RPCClient(ini::IniFile ini_file)
+    : RPCClient(ini_file,
+                ServiceDirectory::shared(Registry::options_from_ini(ini_file))) {}
+
+RPCClient::RPCClient(ini::IniFile ini_file, ServiceDirectory& directory)
+    : directory_(directory) {
 	service_name_ = ini_file["rpc_client"]["provider_service_name"].as<std::string>();
-	zkclient_.start(); // 连接注册中心
-	if(zkclient_.check_znode_exists(service_name_.c_str())){
-		auto ret = zkclient_.get_children(service_name_.c_str());
-		INFO_LOG << ret.size();
-		service_info.swap(ret);
-	}
-	update_ip_info();
-	
+	if (service_name_.find_first_not_of('/') == std::string::npos) {
+		throw std::runtime_error(
+		    "[rpc_client] provider_service_name is not configured");
+	}
+	// 心跳间隔(毫秒) 未配置时不发送心跳
+	if (ini_file["rpc_client"].count("heartbeat_interval")) {
+		heartbeat_.interval = std::chrono::milliseconds(
+		    ini_file["rpc_client"]["heartbeat_interval"].as<int>());
+	}
+	if (ini_file["rpc_client"].count("heartbeat_max_missed")) {
+		heartbeat_.max_missed =
+		    ini_file["rpc_client"]["heartbeat_max_missed"].as<int>();
+	}
+	// 调用的默认期限(毫秒) 未配置时不限制
+	if (ini_file["rpc_client"].count("call_timeout")) {
+		default_timeout_ = std::chrono::milliseconds(
+		    ini_file["rpc_client"]["call_timeout"].as<int>());
+	}
+	if (ini_file["rpc_client"].count("load_balance")) {
+		policy_ = LoadBalancer::policy_from_string(
+		    ini_file["rpc_client"]["load_balance"].as<std::string>());
+	}
+	{
+		std::lock_guard<std::mutex> lock(update_mtx_);
+		publish({});
+	}
+	// 立即以当前的提供者调用一次 之后在目录的后台线程中推送变化
+	watch_id_ = directory_.watch(
+	    service_name_, [this](const ServiceDirectory::Snapshot& snapshot) {
+		    update_endpoints(*snapshot);
+	    });
 }
 
-int RPCClient::initialize_socket() {
-	sock_fd_.set(socket(AF_INET, SOCK_STREAM, 0));
-	const bool socket_failed = (sock_fd_.get() == -1);
-	if (socket_failed) {
-		throw std::runtime_error(strerror(errno));
-	}
-	// 非阻塞模式
-	int old_socket_flag = fcntl(sock_fd_.get(), F_GETFL, 0);
-	int new_socket_flag = old_socket_flag | O_NONBLOCK;
-	auto ret = fcntl(sock_fd_.get(), F_SETFL, new_socket_flag);
-	if (ret == -1)
-		throw std::runtime_error(strerror(errno));
-	return old_socket_flag;
+RPCClient::~RPCClient() {
+	directory_.unwatch(watch_id_); // 等待正在进行的更新结束
+	std::shared_ptr<Pool> pool;
+	{
+		std::lock_guard<std::mutex> lock(update_mtx_);
+		pool = pool_.load(std::memory_order_acquire);
+		publish({});
+	}
+	pool.reset(); // 不持有锁等待读取线程退出
 }
 
-void RPCClient::set_address(const std::string& address, int port) {
-	auto ret = inet_aton(address.c_str(), &server_.sin_addr);
-	// 未解析成功 尝试从字符串中进行解析
-	if (!ret) {
-		struct hostent* host;
-		struct in_addr** addr_list;
-		if ((host = gethostbyname(address.c_str())) == nullptr) {
-			throw std::runtime_error("Failed to resolve hostname");
-		}
-		addr_list = (struct in_addr**)host->h_addr_list;
-		server_.sin_addr = *addr_list[0];
+void RPCClient::publish(std::vector<RPCConnection::ptr> connections) {
+	auto pool = std::make_shared<Pool>();
+	pool->connections = std::move(connections);
+	for (auto& connection : pool->connections) {
+		pool->endpoints.push_back(connection.get());
 	}
-	server_.sin_family = AF_INET; // ipv4 协议
-	server_.sin_port = htons(port);
+	pool->balancer = LoadBalancer::create(policy_);
+	pool->balancer->update(pool->endpoints);
+	pool_.store(std::move(pool), std::memory_order_release);
 }
 
-ResultType RPCClient::connect_server() {
-	int fdopt = 0;
-	try {
-		fdopt = initialize_socket();
-		set_address(ip_, port_);
-	} catch (const std::runtime_error& error) {
-		
-		return ResultType::FAILURE(error.what());
-	}
-	client_ = std::make_shared<Client>(sock_fd_.get());
-	session_ = std::make_shared<RPCSession>(client_);
-	while (true) {
-		// 连接服务器
-		auto connect_result = connect(
-		    sock_fd_.get(), (struct sockaddr*)&server_, sizeof(server_));
-		if (connect_result == 0) {
-			INFO_LOG << "connect to server[" << ip_ << ":" << port_
-			         << "] successfully.";
-			is_connected_ = true;
-			is_closed_ = false;
-			client_->set_connected(true);
-			fcntl(sock_fd_.get(), F_SETFL, fdopt);
-			return ResultType::SUCCESS();
-		} else if (connect_result == -1) {
-			if (errno == EINTR) {
-				INFO_LOG << "connect to server[" << ip_ << ":" << port_
-				         << "] interruptted by signal, try again.";
+void RPCClient::update_endpoints(const ServiceDirectory::Endpoints& endpoints) {
+	std::vector<RPCConnection::ptr> added;
+	std::shared_ptr<Pool> old;
+	bool started = false;
+	{
+		std::lock_guard<std::mutex> lock(update_mtx_);
+		old = pool_.load(std::memory_order_acquire);
+		std::unordered_map<std::string, RPCConnection::ptr> existing;
+		for (auto& connection : old->connections) {
+			existing.emplace(connection->endpoint(), connection);
+		}
+		std::vector<RPCConnection::ptr> connections;
+		std::unordered_set<std::string> seen;
+		for (const auto& data : endpoints) {
+			// 记录以ip:port开头 负载变化时地址不变 沿用原来的连接
+			ProviderRecord record;
+			if (!ProviderRecord::parse(data, record)) {
+				WARNING_LOG << "invalid provider record: " << data;
+				continue;
+			}
+			const auto& endpoint = record.endpoint;
+			if (!seen.insert(endpoint).second)
+				continue;
+			auto it = existing.find(endpoint);
+			if (it != existing.end()) {
+				it->second->set_record(record);
+				connections.push_back(std::move(it->second));
+				existing.erase(it);
 				continue;
-			} else if (errno == EINPROGRESS) {
-				// 连接正在重试中
-				INFO_LOG << "connect to server[" << ip_ << ":" << port_
-				         << "]  try again....";
-				break;
-			} else {
-				return ResultType::FAILURE(strerror(errno));
 			}
+			std::string host;
+			int port = 0;
+			ProviderRecord::split_endpoint(endpoint, host, port);
+			auto connection = std::make_shared<RPCConnection>(host, port);
+			connection->set_heartbeat(heartbeat_);
+			connection->set_record(record);
+			connections.push_back(connection);
+			added.push_back(std::move(connection));
+			INFO_LOG << "add provider: " << endpoint;
+		}
+		for (auto& [endpoint, connection] : existing) {
+			INFO_LOG << "remove provider: " << endpoint;
 		}
+		publish(std::move(connections));
+		started = started_;
 	}
-	// 继续使用select 进行检测 检测可写事件
-	auto ret = fd_wait::wait_for_write(sock_fd_.get());
-	if (ret != fd_wait::Result::SUCCESS) {
+	// 新的提供者在连接成功之前不会被选中
+	// 任务只持有连接 期间被移除时由任务释放 客户端析构时不需要等待
+	if (started) {
+		for (auto& connection : added) {
+			connector_pool().execute([connection = std::move(connection)]() {
+				auto ret = connection->connect();
+				if (!ret.is_successful()) {
+					WARNING_LOG << "connect to provider " << connection->endpoint()
+					            << " failed: " << ret.message();
+				}
+			});
+		}
+	}
+	// 进行中的调用仍持有被移除的连接 最后一个结束时关闭
+	old.reset();
+}
 
-		ERROR_LOG << "connect to server[" << ip_ << ":" << port_ << "] error.";
-		return ResultType::FAILURE(strerror(errno));
-	}
-	int err;
-	socklen_t len = static_cast<socklen_t>(sizeof err);
-	if (::getsockopt(sock_fd_.get(), SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
-		return ResultType::FAILURE(strerror(errno));
-	}
-	if (err == 0) {
-		INFO_LOG << "[select]connect to server[" << ip_ << ":" << port_
-		         << "] successfully.";
-		is_connected_ = true;
-		is_closed_ = false;
-		client_->set_connected(true);
-		fcntl(sock_fd_.get(), F_SETFL, fdopt);
-		return ResultType::SUCCESS();
-	} else {
-		ERROR_LOG << "connect to server[" << ip_ << ":" << port_ << "] error.";
-		return ResultType::FAILURE(strerror(errno));
+ResultType RPCClient::connect_server() {
+	{
+		std::lock_guard<std::mutex> lock(update_mtx_);
+		started_ = true;
+	}
+	auto pool = pool_.load(std::memory_order_acquire);
+	if (pool->connections.empty())
+		return ResultType::FAILURE("no provider of " + service_name_);
+	bool connected = false;
+	ResultType last_error = ResultType::SUCCESS();
+	for (auto& connection : pool->connections) {
+		auto ret = connection->connect();
+		if (ret.is_successful()) {
+			connected = true;
+		} else {
+			last_error = ret;
+		}
 	}
+	return connected ? ResultType::SUCCESS() : last_error;
 }
 
-RPCClient::~RPCClient() {
-	if (is_closed_) {
-		return;
+void RPCClient::set_heartbeat(const HeartbeatMonitor::Options& options) {
+	std::lock_guard<std::mutex> lock(update_mtx_);
+	heartbeat_ = options;
+	for (auto& connection : pool_.load()->connections) {
+		connection->set_heartbeat(options);
+	}
+}
+
+void RPCClient::set_load_balance(LoadBalancer::Policy policy) {
+	std::lock_guard<std::mutex> lock(update_mtx_);
+	policy_ = policy;
+	publish(pool_.load(std::memory_order_acquire)->connections);
+}
+
+std::chrono::microseconds RPCClient::rtt() const {
+	auto pool = pool_.load(std::memory_order_acquire);
+	std::chrono::microseconds total{0};
+	int64_t samples = 0;
+	for (const auto& connection : pool->connections) {
+		auto rtt = connection->rtt();
+		if (connection->is_connected() && rtt.count() > 0) {
+			total += rtt;
+			++samples;
+		}
+	}
+	return samples ? total / samples : total;
+}
+
+bool RPCClient::is_connected() const {
+	auto pool = pool_.load(std::memory_order_acquire);
+	for (const auto& connection : pool->connections) {
+		if (connection->is_connected())
+			return true;
+	}
+	return false;
+}
+
+std::vector<RPCConnection::Stats> RPCClient::endpoint_stats() const {
+	auto pool = pool_.load(std::memory_order_acquire);
+	std::vector<RPCConnection::Stats> stats;
+	stats.reserve(pool->connections.size());
+	for (const auto& connection : pool->connections) {
+		stats.push_back(connection->stats());
 	}
-	auto ret = ::close(sock_fd_.get());
-	is_closed_ = true;
+	return stats;
 }
 
-void RPCClient::update_ip_info(){
-	static std::random_device rd;
-	if(service_info.empty()) return;
-	std::uniform_int_distribution<> dist(0,service_info.size()-1);
-	// 获取一个随机数
-	auto index = dist(rd);
-	// 获取到接口的信息
-	std::string info = service_info[index];
-	auto data = zkclient_.get_data((service_name_+"/"+info).c_str());
-	auto pos = data.find(":");
-	if(pos == std::string::npos){
-		WARNING_LOG << "incoreect service informations";
+RPCConnection::ptr RPCClient::select(const std::string& key) {
+	auto pool = pool_.load(std::memory_order_acquire);
+	size_t index = pool->balancer->select(pool->endpoints, key);
+	if (index == LoadBalancer::npos)
+		return nullptr;
+	return pool->connections[index];
+}
+
+void RPCClient::send_request(Serializer s, std::chrono::milliseconds timeout,
+                             const std::string& key, ResponseHandler handler) {
+	auto connection = select(key);
+	if (!connection) {
+		handler(nullptr, RPC_CLOSED);
 		return;
 	}
-	ip_ = data.substr(0,pos);
-	port_ = std::stoi(data.substr(pos+1));
-	INFO_LOG << "update ip: " << ip_ << ", port: " << port_;
-}
\ No newline at end of file
+	connection->send_request(std::move(s), timeout, std::move(handler));
+}
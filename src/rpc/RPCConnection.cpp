@@ -0,0 +1,459 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/07 10:40:18
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "rpc/RPCConnection.h"
+#include "base/Logger.h"
+#include "net/common.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+RPCConnection::RPCConnection(std::string ip, int port)
+    : ip_(std::move(ip))
+    , port_(port)
+    , endpoint_(ip_ + ":" + std::to_string(port)) {
+	memset(&server_, 0, sizeof(server_));
+}
+
+RPCConnection::~RPCConnection() {
+	// 等待正在执行的心跳结束 之后不会再访问连接
+	if (heartbeat_timer_ != 0) {
+		TimerService::shared().cancel(heartbeat_timer_);
+	}
+	stop_reader();
+	stop_writer();
+	if (is_closed_) {
+		return;
+	}
+	::close(sock_fd_.get());
+	is_closed_ = true;
+}
+
+RPCConnection::Stats RPCConnection::stats() const {
+	Stats stats;
+	stats.endpoint = endpoint_;
+	stats.connected = is_connected_;
+	stats.outstanding = outstanding();
+	stats.latency = latency();
+	stats.rtt = rtt();
+	stats.calls = calls_.load(std::memory_order_relaxed);
+	stats.failures = failures_.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(record_mtx_);
+	stats.record = record_;
+	return stats;
+}
+
+void RPCConnection::set_record(const ProviderRecord& record) {
+	std::lock_guard<std::mutex> lock(record_mtx_);
+	record_ = record;
+	weight_.store(record.capacity(), std::memory_order_relaxed);
+	effective_weight_.store(record.effective_weight(), std::memory_order_relaxed);
+}
+
+int RPCConnection::initialize_socket() {
+	sock_fd_.set(socket(AF_INET, SOCK_STREAM, 0));
+	const bool socket_failed = (sock_fd_.get() == -1);
+	if (socket_failed) {
+		throw std::runtime_error(strerror(errno));
+	}
+	// 关闭Nagle算法 否则请求未被确认时 之后的心跳等小包会被推迟发送
+	int nodelay = 1;
+	setsockopt(sock_fd_.get(), IPPROTO_TCP, TCP_NODELAY, &nodelay,
+	           sizeof(nodelay));
+	// 非阻塞模式
+	int old_socket_flag = fcntl(sock_fd_.get(), F_GETFL, 0);
+	int new_socket_flag = old_socket_flag | O_NONBLOCK;
+	auto ret = fcntl(sock_fd_.get(), F_SETFL, new_socket_flag);
+	if (ret == -1)
+		throw std::runtime_error(strerror(errno));
+	return old_socket_flag;
+}
+
+void RPCConnection::set_address(const std::string& address, int port) {
+	auto ret = inet_aton(address.c_str(), &server_.sin_addr);
+	// 未解析成功 尝试从字符串中进行解析
+	if (!ret) {
+		struct hostent* host;
+		struct in_addr** addr_list;
+		if ((host = gethostbyname(address.c_str())) == nullptr) {
+			throw std::runtime_error("Failed to resolve hostname");
+		}
+		addr_list = (struct in_addr**)host->h_addr_list;
+		server_.sin_addr = *addr_list[0];
+	}
+	server_.sin_family = AF_INET; // ipv4 协议
+	server_.sin_port = htons(port);
+}
+
+ResultType RPCConnection::connect() {
+	std::lock_guard<std::mutex> lock(connect_mtx_);
+	if (is_connected_)
+		return ResultType::SUCCESS();
+	// 重新连接时结束旧连接的心跳与读取线程
+	if (heartbeat_timer_ != 0) {
+		TimerService::shared().cancel(heartbeat_timer_.exchange(0));
+	}
+	stop_reader();
+	stop_writer();
+	if (!is_closed_.exchange(true)) {
+		::close(sock_fd_.get());
+	}
+	int fdopt = 0;
+	try {
+		fdopt = initialize_socket();
+		set_address(ip_, port_);
+	} catch (const std::runtime_error& error) {
+		return ResultType::FAILURE(error.what());
+	}
+	is_closed_ = false;
+	client_ = std::make_shared<Client>(sock_fd_.get());
+	session_ = std::make_shared<RPCSession>(client_);
+	while (true) {
+		// 连接服务器
+		auto connect_result = ::connect(
+		    sock_fd_.get(), (struct sockaddr*)&server_, sizeof(server_));
+		if (connect_result == 0) {
+			INFO_LOG << "connect to server[" << endpoint_ << "] successfully.";
+			on_connected(fdopt);
+			return ResultType::SUCCESS();
+		} else if (connect_result == -1) {
+			if (errno == EINTR) {
+				INFO_LOG << "connect to server[" << endpoint_
+				         << "] interruptted by signal, try again.";
+				continue;
+			} else if (errno == EINPROGRESS) {
+				// 连接正在重试中
+				INFO_LOG << "connect to server[" << endpoint_ << "]  try again....";
+				break;
+			} else {
+				return ResultType::FAILURE(strerror(errno));
+			}
+		}
+	}
+	// 继续使用select 进行检测 检测可写事件
+	auto ret = fd_wait::wait_for_write(sock_fd_.get());
+	if (ret != fd_wait::Result::SUCCESS) {
+		ERROR_LOG << "connect to server[" << endpoint_ << "] error.";
+		return ResultType::FAILURE(strerror(errno));
+	}
+	int err;
+	socklen_t len = static_cast<socklen_t>(sizeof err);
+	if (::getsockopt(sock_fd_.get(), SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+		return ResultType::FAILURE(strerror(errno));
+	}
+	if (err == 0) {
+		INFO_LOG << "[select]connect to server[" << endpoint_
+		         << "] successfully.";
+		on_connected(fdopt);
+		return ResultType::SUCCESS();
+	} else {
+		ERROR_LOG << "connect to server[" << endpoint_ << "] error.";
+		return ResultType::FAILURE(strerror(err));
+	}
+}
+
+void RPCConnection::on_connected(int fdopt) {
+	is_connected_ = true;
+	client_->set_connected(true);
+	fcntl(sock_fd_.get(), F_SETFL, fdopt);
+	start_reader();
+	start_writer();
+	start_heartbeat();
+}
+
+void RPCConnection::start_heartbeat() {
+	if (!heartbeat_.enabled())
+		return;
+	heartbeat_.reset();
+	heartbeat_timer_ = TimerService::shared().run_every(
+	    heartbeat_.options().interval, [this]() { send_heartbeat(); });
+}
+
+Protocol::ptr RPCConnection::recv_frame() {
+	auto proto = session_->recvProtocol();
+	if (!proto)
+		return nullptr;
+	auto now = HeartbeatMonitor::clock::now();
+	if (proto->getMsgType() == Protocol::MsgType::HEARTBEAT_PACKET) {
+		heartbeat_.on_reply(proto->getSequenceId(), now);
+	} else {
+		heartbeat_.on_activity();
+	}
+	return proto;
+}
+
+void RPCConnection::send_heartbeat() {
+	if (!is_connected_)
+		return;
+	uint32_t seq = 0;
+	auto now = HeartbeatMonitor::clock::now();
+	if (heartbeat_.on_timer(now, seq) == HeartbeatMonitor::Action::EXPIRED) {
+		expire_connection("heartbeat timeout");
+		return;
+	}
+	// 定时器线程由整个进程共用 写满的连接不能阻塞其他定时器
+	auto proto = Protocol::Create(Protocol::MsgType::HEARTBEAT_PACKET, "", seq);
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		if (!writing_ || heartbeat_queued_)
+			return;
+		heartbeat_queued_ = true;
+		output_.push_back(std::move(proto));
+	}
+	output_cond_.notify_one();
+}
+
+void RPCConnection::start_reader() {
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx_);
+		accepting_ = true;
+	}
+	reader_ = std::thread([this]() { read_loop(); });
+}
+
+void RPCConnection::stop_reader() {
+	if (!reader_.joinable())
+		return;
+	if (in_reader_thread()) {
+		reader_.detach(); // 在读取线程恢复的协程中析构 不能等待自己
+		return;
+	}
+	::shutdown(sock_fd_.get(), SHUT_RDWR);
+	reader_.join();
+}
+
+void RPCConnection::start_writer() {
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		writing_ = true;
+	}
+	writer_ = std::thread([this]() { write_loop(); });
+}
+
+void RPCConnection::stop_writer() {
+	if (!writer_.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		writing_ = false;
+		heartbeat_queued_ = false;
+		output_.clear();
+	}
+	output_cond_.notify_one();
+	::shutdown(sock_fd_.get(), SHUT_RDWR); // 唤醒阻塞在写上的写线程
+	writer_.join();
+}
+
+bool RPCConnection::enqueue(Protocol::ptr proto) {
+	{
+		std::lock_guard<std::mutex> lock(output_mtx_);
+		if (!writing_ || !is_connected_)
+			return false;
+		output_.push_back(std::move(proto));
+	}
+	output_cond_.notify_one();
+	return true;
+}
+
+void RPCConnection::write_loop() {
+	std::vector<Protocol::ptr> batch;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(output_mtx_);
+			output_cond_.wait(
+			    lock, [this]() { return !output_.empty() || !writing_; });
+			if (!writing_)
+				return;
+			batch.swap(output_);
+			heartbeat_queued_ = false;
+		}
+		{
+			// 排队期间已经超时的请求不再发送
+			std::lock_guard<std::mutex> lock(pending_mtx_);
+			std::erase_if(batch, [this](const Protocol::ptr& proto) {
+				return proto->getMsgType() ==
+				           Protocol::MsgType::RPC_METHOD_REQUEST &&
+				       pending_.count(proto->getSequenceId()) == 0;
+			});
+		}
+		if (batch.empty())
+			continue;
+		ssize_t ret = session_->sendProtocols(batch);
+		batch.clear();
+		if (ret <= 0) {
+			// 读取线程随后以RPC_CLOSED结束所有调用
+			expire_connection("send failed");
+			return;
+		}
+	}
+}
+
+void RPCConnection::read_loop() {
+	while (true) {
+		auto proto = recv_frame();
+		if (!proto)
+			break;
+		if (proto->getMsgType() == Protocol::MsgType::HEARTBEAT_PACKET)
+			continue;
+		PendingCall call;
+		{
+			std::lock_guard<std::mutex> lock(pending_mtx_);
+			auto it = pending_.find(proto->getSequenceId());
+			if (it == pending_.end()) {
+				// 已经超时的调用 或者未知的序号
+				DEBUG_LOG << "discard response with sequence id "
+				          << proto->getSequenceId();
+				continue;
+			}
+			call = std::move(it->second);
+			pending_.erase(it);
+		}
+		if (call.timer != 0) {
+			TimerService::shared().cancel(call.timer);
+		}
+		complete(call, std::move(proto), RPC_SUCCESS);
+	}
+	expire_connection("server closed connection");
+	fail_pending();
+}
+
+void RPCConnection::fail_pending() {
+	std::unordered_map<uint32_t, PendingCall> pending;
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx_);
+		accepting_ = false;
+		pending.swap(pending_);
+	}
+	for (auto& [seq, call] : pending) {
+		if (call.timer != 0) {
+			TimerService::shared().cancel(call.timer);
+		}
+		complete(call, nullptr, RPC_CLOSED);
+	}
+}
+
+void RPCConnection::expire_call(uint32_t seq) {
+	PendingCall call;
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx_);
+		auto it = pending_.find(seq);
+		if (it == pending_.end())
+			return; // 响应恰好已经到达
+		call = std::move(it->second);
+		pending_.erase(it);
+	}
+	complete(call, nullptr, RPC_TIMEOUT);
+}
+
+void RPCConnection::complete(PendingCall& call, Protocol::ptr resp,
+                             RPCState state) {
+	if (state != RPC_CLOSED) {
+		// latency = 7/8 latency + 1/8 sample 与心跳的srtt相同
+		int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(
+		                     clock::now() - call.start)
+		                     .count();
+		sample = std::max<int64_t>(sample, 1);
+		int64_t old = latency_us_.load(std::memory_order_relaxed);
+		int64_t next;
+		do {
+			next = old == 0 ? sample : (7 * old + sample) / 8;
+		} while (!latency_us_.compare_exchange_weak(old, next,
+		                                            std::memory_order_relaxed));
+	}
+	if (state != RPC_SUCCESS)
+		failures_.fetch_add(1, std::memory_order_relaxed);
+	calls_.fetch_add(1, std::memory_order_relaxed);
+	outstanding_.fetch_sub(1, std::memory_order_relaxed);
+	call.handler(std::move(resp), state);
+}
+
+void RPCConnection::send_request(Serializer s, std::chrono::milliseconds timeout,
+                                 ResponseHandler handler) {
+	uint32_t seq = next_seq_.fetch_add(1, std::memory_order_relaxed);
+	bool queued = false;
+	{
+		// 先登记再发送 响应可能在发送返回之前到达
+		std::lock_guard<std::mutex> lock(pending_mtx_);
+		if (accepting_ && is_connected_) {
+			pending_.emplace(seq,
+			                 PendingCall{std::move(handler), 0, clock::now()});
+			outstanding_.fetch_add(1, std::memory_order_relaxed);
+			queued = true;
+		}
+	}
+	if (!queued) {
+		handler(nullptr, RPC_CLOSED); // 连接已失效
+		return;
+	}
+	auto data =
+	    Protocol::Create(Protocol::MsgType::RPC_METHOD_REQUEST, s.toString(), seq);
+	if (timeout.count() > 0) {
+		data->setTimeout(static_cast<uint32_t>(timeout.count()));
+		auto timer = TimerService::shared().run_after(
+		    timeout, [this, seq]() { expire_call(seq); });
+		bool completed = false;
+		{
+			std::lock_guard<std::mutex> lock(pending_mtx_);
+			auto it = pending_.find(seq);
+			if (it != pending_.end()) {
+				it->second.timer = timer;
+			} else {
+				completed = true;
+			}
+		}
+		if (completed) {
+			TimerService::shared().cancel(timer); // 调用已经结束 不能持有锁等待
+		}
+	}
+	// 只入队 对端不读取时不会阻塞调用方 期限由定时器保证
+	if (!enqueue(std::move(data))) {
+		// 读取线程随后以RPC_CLOSED结束包括本次在内的所有调用
+		expire_connection("request send failed");
+	}
+}
+
+Protocol::ptr RPCConnection::request(Serializer s,
+                                     std::chrono::milliseconds timeout,
+                                     RPCState& state) {
+	struct Waiter {
+		std::mutex mtx;
+		std::condition_variable cond;
+		bool done{false};
+		Protocol::ptr resp;
+		RPCState state{RPC_SUCCESS};
+	} waiter;
+	send_request(s, timeout, [&waiter](Protocol::ptr resp, RPCState state) {
+		std::lock_guard<std::mutex> lock(waiter.mtx);
+		waiter.resp = std::move(resp);
+		waiter.state = state;
+		waiter.done = true;
+		waiter.cond.notify_one();
+	});
+	std::unique_lock<std::mutex> lock(waiter.mtx);
+	waiter.cond.wait(lock, [&waiter]() { return waiter.done; });
+	state = waiter.state;
+	return waiter.resp;
+}
+
+void RPCConnection::expire_connection(const std::string& reason) {
+	if (!is_connected_.exchange(false))
+		return;
+	WARNING_LOG << "connection to server[" << endpoint_ << "] lost: " << reason;
+	if (heartbeat_timer_ != 0) {
+		TimerService::shared().cancel(heartbeat_timer_); // 在回调中取消自身
+	}
+	// 唤醒阻塞在读取上的调用 fd由析构函数关闭
+	client_->set_connected(false);
+	::shutdown(sock_fd_.get(), SHUT_RDWR);
+}
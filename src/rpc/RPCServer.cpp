@@ -18,26 +18,191 @@
 #include "rpc/RPCCommon.h"
 #include "rpc/RPCSession.h"
 #include "rpc/Serializer.h"
+#include <algorithm>
+#include <atomic>
 #include <bits/types/struct_iovec.h>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <exception>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 #include <zookeeper/zookeeper.h>
 
-static std::string PROVIDER_NAME = "rpc-provider";
+namespace {
+/**
+ * @brief 连接的strand作为协程的执行器 同一连接的协程不会并发执行
+ */
+class StrandExecutor : public rpc::Executor {
+public:
+	explicit StrandExecutor(Client::strand_t::ptr strand)
+	    : strand_(std::move(strand)) {}
+
+	void post(putils::SmallFunction<void()> fn) override {
+		strand_->post(std::move(fn));
+	}
+
+private:
+	Client::strand_t::ptr strand_;
+};
+
+/**
+ * @brief 作用域内正在执行的请求数加一 方法抛出异常时同样减回
+ */
+class InflightGuard {
+public:
+	explicit InflightGuard(std::atomic<uint32_t>& count)
+	    : count_(count) {
+		count_.fetch_add(1, std::memory_order_relaxed);
+	}
+	~InflightGuard() { count_.fetch_sub(1, std::memory_order_relaxed); }
+
+	InflightGuard(const InflightGuard&) = delete;
+	InflightGuard& operator=(const InflightGuard&) = delete;
+
+private:
+	std::atomic<uint32_t>& count_;
+};
+} // namespace
 
 RPCServer::RPCServer(ini::IniFile& file) {
 	port_ = file["rpc_server"]["port"].as<int>(); // 获取对应的地址
-	int max_client_nums = file["rpc_server"]["max_client_nums"].as<int>();
-	TcpServer::start(port_,
-	                 max_client_nums); // 绑定对应端口 并开始配置线程池的数目
-	// 连接zk
-	zkclient_.start();
+	// 内核监听队列长度 兼容旧配置中的max_client_nums
+	int listen_backlog = SOMAXCONN;
+	if (file["rpc_server"].count("listen_backlog")) {
+		listen_backlog = file["rpc_server"]["listen_backlog"].as<int>();
+	} else if (file["rpc_server"].count("max_client_nums")) {
+		listen_backlog = file["rpc_server"]["max_client_nums"].as<int>();
+	}
+	// reactor数目 未配置时取CPU核数
+	int reactor_nums = 0;
+	if (file["rpc_server"].count("reactor_nums")) {
+		reactor_nums = file["rpc_server"]["reactor_nums"].as<int>();
+	}
+	// IO后端 epoll 或 io_uring 未配置时使用epoll
+	if (file["rpc_server"].count("io_backend")) {
+		set_io_backend(io_backend_from_string(
+		    file["rpc_server"]["io_backend"].as<std::string>()));
+	}
+	// 空闲超时(秒) 未配置时不检测
+	if (file["rpc_server"].count("idle_timeout")) {
+		set_idle_timeout(file["rpc_server"]["idle_timeout"].as<int>());
+	}
+	// 输出队列的高低水位(字节) 超过高水位后暂停读取该连接
+	if (file["rpc_server"].count("output_high_watermark")) {
+		auto high = file["rpc_server"]["output_high_watermark"].as<int>();
+		auto low = high / 4;
+		if (file["rpc_server"].count("output_low_watermark")) {
+			low = file["rpc_server"]["output_low_watermark"].as<int>();
+		}
+		set_output_watermark(high, low);
+	}
+	// CoDel的目标排队时间与观察间隔(毫秒) 未配置时不丢弃
+	if (file["rpc_server"].count("codel_target")) {
+		CoDel::Options codel;
+		codel.target = std::chrono::milliseconds(
+		    file["rpc_server"]["codel_target"].as<int>());
+		if (file["rpc_server"].count("codel_interval")) {
+			codel.interval = std::chrono::milliseconds(
+			    file["rpc_server"]["codel_interval"].as<int>());
+		}
+		set_codel(codel);
+	}
+	// 发布的权重与负载的更新间隔(毫秒)
+	if (file["rpc_server"].count("weight")) {
+		weight_ = file["rpc_server"]["weight"].as<int>();
+	}
+	if (file["rpc_server"].count("load_report_interval")) {
+		load_report_interval_ = std::chrono::milliseconds(
+		    file["rpc_server"]["load_report_interval"].as<int>());
+	}
+	// 独立线程池 格式为 名称:线程数:排队上限 多个之间用逗号分隔
+	if (file["rpc_server"].count("method_pools")) {
+		std::istringstream pools(
+		    file["rpc_server"]["method_pools"].as<std::string>());
+		std::string item;
+		while (std::getline(pools, item, ',')) {
+			std::istringstream fields(item);
+			std::string name;
+			char sep;
+			size_t threads = 0;
+			size_t queue_limit = 0;
+			fields >> std::ws;
+			if (!std::getline(fields, name, ':') || !(fields >> threads) ||
+			    !(fields >> sep >> queue_limit) || sep != ':') {
+				throw std::runtime_error("invalid method_pools item: " + item);
+			}
+			add_method_pool(name, threads, queue_limit);
+		}
+	}
+	// 按协议头部中的内容长度分帧 支持客户端流水线发送请求
+	FrameDecoder::Options frame_options;
+	frame_options.header_length = Protocol::BASE_LENGTH;
+	frame_options.length_offset = Protocol::LENGTH_OFFSET;
+	set_frame_decoder(frame_options);
+	TcpServer::start(port_, listen_backlog,
+	                 reactor_nums); // 绑定对应端口 并开始配置线程池的数目
+	// 连接注册中心 由[registry]指定 未配置时为本机的zookeeper
+	registry_ = Registry::create(Registry::options_from_ini(file));
+}
+
+ResultType RPCServer::close() {
+	TimerService::TimerId report_timer = 0;
+	{
+		std::lock_guard<std::mutex> lock(report_mtx_);
+		std::swap(report_timer, report_timer_);
+	}
+	// 等待正在执行的回调结束 之后不再访问线程池 回调需要report_mtx_ 不能持有锁等待
+	if (report_timer != 0)
+		TimerService::shared().cancel(report_timer);
+	auto ret = TcpServer::close();
+	if (!ret.is_successful())
+		return ret;
+	// reactor已经停止 不再有新的请求
+	// 先执行完独立线程池中的请求(回复经由strand可能提交到共享线程池) 再排空共享线程池
+	// 这些任务会访问handlers_等成员 必须在成员析构之前完成
+	pools_.clear();
+	threadpool.reset();
+	return ret;
+}
+
+ResultType RPCServer::add_method_pool(const std::string& name, size_t threads,
+                                      size_t queue_limit) {
+	if (name == "shared" || pools_.count(name)) {
+		return ResultType::FAILURE("method pool already exists: " + name);
+	}
+	pools_[name] = std::make_unique<MethodPool>(name, threads, queue_limit);
+	pools_[name]->set_codel(codel_options_);
+	INFO_LOG << "add method pool " << name << " with " << threads
+	         << " threads, queue limit " << queue_limit;
+	return ResultType::SUCCESS();
 }
 
-ResultType RPCServer::close() { return TcpServer::close(); }
+void RPCServer::set_codel(const CoDel::Options& options) {
+	codel_options_ = options;
+	shared_codel_.set_options(options);
+	for (auto& [name, pool] : pools_) {
+		pool->set_codel(options);
+	}
+}
+
+std::vector<QueueMeter::Stats> RPCServer::pool_stats() const {
+	std::vector<QueueMeter::Stats> result;
+	QueueMeter::Stats shared;
+	shared.name = "shared";
+	shared.threads = threadpool ? threadpool->size() : 0;
+	shared_meter_.fill(shared);
+	result.push_back(shared);
+	for (const auto& [name, pool] : pools_) {
+		result.push_back(pool->stats());
+	}
+	return result;
+}
 RPCServer::~RPCServer() { close(); }
 
 Serializer RPCServer::call(const std::string& name, const std::string& arg) {
@@ -52,12 +217,35 @@ Serializer RPCServer::call(const std::string& name, const std::string& arg) {
 }
 
 Protocol::ptr RPCServer::handleMethodCall(Protocol::ptr proto) {
-	std::string func_name;
-	Serializer request(proto->getContent());
-	request >> func_name;
-	DEBUG_LOG << "call: [" << func_name << "],args:[" << request.toString()
-	          << "]";
-	Serializer rt = call(func_name, request.toString());
+	// 线程池的任务不捕获异常 方法或者参数解析抛出的异常在这里作为RPC_FAIL回复
+	// 否则异常离开工作线程 整个进程被std::terminate结束
+	auto failure = [](const std::string& msg) {
+		RPCResult<> val;
+		val.setCode(RPC_FAIL);
+		val.setMsg(msg);
+		Serializer serializer;
+		serializer << val;
+		serializer.reset();
+		return serializer;
+	};
+	Serializer rt;
+	try {
+		std::string func_name;
+		Serializer request(proto->getContent());
+		request >> func_name;
+		DEBUG_LOG << "call: [" << func_name << "],args:[" << request.toString()
+		          << "]";
+		InflightGuard inflight(inflight_);
+		rt = call(func_name, request.toString());
+	} catch (const std::exception& err) {
+		ERROR_LOG << "method call failed: " << err.what();
+		rt = failure(err.what());
+	} catch (...) {
+		ERROR_LOG << "method call failed: unknown exception";
+		rt = failure("unknown exception");
+	}
+	latency_.record(std::chrono::duration_cast<std::chrono::microseconds>(
+	    Protocol::clock::now() - proto->getArrival()));
 	Protocol::ptr resp =
 	    Protocol::Create(Protocol::MsgType::RPC_METHOD_RESPONSE, rt.toString(),
 	                     proto->getSequenceId());
@@ -66,42 +254,205 @@ Protocol::ptr RPCServer::handleMethodCall(Protocol::ptr proto) {
 
 void RPCServer::publish_client_msg(Client::ptr client, ByteArray::ptr bt) {
 	INFO_LOG << "handle from:" << client->get_ip() << " msg";
-	Protocol::ptr proto = std::make_shared<Protocol>();
-	RPCSession::ptr session_ = std::make_shared<RPCSession>(client);
-
-	// 读取协议
-	try {
-		proto->decode(bt);
-	} catch (std::exception& err) {
-		ERROR_LOG << err.what();
+	// 按帧分割后的数据 可能包含客户端流水线发来的多个请求
+	std::vector<Protocol::ptr> requests;
+	std::vector<Protocol::ptr> heartbeats;
+	auto now = Protocol::clock::now();
+	while (bt->getReadSize() >= Protocol::BASE_LENGTH) {
+		Protocol::ptr proto = std::make_shared<Protocol>();
+		// 读取协议
+		try {
+			proto->decode(bt);
+		} catch (std::exception& err) {
+			ERROR_LOG << err.what();
+			break;
+		}
+		if (proto->getMagic() != Protocol::MAGIC) {
+			ERROR_LOG << "There is a problem with this serialized data.";
+			break;
+		}
+		if (proto->getMsgType() == Protocol::MsgType::HEARTBEAT_PACKET) {
+			heartbeats.push_back(proto);
+		} else {
+			// 客户端剩余的期限从收到时开始计算 不含网络传输的时间
+			proto->setArrival(now);
+			if (proto->getTimeout() > 0) {
+				proto->setDeadline(now +
+				                   std::chrono::milliseconds(proto->getTimeout()));
+			}
+			requests.push_back(proto);
+		}
+	}
+	// 心跳原样返回(保留序号) 连接没有正在进行的写入时直接在reactor线程中回复
+	// 不经过线程池排队 否则线程池繁忙时测得的RTT包含排队时间 还可能被误判为连接失效
+	if (!heartbeats.empty() && client->is_connected()) {
+		send_protocols(client, std::move(heartbeats), "heartbeat send failed.");
+	}
+	if (requests.empty())
 		return;
+	dispatch_requests(client, std::move(requests));
+}
+
+void RPCServer::dispatch_requests(Client::ptr client,
+                                  std::vector<Protocol::ptr> requests) {
+	std::vector<Protocol::ptr> shared;
+	std::vector<Protocol::ptr> inline_requests;
+	std::vector<Protocol::ptr> rejected;
+	for (auto& proto : requests) {
+		if (proto->getMsgType() != Protocol::MsgType::RPC_METHOD_REQUEST) {
+			continue;
+		}
+		std::string func_name;
+		Serializer request(proto->getContent());
+		try {
+			request >> func_name;
+		} catch (...) {
+		}
+		auto coroutine = coroutine_handlers_.find(func_name);
+		if (coroutine != coroutine_handlers_.end()) {
+			start_coroutine(client, proto, coroutine->second(request.toString()));
+			continue;
+		}
+		auto it = policies_.find(func_name);
+		if (it == policies_.end() ||
+		    it->second.mode == ExecutionPolicy::Mode::SHARED) {
+			shared.push_back(std::move(proto)); // 未注册的方法也由线程池回复
+			continue;
+		}
+		const auto& policy = it->second;
+		if (policy.mode == ExecutionPolicy::Mode::INLINE) {
+			inline_requests.push_back(std::move(proto));
+			continue;
+		}
+		auto* pool = pools_.at(policy.pool).get();
+		auto accepted = pool->try_execute(
+		    policy.lane,
+		    [client, proto, pool, this]() {
+			    if (!client->is_connected())
+				    return;
+			    auto resp = admit(proto, pool->meter(), nullptr);
+			    send_protocols(client, {resp ? resp : handleMethodCall(proto)},
+			                   "data send failed.");
+		    },
+		    [client, proto]() {
+			    send_protocols(client,
+			                   {status_response(proto, RPC_BUSY, "server overloaded")},
+			                   "shed response send failed.");
+		    });
+		if (!accepted) {
+			rejected.push_back(status_response(proto, RPC_BUSY, "server busy"));
+		}
 	}
-	if (proto->getMagic() != Protocol::MAGIC) {
-		ERROR_LOG << "There is a problem with this serialized data.";
+	if (!rejected.empty()) {
+		send_protocols(client, std::move(rejected), "busy response send failed.");
+	}
+	if (!inline_requests.empty()) {
+		execute_requests(client, inline_requests);
+	}
+	if (shared.empty())
 		return;
+
+	// 当前处于reactor线程 方法调用与回写都交给线程池 避免阻塞IO
+	// 流水线发来的一批请求分成至多线程数个任务并行处理 每个任务的回复合并后一次写回
+	// 回复的顺序可能与请求不同 客户端按回复中的序号匹配
+	size_t chunks = std::min(shared.size(), threadpool->size());
+	size_t chunk_size = (shared.size() + chunks - 1) / chunks;
+	auto enqueued = QueueMeter::clock::now();
+	shared_meter_.on_enqueue(shared.size());
+	for (size_t begin = 0; begin < shared.size(); begin += chunk_size) {
+		size_t end = std::min(begin + chunk_size, shared.size());
+		std::vector<Protocol::ptr> chunk(
+		    std::make_move_iterator(shared.begin() + begin),
+		    std::make_move_iterator(shared.begin() + end));
+		threadpool->execute(
+		    [client, requests = std::move(chunk), this, enqueued]() {
+			    shared_meter_.on_dequeue(enqueued, requests.size());
+			    execute_requests(client, requests, true);
+		    });
 	}
-	Protocol::ptr response;
-	Protocol::MsgType type = proto->getMsgType();
-	switch (type) {
-	case Protocol::MsgType::RPC_METHOD_REQUEST: {
-		response = handleMethodCall(proto);
-		break;
+}
+
+void RPCServer::execute_requests(const Client::ptr& client,
+                                 const std::vector<Protocol::ptr>& requests,
+                                 bool queued) {
+	std::vector<Protocol::ptr> responses;
+	for (const auto& proto : requests) {
+		Protocol::ptr resp;
+		if (queued) {
+			resp = admit(proto, shared_meter_, &shared_codel_);
+		}
+		responses.push_back(resp ? resp : handleMethodCall(proto));
 	}
+	if (responses.empty() || !client->is_connected()) {
+		return;
 	}
+	DEBUG_LOG << "send " << responses.size() << " responses.";
+	send_protocols(client, std::move(responses), "data send failed.");
+}
+
+void RPCServer::start_coroutine(const Client::ptr& client,
+                                const Protocol::ptr& proto,
+                                rpc::Task<Serializer> task) {
+	// 执行器由完成回调持有 直到协程结束
+	auto executor = std::make_shared<StrandExecutor>(client->strand());
+	auto* raw = executor.get();
+	inflight_.fetch_add(1, std::memory_order_relaxed);
+	rpc::spawn(raw, std::move(task),
+	           [client, proto, executor = std::move(executor),
+	            this](Serializer rt) {
+		           inflight_.fetch_sub(1, std::memory_order_relaxed);
+		           latency_.record(
+		               std::chrono::duration_cast<std::chrono::microseconds>(
+		                   Protocol::clock::now() - proto->getArrival()));
+		           if (!client->is_connected())
+			           return;
+		           send_protocols(client,
+		                          {Protocol::Create(
+		                              Protocol::MsgType::RPC_METHOD_RESPONSE,
+		                              rt.toString(), proto->getSequenceId())},
+		                          "data send failed.");
+	           });
+}
 
-	// 加入线程池进行处理
-	if (response && client->is_connected()) {
-		DEBUG_LOG << "submit task."
-		          << " " << response->encode()->toHexString();
-		// 需要注意这里的传 指针的方式 要考虑作用域 会不会被释放了
-		threadpool->submit([client, response, session_, this]() {
-			std::lock_guard<std::mutex> lock_(
-			    *(client_write_mtx_[client->get_filedesc()])); // 获取对应的写锁
-			auto size = session_->sendProtocol(response);
-			if (size <= 0)
-				ERROR_LOG << "data send failed.";
-		});
+Protocol::ptr RPCServer::admit(const Protocol::ptr& proto, QueueMeter& meter,
+                              CoDel* codel) {
+	auto now = Protocol::clock::now();
+	if (proto->expired(now)) {
+		DEBUG_LOG << "drop request " << proto->getSequenceId()
+		          << ", deadline exceeded after " << proto->getTimeout() << "ms";
+		meter.on_expire();
+		return status_response(proto, RPC_EXPIRED, "deadline exceeded");
 	}
+	if (codel && codel->should_drop(now - proto->getArrival(), now)) {
+		meter.on_shed();
+		return status_response(proto, RPC_BUSY, "server overloaded");
+	}
+	return nullptr;
+}
+
+Protocol::ptr RPCServer::status_response(const Protocol::ptr& proto,
+                                         RPCState code, const std::string& msg) {
+	RPCResult<> val;
+	val.setCode(code);
+	val.setMsg(msg);
+	Serializer serializer;
+	serializer << val;
+	serializer.reset();
+	return Protocol::Create(Protocol::MsgType::RPC_METHOD_RESPONSE,
+	                        serializer.toString(), proto->getSequenceId());
+}
+
+void RPCServer::send_protocols(Client::ptr client,
+                               std::vector<Protocol::ptr> protos,
+                               const char* what) {
+	client->strand()->dispatch(
+	    [client, protos = std::move(protos), what]() {
+		    if (!client->is_connected())
+			    return;
+		    RPCSession session(client);
+		    if (session.sendProtocols(protos) <= 0)
+			    ERROR_LOG << what;
+	    });
 }
 
 void RPCServer::publish_client_disconnected(Client::ptr client,
@@ -110,23 +461,80 @@ void RPCServer::publish_client_disconnected(Client::ptr client,
 	         << "]has disconnected: " << bt->readStringF32();
 }
 
+void RPCServer::publish_client_watermark(Client::ptr client, bool high) {
+	TcpServer::publish_client_watermark(client, high);
+	client->set_reading(!high);
+}
+
 void RPCServer::registerService(std::string service_name) {
-	std::vector<std::string> paths = parse_path(service_name);
-	int i = 0;
-	std::string res_service_name{"/"};
-	/*处理永久节点*/
-	while (i < paths.size()) {
-		res_service_name += paths[i] + "/";
-		if (!zkclient_.check_znode_exists(res_service_name.c_str())) {
-			INFO_LOG  << "znode is not exist,path: "<<res_service_name;
-			zkclient_.create(res_service_name.c_str(), "", 0); // 永久节点
-		}
-		++i;
-	}
-	//创建临时节点
-	res_service_name += PROVIDER_NAME;
+	registerServices({service_name});
+}
+
+ResultType
+RPCServer::registerServices(const std::vector<std::string>& service_names) {
+	auto begin = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(report_mtx_);
 	// 获取主机ip
-	auto ip = get_local_ip();
-	std::string data = ip+":"+std::to_string(port_);
-	zkclient_.create(res_service_name.c_str(),data.c_str(), data.size(),ZOO_EPHEMERAL_SEQUENTIAL);
-}
\ No newline at end of file
+	if (endpoint_.empty())
+		endpoint_ = get_local_ip() + ":" + std::to_string(port_);
+	auto record = provider_record();
+	auto ret = registry_->register_services(service_names, record.encode());
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+	    std::chrono::steady_clock::now() - begin);
+	if (!ret.is_successful()) {
+		ERROR_LOG << "register " << service_names.size()
+		          << " services failed: " << ret.message();
+		return ret;
+	}
+	INFO_LOG << "register " << service_names.size() << " services in "
+	         << elapsed.count() << " us";
+	// 之前登记的服务也更新为同一份记录
+	if (published_ != record && !published_.endpoint.empty())
+		registry_->update_services(record.encode());
+	published_ = record;
+	if (report_timer_ == 0 && load_report_interval_.count() > 0) {
+		// 注册中心的每次更新都会通知所有订阅者 间隔不小于100毫秒
+		auto interval = std::max(load_report_interval_, std::chrono::milliseconds(100));
+		report_timer_ = TimerService::shared().run_every(
+		    interval, [this]() { report_load(); });
+	}
+	return ret;
+}
+
+ProviderRecord RPCServer::provider_record() {
+	ProviderRecord record;
+	record.endpoint = endpoint_;
+	record.weight = weight_;
+	record.cores = std::max(1u, std::thread::hardware_concurrency());
+	record.inflight = inflight_.load(std::memory_order_relaxed);
+	size_t queued = shared_meter_.queued();
+	for (const auto& [name, pool] : pools_) {
+		queued += pool->meter().queued();
+	}
+	record.queued = static_cast<uint32_t>(queued);
+	record.p99 = latency_.take_percentile(0.99);
+	return record;
+}
+
+void RPCServer::report_load() {
+	std::lock_guard<std::mutex> lock(report_mtx_);
+	auto record = provider_record();
+	if (record.p99.count() == 0)
+		record.p99 = published_.p99; // 这个周期没有请求 沿用之前的
+	// 只在影响客户端选择的变化时更新 每次更新都会让所有订阅者重新读取
+	auto changed = [](double before, double after, double ratio) {
+		return std::abs(after - before) > before * ratio;
+	};
+	if (record.capacity() == published_.capacity() &&
+	    !changed(published_.effective_weight(), record.effective_weight(), 0.1) &&
+	    !changed(static_cast<double>(published_.p99.count()),
+	             static_cast<double>(record.p99.count()), 0.25)) {
+		return;
+	}
+	auto ret = registry_->update_services(record.encode());
+	if (!ret.is_successful()) {
+		WARNING_LOG << "update provider record failed: " << ret.message();
+		return;
+	}
+	published_ = record;
+}
@@ -8,7 +8,11 @@
 
 #include "rpc/RPCSession.h"
 #include "base/Logger.h"
+#include "net/common.h"
+#include <algorithm>
 #include <bits/types/struct_iovec.h>
+#include <cerrno>
+#include <climits>
 #include <sys/socket.h>
 #include <vector>
 
@@ -31,16 +35,22 @@ ssize_t RPCSession::read(ByteArray::ptr buffer, size_t length) {
 }
 
 ssize_t RPCSession::write(const void* buffer, size_t length) {
-	if (!client_ || !client_->is_connected())
+	if (!client_ || !client_->is_connected()) {
+		errno = ENOTCONN; // 不能让wait_writable看到之前的EAGAIN
 		return -1;
+	}
 	return client_->send(buffer, length);
 }
 ssize_t RPCSession::write(ByteArray::ptr buffer, size_t length) {
-	if (!client_ || !client_->is_connected())
+	if (!client_ || !client_->is_connected()) {
+		errno = ENOTCONN;
 		return -1;
+	}
 	std::vector<iovec> iovs;
 	buffer->getReadBuffers(iovs, length);
-	ssize_t n = client_->send(&iovs[0], iovs.size());
+	// 一次最多IOV_MAX个内存块 超过时sendmsg返回EMSGSIZE 剩下的由writeFixSize继续发送
+	size_t count = std::min<size_t>(iovs.size(), IOV_MAX);
+	ssize_t n = client_->send(&iovs[0], count);
 	if (n > 0) {
 		buffer->setPosition(buffer->getPosition() + n);
 	}
@@ -75,11 +85,24 @@ ssize_t RPCSession::readFixSize(ByteArray::ptr buffer, size_t length) {
 	return length;
 }
 
+bool RPCSession::wait_writable() {
+	if (errno == EINTR)
+		return true;
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		return false;
+	// 非阻塞socket的发送缓冲区已满 等待可写而不是判定连接失效
+	return fd_wait::wait_for_write(client_->get_filedesc()) ==
+	       fd_wait::Result::SUCCESS;
+}
+
 ssize_t RPCSession::writeFixSize(const void* buffer, size_t length) {
 	size_t offset = 0;
 	size_t left = length;
 	while (left > 0) {
 		ssize_t n = write((const char*)buffer + offset, left);
+		if (n < 0 && wait_writable()) {
+			continue;
+		}
 		if (n <= 0) {
             client_->set_connected(false);
 			return n;
@@ -95,6 +118,9 @@ ssize_t RPCSession::writeFixSize(ByteArray::ptr buffer, size_t length) {
 	size_t left = length;
 	while (left > 0) {
 		ssize_t n = write(buffer, left);
+		if (n < 0 && wait_writable()) {
+			continue;
+		}
 		if (n <= 0) {
             client_->set_connected(false);
 			return n;
@@ -107,7 +133,8 @@ ssize_t RPCSession::writeFixSize(ByteArray::ptr buffer, size_t length) {
 
 Protocol::ptr RPCSession::recvProtocol() {
 	Protocol::ptr proto = std::make_shared<Protocol>();
-	ByteArray::ptr byteArray = std::make_shared<ByteArray>();
+	ByteArray::ptr byteArray = std::make_shared<ByteArray>(
+	    ByteArray::Layout::Contiguous, Protocol::BASE_LENGTH);
     
 	if (readFixSize(byteArray, proto->BASE_LENGTH) <= 0) {
         
@@ -140,4 +167,16 @@ Protocol::ptr RPCSession::recvProtocol() {
 ssize_t RPCSession::sendProtocol(Protocol::ptr proto) {
     ByteArray::ptr byteArray = proto->encode();
     return writeFixSize(byteArray, byteArray->getReadSize());
+}
+
+ssize_t RPCSession::sendProtocols(const std::vector<Protocol::ptr>& protos) {
+    if (protos.size() == 1)
+        return sendProtocol(protos.front());
+    ByteArray::ptr byteArray = std::make_shared<ByteArray>();
+    for (const auto& proto : protos) {
+        auto data = proto->encode()->toString();
+        byteArray->write(data.data(), data.size());
+    }
+    byteArray->setPosition(0);
+    return writeFixSize(byteArray, byteArray->getReadSize());
 }
\ No newline at end of file
@@ -0,0 +1,398 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/12 10:25:48
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "rpc/Registry.h"
+#include "base/Logger.h"
+#include "base/util.h"
+#include "rpc/ProviderRecord.h"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <set>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const std::string PROVIDER_NAME = "rpc-provider";
+
+/**
+ * @brief 先写入同一目录中的临时文件再rename 读取的一方只会看到完整的内容
+ */
+static ResultType write_atomically(const std::string& dir, const std::string& name,
+                                   const std::string& data) {
+	auto temp = dir + "/." + name;
+	auto file = dir + "/" + name;
+	{
+		std::ofstream out(temp, std::ios::trunc);
+		out << data;
+		if (!out.flush())
+			return ResultType::FAILURE("write " + temp + " failed");
+	}
+	if (::rename(temp.c_str(), file.c_str()) == -1) {
+		auto error = strerror(errno);
+		::unlink(temp.c_str());
+		return ResultType::FAILURE("rename " + file + ": " + error);
+	}
+	return ResultType::SUCCESS();
+}
+
+Registry::Options Registry::options_from_ini(ini::IniFile& ini) {
+	Options options;
+	if (ini.count("registry") == 0)
+		return options;
+	auto& section = ini["registry"];
+	if (section.count("type"))
+		options.type = section["type"].as<std::string>();
+	if (section.count("address"))
+		options.address = section["address"].as<std::string>();
+	if (section.count("timeout"))
+		options.timeout = std::chrono::milliseconds(section["timeout"].as<int>());
+	if (section.count("path"))
+		options.path = section["path"].as<std::string>();
+	return options;
+}
+
+Registry::ptr Registry::create(const Options& options) {
+	if (options.type == "zookeeper")
+		return std::make_shared<ZKRegistry>(options);
+	if (options.type == "file")
+		return std::make_shared<FileRegistry>(options.path);
+	throw std::runtime_error("unknown registry type: " + options.type);
+}
+
+ZKRegistry::ZKRegistry(const Options& options) {
+	// 连接注册中心
+	auto ret = zkclient_.start(options.address,
+	                           static_cast<int>(options.timeout.count()));
+	if (!ret.is_successful())
+		throw std::runtime_error(ret.message());
+}
+
+void ZKRegistry::set_listener(ChangeCallback callback) {
+	if (!callback) {
+		zkclient_.set_watcher(nullptr);
+		return;
+	}
+	zkclient_.set_watcher([callback = std::move(callback)](
+	                          int type, const std::string& path) {
+		if (type == ZOO_CHILD_EVENT) {
+			callback(path); // 服务节点的子节点 即提供者增减
+			return;
+		}
+		// 服务节点被创建 或者提供者节点的数据变化、删除
+		auto pos = path.rfind('/');
+		if (type == ZOO_CREATED_EVENT || pos == 0 || pos == std::string::npos) {
+			callback(path);
+		} else {
+			callback(path.substr(0, pos));
+		}
+	});
+}
+
+std::vector<std::string> ZKRegistry::fetch(const std::string& service) {
+	std::vector<std::string> endpoints;
+	if (!zkclient_.check_znode_exists(service.c_str(), true))
+		return endpoints; // 监视服务节点的创建
+	auto children = zkclient_.get_children(service.c_str(), true);
+	for (const auto& child : children) {
+		// 每一项的数据都是ProviderRecord 以ip:port开头
+		auto data = zkclient_.get_data((service + "/" + child).c_str(), true);
+		ProviderRecord record;
+		if (!ProviderRecord::parse(data, record)) {
+			WARNING_LOG << "invalid provider record: " << data;
+			continue;
+		}
+		endpoints.push_back(data);
+	}
+	return endpoints;
+}
+
+ResultType ZKRegistry::register_services(const std::vector<std::string>& services,
+                                         const std::string& data) {
+	/*永久节点 各个服务共同的前缀只创建一次*/
+	std::vector<std::string> parents;
+	std::set<std::string> seen;
+	std::vector<ZKClient::CreateRequest> providers;
+	for (const auto& service : services) {
+		std::string path;
+		for (const auto& name : parse_path(service)) {
+			path += "/" + name;
+			if (seen.insert(path).second)
+				parents.push_back(path);
+		}
+		//创建临时节点
+		providers.push_back({path + "/" + PROVIDER_NAME, data,
+		                     ZOO_EPHEMERAL_SEQUENTIAL});
+	}
+	std::vector<std::string> created;
+	int rc = zkclient_.create_batch(parents, providers, &created);
+	if (rc != ZOK)
+		return ResultType::FAILURE(std::string("create znode error: ") +
+		                           zerror(rc));
+	for (const auto& path : created) {
+		INFO_LOG << "znode create success... path: " << path;
+	}
+	std::lock_guard<std::mutex> lock(created_mtx_);
+	created_.insert(created_.end(), created.begin(), created.end());
+	return ResultType::SUCCESS();
+}
+
+ResultType ZKRegistry::update_services(const std::string& data) {
+	std::lock_guard<std::mutex> lock(created_mtx_);
+	for (const auto& path : created_) {
+		zkclient_.async_set(path, data, [path](int rc) {
+			if (rc != ZOK)
+				WARNING_LOG << "update znode " << path << " failed: " << zerror(rc);
+		});
+	}
+	return ResultType::SUCCESS();
+}
+
+FileRegistry::FileRegistry(std::string path)
+    : path_(std::move(path)) {
+	std::error_code ec;
+	fs::create_directories(path_, ec);
+	if (ec)
+		throw std::runtime_error("create registry directory " + path_ + ": " +
+		                         ec.message());
+	inotify_fd_.set(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+	if (inotify_fd_.get() == -1)
+		throw std::runtime_error(std::string("inotify_init1: ") + strerror(errno));
+	stop_fd_.set(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+	if (stop_fd_.get() == -1) {
+		::close(inotify_fd_.get());
+		throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+	}
+	root_watch_ = inotify_add_watch(inotify_fd_.get(), path_.c_str(),
+	                                IN_CREATE | IN_DELETE | IN_MOVED_TO |
+	                                    IN_MOVED_FROM | IN_ONLYDIR);
+	if (root_watch_ == -1) {
+		auto error = strerror(errno);
+		::close(inotify_fd_.get());
+		::close(stop_fd_.get());
+		throw std::runtime_error("watch registry directory " + path_ + ": " +
+		                         error);
+	}
+	watcher_ = std::thread([this]() { watch_loop(); });
+}
+
+FileRegistry::~FileRegistry() {
+	{
+		// 注销 其他进程随即收到通知
+		std::lock_guard<std::mutex> lock(files_mtx_);
+		for (const auto& file : files_) {
+			::unlink(file.c_str());
+		}
+		files_.clear();
+	}
+	uint64_t one = 1;
+	::write(stop_fd_.get(), &one, sizeof(one));
+	watcher_.join();
+	::close(inotify_fd_.get());
+	::close(stop_fd_.get());
+}
+
+std::string FileRegistry::encode(const std::string& service) {
+	std::string name;
+	size_t begin = (!service.empty() && service.front() == '/') ? 1 : 0;
+	for (size_t i = begin; i < service.size(); ++i) {
+		if (service[i] == '/') {
+			name += "%2F";
+		} else if (service[i] == '%') {
+			name += "%25";
+		} else {
+			name += service[i];
+		}
+	}
+	return name;
+}
+
+std::string FileRegistry::decode(const std::string& name) {
+	std::string service{"/"};
+	for (size_t i = 0; i < name.size(); ++i) {
+		if (name[i] == '%' && name.compare(i, 3, "%2F") == 0) {
+			service += '/';
+			i += 2;
+		} else if (name[i] == '%' && name.compare(i, 3, "%25") == 0) {
+			service += '%';
+			i += 2;
+		} else {
+			service += name[i];
+		}
+	}
+	return service;
+}
+
+void FileRegistry::set_listener(ChangeCallback callback) {
+	std::lock_guard<std::mutex> lock(listener_mtx_);
+	listener_ = std::move(callback);
+}
+
+std::vector<std::string> FileRegistry::fetch(const std::string& service) {
+	std::vector<std::string> endpoints;
+	auto name = encode(service);
+	if (name.empty() || name == "." || name == "..") {
+		WARNING_LOG << "invalid service name: " << service;
+		return endpoints; // 会解析到根目录或者其上层
+	}
+	auto dir = path_ + "/" + name;
+	// 先监视再读取 读取之后的变化都会通知 目录还不存在时由根目录的监视通知创建
+	int wd = inotify_add_watch(inotify_fd_.get(), dir.c_str(),
+	                           IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+	                               IN_ONLYDIR);
+	if (wd == -1)
+		return endpoints;
+	{
+		std::lock_guard<std::mutex> lock(watch_mtx_);
+		watches_[wd] = service;
+	}
+	std::error_code ec;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end;
+	     it.increment(ec)) {
+		const auto& file = *it;
+		auto name = file.path().filename().string();
+		if (name.empty() || name.front() == '.')
+			continue; // 写入中的临时文件
+		std::error_code type_ec;
+		if (!file.is_regular_file(type_ec))
+			continue; // 子目录等不是提供者的记录
+		// provider-<pid>-<序号> 进程已经不存在时跳过
+		pid_t pid = 0;
+		if (std::sscanf(name.c_str(), "provider-%d-", &pid) == 1 &&
+		    pid != getpid() && ::kill(pid, 0) == -1 && errno == ESRCH) {
+			continue;
+		}
+		std::string data;
+		try {
+			std::ifstream in(file.path());
+			data.assign(std::istreambuf_iterator<char>(in),
+			            std::istreambuf_iterator<char>());
+		} catch (const std::exception& e) {
+			// 在目录的后台线程中调用 一个文件读取失败不能影响其他提供者
+			WARNING_LOG << "read " << file.path().string() << ": " << e.what();
+			continue;
+		}
+		ProviderRecord record;
+		if (!ProviderRecord::parse(data, record)) {
+			WARNING_LOG << "invalid provider record: " << data;
+			continue;
+		}
+		endpoints.push_back(data);
+	}
+	return endpoints;
+}
+
+ResultType FileRegistry::register_services(
+    const std::vector<std::string>& services, const std::string& data) {
+	static std::atomic<uint64_t> next_file{0}; // 同一进程中的多个对象不会重名
+	for (const auto& service : services) {
+		auto dir = path_ + "/" + encode(service);
+		std::error_code ec;
+		fs::create_directories(dir, ec);
+		if (ec)
+			return ResultType::FAILURE("create " + dir + ": " + ec.message());
+		auto name = "provider-" + std::to_string(getpid()) + "-" +
+		            std::to_string(next_file.fetch_add(1));
+		auto ret = write_atomically(dir, name, data);
+		if (!ret.is_successful())
+			return ret;
+		auto file = dir + "/" + name;
+		std::lock_guard<std::mutex> lock(files_mtx_);
+		files_.push_back(file);
+		INFO_LOG << "register provider success... path: " << file;
+	}
+	return ResultType::SUCCESS();
+}
+
+ResultType FileRegistry::update_services(const std::string& data) {
+	std::lock_guard<std::mutex> lock(files_mtx_);
+	for (const auto& file : files_) {
+		auto pos = file.rfind('/');
+		auto ret = write_atomically(file.substr(0, pos), file.substr(pos + 1), data);
+		if (!ret.is_successful())
+			return ret;
+	}
+	return ResultType::SUCCESS();
+}
+
+void FileRegistry::watch_loop() {
+	pollfd fds[2];
+	fds[0].fd = inotify_fd_.get();
+	fds[0].events = POLLIN;
+	fds[1].fd = stop_fd_.get();
+	fds[1].events = POLLIN;
+	while (true) {
+		auto ret = ::poll(fds, 2, -1);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			ERROR_LOG << "registry watcher poll: " << strerror(errno);
+			return;
+		}
+		if (fds[1].revents & POLLIN)
+			return;
+		if (fds[0].revents & POLLIN)
+			handle_events();
+	}
+}
+
+void FileRegistry::handle_events() {
+	alignas(struct inotify_event) char buffer[4096];
+	std::set<std::string> changed; // 一次读取中的多个事件只通知一次
+	while (true) {
+		auto n = ::read(inotify_fd_.get(), buffer, sizeof(buffer));
+		if (n <= 0)
+			break;
+		for (char* p = buffer; p < buffer + n;) {
+			auto* event = reinterpret_cast<struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				// 丢失了事件 所有监视中的服务都重新读取
+				std::lock_guard<std::mutex> lock(watch_mtx_);
+				for (auto& [wd, service] : watches_)
+					changed.insert(service);
+				continue;
+			}
+			std::string name = event->len ? event->name : "";
+			if (event->wd == root_watch_) {
+				// 服务目录的创建与删除
+				if ((event->mask & IN_ISDIR) && !name.empty())
+					changed.insert(decode(name));
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(watch_mtx_);
+			auto it = watches_.find(event->wd);
+			if (it == watches_.end())
+				continue;
+			if (event->mask & IN_IGNORED) {
+				changed.insert(it->second); // 目录被删除 监视随之失效
+				watches_.erase(it);
+			} else if (!name.empty() && name.front() != '.') {
+				changed.insert(it->second);
+			}
+		}
+	}
+	for (const auto& service : changed) {
+		notify(service);
+	}
+}
+
+void FileRegistry::notify(const std::string& service) {
+	std::lock_guard<std::mutex> lock(listener_mtx_);
+	if (listener_)
+		listener_(service);
+}
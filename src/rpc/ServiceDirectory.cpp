@@ -0,0 +1,196 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/10 10:02:17
+ * @version: 1.0
+ * @description:
+ ********************************************************************************/
+
+#include "rpc/ServiceDirectory.h"
+#include "base/Logger.h"
+#include <algorithm>
+#include <stdexcept>
+
+ServiceDirectory::ServiceDirectory(DiscoverySource::ptr source)
+    : source_(std::move(source))
+    , entries_(std::make_shared<const EntryMap>()) {
+	source_->set_listener(
+	    [this](const std::string& service) { mark_dirty(service); });
+	refresher_ = std::thread([this]() { refresh_loop(); });
+}
+
+ServiceDirectory::~ServiceDirectory() {
+	source_->set_listener(nullptr); // 之后来源不会再访问this
+	{
+		std::lock_guard<std::mutex> lock(dirty_mtx_);
+		stopping_ = true;
+	}
+	dirty_cond_.notify_one();
+	refresher_.join();
+}
+
+ServiceDirectory& ServiceDirectory::shared(const Registry::Options& options) {
+	static std::mutex mtx;
+	static std::map<std::string, std::unique_ptr<ServiceDirectory>> directories;
+	auto key = options.type + "|" +
+	           (options.type == "file" ? options.path : options.address);
+	std::lock_guard<std::mutex> lock(mtx);
+	auto& directory = directories[key];
+	if (!directory)
+		directory = std::make_unique<ServiceDirectory>(Registry::create(options));
+	return *directory;
+}
+
+ServiceDirectory& ServiceDirectory::shared() {
+	return shared(Registry::Options{});
+}
+
+ServiceDirectory::Snapshot ServiceDirectory::lookup(const std::string& service) {
+	auto entries = entries_.load(std::memory_order_acquire);
+	auto it = entries->find(service);
+	if (it != entries->end())
+		return it->second->snapshot.load(std::memory_order_acquire);
+	return subscribe(service)->snapshot.load(std::memory_order_acquire);
+}
+
+std::shared_ptr<ServiceDirectory::Entry>
+ServiceDirectory::subscribe(const std::string& service) {
+	// 空名称在注册中心中对应根节点 不是服务
+	if (service.find_first_not_of('/') == std::string::npos)
+		throw std::invalid_argument("invalid service name: \"" + service + "\"");
+	std::lock_guard<std::mutex> lock(subscribe_mtx_);
+	auto entries = entries_.load(std::memory_order_acquire);
+	auto it = entries->find(service);
+	if (it != entries->end())
+		return it->second;
+	auto endpoints = source_->fetch(service);
+	std::sort(endpoints.begin(), endpoints.end());
+	auto entry = std::make_shared<Entry>();
+	entry->snapshot.store(std::make_shared<const Endpoints>(std::move(endpoints)));
+	// 复制后替换 正在读取旧表的线程不受影响
+	auto next = std::make_shared<EntryMap>(*entries);
+	next->emplace(service, entry);
+	entries_.store(std::move(next), std::memory_order_release);
+	INFO_LOG << "subscribe service " << service << ", "
+	         << entry->snapshot.load()->size() << " providers";
+	return entry;
+}
+
+ServiceDirectory::ListenerId ServiceDirectory::watch(const std::string& service,
+                                                     Listener listener) {
+	auto entry = subscribe(service);
+	auto subscriber = std::make_shared<Subscriber>();
+	subscriber->service = service;
+	subscriber->listener = std::move(listener);
+	// 先登记再读取快照 之后的变化不会丢失
+	// 后台线程的通知等待第一次调用结束 顺序不会颠倒
+	std::lock_guard<std::mutex> call_lock(subscriber->call_mtx);
+	ListenerId id;
+	{
+		std::lock_guard<std::mutex> lock(listener_mtx_);
+		id = next_listener_++;
+		listeners_.emplace(id, subscriber);
+	}
+	try {
+		subscriber->listener(entry->snapshot.load(std::memory_order_acquire));
+	} catch (...) {
+		{
+			std::lock_guard<std::mutex> lock(listener_mtx_);
+			listeners_.erase(id);
+		}
+		subscriber->active = false;
+		throw;
+	}
+	return id;
+}
+
+void ServiceDirectory::unwatch(ListenerId id) {
+	std::shared_ptr<Subscriber> subscriber;
+	{
+		std::lock_guard<std::mutex> lock(listener_mtx_);
+		auto it = listeners_.find(id);
+		if (it == listeners_.end())
+			return;
+		subscriber = std::move(it->second);
+		listeners_.erase(it);
+	}
+	// 只等待这个订阅者正在执行的回调
+	std::lock_guard<std::mutex> call_lock(subscriber->call_mtx);
+	subscriber->active = false;
+}
+
+void ServiceDirectory::mark_dirty(const std::string& service) {
+	{
+		std::lock_guard<std::mutex> lock(dirty_mtx_);
+		dirty_.insert(service);
+	}
+	dirty_cond_.notify_one();
+}
+
+void ServiceDirectory::refresh_loop() {
+	while (true) {
+		std::set<std::string> dirty;
+		{
+			std::unique_lock<std::mutex> lock(dirty_mtx_);
+			dirty_cond_.wait(lock, [this]() { return stopping_ || !dirty_.empty(); });
+			if (stopping_)
+				return;
+			dirty.swap(dirty_);
+		}
+		for (const auto& service : dirty) {
+			try {
+				refresh(service);
+			} catch (const std::exception& e) {
+				// 读取失败时保留原来的快照
+				ERROR_LOG << "refresh service " << service << " failed: " << e.what();
+			}
+		}
+	}
+}
+
+void ServiceDirectory::refresh(const std::string& service) {
+	auto entries = entries_.load(std::memory_order_acquire);
+	auto it = entries->find(service);
+	if (it == entries->end()) {
+		// 可能正在订阅 读取之后的变化不能丢失 等订阅完成后再找
+		std::lock_guard<std::mutex> lock(subscribe_mtx_);
+		entries = entries_.load(std::memory_order_acquire);
+		it = entries->find(service);
+		if (it == entries->end())
+			return; // 未订阅的服务
+	}
+	auto entry = it->second;
+	// 来源的监视是一次性的 读取的同时重新设置
+	auto endpoints = source_->fetch(service);
+	std::sort(endpoints.begin(), endpoints.end());
+	if (endpoints == *entry->snapshot.load(std::memory_order_acquire))
+		return;
+	auto snapshot = std::make_shared<const Endpoints>(std::move(endpoints));
+	entry->snapshot.store(snapshot, std::memory_order_release);
+	version_.fetch_add(1, std::memory_order_relaxed);
+	INFO_LOG << "service " << service << " changed, " << snapshot->size()
+	         << " providers";
+
+	// 复制后在锁外通知 回调较慢时不影响其他服务的watch与unwatch
+	std::vector<std::shared_ptr<Subscriber>> subscribers;
+	{
+		std::lock_guard<std::mutex> lock(listener_mtx_);
+		for (auto& [id, subscriber] : listeners_) {
+			if (subscriber->service == service)
+				subscribers.push_back(subscriber);
+		}
+	}
+	for (auto& subscriber : subscribers) {
+		std::lock_guard<std::mutex> call_lock(subscriber->call_mtx);
+		if (!subscriber->active)
+			continue;
+		// 后台线程由所有订阅者共用 一个回调的异常不能结束它
+		try {
+			subscriber->listener(snapshot);
+		} catch (const std::exception& e) {
+			ERROR_LOG << "listener of service " << service << " failed: " << e.what();
+		} catch (...) {
+			ERROR_LOG << "listener of service " << service << " failed";
+		}
+	}
+}
@@ -7,7 +7,11 @@
  ********************************************************************************/
 #include "rpc/ZKClient.h"
 #include "base/Logger.h"
+#include <cerrno>
+#include <condition_variable>
 #include <cstdlib>
+#include <ctime>
+#include <memory>
 #include <semaphore.h>
 #include <string>
 #include <vector>
@@ -18,8 +22,12 @@ static void global_watcher(zhandle_t* zh, int type, int state, const char* path,
                            void* watchrCtx) {
 	if (type == ZOO_SESSION_EVENT) {
 		if (state == ZOO_CONNECTED_STATE) {
+			// 只有start等待第一次连接成功 之后重新连接时上下文已经清空
 			sem_t* sem = (sem_t*)zoo_get_context(zh);
-			sem_post(sem);
+			if (sem != nullptr)
+				sem_post(sem);
+		} else if (state == ZOO_EXPIRED_SESSION_STATE) {
+			WARNING_LOG << "zookeeper session expired";
 		}
 	}
 }
@@ -31,12 +39,12 @@ ZKClient::~ZKClient() {
 	}
 }
 
-void ZKClient::start() {
-	zhandle_ = zookeeper_init("127.0.0.1:2181", global_watcher, 30000, nullptr,
+ResultType ZKClient::start(const std::string& hosts, int timeout_ms) {
+	zhandle_ = zookeeper_init(hosts.c_str(), global_watcher, timeout_ms, nullptr,
 	                          nullptr, 0);
 	if (zhandle_ == nullptr) {
-		ERROR_LOG << "zookeeper_init error!";
-		exit(EXIT_FAILURE);
+		ERROR_LOG << "zookeeper_init error! hosts: " << hosts;
+		return ResultType::FAILURE("zookeeper_init error");
 	}
 
 	sem_t sem;
@@ -44,39 +52,63 @@ void ZKClient::start() {
 	zoo_set_context(zhandle_, &sem);
 
 	// 等待成功注册
-	sem_wait(&sem);
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	int ret;
+	while ((ret = sem_timedwait(&sem, &deadline)) == -1 && errno == EINTR) {
+	}
+	if (ret == -1) {
+		// 关闭后不会再有回调访问sem
+		zookeeper_close(zhandle_);
+		zhandle_ = nullptr;
+		sem_destroy(&sem);
+		ERROR_LOG << "connect zookeeper timeout! hosts: " << hosts;
+		return ResultType::FAILURE("connect zookeeper timeout: " + hosts);
+	}
+	zoo_set_context(zhandle_, nullptr); // sem在返回后失效
+	sem_destroy(&sem);
 	INFO_LOG << "zookeeper_init success!";
+	return ResultType::SUCCESS();
 }
 
-void ZKClient::create(const char* path, const char* data, int data_len,
-                      int state) {
+int ZKClient::create(const char* path, const char* data, int data_len,
+                     int state) {
 	constexpr int bufferlen = 128;
 	char path_buffer[bufferlen];
-	bool flag = check_znode_exists(path);
-	// 对应的节点不存在
-	if (!flag) {
-		flag = zoo_create(zhandle_, path, data, data_len, &ZOO_OPEN_ACL_UNSAFE,
-		                  state, path_buffer, bufferlen);
-		if (flag == ZOK) {
-			INFO_LOG << "znode create success... path: " << path;
-		} else {
-			ERROR_LOG << "flag: " << flag;
-			ERROR_LOG << "znode create error... path: " << path;
-			exit(EXIT_FAILURE);
-		}
-	}else {
-        INFO_LOG << "znode create filure...exist: " << path;
-    }
+	// 直接创建 已经存在时返回ZNODEEXISTS 不需要先检查一次
+	int flag = zoo_create(zhandle_, path, data, data_len, &ZOO_OPEN_ACL_UNSAFE,
+	                      state, path_buffer, bufferlen);
+	if (flag == ZOK) {
+		INFO_LOG << "znode create success... path: " << path;
+	} else if (flag == ZNODEEXISTS) {
+		INFO_LOG << "znode create filure...exist: " << path;
+	} else {
+		ERROR_LOG << "flag: " << flag;
+		ERROR_LOG << "znode create error... path: " << path;
+	}
+	return flag;
 }
+
 std::string ZKClient::get_data(const char* path) {
-	char data_buffer[128];
+	return get_data(path, false);
+}
+
+std::string ZKClient::get_data(const char* path, bool watch) {
+	char data_buffer[512]; // 提供者的记录带有负载信息
 	int bufferlen = sizeof(data_buffer);
-	int flag = zoo_get(zhandle_, path, 0, data_buffer, &bufferlen, nullptr);
-	if (flag != ZOK) {
+	int flag = zoo_wget(zhandle_, path, watch ? &ZKClient::watch_trampoline : nullptr,
+	                    this, data_buffer, &bufferlen, nullptr);
+	if (flag != ZOK || bufferlen < 0) {
 		ERROR_LOG << "get znode error... path: " << path;
 		return std::string{};
 	} else {
-		return std::string(data_buffer);
+		return std::string(data_buffer, bufferlen);
 	}
 }
 
@@ -85,13 +117,206 @@ bool ZKClient::check_znode_exists(const char *path){
 	return !(flag == ZNONODE);
 }
 
+bool ZKClient::check_znode_exists(const char* path, bool watch) {
+	auto flag = zoo_wexists(zhandle_, path,
+	                        watch ? &ZKClient::watch_trampoline : nullptr, this,
+	                        nullptr);
+	return !(flag == ZNONODE);
+}
+
 std::vector<std::string> ZKClient::get_children(const char *path){
-	if(!check_znode_exists(path)) return {}; // 节点不存在 则不必继续下去了
+	return get_children(path, false);
+}
+
+std::vector<std::string> ZKClient::get_children(const char* path, bool watch) {
 	std::vector<std::string> ret;
 	struct String_vector children;
-	zoo_get_children(zhandle_, path, 0,&children);
-	for(int i = 0;i < children.count;i++){
+	int flag = zoo_wget_children(
+	    zhandle_, path, watch ? &ZKClient::watch_trampoline : nullptr, this,
+	    &children);
+	if (flag != ZOK) {
+		return ret; // 节点不存在 则不必继续下去了
+	}
+	for (int i = 0; i < children.count; i++) {
 		ret.emplace_back(children.data[i]);
 	}
+	deallocate_String_vector(&children);
 	return ret;
 }
+
+void ZKClient::set_watcher(WatchCallback callback) {
+	std::lock_guard<std::mutex> lock(watcher_mtx_);
+	watcher_ = std::move(callback);
+}
+
+void ZKClient::watch_trampoline(zhandle_t* /*zh*/, int type, int /*state*/,
+                                const char* path, void* context) {
+	if (type == ZOO_SESSION_EVENT)
+		return;
+	auto* client = static_cast<ZKClient*>(context);
+	std::lock_guard<std::mutex> lock(client->watcher_mtx_);
+	if (client->watcher_)
+		client->watcher_(type, path ? path : "");
+}
+
+namespace {
+
+// 异步请求的上下文 在完成回调中释放
+struct MultiContext {
+	std::vector<ZKClient::CreateRequest> requests; // 路径与数据在完成之前有效
+	std::vector<zoo_op_t> ops;
+	std::vector<zoo_op_result_t> results;
+	std::vector<std::vector<char>> buffers; // 实际创建的路径
+	ZKClient::MultiCallback callback;
+};
+
+void create_completion(int rc, const char* value, const void* data) {
+	std::unique_ptr<ZKClient::CreateCallback> callback(
+	    static_cast<ZKClient::CreateCallback*>(const_cast<void*>(data)));
+	(*callback)(rc, (rc == ZOK && value) ? value : "");
+}
+
+void exists_completion(int rc, const struct Stat* /*stat*/, const void* data) {
+	std::unique_ptr<ZKClient::ExistsCallback> callback(
+	    static_cast<ZKClient::ExistsCallback*>(const_cast<void*>(data)));
+	(*callback)(rc);
+}
+
+void set_completion(int rc, const struct Stat* /*stat*/, const void* data) {
+	std::unique_ptr<ZKClient::SetCallback> callback(
+	    static_cast<ZKClient::SetCallback*>(const_cast<void*>(data)));
+	(*callback)(rc);
+}
+
+void data_completion(int rc, const char* value, int value_len,
+                     const struct Stat* /*stat*/, const void* data) {
+	std::unique_ptr<ZKClient::DataCallback> callback(
+	    static_cast<ZKClient::DataCallback*>(const_cast<void*>(data)));
+	if (rc == ZOK && value && value_len > 0) {
+		(*callback)(rc, std::string(value, value_len));
+	} else {
+		(*callback)(rc, std::string{});
+	}
+}
+
+void multi_completion(int rc, const void* data) {
+	std::unique_ptr<MultiContext> context(
+	    static_cast<MultiContext*>(const_cast<void*>(data)));
+	std::vector<std::string> paths;
+	if (rc == ZOK) {
+		for (auto& buffer : context->buffers) {
+			paths.emplace_back(buffer.data());
+		}
+	}
+	context->callback(rc, paths);
+}
+
+} // namespace
+
+void ZKClient::async_create(const std::string& path, const std::string& data,
+                            int flags, CreateCallback callback) {
+	auto* context = new CreateCallback(std::move(callback));
+	int rc = zoo_acreate(zhandle_, path.c_str(), data.data(),
+	                     static_cast<int>(data.size()), &ZOO_OPEN_ACL_UNSAFE,
+	                     flags, create_completion, context);
+	if (rc != ZOK) {
+		create_completion(rc, nullptr, context); // 未能发送 不会再有回调
+	}
+}
+
+void ZKClient::async_exists(const std::string& path, ExistsCallback callback) {
+	auto* context = new ExistsCallback(std::move(callback));
+	int rc = zoo_aexists(zhandle_, path.c_str(), 0, exists_completion, context);
+	if (rc != ZOK) {
+		exists_completion(rc, nullptr, context);
+	}
+}
+
+void ZKClient::async_get(const std::string& path, DataCallback callback) {
+	auto* context = new DataCallback(std::move(callback));
+	int rc = zoo_aget(zhandle_, path.c_str(), 0, data_completion, context);
+	if (rc != ZOK) {
+		data_completion(rc, nullptr, 0, nullptr, context);
+	}
+}
+
+void ZKClient::async_set(const std::string& path, const std::string& data,
+                         SetCallback callback) {
+	auto* context = new SetCallback(std::move(callback));
+	int rc = zoo_aset(zhandle_, path.c_str(), data.data(),
+	                  static_cast<int>(data.size()), -1, set_completion, context);
+	if (rc != ZOK) {
+		set_completion(rc, nullptr, context);
+	}
+}
+
+void ZKClient::async_create_multi(const std::vector<CreateRequest>& requests,
+                                  MultiCallback callback) {
+	auto* context = new MultiContext;
+	context->requests = requests;
+	context->callback = std::move(callback);
+	size_t count = requests.size();
+	context->ops.resize(count);
+	context->results.resize(count);
+	context->buffers.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		auto& request = context->requests[i];
+		auto& buffer = context->buffers[i];
+		buffer.assign(request.path.size() + 16, '\0'); // 顺序节点追加10位序号
+		zoo_create_op_init(&context->ops[i], request.path.c_str(),
+		                   request.data.data(),
+		                   static_cast<int>(request.data.size()),
+		                   &ZOO_OPEN_ACL_UNSAFE, request.flags, buffer.data(),
+		                   static_cast<int>(buffer.size()));
+	}
+	int rc = zoo_amulti(zhandle_, static_cast<int>(count), context->ops.data(),
+	                    context->results.data(), multi_completion, context);
+	if (rc != ZOK) {
+		multi_completion(rc, context);
+	}
+}
+
+int ZKClient::create_batch(const std::vector<std::string>& parents,
+                           const std::vector<CreateRequest>& nodes,
+                           std::vector<std::string>* created) {
+	struct Batch {
+		std::mutex mtx;
+		std::condition_variable cond;
+		size_t remaining{0};
+		int rc{ZOK};
+		std::vector<std::string> paths;
+
+		void finish(int result) {
+			std::lock_guard<std::mutex> lock(mtx);
+			if (result != ZOK && rc == ZOK)
+				rc = result;
+			if (--remaining == 0)
+				cond.notify_one();
+		}
+	};
+	auto batch = std::make_shared<Batch>();
+	batch->remaining = parents.size() + (nodes.empty() ? 0 : 1);
+	if (batch->remaining == 0)
+		return ZOK;
+	// 全部发送之后才等待
+	for (const auto& parent : parents) {
+		async_create(parent, "", 0, [batch](int rc, const std::string&) {
+			batch->finish(rc == ZNODEEXISTS ? ZOK : rc);
+		});
+	}
+	if (!nodes.empty()) {
+		async_create_multi(nodes, [batch](int rc,
+		                                  const std::vector<std::string>& paths) {
+			{
+				std::lock_guard<std::mutex> lock(batch->mtx);
+				batch->paths = paths;
+			}
+			batch->finish(rc);
+		});
+	}
+	std::unique_lock<std::mutex> lock(batch->mtx);
+	batch->cond.wait(lock, [&batch]() { return batch->remaining == 0; });
+	if (created && batch->rc == ZOK)
+		*created = batch->paths;
+	return batch->rc;
+}
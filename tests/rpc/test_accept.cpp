@@ -0,0 +1,128 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/22 10:26:47
+ * @version: 1.0
+ * @description: 接收连接的测试 突发的连接一次取完、fd耗尽时拒绝连接而不空转
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "net/TcpServer.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static int connect_to(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	connect(fd, (sockaddr*)&addr, sizeof(addr));
+	return fd;
+}
+
+static bool wait_for(const std::function<bool()>& cond) {
+	for (int i = 0; i < 100 && !cond(); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	return cond();
+}
+
+// 连接在服务端处理之前全部到达 一次可读事件就要全部取出
+void test_burst(IoBackend backend, int port) {
+	TcpServer server;
+	server.set_io_backend(backend);
+	assert(server.start(port, 1024, 1).is_successful());
+
+	std::vector<int> fds;
+	for (int i = 0; i < 200; ++i) {
+		fds.push_back(connect_to(port));
+	}
+	assert(wait_for([&]() { return server.accept_stats().accepted == 200; }));
+	auto stats = server.accept_stats();
+	assert(stats.rejected == 0 && stats.errors == 0);
+
+	for (int fd : fds) {
+		::close(fd);
+	}
+	server.close();
+}
+
+// fd耗尽时等待中的连接被拒绝 fd恢复后可以继续接收连接
+void test_fd_exhausted(IoBackend backend, int port) {
+	TcpServer server;
+	server.set_io_backend(backend);
+	assert(server.start(port, 1024, 1).is_successful());
+
+	// 先创建客户端的socket 再用dup占满剩余的fd 服务端accept时得到EMFILE
+	std::vector<int> clients;
+	for (int i = 0; i < 10; ++i) {
+		clients.push_back(socket(AF_INET, SOCK_STREAM, 0));
+	}
+	// 日志文件在第一次写日志时才打开 需要在fd耗尽之前
+	WARNING_LOG << "exhaust file descriptors";
+	rlimit old_limit;
+	getrlimit(RLIMIT_NOFILE, &old_limit);
+	rlimit limit = old_limit;
+	limit.rlim_cur = *std::max_element(clients.begin(), clients.end()) + 64;
+	assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+	std::vector<int> fillers;
+	for (int fd = dup(0); fd != -1; fd = dup(0)) {
+		fillers.push_back(fd);
+	}
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	for (int fd : clients) {
+		connect(fd, (sockaddr*)&addr, sizeof(addr));
+	}
+	// 每个连接都被取出并关闭 不会一直留在监听队列中
+	// io_uring的accept不一定遵循运行中调低的RLIMIT_NOFILE 连接可能被正常接收
+	if (backend == IoBackend::EPOLL) {
+		assert(wait_for([&]() { return server.accept_stats().rejected == 10; }));
+		assert(server.accept_stats().accepted == 0);
+	} else {
+		assert(wait_for([&]() {
+			auto stats = server.accept_stats();
+			return stats.rejected + stats.accepted == 10;
+		}));
+	}
+	auto accepted = server.accept_stats().accepted;
+
+	for (int fd : fillers) {
+		::close(fd);
+	}
+	setrlimit(RLIMIT_NOFILE, &old_limit);
+	for (int fd : clients) {
+		::close(fd);
+	}
+	int fd = connect_to(port);
+	assert(wait_for(
+	    [&]() { return server.accept_stats().accepted == accepted + 1; }));
+	::close(fd);
+	server.close();
+}
+
+int main() {
+	g_log_level = Logger::ERROR;
+	test_burst(IoBackend::EPOLL, 18140);
+	test_burst(IoBackend::IO_URING, 18141);
+	test_fd_exhausted(IoBackend::EPOLL, 18142);
+	test_fd_exhausted(IoBackend::IO_URING, 18143);
+	std::cout << "test_accept passed\n";
+	return 0;
+}
@@ -0,0 +1,127 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/14 10:22:35
+ * @version: 1.0
+ * @description: 两种内存布局的ByteArray读写结果一致
+ ********************************************************************************/
+#include "base/ByteArray.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using Layout = ByteArray::Layout;
+
+static void write_all(ByteArray& bt, const std::string& big) {
+	bt.writeFuint8(0xab);
+	bt.writeFint16(-2);
+	bt.writeFuint32(0x01020304);
+	bt.writeFint64(-1234567890123ll);
+	bt.writeInt32(-300);
+	bt.writeUint32(~0u);
+	bt.writeInt64(-(1ll << 60));
+	bt.writeUint64(~0ull);
+	bt.writeFloat(1.5f);
+	bt.writeDouble(-2.25);
+	bt.writeStringF16("f16");
+	bt.writeStringF32(big);
+	bt.writeStringF64("");
+	bt.writeStringVint(big);
+}
+
+static void read_all(ByteArray& bt, const std::string& big) {
+	assert(bt.readFuint8() == 0xab);
+	assert(bt.readFint16() == -2);
+	assert(bt.readFuint32() == 0x01020304);
+	assert(bt.readFint64() == -1234567890123ll);
+	assert(bt.readInt32() == -300);
+	assert(bt.readUint32() == ~0u);
+	assert(bt.readInt64() == -(1ll << 60));
+	assert(bt.readUint64() == ~0ull);
+	assert(bt.readFloat() == 1.5f);
+	assert(bt.readDouble() == -2.25);
+	assert(bt.readStringF16() == "f16");
+	assert(bt.readStringF32() == big);
+	assert(bt.readStringF64().empty());
+	assert(bt.readStringVint() == big);
+	assert(bt.getReadSize() == 0);
+}
+
+// 跨过多个节点/多次扩容后 两种布局的字节完全相同
+void test_same_bytes() {
+	std::string big(10000, 'x');
+	for (size_t i = 0; i < big.size(); ++i)
+		big[i] = static_cast<char>(i * 7);
+	ByteArray chained(64);
+	ByteArray contiguous(Layout::Contiguous, 0);
+	assert(chained.getLayout() == Layout::Chained);
+	assert(contiguous.getLayout() == Layout::Contiguous);
+	write_all(chained, big);
+	write_all(contiguous, big);
+	assert(chained.getSize() == contiguous.getSize());
+	chained.setPosition(0);
+	contiguous.setPosition(0);
+	assert(chained.toString() == contiguous.toString());
+	read_all(chained, big);
+	read_all(contiguous, big);
+
+	// 随机定位后读取
+	contiguous.setPosition(1);
+	assert(contiguous.readFint16() == -2);
+	contiguous.setPosition(contiguous.getSize() - 1);
+	assert(contiguous.readFuint8() == static_cast<uint8_t>(big.back()));
+}
+
+void test_buffers() {
+	ByteArray bt(Layout::Contiguous, 16);
+	assert(bt.getBaseSize() == ByteArray::INLINE_SIZE);
+	std::vector<iovec> buffers;
+	assert(bt.getWriteBuffers(buffers, 1000) == 1000);
+	assert(buffers.size() == 1 && buffers[0].iov_len == 1000);
+	memset(buffers[0].iov_base, 'a', 1000);
+	bt.setPosition(1000);
+	bt.setPosition(10);
+	buffers.clear();
+	assert(bt.getReadBuffers(buffers) == 990);
+	assert(buffers.size() == 1 && buffers[0].iov_len == 990);
+	assert(bt.toString() == std::string(990, 'a'));
+
+	// 越界的读取抛出异常 位置不变
+	bool thrown = false;
+	bt.setPosition(bt.getSize());
+	try {
+		bt.readUint64();
+	} catch (const std::out_of_range&) {
+		thrown = true;
+	}
+	assert(thrown && bt.getReadSize() == 0);
+	thrown = false;
+	bt.setPosition(0);
+	bt.writeStringVint(std::string(5, 'b'));
+	bt.setPosition(0);
+	bt.writeUint64(2000);
+	bt.setPosition(0);
+	try {
+		bt.readStringVint();
+	} catch (const std::out_of_range&) {
+		thrown = true;
+	}
+	assert(thrown);
+
+	// 清空后保留容量
+	bt.clear();
+	assert(bt.getSize() == 0 && bt.getPosition() == 0);
+	bt.writeStringVint("again");
+	bt.setPosition(0);
+	assert(bt.readStringVint() == "again");
+}
+
+int main() {
+	test_same_bytes();
+	test_buffers();
+	std::cout << "test_bytearray_layout passed\n";
+	return 0;
+}
@@ -0,0 +1,135 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/15 10:08:52
+ * @version: 1.0
+ * @description: 对端不读取、接收窗口写满时 调用仍在期限到达时以RPC_TIMEOUT结束
+ * 心跳不会阻塞共用的定时器线程 并且照常判定连接失效
+ ********************************************************************************/
+#include "rpc/RPCConnection.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+// 只接受连接 从不读取
+struct SilentServer {
+	int listen_fd{-1};
+	int conn_fd{-1};
+	int port{0};
+	std::thread acceptor;
+
+	SilentServer() {
+		listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		int rcvbuf = 4096; // 在listen之前设置 接受的连接继承
+		setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		assert(::bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+		assert(::listen(listen_fd, 4) == 0);
+		socklen_t len = sizeof(addr);
+		getsockname(listen_fd, (sockaddr*)&addr, &len);
+		port = ntohs(addr.sin_port);
+		acceptor = std::thread(
+		    [this]() { conn_fd = ::accept(listen_fd, nullptr, nullptr); });
+	}
+
+	~SilentServer() {
+		acceptor.join();
+		::close(conn_fd);
+		::close(listen_fd);
+	}
+};
+
+static Serializer payload(size_t size) {
+	Serializer s;
+	std::string data(size, 'x');
+	s.writeRowData(data.data(), static_cast<int>(data.size()));
+	s.reset();
+	return s;
+}
+
+void test_timeout_when_window_full() {
+	SilentServer server;
+	auto conn = std::make_unique<RPCConnection>("127.0.0.1", server.port);
+	assert(conn->connect().is_successful());
+
+	// 第一个请求写满对端的接收窗口与本端的发送缓冲区
+	auto large = payload(16 << 20);
+	auto begin = steady_clock::now();
+	RPCState state = RPC_SUCCESS;
+	auto resp = conn->request(std::move(large), milliseconds(200), state);
+	auto elapsed = steady_clock::now() - begin;
+	assert(!resp && state == RPC_TIMEOUT);
+	assert(elapsed >= milliseconds(200) && elapsed < milliseconds(400));
+
+	// 之后的调用排在写满的连接后面 同样按各自的期限结束
+	std::atomic<int> timeouts{0};
+	std::vector<std::thread> callers;
+	begin = steady_clock::now();
+	for (int i = 0; i < 4; ++i) {
+		callers.emplace_back([&]() {
+			RPCState state = RPC_SUCCESS;
+			conn->request(payload(64), milliseconds(100), state);
+			if (state == RPC_TIMEOUT)
+				++timeouts;
+		});
+	}
+	for (auto& caller : callers)
+		caller.join();
+	elapsed = steady_clock::now() - begin;
+	assert(timeouts == 4);
+	assert(elapsed < milliseconds(300));
+	std::cout << "timeout after window full: "
+	          << duration_cast<milliseconds>(elapsed).count() << " ms\n";
+
+	// 析构时不会阻塞在写上
+	begin = steady_clock::now();
+	conn.reset();
+	assert(steady_clock::now() - begin < milliseconds(500));
+}
+
+// 写线程阻塞时 定时器线程上的其他定时器照常执行 心跳超时关闭连接
+void test_heartbeat_when_window_full() {
+	SilentServer server;
+	RPCConnection conn("127.0.0.1", server.port);
+	HeartbeatMonitor::Options options;
+	options.interval = milliseconds(20);
+	options.max_missed = 3;
+	conn.set_heartbeat(options);
+	assert(conn.connect().is_successful());
+	conn.send_request(payload(16 << 20), milliseconds(0),
+	                  [](Protocol::ptr, RPCState) {});
+
+	// 写满之后 每一次心跳都排在被阻塞的写线程后面
+	std::this_thread::sleep_for(milliseconds(100));
+	std::atomic<bool> fired{false};
+	auto begin = steady_clock::now();
+	TimerService::shared().run_after(milliseconds(10), [&]() { fired = true; });
+	while (!fired && steady_clock::now() - begin < seconds(1))
+		std::this_thread::sleep_for(milliseconds(1));
+	assert(fired && steady_clock::now() - begin < milliseconds(100));
+
+	begin = steady_clock::now();
+	while (conn.is_connected() && steady_clock::now() - begin < seconds(2))
+		std::this_thread::sleep_for(milliseconds(1));
+	assert(!conn.is_connected());
+}
+
+int main() {
+	test_timeout_when_window_full();
+	test_heartbeat_when_window_full();
+	std::cout << "test_connection_deadline passed\n";
+	return 0;
+}
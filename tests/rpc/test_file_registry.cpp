@@ -0,0 +1,184 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/12 15:03:27
+ * @version: 1.0
+ * @description: 本机目录注册中心的测试 不需要zookeeper
+ ********************************************************************************/
+#include "rpc/RPCClient.h"
+#include "rpc/Registry.h"
+#include "rpc/ServiceDirectory.h"
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono;
+using Endpoints = ServiceDirectory::Endpoints;
+
+template <typename F>
+static bool wait_for(F done, milliseconds limit = seconds(2)) {
+	auto deadline = steady_clock::now() + limit;
+	while (!done()) {
+		if (steady_clock::now() > deadline)
+			return false;
+		std::this_thread::sleep_for(microseconds(100));
+	}
+	return true;
+}
+
+static std::string temp_root() {
+	char path[] = "/tmp/test_file_registry.XXXXXX";
+	assert(mkdtemp(path) != nullptr);
+	return path;
+}
+
+void test_encode() {
+	assert(FileRegistry::encode("/calc") == "calc");
+	assert(FileRegistry::encode("/a/b") == "a%2Fb");
+	assert(FileRegistry::decode("a%2Fb") == "/a/b");
+	assert(FileRegistry::decode(FileRegistry::encode("/x%y/z")) == "/x%y/z");
+}
+
+// 登记后可以读取 对象销毁后注销
+void test_register() {
+	auto root = temp_root();
+	FileRegistry reader(root);
+	assert(reader.fetch("/calc").empty());
+	{
+		FileRegistry provider(root);
+		assert(provider.register_services({"/calc", "/a/b"}, "10.0.0.1:80")
+		           .is_successful());
+		assert((reader.fetch("/calc") == Endpoints{"10.0.0.1:80"}));
+		assert((reader.fetch("/a/b") == Endpoints{"10.0.0.1:80"}));
+		// 更新记录 替换已登记的文件
+		assert(provider.update_services("10.0.0.1:80;w=2").is_successful());
+		assert((reader.fetch("/calc") == Endpoints{"10.0.0.1:80;w=2"}));
+		assert((reader.fetch("/a/b") == Endpoints{"10.0.0.1:80;w=2"}));
+	}
+	assert(reader.fetch("/calc").empty());
+	std::filesystem::remove_all(root);
+}
+
+// 写入中的临时文件与已经退出的进程留下的文件都被跳过
+void test_stale_files() {
+	auto root = temp_root();
+	pid_t child = fork();
+	if (child == 0)
+		_exit(0);
+	waitpid(child, nullptr, 0);
+	auto dir = root + "/calc";
+	std::filesystem::create_directories(dir);
+	std::ofstream(dir + "/provider-" + std::to_string(child) + "-0") << "10.0.0.9:80";
+	std::ofstream(dir + "/.provider-1-0") << "10.0.0.8:80";
+	std::ofstream(dir + "/provider-" + std::to_string(getpid()) + "-99")
+	    << "10.0.0.7:80";
+	FileRegistry registry(root);
+	assert((registry.fetch("/calc") == Endpoints{"10.0.0.7:80"}));
+	std::filesystem::remove_all(root);
+}
+
+// 服务目录中的子目录与地址无效的记录被跳过 解析到根目录的服务名称不读取
+void test_invalid_entries() {
+	auto root = temp_root();
+	FileRegistry provider(root);
+	provider.register_services({"/calc"}, "10.0.0.1:80");
+	std::filesystem::create_directories(root + "/calc/provider-nested");
+	// 地址无效的记录被跳过
+	auto pid = std::to_string(getpid());
+	std::ofstream(root + "/calc/provider-" + pid + "-90") << "10.0.0.2:0";
+	std::ofstream(root + "/calc/provider-" + pid + "-91") << "10.0.0.3:http";
+	std::ofstream(root + "/calc/provider-" + pid + "-92") << "10.0.0.4:70000;w=1";
+	FileRegistry reader(root);
+	assert((reader.fetch("/calc") == Endpoints{"10.0.0.1:80"}));
+	assert(reader.fetch("").empty());
+	assert(reader.fetch("/").empty());
+	assert(reader.fetch("/..").empty());
+
+	ServiceDirectory directory(std::make_shared<FileRegistry>(root));
+	for (const char* name : {"", "/", "//"}) {
+		bool thrown = false;
+		try {
+			directory.lookup(name);
+		} catch (const std::invalid_argument&) {
+			thrown = true;
+		}
+		assert(thrown);
+	}
+	// 没有配置服务名称的客户端在构造时报错
+	bool thrown = false;
+	try {
+		ini::IniFile ini;
+		RPCClient client(ini, directory);
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	assert(thrown);
+	std::filesystem::remove_all(root);
+}
+
+// 目录的变化经过inotify推送给ServiceDirectory 包括查询时还不存在的服务
+void test_directory() {
+	auto root = temp_root();
+	ServiceDirectory directory(std::make_shared<FileRegistry>(root));
+	assert(directory.lookup("/calc")->empty());
+
+	auto begin = steady_clock::now();
+	auto provider = std::make_unique<FileRegistry>(root);
+	provider->register_services({"/calc"}, "10.0.0.1:80");
+	assert(wait_for([&]() { return directory.lookup("/calc")->size() == 1; }));
+	auto added = duration_cast<microseconds>(steady_clock::now() - begin);
+
+	FileRegistry second(root);
+	second.register_services({"/calc"}, "10.0.0.2:80");
+	assert(wait_for([&]() { return directory.lookup("/calc")->size() == 2; }));
+
+	begin = steady_clock::now();
+	provider.reset();
+	assert(wait_for([&]() {
+		return *directory.lookup("/calc") == Endpoints{"10.0.0.2:80"};
+	}));
+	auto removed = duration_cast<microseconds>(steady_clock::now() - begin);
+	std::cout << "propagation add " << added.count() << " us, remove "
+	          << removed.count() << " us\n";
+	std::filesystem::remove_all(root);
+}
+
+void test_options() {
+	ini::IniFile ini;
+	auto options = Registry::options_from_ini(ini);
+	assert(options.type == "zookeeper" && options.address == "127.0.0.1:2181");
+	ini["registry"]["type"] = "file";
+	ini["registry"]["path"] = "/tmp/x";
+	ini["registry"]["timeout"] = 500;
+	options = Registry::options_from_ini(ini);
+	assert(options.type == "file" && options.path == "/tmp/x");
+	assert(options.timeout == milliseconds(500));
+
+	options.type = "etcd";
+	bool thrown = false;
+	try {
+		Registry::create(options);
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+int main() {
+	test_encode();
+	test_register();
+	test_stale_files();
+	test_invalid_entries();
+	test_directory();
+	test_options();
+	std::cout << "test_file_registry passed\n";
+	return 0;
+}
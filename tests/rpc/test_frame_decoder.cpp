@@ -0,0 +1,162 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/20 15:37:12
+ * @version: 1.0
+ * @description: 接收缓冲区与长度字段分帧的测试 一次写入多个请求、一个请求分多次写入
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "base/RingBuffer.hpp"
+#include "net/FrameDecoder.h"
+#include "net/TcpServer.h"
+#include "rpc/Protocol.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static FrameDecoder::Options protocol_options() {
+	FrameDecoder::Options options;
+	options.header_length = Protocol::BASE_LENGTH;
+	options.length_offset = Protocol::LENGTH_OFFSET;
+	return options;
+}
+
+static std::string encode(const std::string& content, uint32_t id) {
+	return Protocol::Create(Protocol::MsgType::RPC_METHOD_REQUEST, content, id)
+	    ->encode()
+	    ->toString();
+}
+
+void test_ring_buffer() {
+	putils::RingBuffer ring(16);
+	assert(ring.capacity() == 0); // 第一次写入时才分配
+	ring.append("0123456789", 10);
+	char buf[32];
+	ring.peek(buf, 4, 6);
+	assert(memcmp(buf, "6789", 4) == 0);
+	ring.consume(8);
+	// 空闲空间分成两段 数据绕回开头
+	ring.append("abcdefghij", 10);
+	iovec iov[2];
+	assert(ring.read_buffers(iov) == 2);
+	ring.peek(buf, 12);
+	assert(memcmp(buf, "89abcdefghij", 12) == 0);
+	// 扩容后数据保持原来的顺序
+	ring.ensure_writable(100);
+	assert(ring.capacity() == 128 && ring.readable() == 12);
+	ring.peek(buf, 12);
+	assert(memcmp(buf, "89abcdefghij", 12) == 0);
+	assert(ring.write_buffers(iov) == 1 && iov[0].iov_len == 116);
+	ring.consume(12);
+	assert(ring.empty());
+}
+
+void test_decoder() {
+	FrameDecoder decoder(protocol_options());
+	putils::RingBuffer input(16); // 容量很小 数据会绕回开头并触发扩容
+	std::string data = encode("first", 1) + encode("", 2) + encode("third", 3);
+
+	// 逐字节到达 只有在帧完整时才能取出
+	size_t frames = 0;
+	for (size_t i = 0; i < data.size(); ++i) {
+		input.append(&data[i], 1);
+		auto bt = decoder.decode(input);
+		while (bt && bt->getReadSize() > 0) {
+			Protocol proto;
+			proto.decode(bt);
+			assert(proto.getSequenceId() == ++frames);
+		}
+	}
+	assert(frames == 3 && input.empty());
+
+	// 一次到达多个帧和半个帧
+	input.append(data.data(), data.size() - 2);
+	auto bt = decoder.decode(input);
+	assert(bt && bt->getSize() == data.size() - encode("third", 3).size());
+	assert(input.readable() == encode("third", 3).size() - 2);
+	input.append(data.data() + data.size() - 2, 2);
+	bt = decoder.decode(input);
+	assert(bt && bt->toString() == encode("third", 3));
+
+	// 长度字段超过上限
+	FrameDecoder::Options options = protocol_options();
+	options.max_frame_length = 4;
+	FrameDecoder limited(options);
+	data = encode("too long", 4);
+	input.append(data.data(), data.size());
+	bool thrown = false;
+	try {
+		limited.decode(input);
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+class FrameServer : public TcpServer {
+public:
+	std::atomic_int frames{0};
+
+protected:
+	void publish_client_msg(Client::ptr /*client*/, ByteArray::ptr bt) override {
+		while (bt->getReadSize() > 0) {
+			Protocol proto;
+			proto.decode(bt);
+			assert(proto.getSequenceId() == static_cast<uint32_t>(frames + 1));
+			++frames;
+		}
+	}
+};
+
+static int connect_to(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	connect(fd, (sockaddr*)&addr, sizeof(addr));
+	return fd;
+}
+
+void test_pipelining(IoBackend backend, int port) {
+	FrameServer server;
+	server.set_io_backend(backend);
+	server.set_frame_decoder(protocol_options());
+	assert(server.start(port, 16, 1).is_successful());
+
+	int fd = connect_to(port);
+	// 两个请求在同一次写入中
+	std::string data = encode("a", 1) + encode("bb", 2);
+	::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+	// 一个请求分两次写入
+	data = encode(std::string(10000, 'c'), 3);
+	::send(fd, data.data(), 5, MSG_NOSIGNAL);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(server.frames == 2);
+	::send(fd, data.data() + 5, data.size() - 5, MSG_NOSIGNAL);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(server.frames == 3);
+
+	::close(fd);
+	server.close();
+}
+
+int main() {
+	g_log_level = Logger::WARNING;
+	test_ring_buffer();
+	test_decoder();
+	test_pipelining(IoBackend::EPOLL, 18130);
+	test_pipelining(IoBackend::IO_URING, 18131);
+	std::cout << "test_frame_decoder passed\n";
+	return 0;
+}
@@ -0,0 +1,195 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/24 15:26:10
+ * @version: 1.0
+ * @description: 客户端心跳的测试 RTT的计算与失效连接的关闭
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "inicpp.h"
+#include "net/ClientObserver.h"
+#include "net/HeartbeatMonitor.h"
+#include "net/TcpClient.h"
+#include "net/TcpServer.h"
+#include "net/TimerService.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono;
+
+void test_monitor() {
+	HeartbeatMonitor::Options options;
+	options.interval = milliseconds(100);
+	options.max_missed = 2;
+	HeartbeatMonitor monitor(options);
+	assert(monitor.enabled() && monitor.rtt().count() == 0);
+
+	auto now = HeartbeatMonitor::clock::now();
+	uint32_t seq = 0;
+	assert(monitor.on_timer(now, seq) == HeartbeatMonitor::Action::SEND);
+	assert(!monitor.on_reply(seq + 1, now)); // 不是最近一次的心跳
+	assert(monitor.on_reply(seq, now + microseconds(800)));
+	assert(monitor.rtt() == microseconds(800));
+	assert(monitor.rtt_var() == microseconds(400));
+	// 后续样本按1/8平滑
+	assert(monitor.on_timer(now, seq) == HeartbeatMonitor::Action::SEND);
+	assert(monitor.on_reply(seq, now + microseconds(1600)));
+	assert(monitor.rtt() == microseconds(900));
+
+	// 连续两次未回复后判定失效
+	assert(monitor.on_timer(now, seq) == HeartbeatMonitor::Action::SEND);
+	assert(monitor.on_timer(now, seq) == HeartbeatMonitor::Action::SEND);
+	assert(monitor.on_timer(now, seq) == HeartbeatMonitor::Action::EXPIRED);
+	// 收到其他数据说明对端存活
+	monitor.on_activity();
+	assert(monitor.on_timer(now, seq) == HeartbeatMonitor::Action::SEND);
+	assert(monitor.rtt() == microseconds(900));
+}
+
+static ini::IniFile client_ini(int port) {
+	ini::IniFile ini;
+	ini["tcp_client"]["server_ip"] = std::string("127.0.0.1");
+	ini["tcp_client"]["server_port"] = port;
+	ini["tcp_client"]["heartbeat_interval"] = 20;
+	ini["tcp_client"]["heartbeat_max_missed"] = 3;
+	ini["tcp_client"]["heartbeat_payload"] = std::string("ping");
+	return ini;
+}
+
+// 对端应答心跳 得到RTT 连接保持
+void test_echo(int port) {
+	TcpServer server;
+	ServerObserver observer;
+	observer.incoming_packet_handler_ = [&](const std::string& ip,
+	                                        ByteArray::ptr bt) {
+		auto data = bt->toString();
+		server.send_to_client(ip, data.data(), data.size());
+	};
+	server.subscribe(observer);
+	assert(server.start(port, 16, 1).is_successful());
+
+	auto ini = client_ini(port);
+	TcpClient client(ini);
+	std::atomic_bool disconnected{false};
+	ClientObserver client_observer;
+	client_observer.disconnection_handler = [&](const ResultType&) {
+		disconnected = true;
+	};
+	client.subscribe(client_observer);
+	assert(client.connect_server().is_successful());
+	std::this_thread::sleep_for(milliseconds(300));
+	assert(!disconnected);
+	assert(client.rtt() > microseconds(0) && client.rtt() < milliseconds(20));
+	client.close();
+	server.close();
+}
+
+// 对端不再应答(例如已经掉线) 几个心跳周期内断开 而不是等到写失败
+void test_silent_peer(int port) {
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int on = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	assert(bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+	assert(listen(listen_fd, 16) == 0);
+
+	auto ini = client_ini(port);
+	TcpClient client(ini);
+	std::atomic_bool disconnected{false};
+	std::string reason;
+	ClientObserver observer;
+	observer.disconnection_handler = [&](const ResultType& ret) {
+		reason = ret.message();
+		disconnected = true;
+	};
+	client.subscribe(observer);
+	auto begin = steady_clock::now();
+	assert(client.connect_server().is_successful());
+	int peer = accept(listen_fd, nullptr, nullptr); // 接受连接但从不回复
+	while (!disconnected && steady_clock::now() - begin < seconds(2)) {
+		std::this_thread::sleep_for(milliseconds(5));
+	}
+	assert(disconnected && reason == "Heartbeat timeout");
+	assert(steady_clock::now() - begin < milliseconds(500));
+	client.close();
+	::close(peer);
+	::close(listen_fd);
+}
+
+// 对端不读取 发送阻塞在写满的socket上 心跳不能阻塞共用的定时器线程
+void test_window_full(int port) {
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int on = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	int rcvbuf = 4096; // 在listen之前设置 接受的连接继承
+	setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	assert(bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+	assert(listen(listen_fd, 16) == 0);
+
+	auto ini = client_ini(port);
+	TcpClient client(ini);
+	std::atomic_bool disconnected{false};
+	std::string reason;
+	ClientObserver observer;
+	observer.disconnection_handler = [&](const ResultType& ret) {
+		reason = ret.message();
+		disconnected = true;
+	};
+	client.subscribe(observer);
+	auto connected = client.connect_server();
+	assert(connected.is_successful());
+	int peer = accept(listen_fd, nullptr, nullptr); // 接受连接但从不读取
+
+	// 一直发送直到失败 写满之后阻塞在send中
+	std::thread sender([&]() {
+		std::string chunk(64 * 1024, 'x');
+		while (client.send_msg(chunk.data(), chunk.size()).is_successful())
+			;
+	});
+	std::this_thread::sleep_for(milliseconds(100));
+	std::atomic_bool fired{false};
+	auto begin = steady_clock::now();
+	TimerService::shared().run_after(milliseconds(10), [&]() { fired = true; });
+	while (!fired && steady_clock::now() - begin < seconds(1))
+		std::this_thread::sleep_for(milliseconds(1));
+	assert(fired && steady_clock::now() - begin < milliseconds(100));
+
+	// 跳过的心跳计为丢失 关闭连接后发送随之失败
+	while (!disconnected && steady_clock::now() - begin < seconds(2))
+		std::this_thread::sleep_for(milliseconds(5));
+	assert(disconnected && reason == "Heartbeat timeout");
+	sender.join();
+	client.close();
+	::close(peer);
+	::close(listen_fd);
+}
+
+int main() {
+	g_log_level = Logger::ERROR;
+	signal(SIGPIPE, SIG_IGN); // 连接关闭后的发送返回EPIPE
+	test_monitor();
+	test_echo(18160);
+	test_silent_peer(18161);
+	test_window_full(18162);
+	std::cout << "test_heartbeat passed\n";
+	return 0;
+}
@@ -0,0 +1,72 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/13 15:02:31
+ * @version: 1.0
+ * @description: 空闲连接关闭的测试
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "net/TcpServer.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static int connect_to(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	connect(fd, (sockaddr*)&addr, sizeof(addr));
+	return fd;
+}
+
+// 空闲的连接被关闭 持续发送数据的连接保留
+void test_idle_timeout(IoBackend backend, int port) {
+	std::atomic_int disconnected{0};
+	ServerObserver observer;
+	observer.disconnection_handler_ = [&](const std::string&, ByteArray::ptr) {
+		++disconnected;
+	};
+	TcpServer server;
+	server.subscribe(observer);
+	server.set_io_backend(backend);
+	server.set_idle_timeout(2);
+	assert(server.start(port, 16, 1).is_successful());
+
+	int idle_fd = connect_to(port);
+	int busy_fd = connect_to(port);
+	for (int i = 0; i < 8; ++i) {
+		::send(busy_fd, "ping", 4, MSG_NOSIGNAL);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	// 空闲连接已被服务端关闭 读到EOF
+	char buf[8];
+	assert(::recv(idle_fd, buf, sizeof(buf), MSG_DONTWAIT) == 0);
+	assert(::recv(busy_fd, buf, sizeof(buf), MSG_DONTWAIT) == -1 &&
+	       errno == EAGAIN);
+	assert(disconnected == 1);
+
+	// 对端关闭时立即关闭 而不是等到下一次扫描
+	::close(busy_fd);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	assert(disconnected == 2);
+	::close(idle_fd);
+	server.close();
+}
+
+int main() {
+	g_log_level = Logger::WARNING;
+	test_idle_timeout(IoBackend::EPOLL, 18110);
+	test_idle_timeout(IoBackend::IO_URING, 18111);
+	std::cout << "test_idle_timeout passed\n";
+	return 0;
+}
@@ -0,0 +1,229 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/07 15:02:27
+ * @version: 1.0
+ * @description: 负载均衡策略的测试 使用不需要连接的模拟提供者
+ ********************************************************************************/
+#include "rpc/LoadBalancer.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+class FakeEndpoint : public LoadBalancer::Endpoint {
+public:
+	explicit FakeEndpoint(std::string name)
+	    : name_(std::move(name)) {}
+	const std::string& endpoint() const override { return name_; }
+	bool is_connected() const override { return connected; }
+	size_t outstanding() const override { return load; }
+	microseconds latency() const override { return delay; }
+	double weight() const override { return capacity; }
+	double effective_weight() const override {
+		return effective > 0 ? effective : capacity;
+	}
+
+	bool connected{true};
+	size_t load{0};
+	microseconds delay{0};
+	double capacity{0};
+	double effective{0};
+
+private:
+	std::string name_;
+};
+
+struct Pool {
+	explicit Pool(int n) {
+		for (int i = 0; i < n; ++i) {
+			fakes.push_back(std::make_unique<FakeEndpoint>(
+			    "10.0.0." + std::to_string(i + 1) + ":8080"));
+			endpoints.push_back(fakes.back().get());
+		}
+	}
+	std::vector<std::unique_ptr<FakeEndpoint>> fakes;
+	LoadBalancer::Endpoints endpoints;
+};
+
+// 依次轮流 跳过未连接的 都未连接时返回npos
+void test_round_robin() {
+	Pool pool(3);
+	auto balancer = LoadBalancer::create(LoadBalancer::Policy::ROUND_ROBIN);
+	std::vector<int> count(3, 0);
+	for (int i = 0; i < 300; ++i)
+		++count[balancer->select(pool.endpoints, "")];
+	assert(count[0] == 100 && count[1] == 100 && count[2] == 100);
+
+	pool.fakes[1]->connected = false;
+	for (int i = 0; i < 10; ++i)
+		assert(balancer->select(pool.endpoints, "") != 1);
+	for (auto& fake : pool.fakes)
+		fake->connected = false;
+	assert(balancer->select(pool.endpoints, "") == LoadBalancer::npos);
+	assert(balancer->select({}, "") == LoadBalancer::npos);
+}
+
+// 未完成调用多的提供者很少被选中 负载最重的一个从不被选中
+void test_p2c() {
+	Pool pool(4);
+	pool.fakes[0]->load = 100;
+	pool.fakes[1]->load = 10;
+	auto balancer = LoadBalancer::create(LoadBalancer::Policy::P2C_OUTSTANDING);
+	std::vector<int> count(4, 0);
+	for (int i = 0; i < 10000; ++i)
+		++count[balancer->select(pool.endpoints, "")];
+	assert(count[0] == 0);
+	assert(count[1] < count[2] && count[1] < count[3]);
+
+	// 按延迟 慢的提供者即使空闲也较少被选中 还没有样本的会被尝试
+	auto by_latency = LoadBalancer::create(LoadBalancer::Policy::P2C_LATENCY);
+	for (auto& fake : pool.fakes) {
+		fake->load = 0;
+		fake->delay = microseconds(100);
+	}
+	pool.fakes[0]->delay = milliseconds(10);
+	pool.fakes[3]->delay = microseconds(0);
+	std::fill(count.begin(), count.end(), 0);
+	for (int i = 0; i < 10000; ++i)
+		++count[by_latency->select(pool.endpoints, "")];
+	assert(count[0] == 0);
+	assert(count[3] > count[1] && count[3] > count[2]);
+
+	// 只有一个可用时总是选它
+	Pool single(1);
+	assert(balancer->select(single.endpoints, "") == 0);
+	pool.fakes[0]->connected = pool.fakes[1]->connected =
+	    pool.fakes[2]->connected = false;
+	for (int i = 0; i < 100; ++i)
+		assert(balancer->select(pool.endpoints, "") == 3);
+}
+
+// 同一个键落在同一个提供者 增加一个提供者只移动约1/n的键
+void test_consistent_hash() {
+	Pool pool(4);
+	auto balancer = LoadBalancer::create(LoadBalancer::Policy::CONSISTENT_HASH);
+	balancer->update(pool.endpoints);
+	constexpr int KEYS = 10000;
+	std::vector<size_t> before(KEYS);
+	std::vector<int> count(4, 0);
+	for (int i = 0; i < KEYS; ++i) {
+		auto key = "user-" + std::to_string(i);
+		before[i] = balancer->select(pool.endpoints, key);
+		assert(balancer->select(pool.endpoints, key) == before[i]);
+		++count[before[i]];
+	}
+	for (int c : count)
+		assert(c > KEYS / 4 / 2 && c < KEYS / 4 * 2); // 大致均匀
+
+	// 键对应的提供者不可用时 换到环上的下一个 恢复后回到原来的
+	pool.fakes[before[0]]->connected = false;
+	size_t other = balancer->select(pool.endpoints, "user-0");
+	assert(other != before[0] && other != LoadBalancer::npos);
+	pool.fakes[before[0]]->connected = true;
+	assert(balancer->select(pool.endpoints, "user-0") == before[0]);
+
+	Pool grown(5); // 前4个与pool相同
+	balancer->update(grown.endpoints);
+	int moved = 0;
+	for (int i = 0; i < KEYS; ++i) {
+		size_t now = balancer->select(grown.endpoints, "user-" + std::to_string(i));
+		if (now != before[i]) {
+			assert(now == 4); // 只会移动到新的提供者
+			++moved;
+		}
+	}
+	assert(moved > KEYS / 5 / 2 && moved < KEYS / 5 * 2);
+
+	// 没有键时轮流选择
+	std::vector<int> rr(5, 0);
+	for (int i = 0; i < 50; ++i)
+		++rr[balancer->select(grown.endpoints, "")];
+	for (int c : rr)
+		assert(c == 10);
+}
+
+// 所有提供者都有权重时按权重分配 负载高时按考虑负载后的权重
+void test_weighted() {
+	Pool pool(3);
+	pool.fakes[0]->capacity = 4;
+	pool.fakes[1]->capacity = 2;
+	pool.fakes[2]->capacity = 2;
+	auto rr = LoadBalancer::create(LoadBalancer::Policy::ROUND_ROBIN);
+	rr->update(pool.endpoints);
+	std::vector<int> count(3, 0);
+	for (int i = 0; i < 640; ++i)
+		++count[rr->select(pool.endpoints, "")];
+	assert(count[0] == 320 && count[1] == 160 && count[2] == 160);
+
+	// 过载后让出流量
+	pool.fakes[0]->effective = 1;
+	rr->update(pool.endpoints);
+	count.assign(3, 0);
+	for (int i = 0; i < 800; ++i)
+		++count[rr->select(pool.endpoints, "")];
+	assert(count[0] == 160 && count[1] == 320);
+
+	// 有一个没有权重时与不带权重相同
+	pool.fakes[0]->effective = 0;
+	pool.fakes[2]->capacity = 0;
+	rr->update(pool.endpoints);
+	count.assign(3, 0);
+	for (int i = 0; i < 300; ++i)
+		++count[rr->select(pool.endpoints, "")];
+	assert(count[0] == 100 && count[1] == 100);
+
+	// p2c 比较未完成的调用数与权重之比 都空闲时按权重随机
+	Pool p2c_pool(2);
+	p2c_pool.fakes[0]->capacity = 3;
+	p2c_pool.fakes[1]->capacity = 1;
+	auto p2c = LoadBalancer::create(LoadBalancer::Policy::P2C_OUTSTANDING);
+	p2c->update(p2c_pool.endpoints);
+	count.assign(2, 0);
+	for (int i = 0; i < 20000; ++i)
+		++count[p2c->select(p2c_pool.endpoints, "")];
+	double idle_share = count[0] / 20000.0;
+	assert(idle_share > 0.7 && idle_share < 0.8);
+	p2c_pool.fakes[0]->load = 2;
+	p2c_pool.fakes[1]->load = 1;
+	for (int i = 0; i < 100; ++i)
+		assert(p2c->select(p2c_pool.endpoints, "") == 0); // 2/3 < 1/1
+
+	// 一致性哈希 键的分布与容量成正比
+	Pool ring_pool(2);
+	ring_pool.fakes[0]->capacity = 3;
+	ring_pool.fakes[1]->capacity = 1;
+	auto ring = LoadBalancer::create(LoadBalancer::Policy::CONSISTENT_HASH);
+	ring->update(ring_pool.endpoints);
+	count.assign(2, 0);
+	for (int i = 0; i < 20000; ++i)
+		++count[ring->select(ring_pool.endpoints, "user-" + std::to_string(i))];
+	double share = count[0] / 20000.0;
+	assert(share > 0.68 && share < 0.82);
+}
+
+void test_policy_from_string() {
+	using Policy = LoadBalancer::Policy;
+	assert(LoadBalancer::policy_from_string("round_robin") == Policy::ROUND_ROBIN);
+	assert(LoadBalancer::policy_from_string("p2c_outstanding") ==
+	       Policy::P2C_OUTSTANDING);
+	assert(LoadBalancer::policy_from_string("p2c_latency") == Policy::P2C_LATENCY);
+	assert(LoadBalancer::policy_from_string("consistent_hash") ==
+	       Policy::CONSISTENT_HASH);
+	assert(LoadBalancer::policy_from_string("random") == Policy::ROUND_ROBIN);
+}
+
+int main() {
+	test_round_robin();
+	test_p2c();
+	test_consistent_hash();
+	test_weighted();
+	test_policy_from_string();
+	std::cout << "test_load_balancer passed\n";
+	return 0;
+}
@@ -0,0 +1,161 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/31 15:36:44
+ * @version: 1.0
+ * @description: 独立线程池的优先级队列 排队上限与统计的测试
+ ********************************************************************************/
+#include "rpc/MethodPool.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+using Lane = ExecutionPolicy::Lane;
+
+// 唯一的线程被占用时排队的请求 高优先级的先执行
+void test_priority() {
+	MethodPool pool("report", 1, 0);
+	std::atomic_bool release{false};
+	std::mutex mtx;
+	std::vector<int> order;
+	pool.try_execute(Lane::NORMAL, [&]() {
+		while (!release)
+			std::this_thread::yield();
+	});
+	std::this_thread::sleep_for(milliseconds(10));
+	for (int i = 0; i < 3; ++i) {
+		assert(pool.try_execute(Lane::NORMAL, [&, i]() {
+			std::lock_guard<std::mutex> lock(mtx);
+			order.push_back(i);
+		}));
+		assert(pool.try_execute(Lane::HIGH, [&, i]() {
+			std::lock_guard<std::mutex> lock(mtx);
+			order.push_back(10 + i);
+		}));
+	}
+	assert(pool.stats().queued == 6);
+	release = true;
+	while (pool.stats().executed < 7)
+		std::this_thread::yield();
+	std::lock_guard<std::mutex> lock(mtx);
+	assert((order == std::vector<int>{10, 11, 12, 0, 1, 2}));
+}
+
+// 排队达到上限时拒绝 不阻塞调用者 统计排队时间
+void test_limit_and_stats() {
+	MethodPool pool("slow", 1, 2);
+	std::atomic_bool release{false};
+	std::atomic_int done{0};
+	auto slow = [&]() {
+		while (!release)
+			std::this_thread::yield();
+		++done;
+	};
+	assert(pool.try_execute(Lane::NORMAL, slow));
+	std::this_thread::sleep_for(milliseconds(10)); // 第一个开始执行 不再计入排队
+	assert(pool.try_execute(Lane::NORMAL, slow));
+	assert(pool.try_execute(Lane::HIGH, slow));
+	assert(!pool.try_execute(Lane::HIGH, slow));
+	std::this_thread::sleep_for(milliseconds(20));
+	release = true;
+	while (done < 3)
+		std::this_thread::yield();
+
+	auto stats = pool.stats();
+	assert(stats.name == "slow" && stats.threads == 1 && stats.queue_limit == 2);
+	assert(stats.queued == 0 && stats.executed == 3 && stats.rejected == 1);
+	assert(stats.max_wait >= milliseconds(20));
+	assert(stats.avg_wait > microseconds(0) && stats.avg_wait <= stats.max_wait);
+}
+
+// 析构时执行完已经排队的请求
+void test_drain() {
+	std::atomic_int done{0};
+	{
+		MethodPool pool("drain", 2, 0);
+		for (int i = 0; i < 100; ++i) {
+			pool.try_execute(Lane::NORMAL, [&]() {
+				std::this_thread::sleep_for(microseconds(100));
+				++done;
+			});
+		}
+	}
+	assert(done == 100);
+}
+
+// 排队时间短暂超过目标不丢弃 持续一个interval后开始丢弃 丢弃逐渐变密 回落后停止
+void test_codel() {
+	CoDel codel;
+	auto now = CoDel::clock::now();
+	assert(!codel.should_drop(seconds(1), now)); // 默认不丢弃
+	assert(!codel.enabled());
+	codel.set_options({milliseconds(5), milliseconds(100)});
+	assert(codel.enabled());
+
+	assert(!codel.should_drop(milliseconds(1), now));
+	assert(!codel.should_drop(milliseconds(20), now));
+	now += milliseconds(50);
+	assert(!codel.should_drop(milliseconds(1), now)); // 突发已经消化
+	assert(!codel.should_drop(milliseconds(20), now));
+	now += milliseconds(99);
+	assert(!codel.should_drop(milliseconds(20), now));
+	now += milliseconds(1);
+	assert(codel.should_drop(milliseconds(20), now));
+
+	// 持续积压 每毫秒到达一个请求 丢弃的间隔越来越短
+	std::vector<int> drops;
+	for (int ms = 1; ms <= 1000; ++ms) {
+		if (codel.should_drop(milliseconds(20), now + milliseconds(ms)))
+			drops.push_back(ms);
+	}
+	assert(drops.size() > 10);
+	assert(drops[1] - drops[0] > drops.back() - drops[drops.size() - 2]);
+
+	now += seconds(1);
+	assert(!codel.should_drop(milliseconds(1), now));
+	assert(!codel.should_drop(milliseconds(20), now + milliseconds(1)));
+
+	// 关闭后不再丢弃
+	codel.set_options({milliseconds(0), milliseconds(100)});
+	assert(!codel.enabled());
+	assert(!codel.should_drop(seconds(1), now + seconds(10)));
+}
+
+// 过载时丢弃的请求执行on_shed 计入统计
+void test_shed() {
+	MethodPool pool("shed", 1, 0);
+	pool.set_codel({milliseconds(2), milliseconds(10)});
+	std::atomic_int done{0};
+	std::atomic_int shed{0};
+	constexpr int TOTAL = 200;
+	for (int i = 0; i < TOTAL; ++i) {
+		pool.try_execute(
+		    Lane::NORMAL,
+		    [&]() {
+			    std::this_thread::sleep_for(milliseconds(1));
+			    ++done;
+		    },
+		    [&]() { ++shed; });
+	}
+	while (done + shed < TOTAL)
+		std::this_thread::yield();
+	auto stats = pool.stats();
+	assert(shed > 0 && done > 0);
+	assert(stats.shed == static_cast<uint64_t>(shed));
+	assert(stats.executed == TOTAL);
+}
+
+int main() {
+	test_priority();
+	test_limit_and_stats();
+	test_drain();
+	test_codel();
+	test_shed();
+	std::cout << "test_method_pool passed\n";
+	return 0;
+}
@@ -0,0 +1,155 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/29 15:20:08
+ * @version: 1.0
+ * @description: 有界多生产者多消费者队列的测试
+ ********************************************************************************/
+#include "base/MPMCQueue.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+void test_bounded() {
+	putils::MPMCQueue<std::unique_ptr<int>> queue(3); // 取整为4
+	assert(queue.capacity() == 4);
+	for (int i = 0; i < 4; ++i) {
+		assert(queue.try_push(std::make_unique<int>(i)));
+	}
+	auto extra = std::make_unique<int>(4);
+	assert(!queue.try_push(std::move(extra)));
+	assert(extra && *extra == 4); // 失败时不会移动走
+	std::unique_ptr<int> value;
+	for (int i = 0; i < 4; ++i) {
+		assert(queue.try_pop(value) && *value == i);
+	}
+	assert(!queue.try_pop(value));
+}
+
+void test_bulk() {
+	putils::MPMCQueue<int> queue(8);
+	std::vector<int> in{0, 1, 2, 3, 4, 5};
+	std::vector<int> out(8, -1);
+	// 多轮之后位置绕回数组开头
+	for (int round = 0; round < 10; ++round) {
+		assert(queue.push_bulk(in.begin(), 6) == 6);
+		assert(queue.push_bulk(in.begin(), 6) == 2); // 只剩两个空位
+		assert(queue.size_approx() == 8);
+		assert(queue.pop_bulk(out.begin(), 5) == 5);
+		for (int i = 0; i < 5; ++i)
+			assert(out[i] == i);
+		assert(queue.pop_bulk(out.begin(), 8) == 3);
+		assert(out[0] == 5 && out[1] == 0 && out[2] == 1);
+		assert(queue.pop_bulk(out.begin(), 8) == 0);
+	}
+}
+
+// 多个生产者与消费者 每个元素恰好被取出一次
+void test_concurrent(bool bulk) {
+	constexpr int PRODUCERS = 4;
+	constexpr int PER_PRODUCER = 100000;
+	putils::MPMCQueue<int> queue(64);
+	std::vector<std::atomic_int> seen(PRODUCERS * PER_PRODUCER);
+	std::atomic_int consumed{0};
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p) {
+		threads.emplace_back([&, p]() {
+			int next = p * PER_PRODUCER;
+			int end = next + PER_PRODUCER;
+			std::vector<int> batch;
+			while (next < end) {
+				if (bulk) {
+					batch.clear();
+					for (int i = next; i < end && i < next + 16; ++i)
+						batch.push_back(i);
+					size_t n = queue.push_bulk(batch.begin(), batch.size());
+					next += n;
+					if (n == 0)
+						std::this_thread::yield();
+				} else if (queue.try_push(next)) {
+					++next;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (int c = 0; c < 4; ++c) {
+		threads.emplace_back([&]() {
+			int values[16];
+			while (consumed < PRODUCERS * PER_PRODUCER) {
+				size_t n = 0;
+				if (bulk) {
+					n = queue.pop_bulk(values, 16);
+				} else if (queue.try_pop(values[0])) {
+					n = 1;
+				}
+				if (n == 0)
+					std::this_thread::yield();
+				for (size_t i = 0; i < n; ++i)
+					++seen[values[i]];
+				consumed += n;
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	for (auto& count : seen) {
+		assert(count == 1);
+	}
+}
+
+// 队列满时生产者阻塞 停止后唤醒所有等待者 剩余元素仍可取出
+void test_blocking() {
+	putils::BlockingMPMCQueue<int> queue(4);
+	std::atomic_int pushed{0};
+	std::thread producer([&]() {
+		for (int i = 0; i < 8; ++i) {
+			assert(queue.push(i));
+			++pushed;
+		}
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	assert(pushed == 4); // 背压
+	int value;
+	for (int i = 0; i < 8; ++i) {
+		assert(queue.pop(value) && value == i);
+	}
+	producer.join();
+
+	std::thread consumer([&]() {
+		int v;
+		assert(queue.pop(v) && v == 42);
+		assert(!queue.pop(v)); // 停止时等待中的消费者返回
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	assert(queue.push(42));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	queue.stop();
+	consumer.join();
+	assert(!queue.push(1));
+
+	putils::BlockingMPMCQueue<int> drain(8);
+	std::vector<int> items{1, 2, 3};
+	assert(drain.push_bulk(items.begin(), items.size()) == 3);
+	drain.stop();
+	int out[8];
+	assert(drain.pop_bulk(out, 8) == 3);
+	assert(drain.pop_bulk(out, 8) == 0);
+}
+
+int main() {
+	test_bounded();
+	test_bulk();
+	test_concurrent(false);
+	test_concurrent(true);
+	test_blocking();
+	std::cout << "test_mpmc_queue passed\n";
+	return 0;
+}
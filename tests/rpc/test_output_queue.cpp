@@ -0,0 +1,119 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/17 14:26:09
+ * @version: 1.0
+ * @description: 输出队列、高低水位与暂停读取的测试
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "net/TcpServer.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#define PAYLOAD_SIZE (32 * 1024 * 1024)
+
+// 收到消息时回复一个大的数据块 超过高水位后暂停读取
+class BulkServer : public TcpServer {
+public:
+	std::atomic_int messages{0};
+	std::atomic_int highs{0};
+	std::atomic_int lows{0};
+	std::atomic_int disconnected{0};
+
+protected:
+	void publish_client_msg(Client::ptr client, ByteArray::ptr /*bt*/) override {
+		if (++messages > 1)
+			return;
+		std::string payload(PAYLOAD_SIZE, '\0');
+		for (size_t i = 0; i < payload.size(); ++i) {
+			payload[i] = static_cast<char>(i % 251);
+		}
+		// 对端没有读取 也不会阻塞或者只发送一部分
+		auto sent = send_to_client(client, payload.data(), payload.size());
+		assert(sent.is_successful());
+	}
+	void publish_client_disconnected(Client::ptr, ByteArray::ptr) override {
+		++disconnected;
+	}
+	void publish_client_watermark(Client::ptr client, bool high) override {
+		client->set_reading(!high); // 先暂停读取 测试看到计数后才会发送新请求
+		++(high ? highs : lows);
+	}
+};
+
+template <typename F>
+static bool wait_for(F done, std::chrono::milliseconds limit = std::chrono::seconds(5)) {
+	auto deadline = std::chrono::steady_clock::now() + limit;
+	while (!done()) {
+		if (std::chrono::steady_clock::now() > deadline)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+static int connect_to(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	connect(fd, (sockaddr*)&addr, sizeof(addr));
+	return fd;
+}
+
+void test_output_queue(IoBackend backend, int port) {
+	BulkServer server;
+	server.set_io_backend(backend);
+	server.set_output_watermark(1024 * 1024, 256 * 1024);
+	auto started = server.start(port, 16, 1);
+	assert(started.is_successful());
+
+	int fd = connect_to(port);
+	::send(fd, "bulk", 4, MSG_NOSIGNAL);
+	assert(wait_for([&]() { return server.highs == 1; }));
+	assert(server.lows == 0);
+
+	// 超过高水位后暂停读取 新的请求暂不处理
+	// 没有发生的事件无法等待 只能观察一段时间
+	::send(fd, "ping", 4, MSG_NOSIGNAL);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(server.messages == 1);
+
+	// 数据按顺序完整到达
+	size_t received = 0;
+	char buf[65536];
+	while (received < PAYLOAD_SIZE) {
+		auto n = ::recv(fd, buf, sizeof(buf), 0);
+		assert(n > 0);
+		for (ssize_t i = 0; i < n; ++i) {
+			assert(buf[i] == static_cast<char>((received + i) % 251));
+		}
+		received += n;
+	}
+	assert(wait_for([&]() { return server.lows == 1; }));
+	// 恢复读取后收到暂停期间的请求
+	assert(wait_for([&]() { return server.messages == 2; }));
+	assert(server.disconnected == 0);
+
+	::close(fd);
+	server.close();
+}
+
+int main() {
+	g_log_level = Logger::WARNING;
+	test_output_queue(IoBackend::EPOLL, 18120);
+	test_output_queue(IoBackend::IO_URING, 18121);
+	std::cout << "test_output_queue passed\n";
+	return 0;
+}
@@ -0,0 +1,102 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/13 14:47:09
+ * @version: 1.0
+ * @description: 提供者记录的编码与延迟直方图的测试
+ ********************************************************************************/
+#include "rpc/ProviderRecord.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+void test_encode() {
+	ProviderRecord record;
+	record.endpoint = "10.0.0.1:8085";
+	record.weight = 200;
+	record.cores = 8;
+	record.inflight = 3;
+	record.queued = 1;
+	record.p99 = microseconds(1500);
+	auto data = record.encode();
+	assert(data == "10.0.0.1:8085;w=200;c=8;i=3;q=1;p99=1500");
+	ProviderRecord parsed;
+	assert(ProviderRecord::parse(data, parsed) && parsed == record);
+
+	// 只有地址的旧记录 与无法识别的项
+	ProviderRecord legacy;
+	assert(ProviderRecord::parse("10.0.0.2:80", legacy));
+	assert(legacy.endpoint == "10.0.0.2:80" && legacy.capacity() == 0);
+	ProviderRecord future;
+	assert(ProviderRecord::parse("10.0.0.3:80;c=4;zone=a;bad", future));
+	assert(future.endpoint == "10.0.0.3:80" && future.cores == 4);
+}
+
+// 地址无效的记录不能使用 端口必须在1~65535之间
+void test_invalid_endpoint() {
+	ProviderRecord record;
+	for (const char* data :
+	     {"", "10.0.0.1", ":80", "10.0.0.1:", "10.0.0.1:0", "10.0.0.1:65536",
+	      "10.0.0.1:-1", "10.0.0.1:99999999999", "10.0.0.1:80x",
+	      "10.0.0.1: 80;c=4", "10.0.0.1:80:81"}) {
+		assert(!ProviderRecord::parse(data, record));
+	}
+	std::string host;
+	int port = 0;
+	assert(ProviderRecord::split_endpoint("localhost:65535", host, port));
+	assert(host == "localhost" && port == 65535);
+}
+
+void test_effective_weight() {
+	ProviderRecord record;
+	record.cores = 8;
+	assert(record.capacity() == 8 && record.effective_weight() == 8);
+	record.weight = 100;
+	record.inflight = 6;
+	record.queued = 2;
+	assert(record.effective_weight() == 100); // 没有超过核数
+	record.queued = 8;
+	assert(record.effective_weight() == 100.0 * 8 / 14);
+	record.queued = 1000;
+	assert(record.effective_weight() == 100.0 / 16); // 下限
+}
+
+void test_histogram() {
+	// 桶的上界覆盖桶中的值 误差不超过25%
+	for (int64_t us = 0; us < 100000; us += 7) {
+		auto index = LatencyHistogram::index(us);
+		auto upper = LatencyHistogram::upper_bound(index);
+		assert(upper >= us && upper <= us + us / 4 + 1);
+		assert(index == 0 || LatencyHistogram::upper_bound(index - 1) < us);
+	}
+
+	LatencyHistogram histogram;
+	assert(histogram.take_percentile(0.99) == microseconds(0));
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&]() {
+			for (int i = 1; i <= 1000; ++i)
+				histogram.record(microseconds(i));
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	auto p99 = histogram.take_percentile(0.99).count();
+	assert(p99 >= 990 && p99 <= 990 * 5 / 4);
+	// 取出后清空 下一个周期重新统计
+	histogram.record(microseconds(10));
+	assert(histogram.take_percentile(0.99).count() < 13);
+}
+
+int main() {
+	test_encode();
+	test_invalid_endpoint();
+	test_effective_weight();
+	test_histogram();
+	std::cout << "test_provider_record passed\n";
+	return 0;
+}
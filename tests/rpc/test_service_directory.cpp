@@ -0,0 +1,232 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/10 15:12:36
+ * @version: 1.0
+ * @description: 服务发现缓存的测试 使用进程内的模拟注册中心
+ ********************************************************************************/
+#include "rpc/ServiceDirectory.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+using Endpoints = ServiceDirectory::Endpoints;
+
+// 与zookeeper相同 读取后有变化时通知一次 在另一个线程中回调
+class FakeSource : public DiscoverySource,
+                   public std::enable_shared_from_this<FakeSource> {
+public:
+	void set_listener(ChangeCallback callback) override {
+		std::lock_guard<std::mutex> lock(mtx_);
+		callback_ = std::move(callback);
+	}
+
+	std::vector<std::string> fetch(const std::string& service) override {
+		std::lock_guard<std::mutex> lock(mtx_);
+		++fetches;
+		watched_[service] = true;
+		return services_[service];
+	}
+
+	void set(const std::string& service, Endpoints endpoints) {
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			services_[service] = std::move(endpoints);
+			if (!watched_[service])
+				return;
+			watched_[service] = false;
+		}
+		std::thread([self = shared_from_this(), service]() {
+			std::lock_guard<std::mutex> lock(self->mtx_);
+			if (self->callback_)
+				self->callback_(service);
+		}).detach();
+	}
+
+	std::atomic_int fetches{0};
+
+private:
+	std::mutex mtx_;
+	ChangeCallback callback_;
+	std::map<std::string, Endpoints> services_;
+	std::map<std::string, bool> watched_;
+};
+
+template <typename F>
+static bool wait_for(F done, milliseconds limit = seconds(2)) {
+	auto deadline = steady_clock::now() + limit;
+	while (!done()) {
+		if (steady_clock::now() > deadline)
+			return false;
+		std::this_thread::sleep_for(microseconds(100));
+	}
+	return true;
+}
+
+// 第一次查询读取来源 之后从缓存返回 列表按地址排序
+void test_lookup() {
+	auto source = std::make_shared<FakeSource>();
+	source->set("/calc", {"10.0.0.2:80", "10.0.0.1:80"});
+	ServiceDirectory directory(source);
+	auto snapshot = directory.lookup("/calc");
+	assert((*snapshot == Endpoints{"10.0.0.1:80", "10.0.0.2:80"}));
+	for (int i = 0; i < 1000; ++i)
+		assert(directory.lookup("/calc") == snapshot);
+	assert(source->fetches == 1);
+
+	// 还不存在的服务 注册后同样会更新
+	assert(directory.lookup("/later")->empty());
+	source->set("/later", {"10.0.0.3:80"});
+	assert(wait_for([&]() { return directory.lookup("/later")->size() == 1; }));
+}
+
+// 提供者增减后推送给订阅者 取消后不再调用
+void test_watch() {
+	auto source = std::make_shared<FakeSource>();
+	source->set("/calc", {"10.0.0.1:80"});
+	ServiceDirectory directory(source);
+	std::mutex mtx;
+	std::vector<Endpoints> seen;
+	auto id = directory.watch("/calc", [&](const ServiceDirectory::Snapshot& s) {
+		std::lock_guard<std::mutex> lock(mtx);
+		seen.push_back(*s);
+	});
+	assert(seen.size() == 1 && seen[0] == Endpoints{"10.0.0.1:80"});
+
+	auto begin = steady_clock::now();
+	source->set("/calc", {"10.0.0.1:80", "10.0.0.2:80"});
+	assert(wait_for([&]() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return seen.size() == 2;
+	}));
+	auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin);
+	assert(elapsed < milliseconds(100));
+	assert(seen[1].size() == 2 && directory.version() == 1);
+
+	// 内容不变的通知不产生新快照
+	source->set("/calc", {"10.0.0.2:80", "10.0.0.1:80"});
+	std::this_thread::sleep_for(milliseconds(20));
+	assert(seen.size() == 2 && directory.version() == 1);
+
+	directory.unwatch(id);
+	source->set("/calc", {});
+	assert(wait_for([&]() { return directory.lookup("/calc")->empty(); }));
+	std::this_thread::sleep_for(milliseconds(20));
+	assert(seen.size() == 2);
+	std::cout << "push latency " << elapsed.count() << " us\n";
+}
+
+// 更新期间的查询不加锁 每次得到的都是某一次完整写入的列表
+void test_concurrent_lookup() {
+	auto source = std::make_shared<FakeSource>();
+	source->set("/calc", {"0:1", "0:2", "0:3"});
+	ServiceDirectory directory(source);
+	directory.lookup("/calc");
+	std::atomic_bool stop{false};
+	std::atomic_bool ok{true};
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; ++t) {
+		readers.emplace_back([&]() {
+			while (!stop) {
+				auto snapshot = directory.lookup("/calc");
+				if (snapshot->size() != 3)
+					ok = false;
+				auto generation = snapshot->front().substr(0, snapshot->front().find(':'));
+				for (auto& endpoint : *snapshot) {
+					if (endpoint.substr(0, endpoint.find(':')) != generation)
+						ok = false;
+				}
+			}
+		});
+	}
+	for (int g = 1; g <= 200; ++g) {
+		auto prefix = std::to_string(g) + ":";
+		source->set("/calc", {prefix + "1", prefix + "2", prefix + "3"});
+		wait_for([&]() { return directory.lookup("/calc")->front() == prefix + "1"; });
+	}
+	stop = true;
+	for (auto& reader : readers)
+		reader.join();
+	assert(ok);
+}
+
+// 回调在锁外执行 较慢的回调不影响其他服务的订阅与取消
+void test_slow_listener() {
+	auto source = std::make_shared<FakeSource>();
+	ServiceDirectory directory(source);
+	std::atomic_bool entered{false};
+	std::atomic_bool release{false};
+	bool first = true;
+	auto slow = directory.watch("/slow", [&](const ServiceDirectory::Snapshot&) {
+		if (first) {
+			first = false; // watch返回前的那一次
+			return;
+		}
+		entered = true;
+		wait_for([&]() { return release.load(); });
+	});
+	source->set("/slow", {"10.0.0.1:80"});
+	assert(wait_for([&]() { return entered.load(); }));
+
+	auto begin = steady_clock::now();
+	auto id = directory.watch("/calc", [](const ServiceDirectory::Snapshot&) {});
+	directory.unwatch(id);
+	assert(steady_clock::now() - begin < milliseconds(100));
+	release = true;
+	directory.unwatch(slow);
+}
+
+// 回调抛出的异常不会结束后台线程 之后的变化照常推送
+void test_throwing_listener() {
+	auto source = std::make_shared<FakeSource>();
+	ServiceDirectory directory(source);
+	bool first = true;
+	auto failing = directory.watch("/calc", [&](const ServiceDirectory::Snapshot&) {
+		if (first) {
+			first = false;
+			return;
+		}
+		throw std::runtime_error("listener failed");
+	});
+	std::atomic_int calls{0};
+	auto counting = directory.watch(
+	    "/calc", [&](const ServiceDirectory::Snapshot&) { ++calls; });
+	source->set("/calc", {"10.0.0.1:80"});
+	assert(wait_for([&]() { return calls == 2; }));
+	source->set("/calc", {"10.0.0.2:80"});
+	assert(wait_for([&]() { return calls == 3; }));
+
+	// 第一次调用就抛出时不订阅
+	bool thrown = false;
+	try {
+		directory.watch("/calc", [](const ServiceDirectory::Snapshot&) {
+			throw std::runtime_error("listener failed");
+		});
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	assert(thrown);
+	source->set("/calc", {"10.0.0.3:80"});
+	assert(wait_for([&]() { return calls == 4; }));
+	directory.unwatch(failing);
+	directory.unwatch(counting);
+}
+
+int main() {
+	test_lookup();
+	test_watch();
+	test_concurrent_lookup();
+	test_slow_listener();
+	test_throwing_listener();
+	std::cout << "test_service_directory passed\n";
+	return 0;
+}
@@ -0,0 +1,106 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/28 14:05:37
+ * @version: 1.0
+ * @description: SmallFunction与线程池execute的测试
+ ********************************************************************************/
+#include "base/SmallFunction.hpp"
+#include "base/ThreadPool.hpp"
+#include "base/WorkStealingPool.hpp"
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// 统计构造与析构的次数
+struct Counted {
+	static inline int alive = 0;
+	Counted() { ++alive; }
+	Counted(const Counted&) { ++alive; }
+	Counted(Counted&&) noexcept { ++alive; }
+	~Counted() { --alive; }
+};
+
+void test_inline_and_heap() {
+	using Fn = putils::SmallFunction<int(int)>;
+	std::array<char, 48> small{};
+	std::array<char, 128> large{};
+	auto small_fn = [small](int x) { return x + small.size(); };
+	auto large_fn = [large](int x) { return x + large.size(); };
+	static_assert(Fn::fits_inline<decltype(small_fn)>);
+	static_assert(!Fn::fits_inline<decltype(large_fn)>);
+
+	Fn a = small_fn;
+	Fn b = large_fn;
+	assert(a(1) == 49 && b(1) == 129);
+
+	// 移动后原对象为空
+	Fn c = std::move(b);
+	assert(!b && c(2) == 130);
+	c = std::move(a);
+	assert(!a && c(2) == 50);
+
+	Fn empty;
+	assert(!empty);
+	bool thrown = false;
+	try {
+		empty(0);
+	} catch (const std::bad_function_call&) {
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+void test_lifetime() {
+	{
+		putils::SmallFunction<void()> f = [c = Counted()]() {};
+		putils::SmallFunction<void()> g = std::move(f);
+		assert(Counted::alive == 1);
+		f = std::move(g);
+		assert(Counted::alive == 1);
+		f = nullptr;
+		assert(Counted::alive == 0);
+	}
+	{
+		std::array<char, 128> large{};
+		putils::SmallFunction<void()> f = [c = Counted(), large]() {};
+		putils::SmallFunction<void()> g = std::move(f); // 堆上的对象只转移指针
+		assert(Counted::alive == 1);
+	}
+	assert(Counted::alive == 0);
+}
+
+// 只能移动的捕获 std::function无法保存
+void test_move_only() {
+	auto value = std::make_unique<std::string>("hello");
+	putils::SmallFunction<std::string()> f = [value = std::move(value)]() {
+		return *value;
+	};
+	assert(f() == "hello");
+
+	std::atomic_int sum{0};
+	{
+		putils::ThreadPool pool(2);
+		putils::WorkStealingPool ws_pool(2);
+		for (int i = 0; i < 1000; ++i) {
+			auto a = std::make_unique<int>(i);
+			auto b = std::make_unique<int>(i);
+			pool.execute([a = std::move(a), &sum]() { sum += *a; });
+			ws_pool.execute([b = std::move(b), &sum]() { sum += *b; });
+		}
+	}
+	assert(sum == 2 * 999 * 1000 / 2);
+}
+
+int main() {
+	test_inline_and_heap();
+	test_lifetime();
+	test_move_only();
+	std::cout << "test_small_function passed\n";
+	return 0;
+}
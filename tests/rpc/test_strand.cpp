@@ -0,0 +1,135 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/30 14:12:50
+ * @version: 1.0
+ * @description: 串行执行器(strand)的测试
+ ********************************************************************************/
+#include "base/Strand.hpp"
+#include "base/WorkStealingPool.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using Strand = putils::Strand<putils::WorkStealingPool>;
+
+static void wait_until(const std::atomic_int& value, int expected) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (value < expected && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+	assert(value == expected);
+}
+
+// 多个线程向同一strand投递 任务不会并发执行 每个生产者的任务保持顺序
+void test_serial() {
+	constexpr int PRODUCERS = 4;
+	constexpr int PER_PRODUCER = 20000;
+	putils::WorkStealingPool pool(4);
+	auto strand = Strand::create(pool);
+	std::atomic_int running{0};
+	std::atomic_int done{0};
+	std::vector<int> last(PRODUCERS, -1); // 只在strand中访问 不需要同步
+	bool ordered = true;
+
+	std::vector<std::thread> producers;
+	for (int p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i) {
+				auto task = [&, p, i]() {
+					assert(running.fetch_add(1) == 0);
+					if (last[p] != i - 1)
+						ordered = false;
+					last[p] = i;
+					running.fetch_sub(1);
+					++done;
+				};
+				if (i % 2)
+					strand->post(task);
+				else
+					strand->dispatch(task);
+			}
+		});
+	}
+	for (auto& producer : producers) {
+		producer.join();
+	}
+	wait_until(done, PRODUCERS * PER_PRODUCER);
+	assert(ordered);
+}
+
+// 不同strand的任务可以同时执行
+void test_parallel() {
+	putils::WorkStealingPool pool(2);
+	auto a = Strand::create(pool);
+	auto b = Strand::create(pool);
+	std::atomic_int arrived{0};
+	std::atomic_int done{0};
+	auto barrier = [&]() {
+		++arrived;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (arrived < 2 && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::yield();
+		}
+		assert(arrived == 2);
+		++done;
+	};
+	a->post(barrier);
+	b->post(barrier);
+	wait_until(done, 2);
+}
+
+// 空闲时dispatch在调用线程中执行 正在执行时排队 不阻塞调用者
+void test_dispatch() {
+	putils::WorkStealingPool pool(2);
+	auto strand = Strand::create(pool);
+	auto caller = std::this_thread::get_id();
+	bool inline_run = false;
+	strand->dispatch([&]() { inline_run = std::this_thread::get_id() == caller; });
+	assert(inline_run && strand->pending() == 0);
+
+	std::atomic_bool release{false};
+	std::atomic_int done{0};
+	strand->post([&]() {
+		while (!release) {
+			std::this_thread::yield();
+		}
+		++done;
+	});
+	std::thread::id runner;
+	strand->dispatch([&]() {
+		runner = std::this_thread::get_id();
+		++done;
+	});
+	assert(done == 0); // 没有等待前一个任务
+	release = true;
+	wait_until(done, 2);
+	assert(runner != caller);
+}
+
+// strand先于排空任务被释放 排空任务持有它直到执行完
+void test_lifetime() {
+	std::atomic_int done{0};
+	{
+		putils::WorkStealingPool pool(1);
+		{
+			auto strand = Strand::create(pool);
+			for (int i = 0; i < 1000; ++i) {
+				strand->post([&]() { ++done; });
+			}
+		}
+	}
+	assert(done == 1000);
+}
+
+int main() {
+	test_serial();
+	test_parallel();
+	test_dispatch();
+	test_lifetime();
+	std::cout << "test_strand passed\n";
+	return 0;
+}
@@ -0,0 +1,124 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/06/03 16:20:08
+ * @version: 1.0
+ * @description: 协程Task与执行器的测试
+ ********************************************************************************/
+#include "base/Strand.hpp"
+#include "base/WorkStealingPool.hpp"
+#include "rpc/Task.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std::chrono;
+using Strand = putils::Strand<putils::WorkStealingPool>;
+
+class StrandExecutor : public rpc::Executor {
+public:
+	explicit StrandExecutor(Strand::ptr strand)
+	    : strand_(std::move(strand)) {}
+	void post(putils::SmallFunction<void()> fn) override {
+		strand_->post(std::move(fn));
+	}
+
+private:
+	Strand::ptr strand_;
+};
+
+static void wait_until(const std::atomic_int& value, int expected) {
+	auto deadline = steady_clock::now() + seconds(10);
+	while (value < expected && steady_clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+	assert(value == expected);
+}
+
+rpc::Task<int> value(int v) { co_return v; }
+
+rpc::Task<long> sum(int n) {
+	long total = 0;
+	for (int i = 1; i <= n; ++i) {
+		total += co_await value(i);
+	}
+	co_return total;
+}
+
+rpc::Task<> fail() {
+	throw std::runtime_error("boom");
+	co_return;
+}
+
+rpc::Task<std::string> catch_error() {
+	try {
+		co_await fail();
+	} catch (const std::runtime_error& err) {
+		co_return err.what();
+	}
+	co_return "";
+}
+
+// 惰性开始 同步完成的子任务直接切换 不会耗尽栈
+void test_inline() {
+	bool started = false;
+	auto lazy = [&]() -> rpc::Task<> {
+		started = true;
+		co_return;
+	};
+	auto task = lazy();
+	assert(!started);
+
+	long result = 0;
+	rpc::spawn(nullptr, sum(1000000), [&](long v) { result = v; });
+	assert(result == 1000000L * 1000001 / 2);
+
+	std::string msg;
+	rpc::spawn(nullptr, catch_error(), [&](std::string v) { msg = v; });
+	assert(msg == "boom");
+
+	bool done = false;
+	rpc::spawn(nullptr, std::move(task), [&]() { done = true; });
+	assert(started && done);
+}
+
+// 协程帧只保存参数 不能引用临时的lambda对象
+rpc::Task<int> sleepy(rpc::Executor* executor, std::atomic_int& running,
+                      std::atomic_bool& ok) {
+	for (int step = 0; step < 3; ++step) {
+		if (rpc::current_executor() != executor)
+			ok = false;
+		if (running.fetch_add(1) != 0)
+			ok = false; // 同一strand上的协程不会并发执行
+		running.fetch_sub(1);
+		co_await rpc::sleep_for(milliseconds(1));
+	}
+	co_return 1;
+}
+
+// 在执行器中开始 sleep_for在定时器线程到期后回到原来的执行器
+void test_executor() {
+	putils::WorkStealingPool pool(2);
+	StrandExecutor executor(Strand::create(pool));
+	std::atomic_int done{0};
+	std::atomic_int running{0};
+	std::atomic_bool ok{true};
+	for (int i = 0; i < 100; ++i) {
+		rpc::spawn(&executor, sleepy(&executor, running, ok),
+		           [&](int v) { done += v; });
+	}
+	wait_until(done, 100);
+	assert(ok);
+	assert(rpc::current_executor() == nullptr);
+}
+
+int main() {
+	test_inline();
+	test_executor();
+	std::cout << "test_task passed\n";
+	return 0;
+}
@@ -0,0 +1,162 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/23 14:20:36
+ * @version: 1.0
+ * @description: 分层时间轮与基于timerfd的定时器的测试
+ ********************************************************************************/
+#include "base/Logger.h"
+#include "base/TimingWheel.hpp"
+#include "net/Reactor.h"
+#include "net/TimerService.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+void test_timing_wheel() {
+	putils::TimingWheel wheel;
+	int fired = 0;
+	wheel.add(3, [&]() { fired += 1; });
+	auto id = wheel.add(2, [&]() { fired += 100; });
+	wheel.add(300, [&]() { fired += 10; }); // 在第1层 到期前需要下放
+	assert(wheel.cancel(id));
+	assert(!wheel.cancel(id));
+	assert(wheel.next_expiry() == 3);
+	for (int i = 0; i < 3; ++i)
+		wheel.tick();
+	assert(fired == 1);
+	wheel.advance(296);
+	assert(fired == 1 && wheel.next_expiry() == 1);
+	wheel.tick();
+	assert(fired == 11 && wheel.size() == 0);
+	assert(wheel.next_expiry() == putils::TimingWheel::NEVER);
+
+	// 周期任务 执行期间取消后不再安排
+	int periodic = 0;
+	putils::TimingWheel::TimerId every = 0;
+	every = wheel.add(5, [&]() {
+		if (++periodic == 3)
+			wheel.cancel(every);
+	}, 5);
+	for (int i = 0; i < 100; ++i)
+		wheel.tick();
+	assert(periodic == 3 && wheel.size() == 0);
+	// 一次推进跨过多个周期时只执行一次
+	wheel.add(5, [&]() { ++periodic; }, 5);
+	wheel.advance(100);
+	assert(periodic == 4 && wheel.size() == 1);
+}
+
+// 随机的到期时间跨越多层 每个任务都恰好在到期的tick执行
+void test_timing_wheel_levels() {
+	putils::TimingWheel wheel;
+	std::mt19937_64 rng(7);
+	std::vector<uint64_t> fired_at(20000, 0);
+	std::vector<uint64_t> expect(fired_at.size());
+	std::vector<putils::TimingWheel::TimerId> ids(fired_at.size());
+	for (size_t i = 0; i < fired_at.size(); ++i) {
+		// 大多数落在低层 少数跨过第2、3层
+		uint64_t ticks = 1 + rng() % (i % 10 == 0 ? (1 << 20) : 70000);
+		expect[i] = wheel.now() + ticks;
+		ids[i] = wheel.add(ticks, [&, i]() { fired_at[i] = wheel.now(); });
+	}
+	// 取消一半
+	for (size_t i = 0; i < ids.size(); i += 2) {
+		assert(wheel.cancel(ids[i]));
+	}
+	// 按next_expiry()跳跃推进 与事件循环的用法一致
+	while (wheel.size() > 0) {
+		wheel.advance(wheel.next_expiry());
+	}
+	for (size_t i = 0; i < fired_at.size(); ++i) {
+		assert(fired_at[i] == (i % 2 == 0 ? 0 : expect[i]));
+	}
+}
+
+void test_timer_service() {
+	TimerService timers;
+	std::atomic_int fired{0};
+	auto begin = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration elapsed{};
+	timers.run_after(std::chrono::milliseconds(30), [&]() {
+		elapsed = std::chrono::steady_clock::now() - begin;
+		fired += 1;
+	});
+	auto id = timers.run_after(std::chrono::milliseconds(10),
+	                           [&]() { fired += 100; });
+	assert(timers.cancel(id));
+	std::atomic_int ticks{0};
+	auto every = timers.run_every(std::chrono::milliseconds(5), [&]() { ++ticks; });
+
+	// 由使用者的线程驱动
+	while (fired == 0) {
+		timers.handle_read();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	assert(fired == 1 && elapsed >= std::chrono::milliseconds(30));
+	assert(ticks >= 3);
+	assert(timers.cancel(every));
+	assert(timers.size() == 0);
+}
+
+// reactor的定时器由事件循环驱动 可以从其他线程添加
+void test_reactor_timers(IoBackend backend, int port) {
+	auto reactor = Reactor::create(backend, 0);
+	reactor->start(port, 16, nullptr);
+	std::atomic_bool in_loop{false};
+	std::atomic_int fired{0};
+	reactor->timers().run_after(std::chrono::milliseconds(20), [&]() {
+		in_loop = reactor->is_in_loop_thread();
+		++fired;
+	});
+	reactor->timers().run_after(std::chrono::seconds(60), [&]() { ++fired; });
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(fired == 1 && in_loop);
+	reactor->stop();
+}
+
+// 没有事件循环的使用者共用的定时器
+void test_shared() {
+	std::atomic_int fired{0};
+	TimerService::shared().run_after(std::chrono::milliseconds(10),
+	                                 [&]() { ++fired; });
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(fired == 1);
+}
+
+// 其他线程取消正在执行的任务时 等待其执行完毕
+void test_cancel_waits() {
+	std::atomic_bool started{false};
+	std::atomic_bool finished{false};
+	auto id = TimerService::shared().run_every(std::chrono::milliseconds(5), [&]() {
+		started = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		finished = true;
+	});
+	while (!started) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	assert(TimerService::shared().cancel(id));
+	assert(finished);
+	finished = false;
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	assert(!finished);
+}
+
+int main() {
+	g_log_level = Logger::WARNING;
+	test_timing_wheel();
+	test_timing_wheel_levels();
+	test_timer_service();
+	test_reactor_timers(IoBackend::EPOLL, 18150);
+	test_reactor_timers(IoBackend::IO_URING, 18151);
+	test_shared();
+	test_cancel_waits();
+	std::cout << "test_timer_service passed\n";
+	return 0;
+}
@@ -0,0 +1,128 @@
+/********************************************************************************
+ * @author: Huang Pisong
+ * @email: huangpisong@foxmail.com
+ * @date: 2024/05/27 16:40:18
+ * @version: 1.0
+ * @description: 工作窃取线程池的测试
+ ********************************************************************************/
+#include "base/WorkStealingPool.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// 所有者压入与弹出的同时多个线程窃取 每个元素恰好被取走一次
+void test_deque() {
+	constexpr int N = 200000;
+	putils::ChaseLevDeque<int*> deque(4); // 从很小的容量开始 覆盖扩容
+	std::vector<int> values(N);
+	std::vector<std::atomic_int> taken(N);
+	std::atomic_bool done{false};
+	std::atomic_int stolen{0};
+
+	std::vector<std::thread> thieves;
+	for (int i = 0; i < 3; ++i) {
+		thieves.emplace_back([&]() {
+			while (!done || !deque.empty()) {
+				if (int* item = deque.steal()) {
+					++taken[item - values.data()];
+					++stolen;
+				}
+			}
+		});
+	}
+	for (int i = 0; i < N; ++i) {
+		deque.push(&values[i]);
+		if (i % 3 == 0) {
+			if (int* item = deque.pop())
+				++taken[item - values.data()];
+		}
+	}
+	while (int* item = deque.pop()) {
+		++taken[item - values.data()];
+	}
+	done = true;
+	for (auto& thief : thieves) {
+		thief.join();
+	}
+	for (int i = 0; i < N; ++i) {
+		assert(taken[i] == 1);
+	}
+}
+
+// 外部线程通过注入队列提交
+void test_external_submit() {
+	putils::WorkStealingPool pool(4);
+	std::atomic_int count{0};
+	std::vector<std::thread> producers;
+	for (int p = 0; p < 4; ++p) {
+		producers.emplace_back([&]() {
+			for (int i = 0; i < 50000; ++i) {
+				pool.execute([&]() { ++count; });
+			}
+		});
+	}
+	for (auto& producer : producers) {
+		producer.join();
+	}
+	auto sum = pool.submit([](int a, int b) { return a + b; }, 1, 2);
+	assert(sum.get() == 3);
+	while (count < 200000) {
+		std::this_thread::yield();
+	}
+}
+
+// 任务中继续提交任务 放入当前线程的队列 由空闲的线程窃取
+void spawn(putils::WorkStealingPool& pool, std::atomic_int& count, int depth) {
+	++count;
+	if (depth == 0)
+		return;
+	pool.execute([&pool, &count, depth]() { spawn(pool, count, depth - 1); });
+	pool.execute([&pool, &count, depth]() { spawn(pool, count, depth - 1); });
+}
+
+void test_nested(size_t threads) {
+	putils::WorkStealingPool pool(threads);
+	std::atomic_int count{0};
+	pool.execute([&]() { spawn(pool, count, 15); });
+	while (count < (1 << 16) - 1) {
+		std::this_thread::yield();
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	assert(count == (1 << 16) - 1);
+}
+
+// 休眠的线程被唤醒 析构时执行完所有已提交的任务
+void test_park_and_drain() {
+	std::atomic_int count{0};
+	{
+		putils::WorkStealingPool pool(2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20)); // 全部休眠
+		auto future = pool.submit([]() { return 42; });
+		assert(future.wait_for(std::chrono::seconds(1)) ==
+		       std::future_status::ready);
+		assert(future.get() == 42);
+		for (int i = 0; i < 1000; ++i) {
+			pool.execute([&]() {
+				std::this_thread::sleep_for(std::chrono::microseconds(10));
+				++count;
+			});
+		}
+	}
+	assert(count == 1000);
+}
+
+int main() {
+	test_deque();
+	test_external_submit();
+	test_nested(1); // 注入队列中只有一个任务时不能多取
+	test_nested(4);
+	test_park_and_drain();
+	std::cout << "test_work_stealing passed\n";
+	return 0;
+}